@@ -0,0 +1,227 @@
+/*
+ * ImagePaster - arena.c
+ *
+ * Paste arena (see arena.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define ARENA_ALIGN       16
+#define ARENA_HEADER      16                    /* block size, keeps payloads aligned */
+#define ARENA_COMMIT_STEP (256u * 1024)         /* commit granularity */
+#define ARENA_PAGE        4096
+
+/* The arena open on this thread, or the last one opened, so blocks handed
+ * out before arena_end are still recognised afterwards. */
+static _Thread_local PasteArena *t_arena;
+
+/* ── Address space ─────────────────────────────────────────────────────── */
+
+#ifdef _WIN32
+static void *os_reserve(size_t n)
+{
+    return VirtualAlloc(NULL, n, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+static int os_commit(void *p, size_t n)
+{
+    return VirtualAlloc(p, n, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
+static void os_decommit(void *p, size_t n)
+{
+    VirtualFree(p, n, MEM_DECOMMIT);
+}
+
+static void os_unreserve(void *p, size_t n)
+{
+    (void)n;
+    VirtualFree(p, 0, MEM_RELEASE);
+}
+#else
+static void *os_reserve(size_t n)
+{
+    void *p = mmap(NULL, n, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static int os_commit(void *p, size_t n)
+{
+    return mprotect(p, n, PROT_READ | PROT_WRITE) == 0;
+}
+
+static void os_decommit(void *p, size_t n)
+{
+    madvise(p, n, MADV_DONTNEED);
+    mprotect(p, n, PROT_NONE);
+}
+
+static void os_unreserve(void *p, size_t n)
+{
+    munmap(p, n);
+}
+#endif
+
+static size_t round_up(size_t n, size_t step)
+{
+    return (n + step - 1) / step * step;
+}
+
+/* Commits up to `end`; pages are mapped on first touch. */
+static int ensure_committed(PasteArena *a, size_t end)
+{
+    if (end <= a->committed) return 1;
+    if (end > a->reserved) return 0;
+    size_t target = round_up(end, ARENA_COMMIT_STEP);
+    if (target > a->reserved) target = a->reserved;
+    if (!os_commit(a->base + a->committed, target - a->committed)) return 0;
+    a->committed = target;
+    return 1;
+}
+
+static int owns(const PasteArena *a, const void *p)
+{
+    return a && a->base && (const uint8_t *)p >= a->base && (const uint8_t *)p < a->base + a->reserved;
+}
+
+/* ── Lifetime ──────────────────────────────────────────────────────────── */
+
+int arena_init(PasteArena *a, size_t reserveBytes, size_t keepLimit)
+{
+    memset(a, 0, sizeof(*a));
+    a->reserved = round_up(reserveBytes, ARENA_COMMIT_STEP);
+    a->keepLimit = keepLimit < a->reserved ? keepLimit : a->reserved;
+    a->base = a->reserved ? (uint8_t *)os_reserve(a->reserved) : NULL;
+    if (!a->base) a->reserved = 0;
+    return a->base != NULL;
+}
+
+void arena_destroy(PasteArena *a)
+{
+    if (a->base) os_unreserve(a->base, a->reserved);
+    if (t_arena == a) t_arena = NULL;
+    memset(a, 0, sizeof(*a));
+}
+
+void arena_begin(PasteArena *a)
+{
+    t_arena = a;
+    a->open = 1;
+    a->top = 0;
+    a->highWater = 0;
+}
+
+void arena_end(PasteArena *a)
+{
+    a->open = 0;
+    a->top = 0;
+    a->pastes++;
+    if (!a->base) return;
+
+    a->history[a->historyNext++ % ARENA_HISTORY] = a->highWater;
+    size_t keep = 0;
+    for (int i = 0; i < ARENA_HISTORY; i++) {
+        if (a->history[i] > keep) keep = a->history[i];
+    }
+    keep = round_up(keep, ARENA_COMMIT_STEP);
+    if (keep > a->keepLimit) keep = a->keepLimit / ARENA_COMMIT_STEP * ARENA_COMMIT_STEP;
+
+    if (a->committed > keep) {
+        os_decommit(a->base + keep, a->committed - keep);
+        a->committed = keep;
+    } else if (a->committed < keep) {
+        /* Fault the pages in now, between pastes, rather than in the next one */
+        size_t from = a->committed;
+        if (ensure_committed(a, keep)) {
+            for (size_t off = from; off < a->committed; off += ARENA_PAGE) a->base[off] = 0;
+        }
+    }
+}
+
+void arena_release(PasteArena *a)
+{
+    if (!a->base || a->open || a->committed == 0) return;
+    os_decommit(a->base, a->committed);
+    a->committed = 0;
+    a->releases++;
+}
+
+/* ── Allocation ────────────────────────────────────────────────────────── */
+
+void *arena_alloc(size_t n)
+{
+    PasteArena *a = t_arena;
+    if (a && a->open && a->base) {
+        size_t size = round_up(n, ARENA_ALIGN);
+        if (size >= n && a->top + ARENA_HEADER <= a->reserved
+            && size <= a->reserved - a->top - ARENA_HEADER
+            && ensure_committed(a, a->top + ARENA_HEADER + size)) {
+            uint8_t *block = a->base + a->top;
+            memcpy(block, &size, sizeof(size));
+            a->top += ARENA_HEADER + size;
+            if (a->top > a->highWater) a->highWater = a->top;
+            return block + ARENA_HEADER;
+        }
+        a->heapFallbacks++;
+    }
+    return malloc(n);
+}
+
+void *arena_calloc(size_t count, size_t size)
+{
+    if (size && count > (size_t)-1 / size) return NULL;
+    void *p = arena_alloc(count * size);
+    if (p) memset(p, 0, count * size);
+    return p;
+}
+
+void arena_free(void *p)
+{
+    PasteArena *a = t_arena;
+    if (!p) return;
+    if (!owns(a, p)) {
+        free(p);
+        return;
+    }
+    /* Only the most recent block can be given back before the paste ends */
+    uint8_t *block = (uint8_t *)p - ARENA_HEADER;
+    size_t size;
+    memcpy(&size, block, sizeof(size));
+    if (a->open && (uint8_t *)p + size == a->base + a->top) a->top = (size_t)(block - a->base);
+}
+
+void *arena_realloc(void *p, size_t n)
+{
+    PasteArena *a = t_arena;
+    if (!p) return arena_alloc(n);
+    if (!owns(a, p)) return realloc(p, n);
+
+    uint8_t *block = (uint8_t *)p - ARENA_HEADER;
+    size_t old, size = round_up(n, ARENA_ALIGN);
+    memcpy(&old, block, sizeof(old));
+
+    /* The most recent block grows or shrinks in place */
+    size_t offset = (size_t)(block - a->base);
+    if (a->open && (uint8_t *)p + old == a->base + a->top && size >= n
+        && size <= a->reserved - offset - ARENA_HEADER
+        && ensure_committed(a, offset + ARENA_HEADER + size)) {
+        memcpy(block, &size, sizeof(size));
+        a->top = offset + ARENA_HEADER + size;
+        if (a->top > a->highWater) a->highWater = a->top;
+        return p;
+    }
+
+    void *q = arena_alloc(n);
+    if (!q) return NULL;
+    memcpy(q, p, old < n ? old : n);
+    arena_free(p);
+    return q;
+}
@@ -0,0 +1,67 @@
+/*
+ * ImagePaster - arena.h
+ *
+ * The paste arena: one reserved range of address space that a conversion's
+ * temporaries (decoded image, encoder state, encoded image, text) are
+ * carved from, so that large pastes stop paying a first-touch page fault for
+ * every page of freshly allocated memory.
+ *
+ * Allocation is a bump pointer; freeing only gives memory back when the
+ * block is the most recent one, and everything is reclaimed when the paste
+ * ends. Between pastes the arena keeps the moving maximum of recent pastes'
+ * high-water marks committed and touched, up to a configurable limit, so the
+ * next paste of a similar size finds its pages already mapped. After an idle
+ * period the owner releases it, which decommits everything but keeps the
+ * reservation.
+ *
+ * The arena_alloc family allocates from the arena open on the calling
+ * thread, or from the heap when none is open or it is full; arena_free and
+ * arena_realloc accept either kind of block. Plain C; reserving and
+ * committing use VirtualAlloc on Windows and mmap elsewhere.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_HISTORY 8         /* pastes in the moving maximum */
+
+typedef struct {
+    uint8_t *base;              /* reservation, NULL if not initialised */
+    size_t   reserved;
+    size_t   committed;         /* from base; pages up to here are mapped */
+    size_t   keepLimit;         /* most bytes kept committed between pastes */
+    size_t   top;               /* bump pointer of the open paste */
+    size_t   highWater;         /* of the open paste */
+    size_t   history[ARENA_HISTORY];
+    unsigned historyNext;
+    int      open;
+    /* Counters since arena_init */
+    uint64_t pastes;
+    uint64_t heapFallbacks;     /* allocations that did not fit */
+    uint64_t releases;
+} PasteArena;
+
+/* Reserves `reserveBytes` of address space, nothing committed yet. Returns 0
+ * if the reservation fails; the arena functions then use the heap. */
+int  arena_init(PasteArena *a, size_t reserveBytes, size_t keepLimit);
+void arena_destroy(PasteArena *a);
+
+/* Opens the arena for a paste on the calling thread, and closes it. Every
+ * block allocated while open must be freed (or abandoned) before
+ * arena_end, which resets the bump pointer, updates the moving maximum and
+ * commits and pre-faults or decommits to match it. */
+void arena_begin(PasteArena *a);
+void arena_end(PasteArena *a);
+
+/* Decommits everything; the next paste starts cold. */
+void arena_release(PasteArena *a);
+
+void *arena_alloc(size_t n);
+void *arena_calloc(size_t count, size_t size);
+void *arena_realloc(void *p, size_t n);
+void  arena_free(void *p);
+
+#endif // ARENA_H
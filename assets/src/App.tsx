@@ -1,18 +1,27 @@
-import { useEffect, useRef, useState } from "react";
-import { onInit, getInit, reportHeight, type InitData } from "./lib/bridge";
+import { useEffect, useLayoutEffect, useRef, useState } from "react";
+import { onInit, getInit, reportHeight, reportPainted, type InitData } from "./lib/bridge";
 import ConfigView from "./ConfigView";
 import LogView from "./LogView";
+import StatsView from "./StatsView";
 
 export default function App() {
   const containerRef = useRef<HTMLDivElement>(null);
   const [initData, setInitData] = useState<InitData | null>(null);
+  /* The page outlives the dialog: each onInit opens a fresh view, so views
+   * are remounted rather than keeping state from the last time */
+  const [session, setSession] = useState(0);
 
   useEffect(() => {
-    onInit((data) => setInitData(data));
+    onInit((data) => {
+      setInitData(data);
+      setSession((n) => n + 1);
+    });
     getInit();
   }, []);
 
-  useEffect(() => {
+  /* Reported synchronously after layout: the host window stays hidden until
+   * it knows the height, and a hidden page gets no animation frames */
+  useLayoutEffect(() => {
     const el = containerRef.current;
     if (!el || !initData) return;
 
@@ -20,21 +29,41 @@ export default function App() {
       reportHeight(Math.ceil(el.scrollHeight));
     };
 
-    requestAnimationFrame(report);
+    report();
 
     const observer = new ResizeObserver(report);
     observer.observe(el);
     return () => observer.disconnect();
   }, [initData]);
 
+  /* The second frame callback runs after the first frame with the view in it
+   * was presented */
+  useEffect(() => {
+    if (!initData) return;
+    let inner = 0;
+    const outer = requestAnimationFrame(() => {
+      inner = requestAnimationFrame(() => reportPainted(initData.view));
+    });
+    return () => {
+      cancelAnimationFrame(outer);
+      cancelAnimationFrame(inner);
+    };
+  }, [initData]);
+
   if (!initData) return null;
 
   return (
     <div ref={containerRef}>
       {initData.view === "config" ? (
-        <ConfigView config={initData.config!} />
+        <ConfigView key={session} config={initData.config!} />
+      ) : initData.view === "stats" ? (
+        <StatsView key={session} initialStats={initData.stats ?? { stages: [] }} />
       ) : (
-        <LogView initialLog={initData.log ?? []} />
+        <LogView
+          key={session}
+          initialLog={initData.log ?? []}
+          total={initData.logTotal ?? initData.log?.length ?? 0}
+        />
       )}
     </div>
   );
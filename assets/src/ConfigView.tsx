@@ -1,44 +1,335 @@
 import { useState } from "react";
-import { saveSettings, closeDialog, type ConfigData } from "./lib/bridge";
+import {
+  saveSettings,
+  closeDialog,
+  type ConfigData,
+  type ProfileData,
+  type ImageFormat,
+  type TextEncoding,
+  type Delivery,
+  type RoutePolicy,
+  type Trigger,
+} from "./lib/bridge";
 import { Button } from "./components/ui/button";
 import { Input } from "./components/ui/input";
 import { Label } from "./components/ui/label";
+import { cn } from "./lib/utils";
 
 interface Props {
   config: ConfigData;
 }
 
+const selectClass =
+  "flex h-8 w-full rounded-md border border-neutral-300 bg-transparent px-2 py-1 text-xs shadow-sm focus-visible:outline-none focus-visible:ring-1 focus-visible:ring-neutral-400 disabled:cursor-not-allowed disabled:opacity-50";
+
+function newProfile(existing: ProfileData[]): ProfileData {
+  let n = existing.length + 1;
+  while (existing.some((p) => p.name.toLowerCase() === `profile ${n}`)) n++;
+  return {
+    name: `Profile ${n}`,
+    exeMatch: "",
+    classMatch: "",
+    titleMatch: "",
+    format: "png",
+    effort: 6,
+    quality: 85,
+    maxBytes: 0,
+    textEncoding: "base64",
+    delivery: "paste",
+    route: "fixed",
+  };
+}
+
+/* Profile names become registry key names */
+function nameError(name: string, index: number, profiles: ProfileData[]): string | null {
+  const trimmed = name.trim();
+  if (!trimmed) return "Name is required";
+  if (trimmed.length > 63) return "Name is longer than 63 characters";
+  if (trimmed.includes("\\")) return "Name cannot contain a backslash";
+  if (trimmed.toLowerCase() === "default") return "\"Default\" is reserved";
+  if (profiles.some((p, i) => i !== index && p.name.trim().toLowerCase() === trimmed.toLowerCase()))
+    return "Another profile has this name";
+  return null;
+}
+
+function clamp(value: number, min: number, max: number): number {
+  return Number.isFinite(value) ? Math.min(max, Math.max(min, Math.round(value))) : min;
+}
+
 export default function ConfigView({ config }: Props) {
-  const [titleMatch, setTitleMatch] = useState(config.titleMatch);
+  const [profiles, setProfiles] = useState<ProfileData[]>(config.profiles);
+  const [defaultProfile, setDefaultProfile] = useState<ProfileData>(config.defaultProfile);
+  const [trigger, setTrigger] = useState<Trigger>(config.trigger ?? "hook");
+  /* Index into profiles; profiles.length selects the default profile */
+  const [selected, setSelected] = useState(config.profiles.length);
+
+  const isDefault = selected >= profiles.length;
+  const current = isDefault ? defaultProfile : profiles[selected];
+  const errors = profiles.map((p, i) => nameError(p.name, i, profiles));
+  const hasErrors = errors.some((e) => e !== null);
+
+  const update = (patch: Partial<ProfileData>) => {
+    if (isDefault) {
+      setDefaultProfile({ ...defaultProfile, ...patch });
+    } else {
+      setProfiles(profiles.map((p, i) => (i === selected ? { ...p, ...patch } : p)));
+    }
+  };
+
+  const handleAdd = () => {
+    const next = [...profiles, newProfile(profiles)];
+    setProfiles(next);
+    setSelected(next.length - 1);
+  };
+
+  const handleRemove = () => {
+    if (isDefault) return;
+    setProfiles(profiles.filter((_, i) => i !== selected));
+    setSelected(Math.min(selected, profiles.length - 1));
+  };
+
+  const handleMove = (delta: number) => {
+    const target = selected + delta;
+    if (isDefault || target < 0 || target >= profiles.length) return;
+    const next = [...profiles];
+    [next[selected], next[target]] = [next[target], next[selected]];
+    setProfiles(next);
+    setSelected(target);
+  };
 
   const handleSave = () => {
-    saveSettings({ titleMatch: titleMatch.trim() });
+    const trim = (p: ProfileData): ProfileData => ({
+      ...p,
+      name: p.name.trim(),
+      exeMatch: p.exeMatch.trim(),
+      classMatch: p.classMatch.trim(),
+      titleMatch: p.titleMatch.trim(),
+    });
+    saveSettings({ profiles: profiles.map(trim), defaultProfile: trim(defaultProfile), trigger });
   };
 
   const handleCancel = () => {
     closeDialog();
   };
 
+  const listItem = (p: ProfileData, index: number, error: string | null) => (
+    <button
+      key={index}
+      type="button"
+      onClick={() => setSelected(index)}
+      className={cn(
+        "w-full text-left px-2 py-1.5 text-xs rounded truncate",
+        index === selected ? "bg-neutral-900 text-white" : "hover:bg-neutral-100",
+        error && index !== selected && "text-red-600"
+      )}
+    >
+      {p.name || "(unnamed)"}
+    </button>
+  );
+
   return (
     <div className="p-5 space-y-4">
+      <p className="text-[11px] text-neutral-500 font-normal">
+        When you press Ctrl+V with an image on the clipboard in a window matching a profile, the image is
+        converted to text with that profile's settings. Profiles are tried from the top; the default
+        profile is tried last.
+      </p>
+
       <div className="space-y-1.5">
-        <Label htmlFor="titleMatch">Application Title Match</Label>
+        <Label htmlFor="trigger">Paste trigger</Label>
+        <select
+          id="trigger"
+          className={selectClass}
+          value={trigger}
+          onChange={(e) => setTrigger(e.target.value as Trigger)}
+        >
+          <option value="hook">Ctrl+V, keyboard hook</option>
+          <option value="hotkey">Ctrl+Shift+V hotkey, no hook</option>
+          <option value="rawinput">Ctrl+V, Raw Input, no hook</option>
+        </select>
         <p className="text-[11px] text-neutral-500 font-normal">
-          When you press Ctrl+V with an image on the clipboard, it will be converted to base64 text if the focused window's title contains any of these keywords.
+          The keyboard hook sees every key typed in any program before it arrives. The hotkey leaves
+          Ctrl+V alone; Raw Input cannot hold the original Ctrl+V back, so the text follows it. With
+          either, Esc still reaches the window when it stops a paste.
         </p>
-        <Input
-          id="titleMatch"
-          value={titleMatch}
-          onChange={(e) => setTitleMatch(e.target.value)}
-          placeholder="xshell, putty, terminal"
-        />
+      </div>
+
+      <div className="flex gap-4">
+        <div className="w-40 shrink-0 space-y-2">
+          <div className="border border-neutral-200 rounded-md p-1 space-y-0.5">
+            {profiles.map((p, i) => listItem(p, i, errors[i]))}
+            {listItem(defaultProfile, profiles.length, null)}
+          </div>
+          <div className="flex gap-1">
+            <Button variant="outline" size="sm" className="flex-1 px-0" onClick={handleAdd}>
+              Add
+            </Button>
+            <Button variant="outline" size="sm" className="px-2" disabled={isDefault || selected === 0}
+              onClick={() => handleMove(-1)} aria-label="Move up">
+              ↑
+            </Button>
+            <Button variant="outline" size="sm" className="px-2"
+              disabled={isDefault || selected === profiles.length - 1}
+              onClick={() => handleMove(1)} aria-label="Move down">
+              ↓
+            </Button>
+          </div>
+          <Button variant="outline" size="sm" className="w-full" disabled={isDefault} onClick={handleRemove}>
+            Remove
+          </Button>
+        </div>
+
+        <div className="flex-1 space-y-3 min-w-0">
+          <div className="space-y-1.5">
+            <Label htmlFor="name">Name</Label>
+            <Input
+              id="name"
+              value={current.name}
+              disabled={isDefault}
+              onChange={(e) => update({ name: e.target.value })}
+            />
+            {!isDefault && errors[selected] && (
+              <p className="text-[11px] text-red-600">{errors[selected]}</p>
+            )}
+          </div>
+
+          <div className="space-y-1.5">
+            <Label>Match</Label>
+            <p className="text-[11px] text-neutral-500 font-normal">
+              Comma-separated rules; a window matches when every non-empty list does. Use{" "}
+              <code>^word</code> / <code>word$</code> to anchor to the start / end, <code>*</code> and{" "}
+              <code>?</code> for a wildcard match of the whole text, <code>!word</code> to exclude, and{" "}
+              <code>\\</code> for a literal backslash.
+            </p>
+            <Input
+              aria-label="Executable path"
+              value={current.exeMatch}
+              onChange={(e) => update({ exeMatch: e.target.value })}
+              placeholder="Executable path, e.g. \\xshell.exe$"
+            />
+            <Input
+              aria-label="Window class"
+              value={current.classMatch}
+              onChange={(e) => update({ classMatch: e.target.value })}
+              placeholder="Window class, e.g. ^PuTTY$"
+            />
+            <Input
+              aria-label="Window title"
+              value={current.titleMatch}
+              onChange={(e) => update({ titleMatch: e.target.value })}
+              placeholder="Window title, e.g. xshell, putty, terminal"
+            />
+          </div>
+
+          <div className="grid grid-cols-2 gap-3">
+            <div className="space-y-1.5">
+              <Label htmlFor="format">Format</Label>
+              <select
+                id="format"
+                className={selectClass}
+                value={current.format}
+                disabled={current.route !== "fixed"}
+                onChange={(e) => update({ format: e.target.value as ImageFormat })}
+              >
+                <option value="png">PNG (lossless)</option>
+                <option value="jpeg">JPEG</option>
+              </select>
+            </div>
+            <div className="space-y-1.5">
+              <Label htmlFor="route">Format choice</Label>
+              <select
+                id="route"
+                className={selectClass}
+                value={current.route}
+                onChange={(e) => update({ route: e.target.value as RoutePolicy })}
+              >
+                <option value="fixed">Always this format</option>
+                <option value="lossless">Automatic, lossless only</option>
+                <option value="photos">Automatic, JPEG for photos</option>
+                <option value="any">Automatic, fastest</option>
+              </select>
+            </div>
+            {(current.format === "png" || current.route !== "fixed") && (
+              <div className="space-y-1.5">
+                <Label htmlFor="effort">Compression effort (0-9)</Label>
+                <Input
+                  id="effort"
+                  type="number"
+                  min={0}
+                  max={9}
+                  value={current.effort}
+                  onChange={(e) => update({ effort: clamp(e.target.valueAsNumber, 0, 9) })}
+                />
+              </div>
+            )}
+            {((current.format === "jpeg" && current.route === "fixed") ||
+              current.route === "photos" ||
+              current.route === "any") && (
+              <div className="space-y-1.5">
+                <Label htmlFor="quality">Quality (1-100)</Label>
+                <Input
+                  id="quality"
+                  type="number"
+                  min={1}
+                  max={100}
+                  value={current.quality}
+                  onChange={(e) => update({ quality: clamp(e.target.valueAsNumber, 1, 100) })}
+                />
+              </div>
+            )}
+            <div className="space-y-1.5">
+              <Label htmlFor="budget">Size budget (KB, 0 = none)</Label>
+              <Input
+                id="budget"
+                type="number"
+                min={0}
+                value={Math.round(current.maxBytes / 1024)}
+                onChange={(e) =>
+                  update({ maxBytes: clamp(e.target.valueAsNumber, 0, 2 * 1024 * 1024 - 1) * 1024 })
+                }
+              />
+            </div>
+            <div className="space-y-1.5">
+              <Label htmlFor="text">Text encoding</Label>
+              <select
+                id="text"
+                className={selectClass}
+                value={current.textEncoding}
+                onChange={(e) => update({ textEncoding: e.target.value as TextEncoding })}
+              >
+                <option value="base64">Base64, one line</option>
+                <option value="base64-lines">Base64, 76-character lines</option>
+                <option value="data-uri">Data URI</option>
+                <option value="framed">Framed, for the unframe receiver</option>
+              </select>
+            </div>
+            <div className="space-y-1.5">
+              <Label htmlFor="delivery">Delivery</Label>
+              <select
+                id="delivery"
+                className={selectClass}
+                value={current.delivery}
+                onChange={(e) => update({ delivery: e.target.value as Delivery })}
+              >
+                <option value="paste">Paste through the clipboard</option>
+                <option value="type">Type as keystrokes</option>
+              </select>
+            </div>
+          </div>
+          <p className="text-[11px] text-neutral-500 font-normal">
+            An image over budget is compressed harder, then scaled down by halves until it fits.
+            Automatic format choice samples each image and picks the encoding that pastes soonest,
+            fast PNG or this effort, or JPEG where allowed; the Activity Log shows why.
+            Typing is for consoles that block clipboard pastes; it is much slower, and Esc stops it.
+          </p>
+        </div>
       </div>
 
       <div className="flex justify-end gap-2 pt-2">
         <Button variant="outline" size="sm" className="w-20" onClick={handleCancel}>
           Cancel
         </Button>
-        <Button size="sm" className="w-20" onClick={handleSave}>
+        <Button size="sm" className="w-20" disabled={hasErrors} onClick={handleSave}>
           Save
         </Button>
       </div>
@@ -1,41 +1,205 @@
-import { useEffect, useRef, useState } from "react";
-import { onLogUpdate, clearLog, closeDialog, type LogEntry } from "./lib/bridge";
+import { useEffect, useRef, useState, type RefObject } from "react";
+import {
+  onLogUpdate,
+  clearLog,
+  closeDialog,
+  requestThumb,
+  searchLog,
+  getLogPage,
+  type LogEntry,
+  type LogSearchResult,
+  type ThumbRef,
+} from "./lib/bridge";
 import { Button } from "./components/ui/button";
+import { Input } from "./components/ui/input";
 
 interface Props {
   initialLog: LogEntry[];
+  /* Entries in the host's log; initialLog holds only the newest */
+  total: number;
 }
 
-export default function LogView({ initialLog }: Props) {
+/* Shown at most this tall; the thumbnail keeps its aspect ratio */
+const THUMB_DISPLAY_HEIGHT = 48;
+
+/* Search results are fetched a page at a time */
+const PAGE_SIZE = 100;
+/* Typing pauses this long before the search runs */
+const SEARCH_DELAY_MS = 150;
+
+type Range = "all" | "hour" | "today" | "day";
+
+const selectClass =
+  "flex h-8 rounded-md border border-neutral-300 bg-transparent px-2 py-1 text-xs shadow-sm focus-visible:outline-none focus-visible:ring-1 focus-visible:ring-neutral-400";
+
+/* The range as Unix times in ms; 0 leaves an end open */
+function rangeBounds(range: Range): { from: number; to: number } {
+  const now = Date.now();
+  switch (range) {
+    case "hour":
+      return { from: now - 3600 * 1000, to: 0 };
+    case "day":
+      return { from: now - 24 * 3600 * 1000, to: 0 };
+    case "today": {
+      const midnight = new Date();
+      midnight.setHours(0, 0, 0, 0);
+      return { from: midnight.getTime(), to: 0 };
+    }
+    default:
+      return { from: 0, to: 0 };
+  }
+}
+
+/* A pasted image's thumbnail. The pixels are requested only once the row
+ * scrolls into view, so opening a long log fetches just what is visible. */
+function Thumbnail({ thumb, root }: { thumb: ThumbRef; root: RefObject<HTMLDivElement | null> }) {
+  const canvasRef = useRef<HTMLCanvasElement>(null);
+  const [gone, setGone] = useState(false);
+
+  useEffect(() => {
+    const canvas = canvasRef.current;
+    if (!canvas) return;
+    let cancelled = false;
+    const observer = new IntersectionObserver(
+      (records) => {
+        if (!records.some((r) => r.isIntersecting)) return;
+        observer.disconnect();
+        requestThumb(thumb.id).then((image) => {
+          if (cancelled) return;
+          if (image) canvas.getContext("2d")?.putImageData(image, 0, 0);
+          else setGone(true);
+        });
+      },
+      { root: root.current, rootMargin: "64px" }
+    );
+    observer.observe(canvas);
+    return () => {
+      cancelled = true;
+      observer.disconnect();
+    };
+  }, [thumb.id, root]);
+
+  const scale = Math.min(1, THUMB_DISPLAY_HEIGHT / thumb.height);
+  if (gone) return null;
+  return (
+    <canvas
+      ref={canvasRef}
+      width={thumb.width}
+      height={thumb.height}
+      className="mt-1 rounded-sm border border-neutral-200 bg-neutral-100"
+      style={{ width: thumb.width * scale, height: thumb.height * scale }}
+    />
+  );
+}
+
+export default function LogView({ initialLog, total }: Props) {
   const [entries, setEntries] = useState<LogEntry[]>(initialLog);
+  const [hidden, setHidden] = useState(Math.max(0, total - initialLog.length));
+  const [query, setQuery] = useState("");
+  const [range, setRange] = useState<Range>("all");
+  const [result, setResult] = useState<LogSearchResult | null>(null);
+  const [page, setPage] = useState(0);
+  const [pageEntries, setPageEntries] = useState<LogEntry[]>([]);
   const scrollRef = useRef<HTMLDivElement>(null);
+  const filtering = query.trim() !== "" || range !== "all";
 
   useEffect(() => {
     onLogUpdate((entry) => {
-      setEntries((prev) => [...prev, entry]);
+      /* Already in the snapshot if it arrived before it */
+      setEntries((prev) =>
+        prev.length && prev[prev.length - 1].seq >= entry.seq ? prev : [...prev, entry]
+      );
     });
   }, []);
 
+  /* The search runs in the host over the whole log; it answers with seqs
+   * only, and the newest page is shown first */
+  useEffect(() => {
+    if (!filtering) {
+      setResult(null);
+      return;
+    }
+    let cancelled = false;
+    const timer = setTimeout(() => {
+      searchLog({ query, ...rangeBounds(range) }).then((found) => {
+        if (cancelled) return;
+        setResult(found);
+        setPage(Math.max(0, Math.ceil(found.seqs.length / PAGE_SIZE) - 1));
+      });
+    }, SEARCH_DELAY_MS);
+    return () => {
+      cancelled = true;
+      clearTimeout(timer);
+    };
+  }, [query, range, filtering]);
+
+  useEffect(() => {
+    if (!result) return;
+    let cancelled = false;
+    const seqs = result.seqs.slice(page * PAGE_SIZE, (page + 1) * PAGE_SIZE);
+    getLogPage(seqs).then((fetched) => {
+      if (!cancelled) setPageEntries(fetched);
+    });
+    return () => {
+      cancelled = true;
+    };
+  }, [result, page]);
+
+  const shown = result ? pageEntries : entries;
+  const pages = result ? Math.ceil(result.seqs.length / PAGE_SIZE) : 0;
+
   useEffect(() => {
     const el = scrollRef.current;
     if (el) el.scrollTop = el.scrollHeight;
-  }, [entries]);
+  }, [shown]);
 
   const handleClear = () => {
     setEntries([]);
+    setHidden(0);
+    setResult(null);
+    setQuery("");
+    setRange("all");
     clearLog();
   };
 
   return (
     <div className="p-4 flex flex-col gap-3" style={{ minHeight: "100%" }}>
+      <div className="flex gap-2">
+        <Input
+          value={query}
+          onChange={(e) => setQuery(e.target.value)}
+          placeholder='Search the log, e.g. failed or "profile match"'
+        />
+        <select
+          className={selectClass}
+          value={range}
+          onChange={(e) => setRange(e.target.value as Range)}
+        >
+          <option value="all">All time</option>
+          <option value="hour">Last hour</option>
+          <option value="today">Today</option>
+          <option value="day">Last 24 hours</option>
+        </select>
+      </div>
+
+      <div className="text-xs text-neutral-500">
+        {result
+          ? `${result.seqs.length} of ${result.searched} entries match, found in ${(
+              result.micros / 1000
+            ).toFixed(1)} ms`
+          : hidden > 0
+            ? `Showing the newest ${entries.length} entries; search to find the ${hidden} older ones.`
+            : `${entries.length} entries`}
+      </div>
+
       <div
         ref={scrollRef}
         className="flex-1 overflow-y-auto border border-neutral-200 rounded-md"
         style={{ maxHeight: "400px" }}
       >
-        {entries.length === 0 ? (
+        {shown.length === 0 ? (
           <div className="p-6 text-center text-sm text-neutral-400">
-            No activity recorded yet.
+            {result ? "No matching entries." : "No activity recorded yet."}
           </div>
         ) : (
           <table className="w-full text-xs">
@@ -50,13 +214,16 @@ export default function LogView({ initialLog }: Props) {
               </tr>
             </thead>
             <tbody>
-              {entries.map((entry, i) => (
+              {shown.map((entry) => (
                 <tr
-                  key={i}
+                  key={entry.seq}
                   className="border-b border-neutral-100 hover:bg-neutral-50"
                 >
                   <td className="px-3 py-1.5 whitespace-nowrap">{entry.time}</td>
-                  <td className="px-3 py-1.5">{entry.message}</td>
+                  <td className="px-3 py-1.5">
+                    {entry.message}
+                    {entry.thumb && <Thumbnail thumb={entry.thumb} root={scrollRef} />}
+                  </td>
                 </tr>
               ))}
             </tbody>
@@ -65,6 +232,30 @@ export default function LogView({ initialLog }: Props) {
       </div>
 
       <div className="flex justify-end gap-2">
+        {pages > 1 && (
+          <>
+            <Button
+              variant="outline"
+              size="sm"
+              disabled={page === 0}
+              onClick={() => setPage(page - 1)}
+            >
+              Older
+            </Button>
+            <span className="self-center text-xs text-neutral-500">
+              Page {page + 1} of {pages}
+            </span>
+            <Button
+              variant="outline"
+              size="sm"
+              disabled={page === pages - 1}
+              onClick={() => setPage(page + 1)}
+            >
+              Newer
+            </Button>
+            <div className="flex-1" />
+          </>
+        )}
         <Button variant="outline" size="sm" onClick={handleClear}>
           Clear
         </Button>
@@ -0,0 +1,222 @@
+import { useEffect, useState } from "react";
+import {
+  onStatsUpdate,
+  onTransferBench,
+  onKeystrokeBench,
+  resetStats,
+  closeDialog,
+  runTransferBench,
+  runKeystrokeBench,
+  type KeyLatency,
+  type KeystrokeBenchResult,
+  type StatsData,
+  type TransferBenchResult,
+  type Trigger,
+} from "./lib/bridge";
+import { Button } from "./components/ui/button";
+
+interface Props {
+  initialStats: StatsData;
+}
+
+function formatMicros(us: number): string {
+  if (us >= 1000000) return `${(us / 1000000).toFixed(2)} s`;
+  if (us >= 1000) return `${(us / 1000).toFixed(1)} ms`;
+  return `${us} µs`;
+}
+
+function formatRate(bytesPerSec: number): string {
+  if (bytesPerSec <= 0) return "—";
+  if (bytesPerSec >= 1024 * 1024) return `${(bytesPerSec / (1024 * 1024)).toFixed(1)} MB/s`;
+  if (bytesPerSec >= 1024) return `${(bytesPerSec / 1024).toFixed(1)} KB/s`;
+  return `${bytesPerSec.toFixed(0)} B/s`;
+}
+
+function formatKB(kb: number): string {
+  return kb >= 1024 ? `${(kb / 1024).toFixed(1)} MB` : `${kb} KB`;
+}
+
+function formatBench(us: number): string {
+  return us < 0 ? "unavailable" : formatMicros(us);
+}
+
+function formatLatency(l: KeyLatency | null): string {
+  if (!l) return "unavailable";
+  return `p50 ${formatMicros(l.p50)}, p99 ${formatMicros(l.p99)}, max ${formatMicros(l.max)}`;
+}
+
+const triggerNames: Record<Trigger, string> = {
+  hook: "Ctrl+V hook",
+  hotkey: "Ctrl+Shift+V hotkey",
+  rawinput: "Ctrl+V Raw Input",
+};
+
+export default function StatsView({ initialStats }: Props) {
+  const [stats, setStats] = useState<StatsData>(initialStats);
+  const [bench, setBench] = useState<TransferBenchResult | "running" | null>(null);
+  const [keyBench, setKeyBench] = useState<KeystrokeBenchResult | "running" | null>(null);
+
+  useEffect(() => {
+    onStatsUpdate((next) => setStats(next));
+    onTransferBench((result) => setBench(result));
+    onKeystrokeBench((result) => setKeyBench(result));
+  }, []);
+
+  const handleBench = () => {
+    setBench("running");
+    runTransferBench();
+  };
+
+  const handleKeyBench = () => {
+    setKeyBench("running");
+    runKeystrokeBench();
+  };
+
+  const hook = stats.hook;
+  const proc = stats.process;
+  const arena = stats.arena;
+
+  return (
+    <div className="p-4 flex flex-col gap-3">
+      {hook && (
+        <p className="text-[11px] text-neutral-500">
+          {hook.trigger !== "hook" ? (
+            <>{triggerNames[hook.trigger]}, no keyboard hook</>
+          ) : (
+            <>
+              Keyboard hook {hook.installed ? "installed" : <span className="text-red-600">not installed</span>}
+              {" · "}timeout {hook.timeoutMs} ms
+              {" · "}
+              <span className={hook.nearTimeouts > 0 ? "text-amber-600" : undefined}>
+                {hook.nearTimeouts} near-timeout{hook.nearTimeouts === 1 ? "" : "s"}
+              </span>
+              {" · "}
+              <span className={hook.reinstalls > 0 ? "text-red-600" : undefined}>
+                {hook.reinstalls} reinstall{hook.reinstalls === 1 ? "" : "s"}
+              </span>
+            </>
+          )}
+          {" · "}
+          {hook.titleCacheMisses} title cache miss{hook.titleCacheMisses === 1 ? "" : "es"}
+          {" · "}
+          process cache {hook.processCacheHits} hit{hook.processCacheHits === 1 ? "" : "s"},{" "}
+          {hook.processCacheMisses} miss{hook.processCacheMisses === 1 ? "" : "es"}
+        </p>
+      )}
+      {proc && (
+        <p className="text-[11px] text-neutral-500">
+          Ready {proc.startupMs} ms after start ({proc.eagerInit ? "eager" : "lazy"} startup,{" "}
+          {formatMicros(proc.winMainUs)} in WinMain)
+          {" · "}private {formatKB(proc.privateKB)}, working set {formatKB(proc.workingSetKB)}
+          {proc.idleTrims > 0 && (
+            <>
+              {" · "}idle private {formatKB(proc.idlePrivateKB)} after {proc.idleTrims} trim
+              {proc.idleTrims === 1 ? "" : "s"}
+            </>
+          )}
+        </p>
+      )}
+      {arena && (
+        <p className="text-[11px] text-neutral-500">
+          Paste arena {arena.limitKB > 0 ? `up to ${formatKB(arena.limitKB)}` : "off"}
+          {" · "}{formatKB(arena.committedKB)} committed
+          {" · "}in arena: {arena.inArena.pastes} paste{arena.inArena.pastes === 1 ? "" : "s"}
+          {arena.inArena.pastes > 0 &&
+            `, ${arena.inArena.meanFaults} faults and ${formatMicros(arena.inArena.meanUs)} each`}
+          {" · "}on heap: {arena.onHeap.pastes} paste{arena.onHeap.pastes === 1 ? "" : "s"}
+          {arena.onHeap.pastes > 0 &&
+            `, ${arena.onHeap.meanFaults} faults and ${formatMicros(arena.onHeap.meanUs)} each`}
+          {arena.heapFallbacks > 0 && (
+            <span className="text-amber-600">
+              {" · "}{arena.heapFallbacks} allocation{arena.heapFallbacks === 1 ? "" : "s"} did not fit
+            </span>
+          )}
+        </p>
+      )}
+      <div className="border border-neutral-200 rounded-md overflow-hidden">
+        <table className="w-full text-xs">
+          <thead className="bg-neutral-50">
+            <tr className="border-b border-neutral-200">
+              <th className="text-left px-3 py-2 font-medium text-neutral-600">Stage</th>
+              <th className="text-right px-3 py-2 font-medium text-neutral-600">Count</th>
+              <th className="text-right px-3 py-2 font-medium text-neutral-600">p50</th>
+              <th className="text-right px-3 py-2 font-medium text-neutral-600">p95</th>
+              <th className="text-right px-3 py-2 font-medium text-neutral-600">p99</th>
+              <th className="text-right px-3 py-2 font-medium text-neutral-600">Max</th>
+              <th className="text-right px-3 py-2 font-medium text-neutral-600">Throughput</th>
+            </tr>
+          </thead>
+          <tbody>
+            {stats.stages.map((s) => (
+              <tr key={s.name} className="border-b border-neutral-100 hover:bg-neutral-50">
+                <td className="px-3 py-1.5 whitespace-nowrap">{s.name}</td>
+                <td className="px-3 py-1.5 text-right tabular-nums">{s.count}</td>
+                <td className="px-3 py-1.5 text-right tabular-nums">{s.count ? formatMicros(s.p50) : "—"}</td>
+                <td className="px-3 py-1.5 text-right tabular-nums">{s.count ? formatMicros(s.p95) : "—"}</td>
+                <td className="px-3 py-1.5 text-right tabular-nums">{s.count ? formatMicros(s.p99) : "—"}</td>
+                <td className="px-3 py-1.5 text-right tabular-nums">{s.count ? formatMicros(s.max) : "—"}</td>
+                <td className="px-3 py-1.5 text-right tabular-nums whitespace-nowrap">
+                  {formatRate(s.bytesPerSec)}
+                </td>
+              </tr>
+            ))}
+          </tbody>
+        </table>
+      </div>
+
+      {bench && (
+        <p className="text-[11px] text-neutral-500">
+          {bench === "running" ? (
+            "Measuring bridge transfer…"
+          ) : (
+            <>
+              Bridge transfer of {(bench.bytes / (1024 * 1024)).toFixed(0)} MB:
+              {" "}string {formatBench(bench.stringUs)}
+              {" · "}shared JSON {formatBench(bench.sharedJsonUs)}
+              {" · "}shared binary {formatBench(bench.sharedBinaryUs)}
+            </>
+          )}
+        </p>
+      )}
+
+      {keyBench && (
+        <p className="text-[11px] text-neutral-500">
+          {keyBench === "running" ? (
+            "Measuring keystroke latency…"
+          ) : (
+            <>
+              Keystroke latency over {keyBench.keys} key events:
+              {" "}with the keyboard hook {formatLatency(keyBench.hook)}
+              {" · "}without it {formatLatency(keyBench.noHook)}
+            </>
+          )}
+        </p>
+      )}
+
+      <div className="flex justify-end gap-2">
+        <Button
+          variant="outline"
+          size="sm"
+          disabled={keyBench === "running"}
+          onClick={handleKeyBench}
+        >
+          Measure keystroke latency
+        </Button>
+        <Button
+          variant="outline"
+          size="sm"
+          disabled={bench === "running"}
+          onClick={handleBench}
+        >
+          Measure bridge transfer
+        </Button>
+        <Button variant="outline" size="sm" onClick={() => resetStats()}>
+          Reset
+        </Button>
+        <Button size="sm" onClick={() => closeDialog()}>
+          Close
+        </Button>
+      </div>
+    </div>
+  );
+}
@@ -1,44 +1,322 @@
-export interface ConfigData {
+export type ImageFormat = "png" | "jpeg";
+export type TextEncoding = "base64" | "base64-lines" | "data-uri" | "framed";
+export type Delivery = "paste" | "type";
+export type RoutePolicy = "fixed" | "lossless" | "photos" | "any";
+
+/* Rule lists use the title-match syntax; empty lists are not checked */
+export interface ProfileData {
+  name: string;
+  exeMatch: string;
+  classMatch: string;
   titleMatch: string;
+  format: ImageFormat;
+  /* PNG deflate level, 0-9 */
+  effort: number;
+  /* JPEG quality, 1-100 */
+  quality: number;
+  /* Budget for the pasted text in bytes, 0 = unlimited */
+  maxBytes: number;
+  textEncoding: TextEncoding;
+  /* Clipboard + Ctrl+V, or typed as Unicode keystrokes */
+  delivery: Delivery;
+  /* "fixed" always uses format; the others let the image's content choose */
+  route: RoutePolicy;
+}
+
+/* How a paste is noticed: the keyboard hook on Ctrl+V, a Ctrl+Shift+V
+ * hotkey, or Raw Input on Ctrl+V; the last two install no hook */
+export type Trigger = "hook" | "hotkey" | "rawinput";
+
+export interface ConfigData {
+  /* Tried in order; the default profile is tried last */
+  profiles: ProfileData[];
+  defaultProfile: ProfileData;
+  trigger: Trigger;
+}
+
+/* A gallery thumbnail; the pixels are fetched with requestThumb */
+export interface ThumbRef {
+  id: number;
+  width: number;
+  height: number;
 }
 
 export interface LogEntry {
+  /* Increases by one per entry */
+  seq: number;
   time: string;
   message: string;
+  thumb?: ThumbRef;
+}
+
+export interface StageStats {
+  name: string;
+  count: number;
+  /* Latencies in microseconds */
+  p50: number;
+  p95: number;
+  p99: number;
+  max: number;
+  mean: number;
+  bytesPerSec: number;
+}
+
+export interface HookHealth {
+  timeoutMs: number;
+  reinstalls: number;
+  nearTimeouts: number;
+  installed: boolean;
+  trigger: Trigger;
+  titleCacheMisses: number;
+  processCacheHits: number;
+  processCacheMisses: number;
+}
+
+/* Startup time and memory; idlePrivateKB is 0 until the first idle trim */
+export interface ProcessInfo {
+  startupMs: number;
+  winMainUs: number;
+  eagerInit: boolean;
+  privateKB: number;
+  workingSetKB: number;
+  idlePrivateKB: number;
+  idleTrims: number;
+}
+
+/* Mean page faults and time of converting one paste */
+export interface PasteFaults {
+  pastes: number;
+  meanFaults: number;
+  meanUs: number;
+}
+
+/* The paste arena; limitKB 0 means pastes use the heap */
+export interface ArenaInfo {
+  limitKB: number;
+  committedKB: number;
+  heapFallbacks: number;
+  releases: number;
+  inArena: PasteFaults;
+  onHeap: PasteFaults;
+}
+
+export interface StatsData {
+  stages: StageStats[];
+  hook?: HookHealth;
+  process?: ProcessInfo;
+  arena?: ArenaInfo;
 }
 
 export interface InitData {
-  view: "config" | "log";
+  view: "config" | "log" | "stats";
   config?: ConfigData;
   log?: LogEntry[];
+  /* Entries in the ring; log holds only the newest of them */
+  logTotal?: number;
+  stats?: StatsData;
+}
+
+/* Unix times in ms; 0 leaves that end open */
+export interface LogSearchQuery {
+  query: string;
+  from: number;
+  to: number;
+}
+
+export interface LogSearchResult {
+  /* Matching entries, oldest first; fetch them with getLogPage */
+  seqs: number[];
+  micros: number;
+  /* Entries searched */
+  searched: number;
+}
+
+interface LogSearchMessage extends LogSearchResult {
+  id: number;
+}
+
+interface LogPageMessage {
+  id: number;
+  entries: LogEntry[];
+}
+
+/* Times for one payload through each bridge channel, -1 if unavailable */
+export interface TransferBenchResult {
+  bytes: number;
+  stringUs: number;
+  sharedJsonUs: number;
+  sharedBinaryUs: number;
+}
+
+/* Latency of one key event through the system, in microseconds */
+export interface KeyLatency {
+  p50: number;
+  p99: number;
+  max: number;
+}
+
+/* Key events timed with the keyboard hook installed and without it; null
+ * where the keys did not come through */
+export interface KeystrokeBenchResult {
+  keys: number;
+  hook: KeyLatency | null;
+  noHook: KeyLatency | null;
 }
 
 type InitCallback = (data: InitData) => void;
 type LogUpdateCallback = (entry: LogEntry) => void;
+type StatsUpdateCallback = (stats: StatsData) => void;
+type TransferBenchCallback = (result: TransferBenchResult) => void;
+type KeystrokeBenchCallback = (result: KeystrokeBenchResult) => void;
 
 let initCallback: InitCallback | null = null;
 let logUpdateCallback: LogUpdateCallback | null = null;
+let statsUpdateCallback: StatsUpdateCallback | null = null;
+let transferBenchCallback: TransferBenchCallback | null = null;
+let keystrokeBenchCallback: KeystrokeBenchCallback | null = null;
+
+/* Large payloads arrive in shared buffers and small ones as script, which
+ * can overtake each other: a log snapshot may arrive after updates newer
+ * than it. Recent updates are kept to be merged back in by seq. */
+const RECENT_LOG_UPDATES = 64;
+let recentLogUpdates: LogEntry[] = [];
+
+/* Answer to getThumb without a shared buffer; only the id if it is gone */
+interface ThumbMessage {
+  id: number;
+  width?: number;
+  height?: number;
+  rgba?: string | null;
+}
+
+/* Searches and pages requested and not yet answered, by request id */
+let nextRequestId = 1;
+const pendingSearches = new Map<number, (result: LogSearchResult) => void>();
+const pendingPages = new Map<number, (entries: LogEntry[]) => void>();
+
+/* Thumbnails requested and not yet answered, by id */
+const pendingThumbs = new Map<number, (image: ImageData | null) => void>();
+
+function resolveThumb(id: number, image: ImageData | null) {
+  const resolve = pendingThumbs.get(id);
+  pendingThumbs.delete(id);
+  resolve?.(image);
+}
+
+interface SharedBufferEvent {
+  getBuffer: () => ArrayBuffer;
+  additionalData:
+    | { kind: "json"; call: string }
+    | { kind: "bench" }
+    | ({ kind: "thumb" } & ThumbRef);
+}
 
 declare global {
   interface Window {
     onInit: (data: InitData) => void;
     onLogUpdate: (entry: LogEntry) => void;
+    onStatsUpdate: (stats: StatsData) => void;
+    onBenchPayload: (payload: unknown) => void;
+    onTransferBench: (result: TransferBenchResult) => void;
+    onKeystrokeBench: (result: KeystrokeBenchResult) => void;
+    onThumb: (thumb: ThumbMessage) => void;
+    onLogSearch: (result: LogSearchMessage) => void;
+    onLogPage: (page: LogPageMessage) => void;
     chrome?: {
       webview?: {
         postMessage: (s: string) => void;
+        addEventListener: (type: "sharedbufferreceived", listener: (e: SharedBufferEvent) => void) => void;
+        releaseBuffer: (buffer: ArrayBuffer) => void;
       };
     };
   }
 }
 
 window.onInit = (data: InitData) => {
+  if (data.log) {
+    const last = data.log.length ? data.log[data.log.length - 1].seq : -1;
+    data.log = data.log.concat(recentLogUpdates.filter((e) => e.seq > last));
+  }
   initCallback?.(data);
 };
 
 window.onLogUpdate = (entry: LogEntry) => {
+  recentLogUpdates.push(entry);
+  if (recentLogUpdates.length > RECENT_LOG_UPDATES) recentLogUpdates.shift();
   logUpdateCallback?.(entry);
 };
 
+window.onStatsUpdate = (stats: StatsData) => {
+  statsUpdateCallback?.(stats);
+};
+
+window.onBenchPayload = () => {
+  postMessage({ action: "benchAck" });
+};
+
+window.onTransferBench = (result: TransferBenchResult) => {
+  transferBenchCallback?.(result);
+};
+
+window.onKeystrokeBench = (result: KeystrokeBenchResult) => {
+  keystrokeBenchCallback?.(result);
+};
+
+window.onThumb = (thumb: ThumbMessage) => {
+  if (!thumb.rgba || !thumb.width || !thumb.height) {
+    resolveThumb(thumb.id, null);
+    return;
+  }
+  const bytes = Uint8ClampedArray.from(atob(thumb.rgba), (c) => c.charCodeAt(0));
+  resolveThumb(thumb.id, new ImageData(bytes, thumb.width, thumb.height));
+};
+
+window.onLogSearch = ({ id, ...result }: LogSearchMessage) => {
+  pendingSearches.get(id)?.(result);
+  pendingSearches.delete(id);
+};
+
+window.onLogPage = ({ id, entries }: LogPageMessage) => {
+  pendingPages.get(id)?.(entries);
+  pendingPages.delete(id);
+};
+
+/* Functions a shared buffer may carry a JSON payload for */
+const sharedCalls = [
+  "onInit",
+  "onLogUpdate",
+  "onStatsUpdate",
+  "onBenchPayload",
+  "onLogSearch",
+  "onLogPage",
+] as const;
+
+window.chrome?.webview?.addEventListener("sharedbufferreceived", (e) => {
+  const webview = window.chrome!.webview!;
+  const buffer = e.getBuffer();
+  const meta = e.additionalData;
+  if (meta.kind === "bench") {
+    /* Touch the bytes so the transfer is not just a mapping */
+    const bytes = new Uint8Array(buffer);
+    let sum = 0;
+    for (let i = 0; i < bytes.length; i += 4096) sum += bytes[i];
+    webview.releaseBuffer(buffer);
+    postMessage({ action: "benchAck", sum });
+    return;
+  }
+  if (meta.kind === "thumb") {
+    /* Copied out: the buffer is released right away */
+    const bytes = new Uint8ClampedArray(buffer.slice(0));
+    webview.releaseBuffer(buffer);
+    resolveThumb(meta.id, new ImageData(bytes, meta.width, meta.height));
+    return;
+  }
+  const text = new TextDecoder().decode(buffer);
+  webview.releaseBuffer(buffer);
+  const call = sharedCalls.find((name) => name === meta.call);
+  if (call) (window[call] as (data: unknown) => void)(JSON.parse(text));
+});
+
 export function onInit(cb: InitCallback) {
   initCallback = cb;
 }
@@ -47,6 +325,18 @@ export function onLogUpdate(cb: LogUpdateCallback) {
   logUpdateCallback = cb;
 }
 
+export function onStatsUpdate(cb: StatsUpdateCallback) {
+  statsUpdateCallback = cb;
+}
+
+export function onTransferBench(cb: TransferBenchCallback) {
+  transferBenchCallback = cb;
+}
+
+export function onKeystrokeBench(cb: KeystrokeBenchCallback) {
+  keystrokeBenchCallback = cb;
+}
+
 function postMessage(msg: Record<string, unknown>) {
   try {
     window.chrome?.webview?.postMessage(JSON.stringify(msg));
@@ -60,13 +350,23 @@ export function getInit() {
 }
 
 export function saveSettings(config: ConfigData) {
-  postMessage({ action: "saveSettings", titleMatch: config.titleMatch });
+  postMessage({
+    action: "saveSettings",
+    profiles: config.profiles,
+    defaultProfile: config.defaultProfile,
+    trigger: config.trigger,
+  });
 }
 
 export function clearLog() {
+  recentLogUpdates = [];
   postMessage({ action: "clearLog" });
 }
 
+export function resetStats() {
+  postMessage({ action: "resetStats" });
+}
+
 export function closeDialog() {
   postMessage({ action: "close" });
 }
@@ -74,3 +374,49 @@ export function closeDialog() {
 export function reportHeight(height: number) {
   postMessage({ action: "resize", height });
 }
+
+/* Sent once a view's first frame has been presented, for time-to-first-paint */
+export function reportPainted(view: InitData["view"]) {
+  postMessage({ action: "painted", view });
+}
+
+/* Times a 5 MB payload through each bridge channel; see onTransferBench */
+export function runTransferBench() {
+  postMessage({ action: "benchTransfer" });
+}
+
+/* Times key events with and without the keyboard hook; see onKeystrokeBench */
+export function runKeystrokeBench() {
+  postMessage({ action: "benchKeystroke" });
+}
+
+/* The pixels of a gallery thumbnail, or null once its slot has been reused.
+ * Requests for the same id share one answer. */
+export function requestThumb(id: number): Promise<ImageData | null> {
+  return new Promise((resolve) => {
+    const previous = pendingThumbs.get(id);
+    pendingThumbs.set(id, (image) => {
+      previous?.(image);
+      resolve(image);
+    });
+    if (!previous) postMessage({ action: "getThumb", id });
+  });
+}
+
+/* Searches the whole log in the host; answers with the matching seqs only */
+export function searchLog({ query, from, to }: LogSearchQuery): Promise<LogSearchResult> {
+  return new Promise((resolve) => {
+    const id = nextRequestId++;
+    pendingSearches.set(id, resolve);
+    postMessage({ action: "searchLog", id, query, from, to });
+  });
+}
+
+/* The entries of `seqs`, without those the log has dropped since */
+export function getLogPage(seqs: number[]): Promise<LogEntry[]> {
+  return new Promise((resolve) => {
+    const id = nextRequestId++;
+    pendingPages.set(id, resolve);
+    postMessage({ action: "getLogPage", id, seqs });
+  });
+}
@@ -1,11 +1,12 @@
 import { defineConfig } from "vite";
 import react from "@vitejs/plugin-react";
-import { viteSingleFile } from "vite-plugin-singlefile";
 
+/* The host serves dist/ from https://imagepaster.local/ out of a packed
+ * resource (tools/packui.c); content-hashed files under assets/ are cached
+ * for good, so keep the JS and CSS as separate files rather than inlined. */
 export default defineConfig({
-  plugins: [react(), viteSingleFile()],
+  plugins: [react()],
   build: {
     outDir: "dist",
-    assetsInlineLimit: Infinity,
   },
 });
@@ -0,0 +1,178 @@
+/*
+ * ImagePaster - base64.c
+ *
+ * Base64 encoder and decoder (see base64.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "base64.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define B64_SSSE3 1
+#endif
+
+static const char b64_table[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void base64_encode_to(const uint8_t *data, size_t len, char *out)
+{
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3) {
+        uint32_t triple = (uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2];
+        *out++ = b64_table[(triple >> 18) & 0x3F];
+        *out++ = b64_table[(triple >> 12) & 0x3F];
+        *out++ = b64_table[(triple >>  6) & 0x3F];
+        *out++ = b64_table[ triple        & 0x3F];
+    }
+
+    /* padding */
+    if (i < len) {
+        uint32_t triple = (uint32_t)data[i] << 16;
+        if (i + 1 < len) triple |= (uint32_t)data[i + 1] << 8;
+        *out++ = b64_table[(triple >> 18) & 0x3F];
+        *out++ = b64_table[(triple >> 12) & 0x3F];
+        *out++ = i + 1 < len ? b64_table[(triple >> 6) & 0x3F] : '=';
+        *out++ = '=';
+    }
+}
+
+char *base64_encode(const uint8_t *data, size_t len, size_t *outLen)
+{
+    size_t encLen = BASE64_ENCODED_LEN(len);
+    char *out = (char *)malloc(encLen + 1);
+    if (!out) return NULL;
+    base64_encode_to(data, len, out);
+    out[encLen] = '\0';
+    if (outLen) *outLen = encLen;
+    return out;
+}
+
+/* ── Decoding ──────────────────────────────────────────────────────────── */
+
+#define B64_INVALID 0xFF
+
+static uint8_t g_decTable[256];
+static int     g_decReady = 0;
+
+/* Built on first use (idempotent, so a benign race) */
+static void dec_init(void)
+{
+    memset(g_decTable, B64_INVALID, sizeof(g_decTable));
+    for (int i = 0; i < 64; i++) g_decTable[(uint8_t)b64_table[i]] = (uint8_t)i;
+    g_decReady = 1;
+}
+
+/* Decodes whole groups from `in`; returns the characters consumed, stopping
+ * at the first group that holds padding or an invalid character. */
+static size_t decode_groups_scalar(const char *in, size_t len, uint8_t *out)
+{
+    size_t i = 0;
+    for (; i + 4 <= len; i += 4, out += 3) {
+        uint32_t a = g_decTable[(uint8_t)in[i]],     b = g_decTable[(uint8_t)in[i + 1]];
+        uint32_t c = g_decTable[(uint8_t)in[i + 2]], d = g_decTable[(uint8_t)in[i + 3]];
+        if ((a | b | c | d) & 0xC0) break;   /* invalid or '=' */
+        uint32_t triple = a << 18 | b << 12 | c << 6 | d;
+        out[0] = (uint8_t)(triple >> 16);
+        out[1] = (uint8_t)(triple >> 8);
+        out[2] = (uint8_t)triple;
+    }
+    return i;
+}
+
+/* The final group, which may end in one or two '=' */
+static size_t decode_last(const char *in, uint8_t *out)
+{
+    uint32_t a = g_decTable[(uint8_t)in[0]], b = g_decTable[(uint8_t)in[1]];
+    uint32_t c = g_decTable[(uint8_t)in[2]], d = g_decTable[(uint8_t)in[3]];
+    if ((a | b) & 0xC0) return BASE64_DECODE_ERROR;
+    if (in[2] == '=' && in[3] == '=') {
+        out[0] = (uint8_t)(a << 2 | b >> 4);
+        return 1;
+    }
+    if (c & 0xC0) return BASE64_DECODE_ERROR;
+    if (in[3] == '=') {
+        out[0] = (uint8_t)(a << 2 | b >> 4);
+        out[1] = (uint8_t)(b << 4 | c >> 2);
+        return 2;
+    }
+    if (d & 0xC0) return BASE64_DECODE_ERROR;
+    uint32_t triple = a << 18 | b << 12 | c << 6 | d;
+    out[0] = (uint8_t)(triple >> 16);
+    out[1] = (uint8_t)(triple >> 8);
+    out[2] = (uint8_t)triple;
+    return 3;
+}
+
+#ifdef B64_SSSE3
+/* 16 characters to 12 bytes per step: validate and map ASCII to 6-bit values
+ * with nibble lookups, then pack the 6-bit fields with two multiply-adds and
+ * a shuffle. Stops at the first block holding '=' or an invalid character;
+ * the scalar loop takes over from there. */
+__attribute__((target("ssse3")))
+static size_t decode_groups_ssse3(const char *in, size_t len, uint8_t *out)
+{
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i pack1 = _mm_set1_epi32(0x01400140);
+    const __m128i pack2 = _mm_set1_epi32(0x00011000);
+    const __m128i order = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+    size_t i = 0;
+    /* Each store writes 16 bytes for 12; the bound leaves room for the 4 extra */
+    for (; i + 24 <= len; i += 16, out += 12) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi32(v, 4), nibble);
+        __m128i lo = _mm_and_si128(v, nibble);
+        __m128i bad = _mm_and_si128(_mm_shuffle_epi8(lutLo, lo), _mm_shuffle_epi8(lutHi, hi));
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(bad, _mm_setzero_si128()))) break;
+
+        __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(v, slash), hi));
+        v = _mm_add_epi8(v, roll);
+        v = _mm_madd_epi16(_mm_maddubs_epi16(v, pack1), pack2);
+        _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(v, order));
+    }
+    return i;
+}
+
+static int has_ssse3(void)
+{
+    static int cached = -1;
+    if (cached < 0) cached = __builtin_cpu_supports("ssse3") ? 1 : 0;
+    return cached;
+}
+#endif
+
+static size_t decode(const char *in, size_t len, uint8_t *out, int simd)
+{
+    if (len % 4) return BASE64_DECODE_ERROR;
+    if (!g_decReady) dec_init();
+    if (len == 0) return 0;
+
+    size_t i = 0;
+#ifdef B64_SSSE3
+    if (simd && has_ssse3()) i = decode_groups_ssse3(in, len, out);
+#else
+    (void)simd;
+#endif
+    i += decode_groups_scalar(in + i, len - 4 - i, out + i / 4 * 3);
+    if (i != len - 4) return BASE64_DECODE_ERROR;
+    size_t last = decode_last(in + i, out + i / 4 * 3);
+    return last == BASE64_DECODE_ERROR ? last : i / 4 * 3 + last;
+}
+
+size_t base64_decode_to(const char *in, size_t len, uint8_t *out)
+{
+    return decode(in, len, out, 1);
+}
+
+size_t base64_decode_to_scalar(const char *in, size_t len, uint8_t *out)
+{
+    return decode(in, len, out, 0);
+}
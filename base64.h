@@ -0,0 +1,33 @@
+/*
+ * ImagePaster - base64.h
+ *
+ * Standard (RFC 4648) base64 encoding with padding, and decoding. The
+ * decoder uses SSSE3 when the CPU has it (GCC/Clang on x86).
+ */
+
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BASE64_ENCODED_LEN(n) (4 * (((size_t)(n) + 2) / 3))
+
+/* Writes BASE64_ENCODED_LEN(len) characters to `out` (no terminator). */
+void  base64_encode_to(const uint8_t *data, size_t len, char *out);
+
+/* Returns a malloc'd NUL-terminated string, or NULL on allocation failure. */
+char *base64_encode(const uint8_t *data, size_t len, size_t *outLen);
+
+#define BASE64_DECODED_MAX(n) ((size_t)(n) / 4 * 3)
+#define BASE64_DECODE_ERROR  ((size_t)-1)
+
+/* Decodes `len` characters, a multiple of 4 with no whitespace; '=' padding
+ * may end the last group only. Writes at most BASE64_DECODED_MAX(len) bytes
+ * and returns the count, or BASE64_DECODE_ERROR for malformed input. */
+size_t base64_decode_to(const char *in, size_t len, uint8_t *out);
+
+/* The same without SIMD; the reference for benchmarks and cross-checks. */
+size_t base64_decode_to_scalar(const char *in, size_t len, uint8_t *out);
+
+#endif // BASE64_H
@@ -0,0 +1,243 @@
+/*
+ * ImagePaster - bench/band_bench.c
+ *
+ * Host-native benchmark of the PNG band cache (pngenc.h): the encode time of
+ * a 4K capture that differs from the previous one in 5% of its pixels, with
+ * the previous capture's compressed bands cached, against encoding it in
+ * full. Two kinds of change: new lines of output at the bottom of a terminal
+ * (5% of the rows) and a small window redrawn in the middle (5% of the area
+ * but spread over more rows). Checks that a cached encode writes exactly the
+ * bytes of an uncached one and that they decompress to the same scanlines as
+ * the plain encoder's.
+ *
+ *   band_bench [--runs N] [--json FILE]
+ *
+ * Built and run by `make bench` (see Makefile).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pngenc.h"
+#include "stats.h"
+#include "tools/inflate.h"
+
+#define BAND_BENCH_RUNS  5
+#define BENCH_WIDTH      3840
+#define BENCH_HEIGHT     2160
+#define GLYPH_W          9
+#define GLYPH_H          18
+
+/* 5% of 2160 rows is 108; 960x432 is 5% of the pixels */
+static const struct { const char *name; uint32_t x, y, w, h; } g_changes[] = {
+    { "terminal output", 0, BENCH_HEIGHT - 108, BENCH_WIDTH, 108 },
+    { "window redraw",   1440, 864, 960, 432 },
+};
+#define CHANGE_COUNT (sizeof(g_changes) / sizeof(g_changes[0]))
+
+typedef struct {
+    StatHistogram cached;
+    uint32_t      bands, reused;
+    size_t        size;
+    int           same;
+} Change;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* One pixel of glyph `c`: a fixed pseudo-random 9x18 bitmap per character,
+ * so text repeats the way real text does. */
+static int glyph_on(unsigned c, uint32_t gx, uint32_t gy)
+{
+    if (gy < 3 || gy >= GLYPH_H - 3 || gx == GLYPH_W - 1) return 0;
+    uint32_t h = (c * 0x9E3779B1u) ^ (gy * 0x85EBCA6Bu);
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    return (h >> gx) & 1;
+}
+
+/* Screenshot-like: panels with a title bar, a gradient, and lines of text
+ * whose characters depend on `seed` */
+static void draw(RgbImage *img, uint32_t x0, uint32_t y0, uint32_t w, uint32_t h, unsigned seed)
+{
+    for (uint32_t y = y0; y < y0 + h; y++) {
+        uint8_t *p = img->pixels + (size_t)y * img->stride + (size_t)x0 * 3;
+        uint32_t line = y / GLYPH_H;
+        for (uint32_t x = x0; x < x0 + w; x++, p += 3) {
+            uint32_t col = x / GLYPH_W;
+            unsigned c = (unsigned)((line * 131 + col * 7 + seed * 977) % 61);
+            int text = (line % 5 != 4) && (col % 40 < 32 + line % 7) && c > 8;
+            int panel = (x / 960 + y / 540) % 2;
+            if (y % 540 < 24) {
+                p[0] = 0x2B; p[1] = 0x57; p[2] = 0x9A;                  /* title bar */
+            } else if (text && glyph_on(c, x % GLYPH_W, y % GLYPH_H)) {
+                p[0] = p[1] = p[2] = panel ? 0xE0 : 0x20;
+            } else {
+                p[0] = panel ? 0x1E : 0xF8;
+                p[1] = panel ? 0x1E : (uint8_t)(0xF0 + (x >> 9));
+                p[2] = panel ? (uint8_t)(0x24 + (y >> 8)) : 0xF8;
+            }
+        }
+    }
+}
+
+static uint64_t encode_us(const RgbImage *img, PngBandCache *cache, ByteBuf *out)
+{
+    RgbImageRows rows;
+    rgb_image_rows(&rows, img);
+    out->len = 0;
+    uint64_t t = now_ns();
+    int ok = cache ? png_encode_rows_cached(&rows.base, 6, cache, out)
+                   : png_encode_rows(&rows.base, 6, out);
+    uint64_t us = (now_ns() - t) / 1000;
+    return ok ? us : 0;
+}
+
+/* The zlib stream of a PNG this encoder wrote: a single IDAT */
+static int scanlines(const ByteBuf *png, ByteBuf *out)
+{
+    size_t at = 8 + 12 + 13;
+    if (png->len < at + 8 || memcmp(png->data + at + 4, "IDAT", 4) != 0) return 0;
+    uint32_t len = (uint32_t)png->data[at] << 24 | (uint32_t)png->data[at + 1] << 16 |
+                   (uint32_t)png->data[at + 2] << 8 | png->data[at + 3];
+    out->len = 0;
+    return zlib_inflate(png->data + at + 8, len, out) == INFLATE_OK;
+}
+
+static double ms(uint64_t micros)
+{
+    return micros / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = BAND_BENCH_RUNS;
+    const char *jsonPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else {
+            fprintf(stderr, "usage: band_bench [--runs N] [--json FILE]\n");
+            return 2;
+        }
+    }
+    if (runs < 1) runs = 1;
+
+    Change changes[CHANGE_COUNT];
+    RgbImage base = { BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH * 3, NULL };
+    RgbImage edit = base;
+    base.pixels = (uint8_t *)malloc(base.stride * base.height);
+    edit.pixels = (uint8_t *)malloc(edit.stride * edit.height);
+    if (!base.pixels || !edit.pixels) {
+        fprintf(stderr, "band_bench: out of memory\n");
+        return 1;
+    }
+    draw(&base, 0, 0, BENCH_WIDTH, BENCH_HEIGHT, 1);
+
+    ByteBuf out = { 0 }, plain = { 0 }, cold = { 0 }, a = { 0 }, b = { 0 };
+    PngBandCache cache = { 0 };
+    StatHistogram full, banded;
+    stat_reset(&full);
+    stat_reset(&banded);
+
+    /* Full encodes of the unchanged capture, without and with bands */
+    for (int i = 0; i <= runs; i++) {
+        uint64_t us = encode_us(&base, NULL, &plain);
+        if (i > 0) stat_record(&full, us, plain.len);
+        PngBandCache empty = { 0 };
+        us = encode_us(&base, &empty, &out);
+        if (i > 0) stat_record(&banded, us, out.len);
+        png_band_cache_free(&empty);
+    }
+    size_t plainSize = plain.len, bandedSize = out.len;
+    int ok = scanlines(&plain, &a) && scanlines(&out, &b) && a.len == b.len &&
+             memcmp(a.data, b.data, a.len) == 0;
+
+    for (size_t c = 0; c < CHANGE_COUNT; c++) {
+        Change *ch = &changes[c];
+        memcpy(edit.pixels, base.pixels, base.stride * base.height);
+        draw(&edit, g_changes[c].x, g_changes[c].y, g_changes[c].w, g_changes[c].h, 2);
+        stat_reset(&ch->cached);
+
+        for (int i = 0; i <= runs; i++) {
+            encode_us(&base, &cache, &out);             /* the previous capture */
+            uint64_t us = encode_us(&edit, &cache, &out);
+            if (i > 0) stat_record(&ch->cached, us, out.len);
+        }
+        ch->bands = cache.lastBands;
+        ch->reused = cache.lastReused;
+        ch->size = out.len;
+
+        /* The same bytes as encoding the changed capture from scratch */
+        PngBandCache empty = { 0 };
+        encode_us(&edit, &empty, &cold);
+        png_band_cache_free(&empty);
+        encode_us(&edit, NULL, &plain);
+        ch->same = cold.len == out.len && memcmp(cold.data, out.data, out.len) == 0 &&
+                   scanlines(&plain, &a) && scanlines(&out, &b) && a.len == b.len &&
+                   memcmp(a.data, b.data, a.len) == 0;
+        ok &= ch->same && ch->reused < ch->bands;
+    }
+
+    uint64_t fullP50 = stat_percentile(&full, 50), bandedP50 = stat_percentile(&banded, 50);
+
+    FILE *human = (jsonPath && strcmp(jsonPath, "-") == 0) ? stderr : stdout;
+    fprintf(human, "Band cache benchmark: %dx%d capture, level 6, %d runs, about %d KB bands\n\n",
+            BENCH_WIDTH, BENCH_HEIGHT, runs, PNG_BAND_BYTES / 1024);
+    fprintf(human, "%-34s %10s %12s %10s\n", "", "p50 ms", "PNG bytes", "bands");
+    fprintf(human, "%-34s %10.1f %12lu %10s\n", "full encode", ms(fullP50), (unsigned long)plainSize, "-");
+    fprintf(human, "%-34s %10.1f %12lu %10s\n", "full encode in bands", ms(bandedP50),
+            (unsigned long)bandedSize, "-");
+    for (size_t c = 0; c < CHANGE_COUNT; c++) {
+        const Change *ch = &changes[c];
+        char label[64], bands[32];
+        snprintf(label, sizeof(label), "5%% changed, cached (%s)", g_changes[c].name);
+        snprintf(bands, sizeof(bands), "%u/%u", ch->bands - ch->reused, ch->bands);
+        fprintf(human, "%-34s %10.1f %12lu %10s  %.1fx faster%s\n", label,
+                ms(stat_percentile(&ch->cached, 50)), (unsigned long)ch->size, bands,
+                stat_percentile(&ch->cached, 50) ? (double)fullP50 / stat_percentile(&ch->cached, 50) : 0,
+                ch->same ? "" : "  OUTPUT DIFFERS");
+    }
+    fprintf(human, "\nBands column: recompressed of total. Banding costs %.2f%% in size. Scanlines: %s\n",
+            plainSize ? 100.0 * ((double)bandedSize - (double)plainSize) / (double)plainSize : 0,
+            ok ? "same" : "DIFFER");
+
+    if (jsonPath) {
+        FILE *f = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+        if (!f) {
+            fprintf(stderr, "band_bench: cannot write %s\n", jsonPath);
+            return 1;
+        }
+        fprintf(f, "{\"runs\":%d,\"width\":%d,\"height\":%d,\"fullP50Us\":%llu,\"bandedP50Us\":%llu,"
+                   "\"fullBytes\":%lu,\"bandedBytes\":%lu,\"changes\":[",
+                runs, BENCH_WIDTH, BENCH_HEIGHT, (unsigned long long)fullP50,
+                (unsigned long long)bandedP50, (unsigned long)plainSize, (unsigned long)bandedSize);
+        for (size_t c = 0; c < CHANGE_COUNT; c++) {
+            const Change *ch = &changes[c];
+            fprintf(f, "%s{\"name\":\"%s\",\"cachedP50Us\":%llu,\"bands\":%u,\"reused\":%u,"
+                       "\"bytes\":%lu,\"same\":%s}",
+                    c ? "," : "", g_changes[c].name, (unsigned long long)stat_percentile(&ch->cached, 50),
+                    ch->bands, ch->reused, (unsigned long)ch->size, ch->same ? "true" : "false");
+        }
+        fprintf(f, "],\"ok\":%s}\n", ok ? "true" : "false");
+        if (f != stdout) fclose(f);
+    }
+
+    png_band_cache_free(&cache);
+    bb_free(&out);
+    bb_free(&plain);
+    bb_free(&cold);
+    bb_free(&a);
+    bb_free(&b);
+    free(base.pixels);
+    free(edit.pixels);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,612 @@
+/*
+ * ImagePaster - bench/bench.c
+ *
+ * Host-native benchmark of the conversion pipeline (pipeline.h) over a fixed
+ * corpus of synthetic clipboard DIBs at several resolutions and bit depths,
+ * plus any real-world DIBs given on the command line (.bmp files or .ipcap
+ * capture files). Each case runs through pipeline_run() with an in-memory
+ * PasteIo; every stage is timed into a stats.h histogram.
+ *
+ * Per case it reports latency percentiles and throughput per stage, peak RSS,
+ * the pipeline's own peak allocation, page faults per run and output sizes,
+ * as a table on stdout and optionally as JSON. Runs use a paste arena
+ * (arena.h) as the application does, unless --no-arena.
+ *
+ *   bench [--runs N] [--level N] [--format png|jpeg] [--quality N] [--quick]
+ *         [--stream] [--no-arena] [--filter TEXT] [--json FILE]
+ *         [FILE.bmp|FILE.ipcap ...]
+ *
+ * Built and run by `make bench` (see Makefile).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "pipeline.h"
+#include "jpegenc.h"
+#include "capture.h"
+#include "stats.h"
+#include "inflate.h"
+#include "arena.h"
+
+#define BENCH_DEFAULT_RUNS 10
+#define BENCH_QUICK_RUNS   3
+#define BENCH_MAX_NAME     96
+#define BENCH_ARENA_RESERVE ((size_t)1024 * 1024 * 1024)
+#define BENCH_ARENA_KEEP    ((size_t)64 * 1024 * 1024)     /* the application's default */
+
+typedef enum { CONTENT_UI, CONTENT_PHOTO, CONTENT_NOISE, CONTENT_FLAT } ContentKind;
+
+typedef struct {
+    ContentKind kind;
+    uint32_t    width;
+    uint32_t    height;
+    int         bitCount;
+    int         large;      /* skipped by --quick */
+} SyntheticCase;
+
+/* The fixed synthetic corpus. Screenshot-like content dominates because that
+ * is what users paste; noise and flat bound the encoder from both sides. */
+static const SyntheticCase g_corpus[] = {
+    { CONTENT_UI,     640,  480, 32, 0 },
+    { CONTENT_UI,    1920, 1080, 32, 0 },
+    { CONTENT_UI,    1920, 1080, 24, 0 },
+    { CONTENT_UI,    1920, 1080, 16, 0 },
+    { CONTENT_UI,    1280,  720,  8, 0 },
+    { CONTENT_UI,    3840, 2160, 32, 1 },
+    { CONTENT_UI,   11520, 2160, 32, 1 },    /* three 4K monitors, streamed */
+    { CONTENT_PHOTO, 1920, 1080, 24, 0 },
+    { CONTENT_PHOTO, 3840, 2160, 32, 1 },
+    { CONTENT_NOISE, 1920, 1080, 32, 0 },
+    { CONTENT_FLAT,  1920, 1080, 32, 0 },
+};
+
+static const char *g_kindNames[] = { "ui", "photo", "noise", "flat" };
+
+typedef struct {
+    int         runs;
+    int         level;
+    PipeFormat  format;
+    int         quality;
+    int         quick;
+    int         stream;     /* stream every image, not only large ones */
+    int         noArena;
+    const char *filter;
+    const char *jsonPath;
+} BenchOptions;
+
+typedef struct {
+    char          name[BENCH_MAX_NAME];
+    uint32_t      width, height;
+    int           bitCount;
+    size_t        dibBytes;
+    size_t        pngBytes;
+    size_t        base64Bytes;
+    long          peakRssKB;
+    size_t        peakBytes;    /* PipeResult.peakBytes */
+    double        faultsPerRun; /* minor page faults inside pipeline_run */
+    int           streamed;
+    int           runs;
+    const char   *error;
+    StatHistogram stages[PIPE_STAGE_COUNT];
+    StatHistogram total;
+} BenchResult;
+
+/* ── Clock and memory ──────────────────────────────────────────────────── */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Resets the kernel's peak-RSS mark (Linux 4.0+); returns 0 if unsupported. */
+static int reset_peak_rss(void)
+{
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (!f) return 0;
+    int ok = fputs("5", f) >= 0;
+    return (fclose(f) == 0) && ok;
+}
+
+static long minor_faults(void)
+{
+    struct rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_minflt : 0;
+}
+
+static long peak_rss_kb(void)
+{
+    FILE *f = fopen("/proc/self/status", "r");
+    char line[256];
+    long kb = -1;
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            if (strncmp(line, "VmHWM:", 6) == 0) { kb = strtol(line + 6, NULL, 10); break; }
+        }
+        fclose(f);
+    }
+    if (kb < 0) {
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) == 0) kb = ru.ru_maxrss;
+    }
+    return kb;
+}
+
+/* ── Synthetic DIBs ────────────────────────────────────────────────────── */
+
+static uint32_t g_rng = 0x12345678;
+
+static uint32_t rng_next(void)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 17;
+    g_rng ^= g_rng << 5;
+    return g_rng;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24);
+}
+
+/* Fills top-down RGB with content resembling the given kind. */
+static void synth_rgb(ContentKind kind, uint32_t w, uint32_t h, uint8_t *rgb)
+{
+    g_rng = 0x12345678u ^ (w * 2654435761u) ^ h ^ ((uint32_t)kind << 24);
+
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            uint8_t *p = rgb + ((size_t)y * w + x) * 3;
+            switch (kind) {
+            case CONTENT_PHOTO: {
+                uint32_t n = rng_next() & 15;
+                p[0] = (uint8_t)((x * 255 / w + n) & 0xFF);
+                p[1] = (uint8_t)((y * 255 / h + n) & 0xFF);
+                p[2] = (uint8_t)(((x + y) * 127 / (w + h) + 64 + n) & 0xFF);
+                break;
+            }
+            case CONTENT_NOISE: {
+                uint32_t r = rng_next();
+                p[0] = (uint8_t)r; p[1] = (uint8_t)(r >> 8); p[2] = (uint8_t)(r >> 16);
+                break;
+            }
+            case CONTENT_FLAT:
+                p[0] = 0x1E; p[1] = 0x1E; p[2] = 0x1E;
+                break;
+            case CONTENT_UI:
+            default:
+                p[0] = 0xF3; p[1] = 0xF3; p[2] = 0xF3;
+                break;
+            }
+        }
+    }
+    if (kind != CONTENT_UI) return;
+
+    /* Windows: title bar, body, and lines of "text" made of short glyph runs */
+    for (int win = 0; win < 6; win++) {
+        uint32_t wx = rng_next() % (w / 2), wy = rng_next() % (h / 2);
+        uint32_t ww = w / 4 + rng_next() % (w / 3), wh = h / 4 + rng_next() % (h / 3);
+        uint8_t accent[3] = { (uint8_t)(rng_next() & 0x7F), (uint8_t)(0x60 + (rng_next() & 0x7F)), 0xC0 };
+        for (uint32_t y = wy; y < wy + wh && y < h; y++) {
+            for (uint32_t x = wx; x < wx + ww && x < w; x++) {
+                uint8_t *p = rgb + ((size_t)y * w + x) * 3;
+                if (y < wy + 28) memcpy(p, accent, 3);
+                else if (x == wx || x == wx + ww - 1 || y == wy + wh - 1) { p[0] = p[1] = p[2] = 0x80; }
+                else { p[0] = p[1] = p[2] = 0xFF; }
+            }
+        }
+        for (uint32_t ty = wy + 40; ty + 12 < wy + wh && ty + 12 < h; ty += 18) {
+            uint32_t tx = wx + 8;
+            uint32_t lineEnd = wx + 8 + rng_next() % (ww > 16 ? ww - 16 : 1);
+            while (tx + 8 < lineEnd && tx + 8 < w) {
+                uint32_t glyphs = 2 + rng_next() % 8;
+                for (uint32_t g = 0; g < glyphs && tx + 8 < lineEnd && tx + 8 < w; g++, tx += 8) {
+                    uint32_t shape = rng_next();
+                    for (uint32_t gy = 0; gy < 12; gy++) {
+                        for (uint32_t gx = 0; gx < 6; gx++) {
+                            if ((shape >> ((gy * 6 + gx) % 32)) & 1) {
+                                uint8_t *p = rgb + ((size_t)(ty + gy) * w + tx + gx) * 3;
+                                p[0] = p[1] = p[2] = 0x20;
+                            }
+                        }
+                    }
+                }
+                tx += 8;   /* word gap */
+            }
+        }
+    }
+}
+
+/* Packs RGB into a bottom-up packed DIB of the requested depth:
+ * 32 and 24 bpp BI_RGB, 16 bpp BI_BITFIELDS 5-6-5, 8 bpp with a 3-3-2 palette. */
+static uint8_t *synth_dib(const uint8_t *rgb, uint32_t w, uint32_t h, int bpp, size_t *len)
+{
+    size_t stride = (((size_t)w * bpp + 31) / 32) * 4;
+    size_t extra = bpp == 16 ? 12 : bpp == 8 ? 256 * 4 : 0;
+    size_t size = 40 + extra + stride * h;
+    uint8_t *dib = (uint8_t *)calloc(1, size);
+    if (!dib) return NULL;
+
+    put32(dib, 40);
+    put32(dib + 4, w);
+    put32(dib + 8, h);
+    dib[12] = 1;
+    dib[14] = (uint8_t)bpp;
+    put32(dib + 16, bpp == 16 ? DIB_BI_BITFIELDS : DIB_BI_RGB);
+    put32(dib + 20, (uint32_t)(stride * h));
+
+    uint8_t *p = dib + 40;
+    if (bpp == 16) {
+        put32(p, 0xF800); put32(p + 4, 0x07E0); put32(p + 8, 0x001F);
+    } else if (bpp == 8) {
+        for (int i = 0; i < 256; i++) {
+            p[i * 4 + 2] = (uint8_t)(((i >> 5) & 7) * 255 / 7);
+            p[i * 4 + 1] = (uint8_t)(((i >> 2) & 7) * 255 / 7);
+            p[i * 4 + 0] = (uint8_t)((i & 3) * 255 / 3);
+        }
+    }
+    uint8_t *bits = dib + 40 + extra;
+
+    for (uint32_t y = 0; y < h; y++) {
+        const uint8_t *src = rgb + (size_t)(h - 1 - y) * w * 3;
+        uint8_t *dst = bits + stride * y;
+        for (uint32_t x = 0; x < w; x++, src += 3) {
+            switch (bpp) {
+            case 32: dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0]; dst[3] = 0; dst += 4; break;
+            case 24: dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0]; dst += 3; break;
+            case 16: {
+                uint16_t v = (uint16_t)(((src[0] >> 3) << 11) | ((src[1] >> 2) << 5) | (src[2] >> 3));
+                dst[0] = (uint8_t)v; dst[1] = (uint8_t)(v >> 8); dst += 2;
+                break;
+            }
+            default:
+                *dst++ = (uint8_t)((src[0] >> 5) << 5 | (src[1] >> 5) << 2 | (src[2] >> 6));
+                break;
+            }
+        }
+    }
+    *len = size;
+    return dib;
+}
+
+/* ── Running a case ────────────────────────────────────────────────────── */
+
+typedef struct {
+    uint64_t       last;
+    BenchResult   *result;
+    int            record;
+} BenchClock;
+
+static void on_stage(void *ctx, PipeStage stage, uint64_t bytes)
+{
+    BenchClock *c = (BenchClock *)ctx;
+    uint64_t t = now_ns();
+    if (c->record) stat_record(&c->result->stages[stage], (t - c->last) / 1000, bytes);
+    c->last = t;
+}
+
+static void run_case(const uint8_t *dib, size_t len, const BenchOptions *opt, BenchResult *r)
+{
+    DibInfo info;
+    MemoryPasteIo mem;
+    PasteIo io;
+    PipeResult res;
+
+    for (int s = 0; s < PIPE_STAGE_COUNT; s++) stat_reset(&r->stages[s]);
+    stat_reset(&r->total);
+    r->dibBytes = len;
+    if (dib_parse(dib, len, &info) == DIB_OK) {
+        r->width = (uint32_t)info.width;
+        r->height = (uint32_t)(info.height < 0 ? -info.height : info.height);
+        r->bitCount = info.bitCount;
+    }
+
+    int resettable = reset_peak_rss();
+    memory_paste_io_init(&mem, &io, dib, len);
+    long faults = 0;
+
+    /* A fresh arena per case; the warm-up run sizes it, as the previous
+     * paste would in the application */
+    PasteArena arenaStore, *arena = NULL;
+    if (!opt->noArena && arena_init(&arenaStore, BENCH_ARENA_RESERVE, BENCH_ARENA_KEEP)) arena = &arenaStore;
+
+    /* One untimed warm-up run, then the measured ones */
+    for (int run = 0; run <= opt->runs; run++) {
+        BenchClock clk = { now_ns(), r, run > 0 };
+        PipeOptions po = { .level = opt->level, .onStage = on_stage, .ctx = &clk,
+                           .format = opt->format, .quality = opt->quality,
+                           .text = PIPE_TEXT_BASE64, .streamAbove = opt->stream ? 1 : 0 };
+        if (arena) arena_begin(arena);
+        long f0 = minor_faults();
+        uint64_t start = clk.last;
+        PipeStatus st = pipeline_run(&io, &po, &res);
+        uint64_t end = now_ns();
+        if (run > 0) faults += minor_faults() - f0;
+        if (st != PIPE_OK) {
+            r->error = st == PIPE_ERR_DECODE ? dib_result_string(res.dibResult)
+                                             : pipeline_status_string(st);
+            pipeline_result_free(&res);
+            if (arena) arena_end(arena);
+            break;
+        }
+        if (run > 0) stat_record(&r->total, (end - start) / 1000, len);
+        r->pngBytes = res.imageSize;
+        r->base64Bytes = res.base64Len;
+        r->peakBytes = res.peakBytes;
+        r->streamed = res.streamed;
+        pipeline_result_free(&res);
+        if (arena) arena_end(arena);
+        r->runs = run;
+    }
+    r->faultsPerRun = r->runs ? (double)faults / r->runs : 0.0;
+
+    memory_paste_io_free(&mem);
+    if (arena) arena_destroy(arena);
+    r->peakRssKB = resettable ? peak_rss_kb() : -peak_rss_kb();
+}
+
+/* ── Real-world inputs ─────────────────────────────────────────────────── */
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    ByteBuf b = {0};
+    uint8_t chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) bb_append(&b, chunk, n);
+    fclose(f);
+    if (b.failed) { bb_free(&b); return NULL; }
+    *len = b.len;
+    return b.data;
+}
+
+static int ends_with(const char *s, const char *suffix)
+{
+    size_t a = strlen(s), b = strlen(suffix);
+    return a >= b && strcmp(s + a - b, suffix) == 0;
+}
+
+static const char *base_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+/* ── Output ────────────────────────────────────────────────────────────── */
+
+static double mb_per_sec(const StatHistogram *h)
+{
+    return stat_bytes_per_sec(h) / (1024.0 * 1024.0);
+}
+
+static void print_case(FILE *out, const BenchOptions *opt, const BenchResult *r)
+{
+    fprintf(out, "%s  %ux%u %d bpp, DIB %zu B", r->name, r->width, r->height, r->bitCount, r->dibBytes);
+    if (r->error) { fprintf(out, "  FAILED: %s\n\n", r->error); return; }
+    fprintf(out, " -> %s %zu B (%.1f%%), base64 %zu B, peak RSS %ld KB%s, %d runs\n",
+           opt->format == PIPE_FORMAT_JPEG ? "JPEG" : "PNG",
+           r->pngBytes, r->dibBytes ? r->pngBytes * 100.0 / r->dibBytes : 0.0,
+           r->base64Bytes, r->peakRssKB < 0 ? -r->peakRssKB : r->peakRssKB,
+           r->peakRssKB < 0 ? " (process)" : "", r->runs);
+    fprintf(out, "  pipeline peak %zu KB, %s, %.0f page faults per run (%s)\n",
+            (r->peakBytes + 1023) / 1024, r->streamed ? "streamed" : "decoded in memory",
+            r->faultsPerRun, opt->noArena ? "heap" : "arena");
+    fprintf(out, "  %-14s %10s %10s %10s %10s %10s\n", "stage", "p50 us", "p95 us", "p99 us", "max us", "MB/s");
+    for (int s = 0; s <= PIPE_STAGE_COUNT; s++) {
+        const StatHistogram *h = s < PIPE_STAGE_COUNT ? &r->stages[s] : &r->total;
+        if (s == PIPE_STAGE_CLASSIFY && !h->count) continue;     /* not routed */
+        fprintf(out, "  %-14s %10llu %10llu %10llu %10llu %10.1f\n",
+               s < PIPE_STAGE_COUNT ? pipeline_stage_name((PipeStage)s) : "Total",
+               (unsigned long long)stat_percentile(h, 50),
+               (unsigned long long)stat_percentile(h, 95),
+               (unsigned long long)stat_percentile(h, 99),
+               (unsigned long long)h->maxMicros, mb_per_sec(h));
+    }
+    fprintf(out, "\n");
+}
+
+static void json_histogram(FILE *f, const char *name, const StatHistogram *h)
+{
+    fprintf(f, "\"%s\":{\"p50Us\":%llu,\"p95Us\":%llu,\"p99Us\":%llu,\"maxUs\":%llu,"
+               "\"meanUs\":%llu,\"mbPerSec\":%.2f}",
+            name,
+            (unsigned long long)stat_percentile(h, 50),
+            (unsigned long long)stat_percentile(h, 95),
+            (unsigned long long)stat_percentile(h, 99),
+            (unsigned long long)h->maxMicros,
+            (unsigned long long)stat_mean(h), mb_per_sec(h));
+}
+
+static int write_json(const char *path, const BenchOptions *opt, const BenchResult *results, int count)
+{
+    FILE *f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!f) return 0;
+    fprintf(f, "{\"format\":\"%s\",\"level\":%d,\"quality\":%d,\"runs\":%d,\"arena\":%s,\"cases\":[",
+            pipeline_format_name(opt->format), opt->level, opt->quality, opt->runs,
+            opt->noArena ? "false" : "true");
+    for (int i = 0; i < count; i++) {
+        const BenchResult *r = &results[i];
+        fprintf(f, "%s{\"name\":\"", i ? "," : "");
+        for (const char *c = r->name; *c; c++) {
+            if (*c == '"' || *c == '\\') fputc('\\', f);
+            if ((unsigned char)*c >= 0x20) fputc(*c, f);
+        }
+        fprintf(f, "\",\"width\":%u,\"height\":%u,\"bitCount\":%d,\"dibBytes\":%zu",
+                r->width, r->height, r->bitCount, r->dibBytes);
+        if (r->error) {
+            fprintf(f, ",\"error\":\"%s\"}", r->error);
+            continue;
+        }
+        fprintf(f, ",\"pngBytes\":%zu,\"base64Bytes\":%zu,\"peakRssKB\":%ld,"
+                   "\"peakRssPerCase\":%s,\"peakBytes\":%zu,\"streamed\":%s,\"faultsPerRun\":%.1f,"
+                   "\"runs\":%d,\"stages\":{",
+                r->pngBytes, r->base64Bytes, r->peakRssKB < 0 ? -r->peakRssKB : r->peakRssKB,
+                r->peakRssKB < 0 ? "false" : "true", r->peakBytes, r->streamed ? "true" : "false",
+                r->faultsPerRun, r->runs);
+        for (int s = 0; s < PIPE_STAGE_COUNT; s++) {
+            if (s) fputc(',', f);
+            json_histogram(f, pipeline_stage_name((PipeStage)s), &r->stages[s]);
+        }
+        fputc(',', f);
+        json_histogram(f, "Total", &r->total);
+        fprintf(f, "}}");
+    }
+    fprintf(f, "]}\n");
+    return f == stdout ? fflush(f) == 0 : fclose(f) == 0;
+}
+
+/* ── Main ──────────────────────────────────────────────────────────────── */
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: bench [--runs N] [--level N] [--format png|jpeg] [--quality N] [--quick]\n"
+        "             [--stream] [--no-arena] [--filter TEXT] [--json FILE]\n"
+        "             [FILE.bmp|FILE.ipcap ...]\n"
+        "  --runs N     measured runs per case after one warm-up (default %d)\n"
+        "  --level N    deflate level 0-9 (default %d)\n"
+        "  --format F   output format, png or jpeg (default png)\n"
+        "  --quality N  JPEG quality 1-100 (default %d)\n"
+        "  --quick      skip 4K cases and use %d runs\n"
+        "  --stream     encode every image from the DIB's rows, as large ones are\n"
+        "  --no-arena   allocate from the heap instead of a paste arena\n"
+        "  --filter S   only run cases whose name contains S\n"
+        "  --json FILE  also write results as JSON (\"-\" for stdout)\n",
+        BENCH_DEFAULT_RUNS, PIPELINE_DEFAULT_LEVEL, JPEG_DEFAULT_QUALITY, BENCH_QUICK_RUNS);
+}
+
+static BenchResult *add_result(BenchResult **results, int *count, int *cap)
+{
+    if (*count == *cap) {
+        int newCap = *cap ? *cap * 2 : 16;
+        BenchResult *p = (BenchResult *)realloc(*results, sizeof(BenchResult) * (size_t)newCap);
+        if (!p) return NULL;
+        *results = p;
+        *cap = newCap;
+    }
+    BenchResult *r = &(*results)[(*count)++];
+    memset(r, 0, sizeof(*r));
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions opt = { BENCH_DEFAULT_RUNS, PIPELINE_DEFAULT_LEVEL, PIPE_FORMAT_PNG,
+                         JPEG_DEFAULT_QUALITY, 0, 0, 0, NULL, NULL };
+    BenchResult *results = NULL;
+    int count = 0, cap = 0, runsSet = 0, failed = 0;
+    int first = 1;
+
+    while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+        const char *a = argv[first++];
+        if (strcmp(a, "--quick") == 0) opt.quick = 1;
+        else if (strcmp(a, "--stream") == 0) opt.stream = 1;
+        else if (strcmp(a, "--no-arena") == 0) opt.noArena = 1;
+        else if (strcmp(a, "--runs") == 0 && first < argc) { opt.runs = atoi(argv[first++]); runsSet = 1; }
+        else if (strcmp(a, "--level") == 0 && first < argc) opt.level = atoi(argv[first++]);
+        else if (strcmp(a, "--format") == 0 && first < argc) {
+            int f = pipeline_parse_format(argv[first++]);
+            if (f < 0) { usage(); return 2; }
+            opt.format = (PipeFormat)f;
+        }
+        else if (strcmp(a, "--quality") == 0 && first < argc) opt.quality = atoi(argv[first++]);
+        else if (strcmp(a, "--filter") == 0 && first < argc) opt.filter = argv[first++];
+        else if (strcmp(a, "--json") == 0 && first < argc) opt.jsonPath = argv[first++];
+        else { usage(); return 2; }
+    }
+    if (opt.quick && !runsSet) opt.runs = BENCH_QUICK_RUNS;
+    if (opt.runs < 1 || opt.level < 0 || opt.level > 9 || opt.quality < 1 || opt.quality > 100) { usage(); return 2; }
+
+    /* The human table goes to stdout unless JSON does */
+    FILE *human = (opt.jsonPath && strcmp(opt.jsonPath, "-") == 0) ? stderr : stdout;
+    if (opt.format == PIPE_FORMAT_JPEG)
+        fprintf(human, "Pipeline benchmark: JPEG quality %d, %d run(s) per case\n\n", opt.quality, opt.runs);
+    else
+        fprintf(human, "Pipeline benchmark: PNG level %d, %d run(s) per case\n\n", opt.level, opt.runs);
+
+    for (size_t i = 0; i < sizeof(g_corpus) / sizeof(g_corpus[0]); i++) {
+        const SyntheticCase *c = &g_corpus[i];
+        char name[BENCH_MAX_NAME];
+        snprintf(name, sizeof(name), "%s-%ux%u-%dbpp", g_kindNames[c->kind], c->width, c->height, c->bitCount);
+        if ((opt.quick && c->large) || (opt.filter && !strstr(name, opt.filter))) continue;
+
+        uint8_t *rgb = (uint8_t *)malloc((size_t)c->width * c->height * 3);
+        size_t len = 0;
+        uint8_t *dib = rgb ? (synth_rgb(c->kind, c->width, c->height, rgb),
+                              synth_dib(rgb, c->width, c->height, c->bitCount, &len)) : NULL;
+        free(rgb);
+        BenchResult *r = add_result(&results, &count, &cap);
+        if (!r) { free(dib); return 1; }
+        snprintf(r->name, sizeof(r->name), "%s", name);
+        if (dib) run_case(dib, len, &opt, r);
+        else r->error = "out of memory";
+        free(dib);
+
+        print_case(human, &opt, r);
+        failed |= r->error != NULL;
+    }
+
+    for (int i = first; i < argc; i++) {
+        size_t len = 0;
+        uint8_t *data = read_file(argv[i], &len);
+        if (!data) { fprintf(stderr, "bench: cannot read %s\n", argv[i]); failed = 1; continue; }
+
+        if (ends_with(argv[i], ".ipcap")) {
+            /* Each capture record is one case */
+            FILE *f = fmemopen(data, len, "rb");
+            CaptureRecord *rec = (CaptureRecord *)malloc(sizeof(CaptureRecord));
+            int n = 0, rr = -1;
+            while (f && rec && (rr = capture_read(f, rec)) == 1) {
+                char name[BENCH_MAX_NAME];
+                snprintf(name, sizeof(name), "%s#%d", base_name(argv[i]), ++n);
+                if (opt.filter && !strstr(name, opt.filter)) { free(rec->dib); continue; }
+
+                ByteBuf dib = {0};
+                BenchResult *r = add_result(&results, &count, &cap);
+                if (!r) break;
+                snprintf(r->name, sizeof(r->name), "%s", name);
+                if (rec->flags & CAPTURE_FLAG_DEFLATED) {
+                    InflateResult ir = zlib_inflate(rec->dib, rec->storedSize, &dib);
+                    if (ir == INFLATE_OK) run_case(dib.data, dib.len, &opt, r);
+                    else r->error = inflate_result_string(ir);
+                } else {
+                    run_case(rec->dib, rec->storedSize, &opt, r);
+                }
+                bb_free(&dib);
+                free(rec->dib);
+
+                print_case(human, &opt, r);
+                failed |= r->error != NULL;
+            }
+            if (rr < 0) { fprintf(stderr, "bench: %s: corrupt capture record\n", argv[i]); failed = 1; }
+            free(rec);
+            if (f) fclose(f);
+        } else {
+            /* .bmp: skip the 14-byte BITMAPFILEHEADER; anything else is a packed DIB */
+            size_t skip = (len > 14 && data[0] == 'B' && data[1] == 'M') ? 14 : 0;
+            const char *name = base_name(argv[i]);
+            if (!opt.filter || strstr(name, opt.filter)) {
+                BenchResult *r = add_result(&results, &count, &cap);
+                if (r) {
+                    snprintf(r->name, sizeof(r->name), "%s", name);
+                    run_case(data + skip, len - skip, &opt, r);
+                    print_case(human, &opt, r);
+                    failed |= r->error != NULL;
+                }
+            }
+        }
+        free(data);
+    }
+
+    if (opt.jsonPath && !write_json(opt.jsonPath, &opt, results, count)) {
+        fprintf(stderr, "bench: cannot write %s\n", opt.jsonPath);
+        failed = 1;
+    }
+    free(results);
+    return failed ? 1 : 0;
+}
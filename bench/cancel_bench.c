@@ -0,0 +1,276 @@
+/*
+ * ImagePaster - bench/cancel_bench.c
+ *
+ * Host-native benchmark of conversion progress and cancellation
+ * (PipeOptions.onProgress). For a synthetic photo at 1080p, 4K and 8K, in
+ * PNG and JPEG, it reports the encode time without and with a progress
+ * callback, the gaps between two progress calls, and how long a conversion
+ * cancelled halfway takes to return once told. Besides every band of rows,
+ * the PNG encoder polls inside deflate and the JPEG encoder between MCUs.
+ * Checks that a cancel is noticed (longest gap) and torn down within
+ * CANCEL_GOAL_MS, that it returns PIPE_ERR_CANCELLED with no text, and,
+ * with glibc, that it leaves no more heap in use than before it started.
+ * Gaps are in thread CPU time: the work between two checks, without the
+ * stalls a busy or virtual machine adds to any thread. The full encodes run
+ * in a paste arena, as in the application, that the one before has sized;
+ * on the heap, growing the encoded image past 16 MB alone takes over 10 ms
+ * of page faults.
+ *
+ *   cancel_bench [--runs N] [--quick] [--json FILE]
+ *
+ * Built and run by `make bench` (see Makefile).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "pipeline.h"
+#include "stats.h"
+#include "arena.h"
+
+#define CANCEL_BENCH_RUNS   3
+#define CANCEL_GOAL_MS      10      /* from Esc to the conversion's return */
+#define JPEG_QUALITY        85
+#define CANCEL_ARENA_RESERVE ((size_t)1024 * 1024 * 1024)
+#define CANCEL_ARENA_KEEP    ((size_t)64 * 1024 * 1024)     /* the application's default */
+
+static const uint32_t g_sizes[][2] = { { 1920, 1080 }, { 3840, 2160 }, { 7680, 4320 } };
+#define SIZE_COUNT (sizeof(g_sizes) / sizeof(g_sizes[0]))
+
+typedef struct {
+    uint32_t      w, h;
+    PipeFormat    format;
+    StatHistogram plain;        /* full encode, no callback */
+    StatHistogram progress;     /* full encode, counting callback */
+    StatHistogram teardown;     /* from the cancelling callback to the return */
+    StatHistogram gaps;         /* between two progress calls */
+    uint32_t      calls;        /* progress calls of one full encode */
+    long long     leaked;       /* heap bytes a cancelled run left in use */
+    int           ok;
+} Case;
+
+typedef struct {
+    StatHistogram *gaps;
+    uint64_t last;              /* thread CPU time */
+    uint32_t calls;
+    uint32_t cancelAt;          /* row to cancel at, 0 = never */
+    uint64_t cancelledAt;
+} Probe;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Smooth tones with a few levels of noise: photo-like, cheap to draw */
+static void draw_photo(RgbImage *img)
+{
+    uint32_t r = 0x2545F491u;
+    for (uint32_t y = 0; y < img->height; y++) {
+        uint8_t *p = img->pixels + (size_t)y * img->stride;
+        for (uint32_t x = 0; x < img->width; x++, p += 3) {
+            r ^= r << 13;
+            r ^= r >> 17;
+            r ^= r << 5;
+            int n = (int)(r & 7) - 4;
+            int base = (int)((x * 255u) / img->width + (y * 255u) / img->height) / 2;
+            p[0] = (uint8_t)(base + n + 20);
+            p[1] = (uint8_t)(255 - base + n - 20);
+            p[2] = (uint8_t)((base * 3 / 4 + (int)((x ^ y) & 15)) + n);
+        }
+    }
+}
+
+static int on_progress(void *ctx, const PipeProgress *p)
+{
+    Probe *pr = (Probe *)ctx;
+    uint64_t cpu = cpu_ns();
+    if (pr->last && pr->gaps) stat_record(pr->gaps, (cpu - pr->last) / 1000, 0);
+    pr->last = cpu;
+    pr->calls++;
+    if (pr->cancelAt && p->stage == PIPE_STAGE_IMAGE_ENCODE && p->rows >= pr->cancelAt) {
+        pr->cancelledAt = now_ns();
+        return 0;
+    }
+    return 1;
+}
+
+static long long heap_in_use(void)
+{
+#ifdef __GLIBC__
+    return (long long)mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+static int run_case(Case *cs, const RgbImage *img, int runs, PasteArena *arena)
+{
+    PipeOptions opt;
+    PipeResult res;
+    memset(&opt, 0, sizeof(opt));
+    opt.level = PIPELINE_DEFAULT_LEVEL;
+    opt.quality = JPEG_QUALITY;
+    opt.format = cs->format;
+
+    stat_reset(&cs->plain);
+    stat_reset(&cs->progress);
+    stat_reset(&cs->teardown);
+    stat_reset(&cs->gaps);
+    cs->ok = 1;
+    for (int r = 0; r < runs; r++) {
+        opt.onProgress = NULL;
+        opt.ctx = NULL;
+        if (arena) arena_begin(arena);
+        uint64_t t = now_ns();
+        PipeStatus st = pipeline_encode_rgb(img, &opt, &res);
+        stat_record(&cs->plain, (now_ns() - t) / 1000, (uint64_t)img->width * img->height * 3);
+        pipeline_result_free(&res);
+        if (arena) arena_end(arena);
+        if (st != PIPE_OK) return 0;
+
+        Probe probe;
+        memset(&probe, 0, sizeof(probe));
+        probe.gaps = &cs->gaps;
+        opt.onProgress = on_progress;
+        opt.ctx = &probe;
+        if (arena) arena_begin(arena);
+        t = now_ns();
+        st = pipeline_encode_rgb(img, &opt, &res);
+        stat_record(&cs->progress, (now_ns() - t) / 1000, (uint64_t)img->width * img->height * 3);
+        pipeline_result_free(&res);
+        if (arena) arena_end(arena);
+        if (st != PIPE_OK) return 0;
+        cs->calls = probe.calls;
+
+        /* Cancelled halfway; no paste arena is open, so every block is on the
+         * heap. The first such run of a case is cancelled at once instead:
+         * glibc keeps a little bookkeeping from the heap's first encode. */
+        if (r == 0) {
+            memset(&probe, 0, sizeof(probe));
+            probe.cancelAt = 1;
+            pipeline_encode_rgb(img, &opt, &res);
+            pipeline_result_free(&res);
+        }
+        memset(&probe, 0, sizeof(probe));
+        probe.cancelAt = img->height / 2;
+        long long before = heap_in_use();
+        st = pipeline_encode_rgb(img, &opt, &res);
+        uint64_t end = now_ns();
+        long long leaked = heap_in_use() - before;
+        if (leaked > cs->leaked) cs->leaked = leaked;
+        cs->ok &= st == PIPE_ERR_CANCELLED && !res.base64 && probe.cancelledAt && leaked <= 0;
+        if (probe.cancelledAt) stat_record(&cs->teardown, (end - probe.cancelledAt) / 1000, 0);
+        pipeline_result_free(&res);
+    }
+    /* Told between two calls, noticed at the next, then torn down */
+    cs->ok &= cs->gaps.maxMicros + cs->teardown.maxMicros < CANCEL_GOAL_MS * 1000ull;
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = CANCEL_BENCH_RUNS, quick = 0;
+    const char *jsonPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            quick = 1;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else {
+            fprintf(stderr, "usage: cancel_bench [--runs N] [--quick] [--json FILE]\n");
+            return 2;
+        }
+    }
+    if (runs < 1) runs = 1;
+
+    size_t sizeEnd = quick ? 2 : SIZE_COUNT;
+    Case cases[SIZE_COUNT * PIPE_FORMAT_COUNT];
+    size_t count = 0;
+    int ok = 1;
+    for (size_t s = 0; s < sizeEnd; s++) {
+        RgbImage img = { g_sizes[s][0], g_sizes[s][1], (size_t)g_sizes[s][0] * 3, NULL };
+        img.pixels = (uint8_t *)malloc(img.stride * img.height);
+        if (!img.pixels) {
+            fprintf(stderr, "cancel_bench: out of memory\n");
+            return 1;
+        }
+        draw_photo(&img);
+        for (int f = 0; f < PIPE_FORMAT_COUNT; f++) {
+            Case *cs = &cases[count++];
+            memset(cs, 0, sizeof(*cs));
+            cs->w = img.width;
+            cs->h = img.height;
+            cs->format = (PipeFormat)f;
+            /* A fresh arena per case; the plain encode sizes it for the next */
+            PasteArena arenaStore, *arena = NULL;
+            if (arena_init(&arenaStore, CANCEL_ARENA_RESERVE, CANCEL_ARENA_KEEP)) arena = &arenaStore;
+            int done = run_case(cs, &img, runs, arena);
+            if (arena) arena_destroy(arena);
+            if (!done) {
+                fprintf(stderr, "cancel_bench: encoding failed\n");
+                return 1;
+            }
+            ok &= cs->ok;
+        }
+        free(img.pixels);
+    }
+
+    FILE *human = (jsonPath && strcmp(jsonPath, "-") == 0) ? stderr : stdout;
+    fprintf(human, "Cancellation benchmark: a progress call every %u pixels, %d runs, fastest shown\n\n",
+            PIPELINE_PROGRESS_PIXELS, runs);
+    fprintf(human, "%-10s %-5s %10s %10s %8s %6s %10s %10s %11s %8s\n", "size", "fmt", "plain ms",
+            "progress", "overhead", "calls", "p99 gap", "max gap", "teardown", "leaked");
+    for (size_t i = 0; i < count; i++) {
+        const Case *cs = &cases[i];
+        char dims[16];
+        uint64_t plain = cs->plain.minMicros, progress = cs->progress.minMicros;
+        snprintf(dims, sizeof(dims), "%ux%u", cs->w, cs->h);
+        fprintf(human, "%-10s %-5s %10.1f %10.1f %7.1f%% %6u %7llu us %7llu us %8llu us %8lld%s\n",
+                dims, pipeline_format_name(cs->format), plain / 1000.0, progress / 1000.0,
+                plain ? 100.0 * ((double)progress / plain - 1.0) : 0.0, cs->calls,
+                (unsigned long long)stat_percentile(&cs->gaps, 99), (unsigned long long)cs->gaps.maxMicros,
+                (unsigned long long)cs->teardown.maxMicros, cs->leaked, cs->ok ? "" : "  FAILED");
+    }
+    fprintf(human, "\nGoal: a cancel noticed and torn down within %d ms, nothing left allocated. %s\n",
+            CANCEL_GOAL_MS, ok ? "Met" : "NOT MET");
+
+    if (jsonPath) {
+        FILE *f = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+        if (!f) {
+            fprintf(stderr, "cancel_bench: cannot write %s\n", jsonPath);
+            return 1;
+        }
+        fprintf(f, "{\"runs\":%d,\"progressPixels\":%u,\"cases\":[", runs, PIPELINE_PROGRESS_PIXELS);
+        for (size_t i = 0; i < count; i++) {
+            const Case *cs = &cases[i];
+            fprintf(f, "%s{\"width\":%u,\"height\":%u,\"format\":\"%s\",\"plainUs\":%llu,"
+                    "\"progressUs\":%llu,\"calls\":%u,\"p99GapUs\":%llu,\"maxGapUs\":%llu,"
+                    "\"teardownMaxUs\":%llu,\"leakedBytes\":%lld,\"ok\":%s}",
+                    i ? "," : "", cs->w, cs->h, pipeline_format_name(cs->format),
+                    (unsigned long long)cs->plain.minMicros,
+                    (unsigned long long)cs->progress.minMicros, cs->calls,
+                    (unsigned long long)stat_percentile(&cs->gaps, 99), (unsigned long long)cs->gaps.maxMicros,
+                    (unsigned long long)cs->teardown.maxMicros, cs->leaked, cs->ok ? "true" : "false");
+        }
+        fprintf(f, "],\"ok\":%s}\n", ok ? "true" : "false");
+        if (f != stdout) fclose(f);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+/*
+ * ImagePaster - bench/frame_bench.c
+ *
+ * Host-native benchmark of the frame decoder (frame.h) that the unframe
+ * receiver runs: throughput decoding a 50 MB image from its framed text,
+ * fed in the receiver's 64 KB reads, with SSSE3 base64 and SSE4.2 CRC32C
+ * and with the scalar reference. Also decodes the frame with LF and bare
+ * CR line endings, as terminals deliver it, and checks that a corrupted
+ * byte and a lost line are both caught.
+ *
+ *   frame_bench [--runs N] [--mb N] [--json FILE]
+ *
+ * Built and run by `make bench` (see Makefile).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "frame.h"
+#include "stats.h"
+
+#define FRAME_BENCH_RUNS  5
+#define FRAME_BENCH_MB    50
+#define FEED_CHUNK        (64 * 1024)   /* as tools/unframe.c reads */
+
+typedef struct {
+    const uint8_t *expect;
+    uint64_t       offset;
+    int            same;
+} CheckSink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int count_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    (void)ctx;
+    (void)data;
+    (void)len;
+    return 1;
+}
+
+static int check_sink(void *ctx, const uint8_t *data, size_t len)
+{
+    CheckSink *c = (CheckSink *)ctx;
+    if (memcmp(c->expect + c->offset, data, len) != 0) c->same = 0;
+    c->offset += len;
+    return 1;
+}
+
+static FrameStatus feed(FrameDecoder *d, const char *text, size_t len)
+{
+    FrameStatus st = FRAME_MORE;
+    for (size_t i = 0; i < len && st == FRAME_MORE; i += FEED_CHUNK)
+        st = frame_decode(d, text + i, len - i < FEED_CHUNK ? len - i : FEED_CHUNK);
+    return st == FRAME_MORE ? frame_decode_end(d) : st;
+}
+
+static void time_decode(const char *text, size_t len, int simd, int runs, StatHistogram *h, int *ok)
+{
+    static FrameDecoder d;
+    for (int i = 0; i <= runs; i++) {
+        frame_decoder_init(&d, count_sink, NULL);
+        d.simd = simd;
+        uint64_t t = now_ns();
+        FrameStatus st = feed(&d, text, len);
+        uint64_t us = (now_ns() - t) / 1000;
+        if (st != FRAME_DONE) *ok = 0;
+        if (i > 0) stat_record(h, us, d.decoded);   /* the first run warms up */
+    }
+}
+
+static double mb_per_s(uint64_t bytes, uint64_t micros)
+{
+    return micros ? (double)bytes / (double)micros : 0;
+}
+
+/* The frame with its CRLFs rewritten; `cr` keeps only the CR, else only the LF */
+static size_t strip_line_ends(const char *in, size_t len, char *out, int cr)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] == '\r' && i + 1 < len && in[i + 1] == '\n') {
+            out[n++] = cr ? '\r' : '\n';
+            i++;
+        } else {
+            out[n++] = in[i];
+        }
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = FRAME_BENCH_RUNS, mb = FRAME_BENCH_MB;
+    const char *jsonPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mb") == 0 && i + 1 < argc) {
+            mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else {
+            fprintf(stderr, "usage: frame_bench [--runs N] [--mb N] [--json FILE]\n");
+            return 2;
+        }
+    }
+    if (runs < 1) runs = 1;
+    if (mb < 1) mb = 1;
+
+    /* Compressed image data is close to random */
+    size_t imageBytes = (size_t)mb * 1024 * 1024;
+    uint8_t *image = (uint8_t *)malloc(imageBytes);
+    size_t textCap = frame_length("png", imageBytes);
+    char *text = (char *)malloc(textCap);
+    char *alt = (char *)malloc(textCap);
+    if (!image || !text || !alt) {
+        fprintf(stderr, "frame_bench: out of memory\n");
+        return 1;
+    }
+    uint32_t x32 = 0x9E3779B9u;
+    for (size_t i = 0; i < imageBytes; i++) {
+        x32 ^= x32 << 13; x32 ^= x32 >> 17; x32 ^= x32 << 5;
+        image[i] = (uint8_t)(x32 >> 7);
+    }
+
+    uint64_t t = now_ns();
+    size_t textLen = frame_encode_to("png", image, imageBytes, text);
+    uint64_t encodeUs = (now_ns() - t) / 1000;
+
+    /* CRC32C alone, both ways */
+    t = now_ns();
+    uint32_t crcFast = crc32c_update(0, image, imageBytes);
+    uint64_t crcUs = (now_ns() - t) / 1000;
+    t = now_ns();
+    uint32_t crcSlow = crc32c_update_scalar(0, image, imageBytes);
+    uint64_t crcScalarUs = (now_ns() - t) / 1000;
+    int ok = crcFast == crcSlow && textLen == textCap;
+
+    StatHistogram simd, scalar;
+    stat_reset(&simd);
+    stat_reset(&scalar);
+    time_decode(text, textLen, 1, runs, &simd, &ok);
+    time_decode(text, textLen, 0, runs, &scalar, &ok);
+
+    /* Correctness: the bytes themselves, other line endings, damage */
+    static FrameDecoder d;
+    CheckSink check = { image, 0, 1 };
+    frame_decoder_init(&d, check_sink, &check);
+    int bytesSame = feed(&d, text, textLen) == FRAME_DONE && check.same && check.offset == imageBytes;
+
+    int endings = 1;
+    for (int cr = 0; cr < 2; cr++) {
+        size_t n = strip_line_ends(text, textLen, alt, cr);
+        frame_decoder_init(&d, count_sink, NULL);
+        endings &= feed(&d, alt, n) == FRAME_DONE;
+    }
+
+    memcpy(alt, text, textLen);
+    alt[textLen / 2] = alt[textLen / 2] == 'A' ? 'B' : 'A';
+    frame_decoder_init(&d, count_sink, NULL);
+    FrameStatus flipped = feed(&d, alt, textLen);
+
+    const size_t lineLen = FRAME_LINE_CHARS + 2;
+    size_t cut = textLen / 2 / lineLen * lineLen + 60;    /* a line start past the header */
+    while (alt[cut - 1] != '\n') cut++;
+    memcpy(alt, text, textLen);
+    memmove(alt + cut, alt + cut + lineLen, textLen - cut - lineLen);
+    frame_decoder_init(&d, count_sink, NULL);
+    FrameStatus dropped = feed(&d, alt, textLen - lineLen);
+
+    int damageCaught = flipped == FRAME_ERR_CRC && dropped == FRAME_ERR_LENGTH;
+    ok &= bytesSame && endings && damageCaught;
+
+    uint64_t simdP50 = stat_percentile(&simd, 50), scalarP50 = stat_percentile(&scalar, 50);
+
+    FILE *human = (jsonPath && strcmp(jsonPath, "-") == 0) ? stderr : stdout;
+    fprintf(human, "Frame benchmark: %d MB image, %lu-character frame, %d runs, %d KB reads\n\n",
+            mb, (unsigned long)textLen, runs, FEED_CHUNK / 1024);
+    fprintf(human, "%-22s %10s %12s\n", "", "p50 ms", "image MB/s");
+    fprintf(human, "%-22s %10.1f %12.0f\n", "decode (SIMD)", simdP50 / 1000.0, mb_per_s(imageBytes, simdP50));
+    fprintf(human, "%-22s %10.1f %12.0f\n", "decode (scalar)", scalarP50 / 1000.0, mb_per_s(imageBytes, scalarP50));
+    fprintf(human, "%-22s %10.1f %12.0f\n", "CRC32C (SSE4.2)", crcUs / 1000.0, mb_per_s(imageBytes, crcUs));
+    fprintf(human, "%-22s %10.1f %12.0f\n", "CRC32C (scalar)", crcScalarUs / 1000.0, mb_per_s(imageBytes, crcScalarUs));
+    fprintf(human, "%-22s %10.1f %12.0f\n", "encode", encodeUs / 1000.0, mb_per_s(imageBytes, encodeUs));
+    fprintf(human, "\nDecoder state: %lu KB, whatever the frame size. Bytes: %s. "
+                   "LF/CR line endings: %s. Corruption caught: %s\n",
+            (unsigned long)(sizeof(FrameDecoder) / 1024), bytesSame ? "same" : "DIFFER",
+            endings ? "ok" : "FAILED", damageCaught ? "yes" : "NO");
+
+    if (jsonPath) {
+        FILE *f = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+        if (!f) {
+            fprintf(stderr, "frame_bench: cannot write %s\n", jsonPath);
+            return 1;
+        }
+        fprintf(f, "{\"runs\":%d,\"imageBytes\":%lu,\"frameChars\":%lu,\"decoderBytes\":%lu,"
+                   "\"decodeP50Us\":%llu,\"decodeScalarP50Us\":%llu,\"crcUs\":%llu,\"crcScalarUs\":%llu,"
+                   "\"encodeUs\":%llu,\"decodeMBps\":%.0f,\"decodeScalarMBps\":%.0f,\"ok\":%s}\n",
+                runs, (unsigned long)imageBytes, (unsigned long)textLen,
+                (unsigned long)sizeof(FrameDecoder),
+                (unsigned long long)simdP50, (unsigned long long)scalarP50,
+                (unsigned long long)crcUs, (unsigned long long)crcScalarUs,
+                (unsigned long long)encodeUs, mb_per_s(imageBytes, simdP50),
+                mb_per_s(imageBytes, scalarP50), ok ? "true" : "false");
+        if (f != stdout) fclose(f);
+    }
+
+    free(image);
+    free(text);
+    free(alt);
+    return ok ? 0 : 1;
+}
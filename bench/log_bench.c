@@ -0,0 +1,243 @@
+/*
+ * ImagePaster - bench/log_bench.c
+ *
+ * Host-native benchmark of the Activity Log search index (logindex.h). It
+ * logs paste sessions shaped like the real log into a ring of 100,000
+ * entries, running past the ring so the oldest entries are overwritten.
+ * The entries cover three days. It reports the cost of indexing an entry,
+ * the index size and the latency of typical queries: a rare word, a
+ * phrase, several terms, a term too short for a trigram, a match-nothing,
+ * and a time range of this morning. Every answer is checked against a scan
+ * of the ring.
+ *
+ *   log_bench [--entries N] [--runs N] [--json FILE]
+ *
+ * Built and run by `make bench` (see Makefile).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "logindex.h"
+#include "stats.h"
+
+#define LOG_BENCH_ENTRIES  100000
+#define LOG_BENCH_RUNS     20
+#define MESSAGE_BYTES      160
+#define SPAN_MS            (3ull * 24 * 3600 * 1000)
+#define LATENCY_GOAL_US    10000
+
+typedef struct {
+    char    (*text)[MESSAGE_BYTES];
+    uint64_t *time;
+    uint32_t  cap;
+    uint32_t  next;             /* seq of the next entry */
+} Ring;
+
+static const struct { const char *name, *query; int morning; } g_queries[] = {
+    { "rare word",        "FAILED",                         0 },
+    { "phrase",           "\"clipboard replaced with\"",   0 },
+    { "several terms",    "pasted 1920x1080 png",          0 },
+    { "short term",       "ms",                             0 },
+    { "no match",         "zebra",                          0 },
+    { "this morning",     "pasted",                         1 },
+};
+#define QUERY_COUNT (sizeof(g_queries) / sizeof(g_queries[0]))
+
+static const char *g_profiles[] = { "Default", "xshell", "putty", "Jira", "terminal" };
+static const char *g_sizes[] = { "1920x1080", "2560x1440", "3840x2160", "1280x720", "640x480", "800x600" };
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t g_rand = 0x2545F491u;
+
+static uint32_t next_rand(void)
+{
+    g_rand ^= g_rand << 13;
+    g_rand ^= g_rand >> 17;
+    g_rand ^= g_rand << 5;
+    return g_rand;
+}
+
+static const char *ring_text(void *ctx, uint32_t seq)
+{
+    const Ring *r = (const Ring *)ctx;
+    if (r->next - seq > r->cap || seq >= r->next) return NULL;
+    return r->text[seq % r->cap];
+}
+
+/* One line of a paste session, picked by `step` */
+static void make_message(char *out, unsigned step)
+{
+    const char *profile = g_profiles[next_rand() % 5];
+    const char *size = g_sizes[next_rand() % 6];
+    unsigned a = next_rand() % 9000 + 100, b = next_rand() % 900 + 10;
+    switch (step % 8) {
+    case 0: snprintf(out, MESSAGE_BYTES, "--- Ctrl+V detected ---"); break;
+    case 1: snprintf(out, MESSAGE_BYTES, "Profile match: \"%s\" (title \"%s\")", profile, profile); break;
+    case 2: snprintf(out, MESSAGE_BYTES, "Clipboard has image: %s", a % 3 ? "YES" : "NO"); break;
+    case 3: snprintf(out, MESSAGE_BYTES, "Decoded image: %s", size); break;
+    case 4:
+        if (a % 97 == 0) snprintf(out, MESSAGE_BYTES, "Conversion FAILED, blocking paste");
+        else snprintf(out, MESSAGE_BYTES, "Clipboard replaced with base64 text (%u chars)", a * 37);
+        break;
+    case 5:
+        snprintf(out, MESSAGE_BYTES, "Timings: open %u us, decode %u ms, encode %u ms, publish %u us",
+                 b, a % 97, a % 311, b * 3);
+        break;
+    case 6:
+        snprintf(out, MESSAGE_BYTES, "Pasted %s image: DIB %u KB -> PNG %u KB -> text %u KB",
+                 size, a * 3, a / 4, a / 3);
+        break;
+    default: snprintf(out, MESSAGE_BYTES, "Simulated Ctrl+V (re-injection)"); break;
+    }
+}
+
+/* The reference: every entry still in the ring, checked one by one */
+static size_t scan(const Ring *r, const LogQuery *q, LogHits *out)
+{
+    out->count = 0;
+    uint32_t first = r->next > r->cap ? r->next - r->cap : 0;
+    for (uint32_t seq = first; seq < r->next; seq++) {
+        uint64_t t = r->time[seq % r->cap];
+        if ((q->from && t < q->from) || (q->to && t > q->to)) continue;
+        const char *text = r->text[seq % r->cap];
+        int all = 1;
+        for (int i = 0; i < q->termCount && all; i++) {
+            size_t n = strlen(q->terms[i]);
+            all = 0;
+            for (const char *h = text; *h && !all; h++) {
+                size_t k = 0;
+                while (k < n && h[k] && (char)(h[k] >= 'A' && h[k] <= 'Z' ? h[k] + 32 : h[k]) == q->terms[i][k]) k++;
+                all = k == n;
+            }
+        }
+        if (all) {
+            if (out->count == out->cap) {
+                out->cap = out->cap ? out->cap * 2 : 256;
+                out->seqs = (uint32_t *)realloc(out->seqs, out->cap * sizeof(uint32_t));
+            }
+            out->seqs[out->count++] = seq;
+        }
+    }
+    return out->count;
+}
+
+int main(int argc, char **argv)
+{
+    int entries = LOG_BENCH_ENTRIES, runs = LOG_BENCH_RUNS;
+    const char *jsonPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--entries") == 0 && i + 1 < argc) {
+            entries = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else {
+            fprintf(stderr, "usage: log_bench [--entries N] [--runs N] [--json FILE]\n");
+            return 2;
+        }
+    }
+    if (entries < 1000) entries = 1000;
+    if (runs < 1) runs = 1;
+
+    Ring ring = { NULL, NULL, (uint32_t)entries, 0 };
+    ring.text = malloc((size_t)entries * MESSAGE_BYTES);
+    ring.time = malloc((size_t)entries * sizeof(uint64_t));
+    if (!ring.text || !ring.time) {
+        fprintf(stderr, "log_bench: out of memory\n");
+        return 1;
+    }
+
+    /* A quarter more than the ring holds, so eviction runs too */
+    LogIndex ix;
+    log_index_init(&ix);
+    uint32_t total = (uint32_t)entries + (uint32_t)entries / 4;
+    uint64_t start = 1700000000000ull, step = SPAN_MS / total;
+    int ok = 1;
+    uint64_t t0 = now_ns();
+    for (uint32_t seq = 0; seq < total; seq++) {
+        char *text = ring.text[seq % ring.cap];
+        make_message(text, seq);
+        ring.time[seq % ring.cap] = start + seq * step;
+        ring.next = seq + 1;
+        ok &= log_index_add(&ix, seq, start + seq * step, text);
+        if (ring.next > ring.cap) log_index_drop_before(&ix, ring.next - ring.cap);
+    }
+    double addNs = (double)(now_ns() - t0) / total;
+    size_t indexBytes = log_index_memory_bytes(&ix);
+    ok &= log_index_count(&ix) == ring.cap;
+
+    StatHistogram lat[QUERY_COUNT];
+    size_t hits[QUERY_COUNT];
+    int same[QUERY_COUNT];
+    LogHits got = { 0 }, want = { 0 };
+    uint64_t end = start + (uint64_t)(total - 1) * step;
+
+    for (size_t i = 0; i < QUERY_COUNT; i++) {
+        LogQuery q;
+        log_query_parse(&q, g_queries[i].query);
+        if (g_queries[i].morning) {
+            q.from = end - 6ull * 3600 * 1000;
+            q.to = end - 2ull * 3600 * 1000;
+        }
+        stat_reset(&lat[i]);
+        for (int r = 0; r <= runs; r++) {
+            got.count = 0;
+            uint64_t t = now_ns();
+            ok &= log_index_search(&ix, &q, ring_text, &ring, &got);
+            uint64_t us = (now_ns() - t) / 1000;
+            if (r > 0) stat_record(&lat[i], us, got.count);
+        }
+        hits[i] = got.count;
+        same[i] = scan(&ring, &q, &want) == got.count &&
+                  memcmp(want.seqs, got.seqs, got.count * sizeof(uint32_t)) == 0;
+        ok &= same[i] && lat[i].maxMicros < LATENCY_GOAL_US;
+    }
+
+    FILE *human = (jsonPath && strcmp(jsonPath, "-") == 0) ? stderr : stdout;
+    fprintf(human, "Log search benchmark: %d entries over 3 days, %lu logged, %d runs\n\n",
+            entries, (unsigned long)total, runs);
+    fprintf(human, "Indexing: %.2f us per entry, index %lu KB (%.0f bytes per entry)\n\n",
+            addNs / 1000.0, (unsigned long)(indexBytes / 1024), (double)indexBytes / entries);
+    fprintf(human, "%-14s %-30s %8s %9s %9s\n", "", "query", "hits", "p50 us", "max us");
+    for (size_t i = 0; i < QUERY_COUNT; i++) {
+        fprintf(human, "%-14s %-30s %8lu %9llu %9llu%s\n", g_queries[i].name, g_queries[i].query,
+                (unsigned long)hits[i], (unsigned long long)stat_percentile(&lat[i], 50),
+                (unsigned long long)lat[i].maxMicros, same[i] ? "" : "  RESULTS DIFFER");
+    }
+    fprintf(human, "\nGoal: every query under %d ms. %s\n", LATENCY_GOAL_US / 1000, ok ? "Met" : "NOT MET");
+
+    if (jsonPath) {
+        FILE *f = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+        if (!f) {
+            fprintf(stderr, "log_bench: cannot write %s\n", jsonPath);
+            return 1;
+        }
+        fprintf(f, "{\"entries\":%d,\"runs\":%d,\"addNs\":%.0f,\"indexBytes\":%lu,\"queries\":[",
+                entries, runs, addNs, (unsigned long)indexBytes);
+        for (size_t i = 0; i < QUERY_COUNT; i++) {
+            fprintf(f, "%s{\"name\":\"%s\",\"hits\":%lu,\"p50Us\":%llu,\"maxUs\":%llu,\"same\":%s}",
+                    i ? "," : "", g_queries[i].name, (unsigned long)hits[i],
+                    (unsigned long long)stat_percentile(&lat[i], 50),
+                    (unsigned long long)lat[i].maxMicros, same[i] ? "true" : "false");
+        }
+        fprintf(f, "],\"ok\":%s}\n", ok ? "true" : "false");
+        if (f != stdout) fclose(f);
+    }
+
+    log_hits_free(&got);
+    log_hits_free(&want);
+    log_index_free(&ix);
+    free(ring.text);
+    free(ring.time);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,315 @@
+/*
+ * ImagePaster - bench/matcher_bench.c
+ *
+ * Host-native benchmark of the compiled title matcher (matcher.h) against the
+ * per-keyword substring loop it replaced. Rule sets of 10, 100 and 1,000
+ * generated rules (plain, anchored, glob and negated, shaped like host and
+ * application names) are matched against a fixed set of realistic window
+ * titles. Reports compile time, automaton size and nanoseconds per title for
+ * both approaches, and cross-checks their answers on plain-keyword rule sets.
+ *
+ *   matcher_bench [--rules N] [--json FILE]
+ *
+ * Built and run by `make bench` (see Makefile).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "matcher.h"
+
+#define MIN_BENCH_NS 200000000ull   /* time each measurement for at least 0.2 s */
+
+static const char *g_titles[] = {
+    "root@prod-web-042: ~ - Xshell 7 (Free for Home/School)",
+    "deploy@stage-api-07:/var/log/nginx - Xshell 7",
+    "PuTTY (inactive) - admin@db-eu-west-3",
+    "putty-admin-2 - PuTTY",
+    "Windows PowerShell",
+    "Administrator: Command Prompt",
+    "MINGW64:/c/Users/dev/src/ImagePaster",
+    "ssh deploy@10.0.3.17 - Windows Terminal",
+    "Inbox - someone@example.com - Outlook",
+    "Slack | #ops-alerts | ACME Corp",
+    "main.c - ImagePaster - Visual Studio Code",
+    "Документы — Проводник",
+    "Übersicht – Mozilla Firefox",
+    "New Tab - Google Chrome",
+    "Grafana - Kubernetes / Compute Resources / Namespace (Pods) - Google Chrome",
+    "tmux: session 0 - builder@ci-runner-113 - MobaXterm Professional",
+    "Jira | ENG-4711 Paste of large screenshots stalls the terminal when the clipboard "
+        "owner is a remote desktop session - Microsoft Edge",
+    "Untitled - Notepad",
+    "Task Manager",
+    "Remote Desktop Connection - jump-host-eu.corp.example",
+};
+#define TITLE_COUNT (sizeof(g_titles) / sizeof(g_titles[0]))
+
+static const char *g_regions[] = { "eu-west", "us-east", "ap-south", "sa-east" };
+static const char *g_roles[]   = { "web", "api", "db", "cache", "queue", "batch" };
+static const char *g_apps[]    = { "xshell", "putty", "mobaxterm", "securecrt", "kitty",
+                                   "termius", "windows terminal", "mremoteng" };
+
+typedef struct {
+    uint16_t *units;
+    size_t    len;
+} U16Str;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* UTF-8 to UTF-16 for the fixed titles (BMP only) */
+static U16Str to_u16(const char *s)
+{
+    U16Str out;
+    size_t n = strlen(s);
+    out.units = (uint16_t *)malloc((n + 1) * sizeof(uint16_t));
+    out.len = 0;
+    for (const unsigned char *p = (const unsigned char *)s; *p; ) {
+        uint32_t c = *p++;
+        if (c >= 0xE0) { c = ((c & 0x0F) << 12) | ((p[0] & 0x3F) << 6) | (p[1] & 0x3F); p += 2; }
+        else if (c >= 0xC0) { c = ((c & 0x1F) << 6) | (p[0] & 0x3F); p += 1; }
+        out.units[out.len++] = (uint16_t)c;
+    }
+    return out;
+}
+
+/* Builds a TitleMatch string of `count` generated rules. With
+ * plainOnly every rule is a plain keyword, comparable with the old loop. */
+static char *make_rules(int count, int plainOnly)
+{
+    size_t cap = (size_t)count * 48 + 64;
+    char *buf = (char *)malloc(cap);
+    size_t len = 0;
+    buf[0] = '\0';
+
+    for (int i = 0; i < count; i++) {
+        char rule[64];
+        int kind = plainOnly ? 0 : i % 20;
+        const char *region = g_regions[i % 4];
+        const char *role = g_roles[(i / 4) % 6];
+
+        if (i < 8) snprintf(rule, sizeof(rule), "%s", g_apps[i]);
+        else if (kind < 14) snprintf(rule, sizeof(rule), "%s-%s-%d", role, region, i);
+        else if (kind < 16) snprintf(rule, sizeof(rule), "^ssh deploy@10.0.%d.%d", i % 16, i % 251);
+        else if (kind < 18) snprintf(rule, sizeof(rule), "*@stage-%s-%02d:*", role, i % 100);
+        else if (kind < 19) snprintf(rule, sizeof(rule), "!putty-admin-%d", i);
+        else snprintf(rule, sizeof(rule), "%s-%d$", role, i);
+        len += (size_t)snprintf(buf + len, cap - len, "%s%s", len ? ", " : "", rule);
+    }
+    return buf;
+}
+
+/* ── The replaced approach: lowercase ASCII, one substring scan per keyword ── */
+
+typedef struct {
+    U16Str *keywords;
+    int     count;
+} NaiveRules;
+
+static NaiveRules naive_compile(const char *rules)
+{
+    NaiveRules n = { NULL, 0 };
+    char *copy = strdup(rules);
+    int cap = 16;
+    n.keywords = (U16Str *)malloc(sizeof(U16Str) * (size_t)cap);
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+        while (*tok == ' ') tok++;
+        if (!*tok) continue;
+        if (n.count == cap) {
+            cap *= 2;
+            n.keywords = (U16Str *)realloc(n.keywords, sizeof(U16Str) * (size_t)cap);
+        }
+        U16Str k = to_u16(tok);
+        for (size_t i = 0; i < k.len; i++)
+            if (k.units[i] >= 'A' && k.units[i] <= 'Z') k.units[i] += 32;
+        n.keywords[n.count++] = k;
+    }
+    free(copy);
+    return n;
+}
+
+static const uint16_t *u16_strstr(const uint16_t *h, size_t hlen, const uint16_t *n, size_t nlen)
+{
+    if (nlen > hlen) return NULL;
+    for (size_t i = 0; i + nlen <= hlen; i++) {
+        if (h[i] == n[0] && memcmp(h + i, n, nlen * sizeof(uint16_t)) == 0) return h + i;
+    }
+    return NULL;
+}
+
+static int naive_match(const NaiveRules *n, const U16Str *title)
+{
+    uint16_t lower[512];
+    size_t len = title->len < 512 ? title->len : 512;
+    for (size_t i = 0; i < len; i++) {
+        uint16_t c = title->units[i];
+        lower[i] = (c >= 'A' && c <= 'Z') ? (uint16_t)(c + 32) : c;
+    }
+    for (int i = 0; i < n->count; i++) {
+        if (u16_strstr(lower, len, n->keywords[i].units, n->keywords[i].len)) return i;
+    }
+    return -1;
+}
+
+static void naive_free(NaiveRules *n)
+{
+    for (int i = 0; i < n->count; i++) free(n->keywords[i].units);
+    free(n->keywords);
+}
+
+/* ── Measurement ───────────────────────────────────────────────────────── */
+
+typedef struct {
+    int      rules;
+    double   compileUs;
+    size_t   states;
+    size_t   memoryBytes;
+    double   compiledNs;     /* per title */
+    double   naiveNs;        /* per title, same rule count as plain keywords */
+    int      matches;        /* titles matched by the compiled rule set */
+    int      agree;          /* plain-keyword cross-check */
+} MatcherResult;
+
+static volatile int g_sink;
+
+static double time_compiled(const TitleMatcher *m, const U16Str *titles)
+{
+    uint64_t iters = 0, start = now_ns(), elapsed;
+    do {
+        for (size_t t = 0; t < TITLE_COUNT; t++) g_sink += matcher_match(m, titles[t].units, titles[t].len, NULL);
+        iters++;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_BENCH_NS);
+    return (double)elapsed / (double)(iters * TITLE_COUNT);
+}
+
+static double time_naive(const NaiveRules *n, const U16Str *titles)
+{
+    uint64_t iters = 0, start = now_ns(), elapsed;
+    do {
+        for (size_t t = 0; t < TITLE_COUNT; t++) g_sink += naive_match(n, &titles[t]);
+        iters++;
+        elapsed = now_ns() - start;
+    } while (elapsed < MIN_BENCH_NS);
+    return (double)elapsed / (double)(iters * TITLE_COUNT);
+}
+
+static int run(int ruleCount, const U16Str *titles, MatcherResult *r)
+{
+    char *rules = make_rules(ruleCount, 0);
+    char *plain = make_rules(ruleCount, 1);
+
+    memset(r, 0, sizeof(*r));
+    r->rules = ruleCount;
+
+    uint64_t t0 = now_ns();
+    TitleMatcher *m = matcher_compile(rules);
+    r->compileUs = (double)(now_ns() - t0) / 1000.0;
+    TitleMatcher *mp = matcher_compile(plain);
+    NaiveRules naive = naive_compile(plain);
+    if (!m || !mp) {
+        fprintf(stderr, "matcher_bench: compile failed for %d rules\n", ruleCount);
+        return 0;
+    }
+    r->states = matcher_state_count(m);
+    r->memoryBytes = matcher_memory_bytes(m);
+
+    /* Same answer from both approaches on plain keywords (the old loop is
+     * ASCII-only, and every generated keyword is ASCII) */
+    r->agree = 1;
+    for (size_t t = 0; t < TITLE_COUNT; t++) {
+        int a = matcher_match(mp, titles[t].units, titles[t].len, NULL) >= 0;
+        int b = naive_match(&naive, &titles[t]) >= 0;
+        if (a != b) {
+            fprintf(stderr, "matcher_bench: disagreement on \"%s\"\n", g_titles[t]);
+            r->agree = 0;
+        }
+        r->matches += matcher_match(m, titles[t].units, titles[t].len, NULL) >= 0;
+    }
+
+    r->compiledNs = time_compiled(m, titles);
+    r->naiveNs = time_naive(&naive, titles);
+
+    matcher_free(m);
+    matcher_free(mp);
+    naive_free(&naive);
+    free(rules);
+    free(plain);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    int counts[8] = { 10, 100, 1000 };
+    int countN = 3;
+    const char *jsonPath = NULL;
+    U16Str titles[TITLE_COUNT];
+    MatcherResult results[8];
+    size_t totalUnits = 0;
+    int ok = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+            counts[0] = atoi(argv[++i]);
+            countN = 1;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else {
+            fprintf(stderr, "usage: matcher_bench [--rules N] [--json FILE]\n");
+            return 2;
+        }
+    }
+
+    for (size_t t = 0; t < TITLE_COUNT; t++) {
+        titles[t] = to_u16(g_titles[t]);
+        totalUnits += titles[t].len;
+    }
+
+    /* The table goes to stdout unless JSON does */
+    FILE *human = (jsonPath && strcmp(jsonPath, "-") == 0) ? stderr : stdout;
+
+    fprintf(human, "Title matcher benchmark: %u titles, %lu UTF-16 units on average\n\n",
+           (unsigned)TITLE_COUNT, (unsigned long)(totalUnits / TITLE_COUNT));
+    fprintf(human, "%7s %11s %8s %10s %8s %13s %10s %9s\n",
+           "rules", "compile us", "states", "memory KB", "matched", "compiled ns", "naive ns", "speedup");
+    for (int i = 0; i < countN; i++) {
+        MatcherResult *r = &results[i];
+        if (!run(counts[i], titles, r)) return 1;
+        ok &= r->agree;
+        fprintf(human, "%7d %11.1f %8lu %10.1f %5d/%-2u %13.1f %10.1f %8.1fx\n",
+               r->rules, r->compileUs, (unsigned long)r->states, r->memoryBytes / 1024.0,
+               r->matches, (unsigned)TITLE_COUNT, r->compiledNs, r->naiveNs,
+               r->compiledNs > 0 ? r->naiveNs / r->compiledNs : 0.0);
+    }
+    fprintf(human, "\nnaive = ASCII lowercase + one substring scan per keyword (the previous matcher),\n"
+           "run on the same number of plain keywords. Cross-check: %s\n", ok ? "agree" : "DISAGREE");
+
+    if (jsonPath) {
+        FILE *f = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+        if (!f) {
+            fprintf(stderr, "matcher_bench: cannot write %s\n", jsonPath);
+            return 1;
+        }
+        fprintf(f, "{\"titles\":%u,\"results\":[", (unsigned)TITLE_COUNT);
+        for (int i = 0; i < countN; i++) {
+            const MatcherResult *r = &results[i];
+            fprintf(f, "%s{\"rules\":%d,\"compileUs\":%.1f,\"states\":%lu,\"memoryBytes\":%lu,"
+                       "\"matched\":%d,\"compiledNsPerTitle\":%.1f,\"naiveNsPerTitle\":%.1f,"
+                       "\"agree\":%s}",
+                    i ? "," : "", r->rules, r->compileUs, (unsigned long)r->states,
+                    (unsigned long)r->memoryBytes, r->matches, r->compiledNs, r->naiveNs,
+                    r->agree ? "true" : "false");
+        }
+        fprintf(f, "]}\n");
+        if (f != stdout) fclose(f);
+    }
+
+    for (size_t t = 0; t < TITLE_COUNT; t++) free(titles[t].units);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,402 @@
+/*
+ * ImagePaster - bench/route_bench.c
+ *
+ * Host-native benchmark of the content-aware format choice (route.h). For
+ * synthetic screenshots, terminals, charts, photos and a screenshot with a
+ * photo in it, at 720p, 1080p and 4K, it reports the classifier's time and
+ * features, the predicted against the actual size and encode time of every
+ * choice, and what each policy picks. Checks that the classifier stays under
+ * 1 ms, that photos go to JPEG under "photos" while screenshots, terminals
+ * and charts stay PNG, and that a routed pipeline run encodes what the
+ * decision said.
+ *
+ *   route_bench [--runs N] [--quick] [--json FILE]
+ *
+ * Built and run by `make bench` (see Makefile).
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pipeline.h"
+#include "route.h"
+#include "stats.h"
+
+#define ROUTE_BENCH_RUNS    20
+#define CLASSIFY_GOAL_US    1000
+#define PASTE_BYTES_PER_SEC (8u * 1024 * 1024)   /* as main.c assumes for a clipboard paste */
+#define PNG_LEVEL           PIPELINE_DEFAULT_LEVEL
+#define JPEG_QUALITY        85
+
+typedef enum { KIND_UI, KIND_TERMINAL, KIND_CHART, KIND_PHOTO, KIND_NOISY, KIND_SOFT, KIND_MIXED, KIND_COUNT } Kind;
+
+static const struct { const char *name; int photo; } g_kinds[KIND_COUNT] = {
+    { "screenshot", 0 }, { "terminal", 0 }, { "chart", 0 },
+    { "photo", 1 }, { "noisy photo", 1 }, { "soft photo", 1 }, { "mixed", -1 },
+};
+
+static const uint32_t g_sizes[][2] = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+#define SIZE_COUNT (sizeof(g_sizes) / sizeof(g_sizes[0]))
+
+typedef struct {
+    Kind          kind;
+    uint32_t      w, h;
+    RouteFeatures f;
+    StatHistogram classify;
+    size_t        bytes[ROUTE_CHOICE_COUNT];
+    uint64_t      encodeUs[ROUTE_CHOICE_COUNT];
+    RouteDecision predicted;                    /* under "any": every choice */
+    RouteChoice   picked[ROUTE_POLICY_COUNT];
+    int           ok;
+} Case;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t g_rand;
+
+static uint32_t next_rand(void)
+{
+    g_rand ^= g_rand << 13;
+    g_rand ^= g_rand >> 17;
+    g_rand ^= g_rand << 5;
+    return g_rand;
+}
+
+static double gauss(void)
+{
+    double u = (next_rand() + 1.0) / 4294967297.0, v = (next_rand() + 1.0) / 4294967297.0;
+    return sqrt(-2 * log(u)) * cos(6.2831853 * v);
+}
+
+static uint8_t clamp8(double v)
+{
+    return v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+}
+
+static uint8_t *pixel(RgbImage *img, uint32_t x, uint32_t y)
+{
+    return img->pixels + (size_t)y * img->stride + (size_t)x * 3;
+}
+
+/* Smooth landscape-like tones with sensor noise of `noise` levels */
+static void draw_photo(RgbImage *img, uint32_t x0, uint32_t y0, uint32_t w, uint32_t h, double noise)
+{
+    for (uint32_t y = y0; y < y0 + h; y++) {
+        for (uint32_t x = x0; x < x0 + w; x++) {
+            double u = (double)x / img->width, v = (double)y / img->height;
+            double base = 128 + 60 * sin(u * 7 + v * 3) + 30 * sin(u * 23 - v * 17) + 15 * sin(u * 71 + v * 53);
+            double n = gauss() * noise;
+            uint8_t *p = pixel(img, x, y);
+            p[0] = clamp8(base + 40 * sin(v * 5) + n);
+            p[1] = clamp8(base * 0.8 + 20 + n);
+            p[2] = clamp8(base * 0.6 + 50 * cos(u * 4) + n);
+        }
+    }
+}
+
+/* One pixel of glyph `c`: a fixed pseudo-random 9x18 bitmap per character */
+static int glyph_on(unsigned c, uint32_t gx, uint32_t gy)
+{
+    if (gy < 3 || gy >= 15 || gx == 8) return 0;
+    uint32_t h = (c * 0x9E3779B1u) ^ (gy * 0x85EBCA6Bu);
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    return (h >> gx) & 1;
+}
+
+/* Overlapping windows: title bar, border, white client area, lines of text */
+static void draw_ui(RgbImage *img)
+{
+    const uint32_t W = img->width, H = img->height;
+    memset(img->pixels, 0xF3, img->stride * H);
+    for (int win = 0; win < 6; win++) {
+        uint32_t wx = next_rand() % (W / 2), wy = next_rand() % (H / 2);
+        uint32_t ww = W / 4 + next_rand() % (W / 3), wh = H / 4 + next_rand() % (H / 3);
+        uint8_t accent[3] = { (uint8_t)(next_rand() & 0x7F), (uint8_t)(0x60 + (next_rand() & 0x7F)), 0xC0 };
+        for (uint32_t y = wy; y < wy + wh && y < H; y++) {
+            for (uint32_t x = wx; x < wx + ww && x < W; x++) {
+                uint8_t *p = pixel(img, x, y);
+                if (y < wy + 28) memcpy(p, accent, 3);
+                else if (x == wx || x == wx + ww - 1 || y == wy + wh - 1) p[0] = p[1] = p[2] = 0x80;
+                else p[0] = p[1] = p[2] = 0xFF;
+            }
+        }
+        for (uint32_t ty = wy + 40; ty + 18 < wy + wh && ty + 18 < H; ty += 18) {
+            uint32_t end = wx + 8 + next_rand() % (ww > 16 ? ww - 16 : 1);
+            for (uint32_t tx = wx + 8; tx + 9 < end && tx + 9 < W; tx += 9) {
+                unsigned c = next_rand() % 61;
+                if (c < 8) continue;                                    /* a space */
+                for (uint32_t gy = 0; gy < 18; gy++)
+                    for (uint32_t gx = 0; gx < 9; gx++)
+                        if (glyph_on(c, gx, gy)) memset(pixel(img, tx + gx, ty + gy), 0x20, 3);
+            }
+        }
+    }
+}
+
+static void draw_terminal(RgbImage *img)
+{
+    for (uint32_t y = 0; y < img->height; y++) {
+        for (uint32_t x = 0; x < img->width; x++) {
+            uint32_t line = y / 18, col = x / 9;
+            unsigned c = (line * 131 + col * 7) % 61;
+            int on = (line % 5 != 4) && (col % 40 < 32 + line % 7) && c > 8 && glyph_on(c, x % 9, y % 18);
+            uint8_t *p = pixel(img, x, y);
+            if (on) {
+                p[0] = p[1] = p[2] = 0xD0;
+            } else {
+                p[0] = 0x1E; p[1] = 0x1E; p[2] = 0x24;
+            }
+        }
+    }
+}
+
+/* A smooth gradient under grid lines */
+static void draw_chart(RgbImage *img)
+{
+    const uint32_t W = img->width, H = img->height;
+    for (uint32_t y = 0; y < H; y++) {
+        for (uint32_t x = 0; x < W; x++) {
+            uint8_t *p = pixel(img, x, y);
+            p[0] = (uint8_t)(x * 255 / W);
+            p[1] = (uint8_t)(y * 255 / H);
+            p[2] = (uint8_t)(200 - (x + y) * 100 / (W + H));
+            if (x % 97 == 0 || y % 61 == 0) p[0] = p[1] = p[2] = 40;
+        }
+    }
+}
+
+static void draw(RgbImage *img, Kind kind)
+{
+    const uint32_t W = img->width, H = img->height;
+    g_rand = 12345u + (uint32_t)kind;
+    switch (kind) {
+    case KIND_UI:       draw_ui(img); break;
+    case KIND_TERMINAL: draw_terminal(img); break;
+    case KIND_CHART:    draw_chart(img); break;
+    case KIND_PHOTO:    draw_photo(img, 0, 0, W, H, 3); break;
+    case KIND_NOISY:    draw_photo(img, 0, 0, W, H, 12); break;
+    case KIND_SOFT:     draw_photo(img, 0, 0, W, H, 1); break;
+    default:            draw_ui(img); draw_photo(img, W / 4, H / 4, W / 2, H / 2, 3); break;
+    }
+}
+
+/* Actual size and encode time of one choice, through the pipeline */
+static int encode_choice(const RgbImage *img, RouteChoice c, size_t *bytes, uint64_t *micros)
+{
+    PipeOptions opt;
+    PipeResult res;
+    memset(&opt, 0, sizeof(opt));
+    memset(&res, 0, sizeof(res));
+    opt.format = c == ROUTE_JPEG ? PIPE_FORMAT_JPEG : PIPE_FORMAT_PNG;
+    opt.level = c == ROUTE_PNG_FAST ? ROUTE_FAST_LEVEL : PNG_LEVEL;
+    opt.quality = JPEG_QUALITY;
+
+    uint64_t t = now_ns();
+    PipeStatus st = pipeline_encode_rgb(img, &opt, &res);
+    *micros = (now_ns() - t) / 1000;
+    *bytes = res.imageSize;
+    pipeline_result_free(&res);
+    return st == PIPE_OK;
+}
+
+/* A routed run must encode what route_decide picked for the same features */
+static int routed_matches(const RgbImage *img, const Case *cs)
+{
+    PipeOptions opt;
+    PipeResult res;
+    memset(&opt, 0, sizeof(opt));
+    memset(&res, 0, sizeof(res));
+    opt.level = PNG_LEVEL;
+    opt.quality = JPEG_QUALITY;
+    opt.route = ROUTE_PHOTOS;
+    opt.textBytesPerSec = PASTE_BYTES_PER_SEC;
+
+    int ok = pipeline_encode_rgb(img, &opt, &res) == PIPE_OK && res.routed &&
+             res.route.choice == cs->picked[ROUTE_PHOTOS] &&
+             res.format == (cs->picked[ROUTE_PHOTOS] == ROUTE_JPEG ? PIPE_FORMAT_JPEG : PIPE_FORMAT_PNG);
+    pipeline_result_free(&res);
+    return ok;
+}
+
+static double text_per_byte(void)
+{
+    return (double)pipeline_text_length(1u << 20, PIPE_FORMAT_PNG, PIPE_TEXT_BASE64) / (1u << 20);
+}
+
+static int run_case(Case *cs, int runs)
+{
+    RgbImage img = { cs->w, cs->h, (size_t)cs->w * 3, NULL };
+    uint8_t *rowBuf = (uint8_t *)malloc((size_t)cs->w * 6);
+    img.pixels = (uint8_t *)malloc(img.stride * cs->h);
+    if (!img.pixels || !rowBuf) {
+        free(img.pixels);
+        free(rowBuf);
+        return 0;
+    }
+    draw(&img, cs->kind);
+
+    RgbImageRows rows;
+    stat_reset(&cs->classify);
+    for (int r = 0; r < runs; r++) {
+        rgb_image_rows(&rows, &img);
+        uint64_t t = now_ns();
+        route_classify(&rows.base, rowBuf, &cs->f);
+        stat_record(&cs->classify, (now_ns() - t) / 1000, (uint64_t)cs->w * 6);
+    }
+
+    cs->ok = 1;
+    for (int c = 0; c < ROUTE_CHOICE_COUNT; c++)
+        cs->ok &= encode_choice(&img, (RouteChoice)c, &cs->bytes[c], &cs->encodeUs[c]);
+
+    route_decide(NULL, &cs->f, ROUTE_ANY, cs->w, cs->h, PNG_LEVEL, JPEG_QUALITY, text_per_byte(), 0,
+                 PASTE_BYTES_PER_SEC, &cs->predicted);
+    for (int p = 0; p < ROUTE_POLICY_COUNT; p++) {
+        RouteDecision d;
+        route_decide(NULL, &cs->f, (RoutePolicy)p, cs->w, cs->h, PNG_LEVEL, JPEG_QUALITY,
+                     text_per_byte(), 0, PASTE_BYTES_PER_SEC, &d);
+        cs->picked[p] = d.choice;
+    }
+
+    /* Photos to JPEG where allowed; flat content never, and never when lossless */
+    int photo = g_kinds[cs->kind].photo;
+    if (photo == 1) cs->ok &= cs->picked[ROUTE_PHOTOS] == ROUTE_JPEG;
+    if (photo == 0) cs->ok &= cs->picked[ROUTE_PHOTOS] != ROUTE_JPEG;
+    cs->ok &= cs->picked[ROUTE_LOSSLESS] != ROUTE_JPEG;
+    cs->ok &= cs->classify.maxMicros < CLASSIFY_GOAL_US;
+    cs->ok &= routed_matches(&img, cs);
+
+    free(rowBuf);
+    free(img.pixels);
+    return 1;
+}
+
+/* Actual paste time of a choice: encode plus the text at the paste rate */
+static uint64_t actual_total(const Case *cs, int c)
+{
+    double text = cs->bytes[c] * text_per_byte();
+    return cs->encodeUs[c] + (uint64_t)(text * 1e6 / PASTE_BYTES_PER_SEC);
+}
+
+int main(int argc, char **argv)
+{
+    int runs = ROUTE_BENCH_RUNS, quick = 0;
+    const char *jsonPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            quick = 1;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else {
+            fprintf(stderr, "usage: route_bench [--runs N] [--quick] [--json FILE]\n");
+            return 2;
+        }
+    }
+    if (runs < 1) runs = 1;
+
+    size_t sizeFirst = quick ? 1 : 0, sizeEnd = quick ? 2 : SIZE_COUNT;
+    Case cases[SIZE_COUNT * KIND_COUNT];
+    size_t count = 0;
+    int ok = 1;
+    for (size_t s = sizeFirst; s < sizeEnd; s++) {
+        for (int k = 0; k < KIND_COUNT; k++) {
+            Case *cs = &cases[count++];
+            memset(cs, 0, sizeof(*cs));
+            cs->kind = (Kind)k;
+            cs->w = g_sizes[s][0];
+            cs->h = g_sizes[s][1];
+            if (!run_case(cs, runs)) {
+                fprintf(stderr, "route_bench: out of memory\n");
+                return 1;
+            }
+            ok &= cs->ok;
+        }
+    }
+
+    FILE *human = (jsonPath && strcmp(jsonPath, "-") == 0) ? stderr : stdout;
+    fprintf(human, "Format choice benchmark: PNG effort %d, JPEG quality %d, pasting at %u MB/s, "
+            "%d classifier runs\n\n", PNG_LEVEL, JPEG_QUALITY, PASTE_BYTES_PER_SEC / (1024 * 1024), runs);
+    fprintf(human, "%-12s %9s %6s %6s %5s %5s %5s  %-26s %-26s %-26s  %-8s %-8s %-8s\n",
+            "image", "size", "cls us", "colour", "flat", "edge", "bits",
+            "PNG fast KB/ms pred->act", "PNG KB/ms pred->act", "JPEG KB/ms pred->act",
+            "lossless", "photos", "any");
+    for (size_t i = 0; i < count; i++) {
+        const Case *cs = &cases[i];
+        char dims[16];
+        snprintf(dims, sizeof(dims), "%ux%u", cs->w, cs->h);
+        fprintf(human, "%-12s %9s %6llu %6u %5.1f %5.1f %5.2f ", g_kinds[cs->kind].name, dims,
+                (unsigned long long)cs->classify.maxMicros, cs->f.colours, cs->f.flat / 10.0,
+                cs->f.edges / 10.0, cs->f.entropy / 100.0);
+        for (int c = 0; c < ROUTE_CHOICE_COUNT; c++) {
+            char cell[80];
+            snprintf(cell, sizeof(cell), "%llu/%llu->%lu/%llu",
+                     (unsigned long long)(cs->predicted.bytes[c] / 1024),
+                     (unsigned long long)(cs->predicted.encodeMicros[c] / 1000),
+                     (unsigned long)(cs->bytes[c] / 1024), (unsigned long long)(cs->encodeUs[c] / 1000));
+            fprintf(human, " %-26s", cell);
+        }
+        fprintf(human, "  %-8s %-8s %-8s%s\n", route_choice_name(cs->picked[ROUTE_LOSSLESS]),
+                route_choice_name(cs->picked[ROUTE_PHOTOS]), route_choice_name(cs->picked[ROUTE_ANY]),
+                cs->ok ? "" : "  FAILED");
+    }
+
+    /* How much longer the "any" pick pastes than the best choice in hindsight */
+    double worst = 0, sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Case *cs = &cases[i];
+        uint64_t best = actual_total(cs, 0);
+        for (int c = 1; c < ROUTE_CHOICE_COUNT; c++)
+            if (actual_total(cs, c) < best) best = actual_total(cs, c);
+        double over = best ? (double)actual_total(cs, cs->picked[ROUTE_ANY]) / best - 1.0 : 0;
+        sum += over;
+        if (over > worst) worst = over;
+    }
+    fprintf(human, "\n\"any\" pastes %.0f%% slower than the best choice in hindsight on average, "
+            "%.0f%% at worst\n", 100.0 * sum / count, 100.0 * worst);
+    fprintf(human, "Goal: classifier under %d ms, photos to JPEG and the rest PNG under \"photos\". %s\n",
+            CLASSIFY_GOAL_US / 1000, ok ? "Met" : "NOT MET");
+
+    if (jsonPath) {
+        FILE *f = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+        if (!f) {
+            fprintf(stderr, "route_bench: cannot write %s\n", jsonPath);
+            return 1;
+        }
+        fprintf(f, "{\"runs\":%d,\"cases\":[", runs);
+        for (size_t i = 0; i < count; i++) {
+            const Case *cs = &cases[i];
+            fprintf(f, "%s{\"image\":\"%s\",\"width\":%u,\"height\":%u,\"classifyMaxUs\":%llu,"
+                    "\"colours\":%u,\"flat\":%u,\"edges\":%u,\"entropy\":%u,\"photo\":%s,\"choices\":[",
+                    i ? "," : "", g_kinds[cs->kind].name, cs->w, cs->h,
+                    (unsigned long long)cs->classify.maxMicros, cs->f.colours, cs->f.flat, cs->f.edges,
+                    cs->f.entropy, cs->f.photo ? "true" : "false");
+            for (int c = 0; c < ROUTE_CHOICE_COUNT; c++) {
+                fprintf(f, "%s{\"name\":\"%s\",\"predictedBytes\":%llu,\"bytes\":%lu,"
+                        "\"predictedEncodeUs\":%llu,\"encodeUs\":%llu}",
+                        c ? "," : "", route_choice_name((RouteChoice)c),
+                        (unsigned long long)cs->predicted.bytes[c], (unsigned long)cs->bytes[c],
+                        (unsigned long long)cs->predicted.encodeMicros[c],
+                        (unsigned long long)cs->encodeUs[c]);
+            }
+            fprintf(f, "],\"picked\":{");
+            for (int p = 0; p < ROUTE_POLICY_COUNT; p++) {
+                fprintf(f, "%s\"%s\":\"%s\"", p ? "," : "", route_policy_name((RoutePolicy)p),
+                        route_choice_name(cs->picked[p]));
+            }
+            fprintf(f, "},\"ok\":%s}", cs->ok ? "true" : "false");
+        }
+        fprintf(f, "],\"ok\":%s}\n", ok ? "true" : "false");
+        if (f != stdout) fclose(f);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+/*
+ * ImagePaster - bench/thumb_bench.c
+ *
+ * Host-native benchmark of the gallery thumbnailer (thumb.h): the time a
+ * thumbnail adds to a paste, for decoded images from 640x480 to 4K, with the
+ * SSE2 row sums and with the scalar reference. Checks that both produce the
+ * same pixels and that a 4K thumbnail stays within the 1 ms paste budget.
+ *
+ *   thumb_bench [--runs N] [--json FILE]
+ *
+ * Built and run by `make bench` (see Makefile).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "thumb.h"
+#include "stats.h"
+
+#define THUMB_BENCH_RUNS   200
+#define THUMB_BUDGET_US    1000     /* allowed per 4K paste, p99 */
+
+static const struct { uint32_t width, height; } g_sizes[] = {
+    {  640,  480 },
+    { 1920, 1080 },
+    { 2560, 1440 },
+    { 3840, 2160 },
+    { 2160, 3840 },     /* portrait monitor */
+};
+#define SIZE_COUNT (sizeof(g_sizes) / sizeof(g_sizes[0]))
+
+typedef struct {
+    uint32_t      width, height;
+    uint32_t      tw, th;
+    StatHistogram simd;
+    StatHistogram scalar;
+    int           agree;
+} ThumbResult;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Screenshot-like: flat panels, text-like noise bands and a gradient */
+static void synth(RgbImage *img)
+{
+    uint32_t x32 = 0x9E3779B9u;
+    for (uint32_t y = 0; y < img->height; y++) {
+        uint8_t *p = img->pixels + (size_t)y * img->stride;
+        for (uint32_t x = 0; x < img->width; x++, p += 3) {
+            x32 ^= x32 << 13; x32 ^= x32 >> 17; x32 ^= x32 << 5;
+            int text = (y / 18) % 3 == 1 && (x / 9) % 7 != 0;
+            p[0] = text ? (uint8_t)(x32 & 0xFF) : (uint8_t)(x * 255 / img->width);
+            p[1] = text ? (uint8_t)(x32 >> 8) : (uint8_t)(y * 255 / img->height);
+            p[2] = (x / 240 + y / 135) % 2 ? 0xF0 : 0x30;
+        }
+    }
+}
+
+static void time_one(const RgbImage *img, uint8_t *out, ThumbResult *r, StatHistogram *h,
+                     void (*fn)(const RgbImage *, uint8_t *, uint32_t, uint32_t), int runs)
+{
+    fn(img, out, r->tw, r->th);   /* warm-up */
+    for (int i = 0; i < runs; i++) {
+        uint64_t t = now_ns();
+        fn(img, out, r->tw, r->th);
+        stat_record(h, (now_ns() - t) / 1000, (uint64_t)img->width * img->height * 3);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int runs = THUMB_BENCH_RUNS;
+    const char *jsonPath = NULL;
+    ThumbResult results[SIZE_COUNT];
+    int ok = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else {
+            fprintf(stderr, "usage: thumb_bench [--runs N] [--json FILE]\n");
+            return 2;
+        }
+    }
+    if (runs < 1) runs = 1;
+
+    /* The table goes to stdout unless JSON does */
+    FILE *human = (jsonPath && strcmp(jsonPath, "-") == 0) ? stderr : stdout;
+    fprintf(human, "Thumbnail benchmark: %d runs per size, %d-pixel thumbnails, %d rows per band\n\n",
+            runs, THUMB_MAX_SIDE, THUMB_MAX_TAPS);
+    fprintf(human, "%11s %9s %10s %10s %10s %12s %12s %8s\n",
+            "image", "thumb", "p50 us", "p99 us", "max us", "scalar p50", "scalar p99", "same");
+
+    for (size_t s = 0; s < SIZE_COUNT; s++) {
+        ThumbResult *r = &results[s];
+        RgbImage img = { g_sizes[s].width, g_sizes[s].height, (size_t)g_sizes[s].width * 3, NULL };
+        memset(r, 0, sizeof(*r));
+        stat_reset(&r->simd);
+        stat_reset(&r->scalar);
+        r->width = img.width;
+        r->height = img.height;
+        thumb_size(img.width, img.height, &r->tw, &r->th);
+
+        img.pixels = (uint8_t *)malloc(img.stride * img.height);
+        uint8_t *a = (uint8_t *)malloc(THUMB_SLOT_BYTES);
+        uint8_t *b = (uint8_t *)malloc(THUMB_SLOT_BYTES);
+        if (!img.pixels || !a || !b) {
+            fprintf(stderr, "thumb_bench: out of memory\n");
+            return 1;
+        }
+        synth(&img);
+
+        time_one(&img, a, r, &r->simd, thumb_downscale, runs);
+        time_one(&img, b, r, &r->scalar, thumb_downscale_scalar, runs);
+        r->agree = memcmp(a, b, (size_t)r->tw * r->th * 4) == 0;
+        ok &= r->agree;
+
+        char dims[24], tdims[24];
+        snprintf(dims, sizeof(dims), "%ux%u", r->width, r->height);
+        snprintf(tdims, sizeof(tdims), "%ux%u", r->tw, r->th);
+        fprintf(human, "%11s %9s %10llu %10llu %10llu %12llu %12llu %8s\n", dims, tdims,
+                (unsigned long long)stat_percentile(&r->simd, 50),
+                (unsigned long long)stat_percentile(&r->simd, 99),
+                (unsigned long long)r->simd.maxMicros,
+                (unsigned long long)stat_percentile(&r->scalar, 50),
+                (unsigned long long)stat_percentile(&r->scalar, 99),
+                r->agree ? "yes" : "NO");
+
+        free(img.pixels);
+        free(a);
+        free(b);
+    }
+
+    /* The budget applies to the largest images pasted in practice */
+    int withinBudget = 1;
+    for (size_t s = 0; s < SIZE_COUNT; s++) {
+        if ((uint64_t)results[s].width * results[s].height >= 3840ull * 2160
+            && stat_percentile(&results[s].simd, 99) > THUMB_BUDGET_US) withinBudget = 0;
+    }
+    fprintf(human, "\n4K budget of %d us at p99: %s. Cross-check: %s\n", THUMB_BUDGET_US,
+            withinBudget ? "met" : "EXCEEDED", ok ? "agree" : "DISAGREE");
+
+    if (jsonPath) {
+        FILE *f = strcmp(jsonPath, "-") == 0 ? stdout : fopen(jsonPath, "w");
+        if (!f) {
+            fprintf(stderr, "thumb_bench: cannot write %s\n", jsonPath);
+            return 1;
+        }
+        fprintf(f, "{\"runs\":%d,\"maxSide\":%d,\"taps\":%d,\"budgetUs\":%d,\"withinBudget\":%s,"
+                   "\"results\":[",
+                runs, THUMB_MAX_SIDE, THUMB_MAX_TAPS, THUMB_BUDGET_US, withinBudget ? "true" : "false");
+        for (size_t s = 0; s < SIZE_COUNT; s++) {
+            const ThumbResult *r = &results[s];
+            fprintf(f, "%s{\"width\":%u,\"height\":%u,\"thumbWidth\":%u,\"thumbHeight\":%u,"
+                       "\"p50Us\":%llu,\"p99Us\":%llu,\"maxUs\":%llu,"
+                       "\"scalarP50Us\":%llu,\"scalarP99Us\":%llu,\"agree\":%s}",
+                    s ? "," : "", r->width, r->height, r->tw, r->th,
+                    (unsigned long long)stat_percentile(&r->simd, 50),
+                    (unsigned long long)stat_percentile(&r->simd, 99),
+                    (unsigned long long)r->simd.maxMicros,
+                    (unsigned long long)stat_percentile(&r->scalar, 50),
+                    (unsigned long long)stat_percentile(&r->scalar, 99),
+                    r->agree ? "true" : "false");
+        }
+        fprintf(f, "]}\n");
+        if (f != stdout) fclose(f);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+/*
+ * ImagePaster - bytebuf.h
+ *
+ * Growable byte buffer shared by the portable encoder modules. Allocation
+ * failure is sticky: once `failed` is set every append is a no-op, so callers
+ * can check once at the end of a sequence of writes. A non-zero `limit`
+ * caps the allocation: growing past it fails the same way. A buffer with
+ * `arena` set is a paste temporary and is allocated with arena_realloc.
+ */
+
+#ifndef BYTEBUF_H
+#define BYTEBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+typedef struct {
+    uint8_t *data;
+    size_t   len;
+    size_t   cap;
+    size_t   limit;     /* most bytes to allocate, 0 = no limit */
+    int      arena;     /* allocate from the paste arena (arena.h) */
+    int      failed;
+} ByteBuf;
+
+static inline int bb_reserve(ByteBuf *b, size_t extra)
+{
+    if (b->failed) return 0;
+    if (b->len + extra <= b->cap) return 1;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + extra) {
+        if (cap > ((size_t)-1) / 2) { b->failed = 1; return 0; }
+        cap *= 2;
+    }
+    if (b->limit && cap > b->limit) {
+        if (b->len + extra > b->limit) { b->failed = 1; return 0; }
+        cap = b->limit;
+    }
+    uint8_t *p = (uint8_t *)(b->arena ? arena_realloc(b->data, cap) : realloc(b->data, cap));
+    if (!p) { b->failed = 1; return 0; }
+    b->data = p;
+    b->cap = cap;
+    return 1;
+}
+
+static inline void bb_append(ByteBuf *b, const void *src, size_t n)
+{
+    if (!bb_reserve(b, n)) return;
+    memcpy(b->data + b->len, src, n);
+    b->len += n;
+}
+
+static inline void bb_put_u8(ByteBuf *b, uint8_t v)
+{
+    if (!bb_reserve(b, 1)) return;
+    b->data[b->len++] = v;
+}
+
+static inline void bb_put_be32(ByteBuf *b, uint32_t v)
+{
+    uint8_t tmp[4] = { (uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v };
+    bb_append(b, tmp, 4);
+}
+
+static inline void bb_free(ByteBuf *b)
+{
+    if (b->arena) arena_free(b->data);
+    else free(b->data);
+    b->data = NULL;
+    b->len = b->cap = 0;
+    b->limit = 0;
+    b->arena = 0;
+    b->failed = 0;
+}
+
+#endif // BYTEBUF_H
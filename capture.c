@@ -0,0 +1,158 @@
+/*
+ * ImagePaster - capture.c
+ *
+ * Capture record serialisation (see capture.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+#include "bytebuf.h"
+#include "deflate.h"
+
+static void put_le16(ByteBuf *b, uint16_t v)
+{
+    uint8_t t[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+    bb_append(b, t, 2);
+}
+
+static void put_le32(ByteBuf *b, uint32_t v)
+{
+    uint8_t t[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    bb_append(b, t, 4);
+}
+
+static void put_le64(ByteBuf *b, uint64_t v)
+{
+    put_le32(b, (uint32_t)v);
+    put_le32(b, (uint32_t)(v >> 32));
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    return get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+}
+
+long capture_write(FILE *f, const CaptureRecord *rec, int level)
+{
+    ByteBuf b = {0};
+    ByteBuf stored = {0};
+    uint16_t flags = rec->flags & ~CAPTURE_FLAG_DEFLATED;
+    const uint8_t *dibData = rec->dib;
+    size_t dibStored = rec->dibSize;
+
+    if (level >= 0) {
+        DeflateStream *z = deflate_create(level, &stored);
+        if (!z) return -1;
+        int ok = deflate_write(z, rec->dib, rec->dibSize) && deflate_finish(z);
+        deflate_destroy(z);
+        if (!ok) { bb_free(&stored); return -1; }
+        flags |= CAPTURE_FLAG_DEFLATED;
+        dibData = stored.data;
+        dibStored = stored.len;
+    }
+
+    size_t titleLen = strlen(rec->title);
+    if (titleLen > CAPTURE_MAX_TITLE - 1) titleLen = CAPTURE_MAX_TITLE - 1;
+    uint32_t stageCount = rec->stageCount > CAPTURE_MAX_STAGES ? CAPTURE_MAX_STAGES : rec->stageCount;
+
+    put_le32(&b, CAPTURE_MAGIC);
+    put_le16(&b, CAPTURE_VERSION);
+    put_le16(&b, flags);
+    put_le32(&b, 0);                       /* bodyLen, patched below */
+    size_t bodyStart = b.len;
+
+    put_le64(&b, rec->timestampMs);
+    put_le16(&b, (uint16_t)titleLen);
+    bb_append(&b, rec->title, titleLen);
+    bb_put_u8(&b, (uint8_t)stageCount);
+    for (uint32_t i = 0; i < stageCount; i++) {
+        size_t n = strnlen(rec->stageNames[i], sizeof(rec->stageNames[i]));
+        bb_put_u8(&b, (uint8_t)n);
+        bb_append(&b, rec->stageNames[i], n);
+        put_le64(&b, rec->stageMicros[i]);
+    }
+    put_le64(&b, rec->pngSize);
+    put_le64(&b, rec->base64Len);
+    put_le32(&b, (uint32_t)rec->dibSize);
+    put_le32(&b, (uint32_t)dibStored);
+    bb_append(&b, dibData, dibStored);
+    bb_free(&stored);
+
+    long written = -1;
+    if (!b.failed && b.len - bodyStart <= CAPTURE_MAX_BODY) {
+        uint32_t bodyLen = (uint32_t)(b.len - bodyStart);
+        b.data[8]  = (uint8_t)bodyLen;
+        b.data[9]  = (uint8_t)(bodyLen >> 8);
+        b.data[10] = (uint8_t)(bodyLen >> 16);
+        b.data[11] = (uint8_t)(bodyLen >> 24);
+        put_le32(&b, crc32_update(0, b.data, b.len));
+        if (!b.failed && fwrite(b.data, 1, b.len, f) == b.len && fflush(f) == 0)
+            written = (long)b.len;
+    }
+    bb_free(&b);
+    return written;
+}
+
+int capture_read(FILE *f, CaptureRecord *rec)
+{
+    uint8_t hdr[12];
+    memset(rec, 0, sizeof(*rec));
+
+    size_t got = fread(hdr, 1, sizeof(hdr), f);
+    if (got == 0) return 0;
+    if (got != sizeof(hdr) || get_le32(hdr) != CAPTURE_MAGIC) return -1;
+    if ((hdr[4] | hdr[5] << 8) != CAPTURE_VERSION) return -1;
+    uint32_t bodyLen = get_le32(hdr + 8);
+    if (bodyLen > CAPTURE_MAX_BODY) return -1;
+
+    uint8_t *body = (uint8_t *)malloc((size_t)bodyLen + 4);
+    if (!body) return -1;
+    if (fread(body, 1, (size_t)bodyLen + 4, f) != (size_t)bodyLen + 4) { free(body); return -1; }
+    uint32_t crc = crc32_update(crc32_update(0, hdr, sizeof(hdr)), body, bodyLen);
+    if (crc != get_le32(body + bodyLen)) { free(body); return -1; }
+
+    /* Fields are bounds-checked against bodyLen as they are consumed */
+    const uint8_t *p = body, *end = body + bodyLen;
+#define NEED(n) do { if ((size_t)(end - p) < (size_t)(n)) goto corrupt; } while (0)
+    rec->flags = (uint16_t)(hdr[6] | hdr[7] << 8);
+    NEED(10);
+    rec->timestampMs = get_le64(p); p += 8;
+    size_t titleLen = (size_t)(p[0] | p[1] << 8); p += 2;
+    NEED(titleLen);
+    if (titleLen > CAPTURE_MAX_TITLE - 1) goto corrupt;
+    memcpy(rec->title, p, titleLen); p += titleLen;
+    NEED(1);
+    rec->stageCount = *p++;
+    if (rec->stageCount > CAPTURE_MAX_STAGES) goto corrupt;
+    for (uint32_t i = 0; i < rec->stageCount; i++) {
+        NEED(1);
+        size_t n = *p++;
+        NEED(n + 8);
+        if (n > sizeof(rec->stageNames[i]) - 1) goto corrupt;
+        memcpy(rec->stageNames[i], p, n); p += n;
+        rec->stageMicros[i] = get_le64(p); p += 8;
+    }
+    NEED(24);
+    rec->pngSize   = get_le64(p); p += 8;
+    rec->base64Len = get_le64(p); p += 8;
+    rec->dibSize    = get_le32(p); p += 4;
+    rec->storedSize = get_le32(p); p += 4;
+    NEED(rec->storedSize);
+#undef NEED
+
+    rec->dib = (uint8_t *)malloc(rec->storedSize ? rec->storedSize : 1);
+    if (!rec->dib) goto corrupt;
+    memcpy(rec->dib, p, rec->storedSize);
+    free(body);
+    return 1;
+
+corrupt:
+    free(body);
+    return -1;
+}
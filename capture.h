@@ -0,0 +1,61 @@
+/*
+ * ImagePaster - capture.h
+ *
+ * Paste capture records: the raw clipboard DIB (BITMAPINFOHEADER included),
+ * the matched window title, the output sizes and the per-stage timings of one
+ * paste. Records are appended to a capture file and replayed offline by
+ * tools/replay.c.
+ *
+ * Record layout, all integers little-endian:
+ *
+ *   u32 magic 'IPCR'   u16 version   u16 flags   u32 bodyLen
+ *   body: u64 timestampMs (Unix epoch)
+ *         u16 titleLen, title (UTF-8)
+ *         u8 stageCount, then per stage: u8 nameLen, name, u64 micros
+ *         u64 pngSize, u64 base64Len
+ *         u32 dibSize, u32 storedSize, stored DIB bytes
+ *   u32 CRC-32 of everything above
+ *
+ * With CAPTURE_FLAG_DEFLATED the stored DIB is a zlib stream.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define CAPTURE_MAGIC          0x52435049u   /* "IPCR" */
+#define CAPTURE_VERSION        1
+#define CAPTURE_FLAG_DEFLATED  0x0001
+#define CAPTURE_FLAG_FAILED    0x0002        /* the live conversion failed */
+#define CAPTURE_MAX_STAGES     16
+#define CAPTURE_MAX_TITLE      1024
+#define CAPTURE_MAX_BODY       (256u << 20)
+#define CAPTURE_DEFAULT_LEVEL  1
+
+typedef struct {
+    uint64_t timestampMs;
+    uint16_t flags;
+    char     title[CAPTURE_MAX_TITLE];
+    uint32_t stageCount;
+    char     stageNames[CAPTURE_MAX_STAGES][32];
+    uint64_t stageMicros[CAPTURE_MAX_STAGES];
+    uint64_t pngSize;
+    uint64_t base64Len;
+    uint8_t *dib;           /* raw DIB when writing; stored bytes after capture_read */
+    size_t   dibSize;       /* raw DIB size */
+    size_t   storedSize;    /* set by capture_read */
+} CaptureRecord;
+
+/* Appends one record, deflating the DIB at `level` (< 0 stores it raw).
+ * Returns the number of bytes written or -1. */
+long capture_write(FILE *f, const CaptureRecord *rec, int level);
+
+/* Reads the next record. On success rec->dib is a malloc'd copy of the stored
+ * bytes (the caller inflates it if CAPTURE_FLAG_DEFLATED is set and frees it).
+ * Returns 1 on success, 0 at end of file, -1 on a corrupt record. */
+int  capture_read(FILE *f, CaptureRecord *rec);
+
+#endif // CAPTURE_H
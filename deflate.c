@@ -0,0 +1,861 @@
+/*
+ * ImagePaster - deflate.c
+ *
+ * zlib-format compressor (see deflate.h). The structure follows the classic
+ * zlib design: a 64 KB window that slides by 32 KB, hash chains over 3-byte
+ * prefixes, greedy matching at levels 1-3 and lazy matching above, and
+ * blocks of up to 16K symbols. Each block is emitted as whichever of stored,
+ * fixed or dynamic Huffman coding is smallest.
+ *
+ * Blocks never span a window slide, so the raw bytes needed for a stored
+ * block are always still in the window when the block is written.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "deflate.h"
+#include "arena.h"
+
+#define WSIZE         32768
+#define WMASK         (WSIZE - 1)
+#define HASH_BITS     15
+#define HASH_SIZE     (1 << HASH_BITS)
+#define MIN_MATCH     3
+#define MAX_MATCH     258
+#define LOOKAHEAD     (MAX_MATCH + MIN_MATCH + 1)
+#define MAX_DIST      (WSIZE - LOOKAHEAD)
+#define SYM_BUF_SIZE  16384
+#define WIN_PAD       8       /* slack after the window for match_length's wide reads */
+#define NIL           0       /* offset 0 is never a match candidate, as in zlib */
+
+#define LITLEN_CODES  286
+#define DIST_CODES    30
+#define CODELEN_CODES 19
+#define MAX_BITS      15
+#define MAX_CL_BITS   7
+#define END_BLOCK     256
+
+typedef struct {
+    int chain;      /* max hash-chain links followed */
+    int lazy;       /* 0 = greedy; else don't look further once a match reaches this */
+    int nice;       /* stop searching once a match this long is found */
+    int good;       /* quarter the chain once the previous match reaches this */
+    int maxInsert;  /* greedy levels: only index substrings of matches up to this */
+} LevelCfg;
+
+static const LevelCfg g_levels[DEFLATE_MAX_LEVEL + 1] = {
+    {    0,   0,   0,  0, 0 },  /* 0: stored */
+    {    4,   0,   8,  4, 4 },
+    {    8,   0,  16,  4, 5 },
+    {   32,   0,  32,  4, 6 },
+    {   16,   4,  16,  4, 0 },
+    {   32,  16,  32,  8, 0 },
+    {  128,  16, 128,  8, 0 },
+    {  256,  32, 128,  8, 0 },
+    { 1024, 128, 258, 32, 0 },
+    { 4096, 258, 258, 32, 0 },
+};
+
+static const uint8_t g_clOrder[CODELEN_CODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+struct DeflateStream {
+    ByteBuf  *out;
+    LevelCfg  cfg;
+    int       level;
+
+    uint8_t  *window;       /* 2 * WSIZE + WIN_PAD */
+    uint16_t *head;         /* HASH_SIZE chain heads (window offsets) */
+    uint16_t *prev;         /* WSIZE chain links, indexed by offset & WMASK */
+    size_t    winLen;       /* valid bytes in window */
+    size_t    pos;          /* next offset to process */
+    size_t    blockStart;   /* first window offset covered by the open block */
+    size_t    symEnd;       /* window offset just past the last emitted symbol */
+
+    int       prevLen;      /* lazy matching state */
+    unsigned  prevDist;
+    int       matchAvailable;
+
+    uint16_t *symLit;       /* literal byte, or match length */
+    uint16_t *symDist;      /* 0 for literals */
+    size_t    nsym;
+
+    uint64_t  bitBuf;
+    int       bitCount;
+
+    uint32_t  adler;        /* of the input before the open segment */
+    uint32_t  segAdler;     /* of the input since the last segment flush */
+    uint64_t  segIn;
+    uint64_t  totalIn;
+    int       finished;
+
+    int     (*poll)(void *ctx);
+    void     *pollCtx;
+    size_t    sincePoll;    /* input bytes processed since the last poll */
+    int       stopped;      /* poll returned 0 */
+};
+
+/* ── Adler-32 ──────────────────────────────────────────────────────────── */
+
+uint32_t adler32_update(uint32_t adler, const uint8_t *p, size_t len)
+{
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (len > 0) {
+        size_t n = len < 5552 ? len : 5552;   /* largest n with no 32-bit overflow */
+        len -= n;
+        while (n--) {
+            a += *p++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+/* Adler-32 of A followed by B, from adler(A), adler(B) and len(B) (zlib's
+ * adler32_combine). */
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t len2)
+{
+    const uint32_t base = 65521;
+    uint32_t rem = (uint32_t)(len2 % base);
+    uint64_t sum1 = adler1 & 0xFFFF;
+    uint64_t sum2 = (uint64_t)rem * sum1 % base;
+    sum1 += (adler2 & 0xFFFF) + base - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + base - rem;
+    if (sum1 >= base) sum1 -= base;
+    if (sum1 >= base) sum1 -= base;
+    if (sum2 >= 2 * (uint64_t)base) sum2 -= 2 * (uint64_t)base;
+    if (sum2 >= base) sum2 -= base;
+    return (uint32_t)(sum1 | (sum2 << 16));
+}
+
+/* ── CRC-32 (PNG chunks, capture records) ──────────────────────────────── */
+
+static uint32_t g_crcTable[8][256];
+static int      g_crcReady = 0;
+
+static void crc32_init(void)
+{
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        g_crcTable[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t c = g_crcTable[t - 1][n];
+            g_crcTable[t][n] = g_crcTable[0][c & 0xFF] ^ (c >> 8);
+        }
+    }
+    g_crcReady = 1;
+}
+
+/* Slicing-by-8; the table is built on first use (idempotent, so a benign race). */
+uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t len)
+{
+    if (!g_crcReady) crc32_init();
+    crc = ~crc;
+    while (len >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                             (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 |
+                      (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+        crc = g_crcTable[7][lo & 0xFF] ^ g_crcTable[6][(lo >> 8) & 0xFF] ^
+              g_crcTable[5][(lo >> 16) & 0xFF] ^ g_crcTable[4][lo >> 24] ^
+              g_crcTable[3][hi & 0xFF] ^ g_crcTable[2][(hi >> 8) & 0xFF] ^
+              g_crcTable[1][(hi >> 16) & 0xFF] ^ g_crcTable[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) crc = g_crcTable[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+/* ── Bit output ────────────────────────────────────────────────────────── */
+
+static void put_bits(DeflateStream *s, uint32_t value, int nbits)
+{
+    s->bitBuf |= (uint64_t)value << s->bitCount;
+    s->bitCount += nbits;
+    if (s->bitCount >= 32) {
+        uint8_t tmp[4] = {
+            (uint8_t)s->bitBuf, (uint8_t)(s->bitBuf >> 8),
+            (uint8_t)(s->bitBuf >> 16), (uint8_t)(s->bitBuf >> 24)
+        };
+        bb_append(s->out, tmp, 4);
+        s->bitBuf >>= 32;
+        s->bitCount -= 32;
+    }
+}
+
+static void align_byte(DeflateStream *s)
+{
+    while (s->bitCount > 0) {
+        bb_put_u8(s->out, (uint8_t)s->bitBuf);
+        s->bitBuf >>= 8;
+        s->bitCount = s->bitCount > 8 ? s->bitCount - 8 : 0;
+    }
+    s->bitBuf = 0;
+}
+
+/* ── Length / distance codes ───────────────────────────────────────────── */
+
+static int floor_log2(unsigned v)
+{
+    return 31 - __builtin_clz(v);
+}
+
+/* Maps a match length (3..258) to its code (257..285) and extra bits. */
+static int length_code(int len, int *extraBits, int *extraVal)
+{
+    unsigned l = (unsigned)(len - MIN_MATCH);
+    if (len == MAX_MATCH) { *extraBits = 0; *extraVal = 0; return 285; }
+    if (l < 8) { *extraBits = 0; *extraVal = 0; return 257 + (int)l; }
+    int k = floor_log2(l);
+    unsigned sel = (l >> (k - 2)) & 3;
+    *extraBits = k - 2;
+    *extraVal = (int)(l - ((4 + sel) << (k - 2)));
+    return 257 + 4 * (k - 1) + (int)sel;
+}
+
+static int dist_code(unsigned dist, int *extraBits, int *extraVal)
+{
+    unsigned d = dist - 1;
+    if (d < 4) { *extraBits = 0; *extraVal = 0; return (int)d; }
+    int k = floor_log2(d);
+    unsigned sel = (d >> (k - 1)) & 1;
+    *extraBits = k - 1;
+    *extraVal = (int)(d - ((2 + sel) << (k - 1)));
+    return 2 * k + (int)sel;
+}
+
+static int length_code_extra(int code)
+{
+    if (code < 265 || code == 285) return 0;
+    return (code - 261) / 4;
+}
+
+static int dist_code_extra(int code)
+{
+    return code < 4 ? 0 : code / 2 - 1;
+}
+
+/* ── Huffman code construction ─────────────────────────────────────────── */
+
+typedef struct { uint32_t freq; int sym; } HuffLeaf;
+
+static int cmp_leaf(const void *a, const void *b)
+{
+    const HuffLeaf *x = (const HuffLeaf *)a, *y = (const HuffLeaf *)b;
+    if (x->freq != y->freq) return x->freq < y->freq ? -1 : 1;
+    return x->sym - y->sym;
+}
+
+/*
+ * Builds code lengths limited to maxBits. Overlong trees are rebuilt from
+ * halved frequencies until they fit, which converges quickly and costs
+ * little compression in practice. Always yields at least two codes so the
+ * resulting prefix code is complete.
+ */
+static void build_lengths(const uint32_t *freq, int n, int maxBits, uint8_t *lens)
+{
+    HuffLeaf leaves[LITLEN_CODES];
+    uint32_t weight[2 * LITLEN_CODES];
+    int      parent[2 * LITLEN_CODES];
+    int      depth[2 * LITLEN_CODES];
+    int count = 0;
+
+    memset(lens, 0, (size_t)n);
+    for (int i = 0; i < n; i++) {
+        if (freq[i]) { leaves[count].freq = freq[i]; leaves[count].sym = i; count++; }
+    }
+    if (count < 2) {
+        int used = count ? leaves[0].sym : 0;
+        lens[used] = 1;
+        lens[used == 0 ? 1 : 0] = 1;
+        return;
+    }
+
+    for (;;) {
+        qsort(leaves, (size_t)count, sizeof(HuffLeaf), cmp_leaf);
+        for (int i = 0; i < count; i++) weight[i] = leaves[i].freq;
+
+        /* Two-queue construction: leaves in order, internal nodes in order */
+        int li = 0, ni = count, next = count;
+        for (; next < 2 * count - 1; next++) {
+            int pick[2];
+            for (int t = 0; t < 2; t++) {
+                if (li < count && (ni >= next || weight[li] <= weight[ni])) pick[t] = li++;
+                else pick[t] = ni++;
+            }
+            weight[next] = weight[pick[0]] + weight[pick[1]];
+            parent[pick[0]] = parent[pick[1]] = next;
+        }
+
+        int root = 2 * count - 2, maxDepth = 0;
+        depth[root] = 0;
+        for (int i = root - 1; i >= 0; i--) {
+            depth[i] = depth[parent[i]] + 1;
+            if (i < count && depth[i] > maxDepth) maxDepth = depth[i];
+        }
+
+        if (maxDepth <= maxBits) {
+            for (int i = 0; i < count; i++) lens[leaves[i].sym] = (uint8_t)depth[i];
+            return;
+        }
+        for (int i = 0; i < count; i++) leaves[i].freq = (leaves[i].freq + 1) / 2;
+    }
+}
+
+/* Canonical codes, bit-reversed for LSB-first output. */
+static void build_codes(const uint8_t *lens, int n, uint16_t *codes)
+{
+    uint16_t blCount[MAX_BITS + 1] = {0};
+    uint16_t nextCode[MAX_BITS + 1];
+    for (int i = 0; i < n; i++) blCount[lens[i]]++;
+    blCount[0] = 0;
+
+    uint16_t code = 0;
+    for (int bits = 1; bits <= MAX_BITS; bits++) {
+        code = (uint16_t)((code + blCount[bits - 1]) << 1);
+        nextCode[bits] = code;
+    }
+    for (int i = 0; i < n; i++) {
+        int len = lens[i];
+        if (!len) { codes[i] = 0; continue; }
+        uint16_t c = nextCode[len]++, r = 0;
+        for (int b = 0; b < len; b++) { r = (uint16_t)((r << 1) | (c & 1)); c >>= 1; }
+        codes[i] = r;
+    }
+}
+
+/* ── Block emission ────────────────────────────────────────────────────── */
+
+typedef struct {
+    uint8_t  sym[LITLEN_CODES + DIST_CODES];
+    uint8_t  extra[LITLEN_CODES + DIST_CODES];
+    int      count;
+} CodeLenRle;
+
+static void rle_code_lengths(const uint8_t *lens, int n, CodeLenRle *rle)
+{
+    rle->count = 0;
+    for (int i = 0; i < n; ) {
+        uint8_t cur = lens[i];
+        int run = 1;
+        while (i + run < n && lens[i + run] == cur) run++;
+        int left = run;
+        if (cur == 0) {
+            while (left >= 11) {
+                int r = left > 138 ? 138 : left;
+                rle->sym[rle->count] = 18; rle->extra[rle->count++] = (uint8_t)(r - 11);
+                left -= r;
+            }
+            if (left >= 3) {
+                rle->sym[rle->count] = 17; rle->extra[rle->count++] = (uint8_t)(left - 3);
+                left = 0;
+            }
+        } else {
+            rle->sym[rle->count] = cur; rle->extra[rle->count++] = 0;
+            left--;
+            while (left >= 3) {
+                int r = left > 6 ? 6 : left;
+                rle->sym[rle->count] = 16; rle->extra[rle->count++] = (uint8_t)(r - 3);
+                left -= r;
+            }
+        }
+        while (left-- > 0) { rle->sym[rle->count] = cur; rle->extra[rle->count++] = 0; }
+        i += run;
+    }
+}
+
+static const int g_clExtraBits[CODELEN_CODES] = {
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 2, 3, 7
+};
+
+static void write_symbols(DeflateStream *s, const uint8_t *litLens, const uint16_t *litCodes,
+                          const uint8_t *distLens, const uint16_t *distCodes)
+{
+    for (size_t i = 0; i < s->nsym; i++) {
+        unsigned dist = s->symDist[i];
+        if (dist == 0) {
+            unsigned lit = s->symLit[i];
+            put_bits(s, litCodes[lit], litLens[lit]);
+        } else {
+            int eb, ev;
+            int lc = length_code(s->symLit[i], &eb, &ev);
+            put_bits(s, litCodes[lc], litLens[lc]);
+            if (eb) put_bits(s, (uint32_t)ev, eb);
+            int dc = dist_code(dist, &eb, &ev);
+            put_bits(s, distCodes[dc], distLens[dc]);
+            if (eb) put_bits(s, (uint32_t)ev, eb);
+        }
+    }
+    put_bits(s, litCodes[END_BLOCK], litLens[END_BLOCK]);
+}
+
+static void write_stored(DeflateStream *s, const uint8_t *raw, size_t len, int final)
+{
+    do {
+        size_t n = len > 65535 ? 65535 : len;
+        int last = final && n == len;
+        put_bits(s, (uint32_t)last, 1);
+        put_bits(s, 0, 2);
+        align_byte(s);
+        uint8_t hdr[4] = {
+            (uint8_t)n, (uint8_t)(n >> 8), (uint8_t)~n, (uint8_t)(~n >> 8)
+        };
+        bb_append(s->out, hdr, 4);
+        bb_append(s->out, raw, n);
+        raw += n;
+        len -= n;
+    } while (len > 0);
+}
+
+static void emit_block(DeflateStream *s, int final)
+{
+    uint32_t litFreq[LITLEN_CODES] = {0}, distFreq[DIST_CODES] = {0};
+    size_t rawLen = s->symEnd - s->blockStart;
+    const uint8_t *raw = s->window + s->blockStart;
+
+    for (size_t i = 0; i < s->nsym; i++) {
+        if (s->symDist[i] == 0) {
+            litFreq[s->symLit[i]]++;
+        } else {
+            int eb, ev;
+            litFreq[length_code(s->symLit[i], &eb, &ev)]++;
+            distFreq[dist_code(s->symDist[i], &eb, &ev)]++;
+        }
+    }
+    litFreq[END_BLOCK] = 1;
+
+    /* Stored cost: header + alignment + LEN/NLEN per 64 KB chunk */
+    uint64_t storedBits = (uint64_t)rawLen * 8 + ((rawLen / 65535) + 1) * (3 + 7 + 32);
+
+    if (s->level == 0) {
+        write_stored(s, raw, rawLen, final);
+        goto done;
+    }
+
+    /* Extra bits are the same for fixed and dynamic coding */
+    uint64_t extraBits = 0;
+    for (int c = 257; c < LITLEN_CODES; c++) extraBits += (uint64_t)litFreq[c] * length_code_extra(c);
+    for (int c = 0; c < DIST_CODES; c++) extraBits += (uint64_t)distFreq[c] * dist_code_extra(c);
+
+    /* Fixed Huffman cost */
+    uint8_t fixedLit[288], fixedDist[DIST_CODES];
+    for (int i = 0; i < 288; i++) fixedLit[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    for (int i = 0; i < DIST_CODES; i++) fixedDist[i] = 5;
+    uint64_t fixedBits = 3 + extraBits;
+    for (int c = 0; c < LITLEN_CODES; c++) fixedBits += (uint64_t)litFreq[c] * fixedLit[c];
+    for (int c = 0; c < DIST_CODES; c++) fixedBits += (uint64_t)distFreq[c] * fixedDist[c];
+
+    /* Dynamic Huffman cost */
+    uint8_t litLens[LITLEN_CODES], distLens[DIST_CODES], clLens[CODELEN_CODES];
+    build_lengths(litFreq, LITLEN_CODES, MAX_BITS, litLens);
+    build_lengths(distFreq, DIST_CODES, MAX_BITS, distLens);
+
+    int hlit = LITLEN_CODES, hdist = DIST_CODES;
+    while (hlit > 257 && litLens[hlit - 1] == 0) hlit--;
+    while (hdist > 1 && distLens[hdist - 1] == 0) hdist--;
+
+    uint8_t allLens[LITLEN_CODES + DIST_CODES];
+    memcpy(allLens, litLens, (size_t)hlit);
+    memcpy(allLens + hlit, distLens, (size_t)hdist);
+    CodeLenRle rle;
+    rle_code_lengths(allLens, hlit + hdist, &rle);
+
+    uint32_t clFreq[CODELEN_CODES] = {0};
+    for (int i = 0; i < rle.count; i++) clFreq[rle.sym[i]]++;
+    build_lengths(clFreq, CODELEN_CODES, MAX_CL_BITS, clLens);
+    int hclen = CODELEN_CODES;
+    while (hclen > 4 && clLens[g_clOrder[hclen - 1]] == 0) hclen--;
+
+    uint64_t dynBits = 3 + 5 + 5 + 4 + 3 * (uint64_t)hclen + extraBits;
+    for (int i = 0; i < CODELEN_CODES; i++)
+        dynBits += (uint64_t)clFreq[i] * (clLens[i] + g_clExtraBits[i]);
+    for (int c = 0; c < LITLEN_CODES; c++) dynBits += (uint64_t)litFreq[c] * litLens[c];
+    for (int c = 0; c < DIST_CODES; c++) dynBits += (uint64_t)distFreq[c] * distLens[c];
+
+    if (storedBits <= fixedBits && storedBits <= dynBits) {
+        write_stored(s, raw, rawLen, final);
+    } else if (fixedBits <= dynBits) {
+        uint16_t litCodes[288], distCodes[DIST_CODES];
+        build_codes(fixedLit, 288, litCodes);
+        build_codes(fixedDist, DIST_CODES, distCodes);
+        put_bits(s, (uint32_t)final, 1);
+        put_bits(s, 1, 2);
+        write_symbols(s, fixedLit, litCodes, fixedDist, distCodes);
+    } else {
+        uint16_t litCodes[LITLEN_CODES], distCodes[DIST_CODES], clCodes[CODELEN_CODES];
+        build_codes(litLens, LITLEN_CODES, litCodes);
+        build_codes(distLens, DIST_CODES, distCodes);
+        build_codes(clLens, CODELEN_CODES, clCodes);
+
+        put_bits(s, (uint32_t)final, 1);
+        put_bits(s, 2, 2);
+        put_bits(s, (uint32_t)(hlit - 257), 5);
+        put_bits(s, (uint32_t)(hdist - 1), 5);
+        put_bits(s, (uint32_t)(hclen - 4), 4);
+        for (int i = 0; i < hclen; i++) put_bits(s, clLens[g_clOrder[i]], 3);
+        for (int i = 0; i < rle.count; i++) {
+            int sym = rle.sym[i];
+            put_bits(s, clCodes[sym], clLens[sym]);
+            if (g_clExtraBits[sym]) put_bits(s, rle.extra[i], g_clExtraBits[sym]);
+        }
+        write_symbols(s, litLens, litCodes, distLens, distCodes);
+    }
+
+done:
+    s->nsym = 0;
+    s->blockStart = s->symEnd;
+}
+
+/* ── LZ77 matching ─────────────────────────────────────────────────────── */
+
+static inline uint32_t hash3(const uint8_t *p)
+{
+    uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (v * 0x9E3779B1u) >> (32 - HASH_BITS);
+}
+
+/* Links `pos` into its hash chain; returns the previous chain head. */
+static inline unsigned insert_string(DeflateStream *s, size_t pos)
+{
+    uint32_t h = hash3(s->window + pos);
+    unsigned old = s->head[h];
+    s->prev[pos & WMASK] = (uint16_t)old;
+    s->head[h] = (uint16_t)pos;
+    return old;
+}
+
+static inline uint16_t load16(const uint8_t *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/* Length of the common prefix of `a` and `b`, which share their first two
+ * bytes, up to `maxLen`. Reads up to 7 bytes past `maxLen`, which the
+ * window's tail padding keeps in bounds. */
+static inline int match_length(const uint8_t *a, const uint8_t *b, int maxLen)
+{
+    int len = 2;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (len < maxLen) {
+        uint64_t x, y;
+        memcpy(&x, a + len, sizeof(x));
+        memcpy(&y, b + len, sizeof(y));
+        if (x != y) {
+            len += __builtin_ctzll(x ^ y) >> 3;
+            break;
+        }
+        len += 8;
+    }
+    return len < maxLen ? len : maxLen;
+#else
+    while (len < maxLen && a[len] == b[len]) len++;
+    return len;
+#endif
+}
+
+static int longest_match(DeflateStream *s, size_t pos, unsigned cand, size_t avail,
+                         int prevLen, unsigned *distOut)
+{
+    int best = prevLen;
+    int maxLen = avail < MAX_MATCH ? (int)avail : MAX_MATCH;
+    int nice = s->cfg.nice < maxLen ? s->cfg.nice : maxLen;
+    int chain = s->cfg.chain;
+    size_t limit = pos > MAX_DIST ? pos - MAX_DIST : 0;
+    const uint8_t *window = s->window, *scan = window + pos;
+    const uint16_t *prev = s->prev;
+
+    if (best >= maxLen) return best;
+    if (prevLen >= s->cfg.good) chain >>= 2;
+
+    /* A match must beat `best`, so its last two bytes are compared first:
+     * they differ far more often than the first two. */
+    uint16_t head2 = load16(scan), tail2 = load16(scan + best - 1);
+    while (cand > limit && cand < pos) {
+        const uint8_t *m = window + cand;
+        if (load16(m + best - 1) == tail2 && load16(m) == head2) {
+            int len = match_length(scan, m, maxLen);
+            if (len > best) {
+                best = len;
+                *distOut = (unsigned)(pos - (size_t)cand);
+                if (len >= nice) break;
+                tail2 = load16(scan + best - 1);
+            }
+        }
+        if (--chain <= 0) break;
+        cand = prev[cand & WMASK];
+    }
+    return best;
+}
+
+static inline void emit_literal(DeflateStream *s, size_t at)
+{
+    s->symLit[s->nsym] = s->window[at];
+    s->symDist[s->nsym] = 0;
+    s->nsym++;
+    s->symEnd = at + 1;
+    if (s->nsym == SYM_BUF_SIZE) emit_block(s, 0);
+}
+
+static inline void emit_match(DeflateStream *s, size_t at, int len, unsigned dist)
+{
+    s->symLit[s->nsym] = (uint16_t)len;
+    s->symDist[s->nsym] = (uint16_t)dist;
+    s->nsym++;
+    s->symEnd = at + (size_t)len;
+    if (s->nsym == SYM_BUF_SIZE) emit_block(s, 0);
+}
+
+static void process_greedy(DeflateStream *s, int flush)
+{
+    for (;;) {
+        size_t avail = s->winLen - s->pos;
+        if (avail == 0 || (avail < LOOKAHEAD && !flush)) break;
+
+        int len = 0;
+        unsigned dist = 0;
+        if (avail >= MIN_MATCH) {
+            unsigned cand = insert_string(s, s->pos);
+            if (cand != NIL) len = longest_match(s, s->pos, cand, avail, MIN_MATCH - 1, &dist);
+        }
+
+        if (len >= MIN_MATCH) {
+            emit_match(s, s->pos, len, dist);
+            if (len <= s->cfg.maxInsert) {
+                for (int i = 1; i < len; i++) {
+                    if (s->pos + i + MIN_MATCH <= s->winLen) insert_string(s, s->pos + i);
+                }
+            }
+            s->pos += (size_t)len;
+        } else {
+            emit_literal(s, s->pos);
+            s->pos++;
+        }
+    }
+}
+
+static void process_lazy(DeflateStream *s, int flush)
+{
+    for (;;) {
+        size_t avail = s->winLen - s->pos;
+        if (avail == 0 || (avail < LOOKAHEAD && !flush)) break;
+
+        int curLen = MIN_MATCH - 1;
+        unsigned curDist = 0;
+        if (avail >= MIN_MATCH) {
+            unsigned cand = insert_string(s, s->pos);
+            if (cand != NIL && s->prevLen < s->cfg.lazy) {
+                curLen = longest_match(s, s->pos, cand, avail, s->prevLen, &curDist);
+                if (curLen <= s->prevLen) curLen = MIN_MATCH - 1;
+                /* A 3-byte match far away costs more than three literals */
+                if (curLen == MIN_MATCH && curDist > 4096) curLen = MIN_MATCH - 1;
+            }
+        }
+
+        if (s->prevLen >= MIN_MATCH && curLen <= s->prevLen) {
+            size_t at = s->pos - 1;
+            size_t end = at + (size_t)s->prevLen;
+            emit_match(s, at, s->prevLen, s->prevDist);
+            for (size_t p = s->pos + 1; p < end; p++) {
+                if (p + MIN_MATCH <= s->winLen) insert_string(s, p);
+            }
+            s->pos = end;
+            s->matchAvailable = 0;
+            s->prevLen = MIN_MATCH - 1;
+        } else if (s->matchAvailable) {
+            emit_literal(s, s->pos - 1);
+            s->prevLen = curLen;
+            s->prevDist = curDist;
+            s->pos++;
+        } else {
+            s->matchAvailable = 1;
+            s->prevLen = curLen;
+            s->prevDist = curDist;
+            s->pos++;
+        }
+    }
+
+    if (flush && s->matchAvailable) {
+        emit_literal(s, s->pos - 1);
+        s->matchAvailable = 0;
+        s->prevLen = MIN_MATCH - 1;
+    }
+}
+
+static void process(DeflateStream *s, int flush)
+{
+    if (s->level == 0) {
+        s->pos = s->winLen;
+        s->symEnd = s->winLen;
+    } else if (s->cfg.lazy) {
+        process_lazy(s, flush);
+    } else {
+        process_greedy(s, flush);
+    }
+}
+
+static void slide_window(DeflateStream *s)
+{
+    /* The open block's raw bytes are about to move out of reach */
+    if (s->symEnd > s->blockStart) emit_block(s, 0);
+
+    memmove(s->window, s->window + WSIZE, WSIZE);
+    s->winLen -= WSIZE;
+    s->pos -= WSIZE;
+    s->blockStart -= WSIZE;
+    s->symEnd -= WSIZE;
+
+    for (int i = 0; i < HASH_SIZE; i++) {
+        unsigned v = s->head[i];
+        s->head[i] = (uint16_t)(v >= WSIZE ? v - WSIZE : NIL);
+    }
+    for (int i = 0; i < WSIZE; i++) {
+        unsigned v = s->prev[i];
+        s->prev[i] = (uint16_t)(v >= WSIZE ? v - WSIZE : NIL);
+    }
+}
+
+/* ── Public API ────────────────────────────────────────────────────────── */
+
+size_t deflate_working_bytes(void)
+{
+    return sizeof(DeflateStream) + 2 * WSIZE + WIN_PAD + sizeof(uint16_t) * (HASH_SIZE + WSIZE)
+         + 2 * sizeof(uint16_t) * SYM_BUF_SIZE;
+}
+
+DeflateStream *deflate_create(int level, ByteBuf *out)
+{
+    if (level < DEFLATE_MIN_LEVEL) level = DEFLATE_MIN_LEVEL;
+    if (level > DEFLATE_MAX_LEVEL) level = DEFLATE_MAX_LEVEL;
+
+    DeflateStream *s = (DeflateStream *)arena_calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    s->out = out;
+    s->level = level;
+    s->cfg = g_levels[level];
+    s->window  = (uint8_t *)arena_alloc(2 * WSIZE + WIN_PAD);
+    s->head    = (uint16_t *)arena_alloc(sizeof(uint16_t) * HASH_SIZE);
+    s->prev    = (uint16_t *)arena_alloc(sizeof(uint16_t) * WSIZE);
+    s->symLit  = (uint16_t *)arena_alloc(sizeof(uint16_t) * SYM_BUF_SIZE);
+    s->symDist = (uint16_t *)arena_alloc(sizeof(uint16_t) * SYM_BUF_SIZE);
+    if (!s->window || !s->head || !s->prev || !s->symLit || !s->symDist) {
+        deflate_destroy(s);
+        return NULL;
+    }
+    for (int i = 0; i < HASH_SIZE; i++) s->head[i] = NIL;
+    for (int i = 0; i < WSIZE; i++) s->prev[i] = NIL;
+    s->prevLen = MIN_MATCH - 1;
+    s->adler = 1;
+    s->segAdler = 1;
+
+    /* zlib header: deflate, 32 KB window, FLEVEL hint, FCHECK */
+    static const uint8_t flg[4] = { 0x01, 0x5E, 0x9C, 0xDA };
+    int flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    bb_put_u8(out, 0x78);
+    bb_put_u8(out, flg[flevel]);
+    return s;
+}
+
+void deflate_destroy(DeflateStream *s)
+{
+    if (!s) return;
+    /* Newest first, so the paste arena can take them back */
+    arena_free(s->symDist);
+    arena_free(s->symLit);
+    arena_free(s->prev);
+    arena_free(s->head);
+    arena_free(s->window);
+    arena_free(s);
+}
+
+void deflate_set_poll(DeflateStream *s, int (*poll)(void *ctx), void *ctx)
+{
+    s->poll = poll;
+    s->pollCtx = ctx;
+    s->sincePoll = 0;
+}
+
+int deflate_write(DeflateStream *s, const uint8_t *data, size_t len)
+{
+    if (s->finished || s->stopped) return 0;
+    s->segAdler = adler32_update(s->segAdler, data, len);
+    s->segIn += len;
+    s->totalIn += len;
+
+    while (len > 0) {
+        if (s->poll && s->sincePoll >= DEFLATE_POLL_BYTES) {
+            s->sincePoll = 0;
+            if (!s->poll(s->pollCtx)) {
+                s->stopped = 1;
+                return 0;
+            }
+        }
+        if (s->winLen == 2 * WSIZE) slide_window(s);
+        size_t room = 2 * WSIZE - s->winLen;
+        size_t n = len < room ? len : room;
+        if (n > DEFLATE_POLL_BYTES) n = DEFLATE_POLL_BYTES;
+        memcpy(s->window + s->winLen, data, n);
+        s->winLen += n;
+        data += n;
+        len -= n;
+        process(s, 0);
+        s->sincePoll += n;
+    }
+    return !s->out->failed;
+}
+
+int deflate_finish(DeflateStream *s)
+{
+    if (s->stopped) return 0;
+    if (s->finished) return !s->out->failed;
+    process(s, 1);
+    emit_block(s, 1);
+    align_byte(s);
+    bb_put_be32(s->out, adler32_combine(s->adler, s->segAdler, s->segIn));
+    s->finished = 1;
+    return !s->out->failed;
+}
+
+int deflate_flush_segment(DeflateStream *s, uint32_t *adler, uint64_t *len)
+{
+    if (s->finished || s->stopped) return 0;
+    process(s, 1);
+    if (s->symEnd > s->blockStart) emit_block(s, 0);
+    write_stored(s, s->window, 0, 0);   /* empty block: byte-aligns the output */
+
+    /* Forget the window, so the next segment never refers back into this one */
+    s->winLen = s->pos = s->blockStart = s->symEnd = 0;
+    s->prevLen = MIN_MATCH - 1;
+    s->prevDist = 0;
+    s->matchAvailable = 0;
+    for (int i = 0; i < HASH_SIZE; i++) s->head[i] = NIL;
+
+    *adler = s->segAdler;
+    *len = s->segIn;
+    s->adler = adler32_combine(s->adler, s->segAdler, s->segIn);
+    s->segAdler = 1;
+    s->segIn = 0;
+    return !s->out->failed;
+}
+
+int deflate_splice(DeflateStream *s, const uint8_t *segment, size_t n, uint32_t adler, uint64_t len)
+{
+    if (s->finished || s->winLen != 0 || s->segIn != 0) return 0;
+    bb_append(s->out, segment, n);
+    s->adler = adler32_combine(s->adler, adler, len);
+    s->totalIn += len;
+    return !s->out->failed;
+}
+
+uint64_t deflate_total_in(const DeflateStream *s)
+{
+    return s->totalIn;
+}
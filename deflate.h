@@ -0,0 +1,62 @@
+/*
+ * ImagePaster - deflate.h
+ *
+ * Incremental zlib (RFC 1950/1951) compressor used by the PNG encoder.
+ * LZ77 over a 32 KB window with hash chains, lazy matching at higher levels,
+ * and per-block choice between stored, fixed and dynamic Huffman coding.
+ *
+ * Compressed bytes are appended to a caller-owned ByteBuf; callers that stream
+ * may drain it (consume data[0..len) and reset len to 0) between writes.
+ */
+
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bytebuf.h"
+
+#define DEFLATE_MIN_LEVEL     0   /* stored only */
+#define DEFLATE_MAX_LEVEL     9
+#define DEFLATE_DEFAULT_LEVEL 6
+
+typedef struct DeflateStream DeflateStream;
+
+DeflateStream *deflate_create(int level, ByteBuf *out);
+void           deflate_destroy(DeflateStream *s);
+
+/* Calls `poll` between chunks of at most DEFLATE_POLL_BYTES of input, so a
+ * long write can be stopped; once it returns 0 the stream fails. */
+#define DEFLATE_POLL_BYTES    (8 * 1024)
+void deflate_set_poll(DeflateStream *s, int (*poll)(void *ctx), void *ctx);
+
+/* Feeds input; returns 0 on allocation failure or when polling stopped it. */
+int  deflate_write(DeflateStream *s, const uint8_t *data, size_t len);
+
+/* Flushes all pending input, writes the final block and the Adler-32 trailer. */
+int  deflate_finish(DeflateStream *s);
+
+/* Ends a segment: compresses all pending input, byte-aligns the output with
+ * an empty stored block and forgets the window, so the bytes written since
+ * the previous segment (or the zlib header) never refer to earlier data and
+ * can be replayed into another stream. Reports the segment's Adler-32 and
+ * uncompressed length for deflate_splice(). */
+int  deflate_flush_segment(DeflateStream *s, uint32_t *adler, uint64_t *len);
+
+/* Appends `n` bytes of a segment written by deflate_flush_segment() at the
+ * same level, in place of compressing its `len` bytes of input again. Only
+ * at the start of a stream or right after a segment flush. */
+int  deflate_splice(DeflateStream *s, const uint8_t *segment, size_t n, uint32_t adler, uint64_t len);
+
+/* Memory a stream allocates, whatever its level. */
+size_t   deflate_working_bytes(void);
+
+/* Total uncompressed bytes consumed so far. */
+uint64_t deflate_total_in(const DeflateStream *s);
+
+/* Running checksums; start Adler-32 at 1 and CRC-32 at 0. */
+uint32_t adler32_update(uint32_t adler, const uint8_t *p, size_t len);
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t len2);
+uint32_t crc32_update(uint32_t crc, const uint8_t *p, size_t len);
+
+#endif // DEFLATE_H
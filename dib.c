@@ -0,0 +1,257 @@
+/*
+ * ImagePaster - dib.c
+ *
+ * Clipboard DIB parsing and RGB conversion (see dib.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "dib.h"
+#include "arena.h"
+
+#define DIB_MAX_DIMENSION   32768
+#define DIB_BI_ALPHABITFIELDS 6
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint16_t rd16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+DibResult dib_parse(const uint8_t *dib, size_t len, DibInfo *info)
+{
+    memset(info, 0, sizeof(*info));
+    if (len < 40) return DIB_ERR_TRUNCATED;
+
+    info->headerSize  = rd32(dib);
+    info->width       = (int32_t)rd32(dib + 4);
+    info->height      = (int32_t)rd32(dib + 8);
+    info->bitCount    = rd16(dib + 14);
+    info->compression = rd32(dib + 16);
+    info->clrUsed     = rd32(dib + 32);
+
+    if (info->headerSize < 40) return DIB_ERR_UNSUPPORTED;   /* BITMAPCOREHEADER */
+    if (len < info->headerSize) return DIB_ERR_TRUNCATED;
+    if (info->width <= 0 || info->height == 0 || info->height == INT32_MIN) return DIB_ERR_HEADER;
+    uint32_t absHeight = info->height < 0 ? (uint32_t)-info->height : (uint32_t)info->height;
+    if ((uint32_t)info->width > DIB_MAX_DIMENSION || absHeight > DIB_MAX_DIMENSION)
+        return DIB_ERR_UNSUPPORTED;
+
+    int bitfields = info->compression == DIB_BI_BITFIELDS ||
+                    info->compression == DIB_BI_ALPHABITFIELDS;
+    switch (info->bitCount) {
+    case 1: case 4: case 8: case 24:
+        if (info->compression != DIB_BI_RGB) return DIB_ERR_UNSUPPORTED;
+        break;
+    case 16: case 32:
+        if (info->compression != DIB_BI_RGB && !bitfields) return DIB_ERR_UNSUPPORTED;
+        break;
+    default:
+        return DIB_ERR_UNSUPPORTED;
+    }
+
+    size_t off = info->headerSize;
+    if (bitfields) {
+        if (info->headerSize >= 52) {
+            info->masks[0] = rd32(dib + 40);
+            info->masks[1] = rd32(dib + 44);
+            info->masks[2] = rd32(dib + 48);
+        } else {
+            size_t maskBytes = info->compression == DIB_BI_ALPHABITFIELDS ? 16 : 12;
+            if (len < off + maskBytes) return DIB_ERR_TRUNCATED;
+            info->masks[0] = rd32(dib + off);
+            info->masks[1] = rd32(dib + off + 4);
+            info->masks[2] = rd32(dib + off + 8);
+            off += maskBytes;
+        }
+    } else if (info->bitCount == 16) {
+        info->masks[0] = 0x7C00; info->masks[1] = 0x03E0; info->masks[2] = 0x001F;
+    } else if (info->bitCount == 32) {
+        info->masks[0] = 0xFF0000; info->masks[1] = 0x00FF00; info->masks[2] = 0x0000FF;
+    }
+
+    /* Colour table: required below 9 bpp, optional (and ignored) above */
+    uint32_t tableEntries = info->clrUsed;
+    if (info->bitCount <= 8) {
+        uint32_t maxEntries = 1u << info->bitCount;
+        if (tableEntries == 0 || tableEntries > maxEntries) tableEntries = maxEntries;
+        info->paletteCount = tableEntries;
+    } else if (tableEntries > 256) {
+        return DIB_ERR_HEADER;
+    }
+    info->paletteOffset = off;
+    off += (size_t)tableEntries * 4;
+    if (len < off) return DIB_ERR_TRUNCATED;
+
+    info->stride = (((size_t)info->width * info->bitCount + 31) / 32) * 4;
+    size_t rowBytes = ((size_t)info->width * info->bitCount + 7) / 8;
+    size_t imageBytes = info->stride * (absHeight - 1) + rowBytes;
+
+    /* Some producers repeat the masks after a V4/V5 header that already has them */
+    if (bitfields && info->headerSize >= 52 && len >= off + 12 + imageBytes &&
+        rd32(dib + off) == info->masks[0] && rd32(dib + off + 4) == info->masks[1] &&
+        rd32(dib + off + 8) == info->masks[2]) {
+        off += 12;
+    }
+
+    if (len < off + imageBytes) return DIB_ERR_TRUNCATED;
+    info->pixelOffset = off;
+    return DIB_OK;
+}
+
+/* ── Pixel conversion ──────────────────────────────────────────────────── */
+
+static DibMaskChannel mask_channel(uint32_t mask)
+{
+    DibMaskChannel c = { mask, 0, 0 };
+    if (!mask) return c;
+    c.shift = __builtin_ctz(mask);
+    c.bits  = __builtin_popcount(mask >> c.shift);
+    return c;
+}
+
+static inline uint8_t mask_extract(const DibMaskChannel *c, uint32_t px)
+{
+    uint32_t v = (px & c->mask) >> c->shift;
+    if (c->bits >= 8) return (uint8_t)(v >> (c->bits - 8));
+    if (c->bits == 0) return 0;
+    uint32_t max = (1u << c->bits) - 1;
+    return (uint8_t)((v * 255 + max / 2) / max);
+}
+
+/* Converts stored row y (top-down) into dst. */
+static void convert_row(const DibRowReader *r, uint32_t y, uint8_t *dst)
+{
+    const DibInfo *info = &r->info;
+    uint32_t w = r->base.width, h = r->base.height;
+    const uint8_t *src = r->dib + info->pixelOffset + info->stride * (info->height < 0 ? y : h - 1 - y);
+    const DibMaskChannel *mr = &r->masks[0], *mg = &r->masks[1], *mb = &r->masks[2];
+
+    switch (info->bitCount) {
+    case 24:
+        for (uint32_t x = 0; x < w; x++, src += 3, dst += 3) {
+            dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0];
+        }
+        break;
+    case 32:
+        if (r->stdMasks32) {
+            for (uint32_t x = 0; x < w; x++, src += 4, dst += 3) {
+                dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0];
+            }
+        } else {
+            for (uint32_t x = 0; x < w; x++, src += 4, dst += 3) {
+                uint32_t px = rd32(src);
+                dst[0] = mask_extract(mr, px);
+                dst[1] = mask_extract(mg, px);
+                dst[2] = mask_extract(mb, px);
+            }
+        }
+        break;
+    case 16:
+        for (uint32_t x = 0; x < w; x++, src += 2, dst += 3) {
+            uint32_t px = rd16(src);
+            dst[0] = mask_extract(mr, px);
+            dst[1] = mask_extract(mg, px);
+            dst[2] = mask_extract(mb, px);
+        }
+        break;
+    default: {   /* 1, 4, 8 bpp palette indices, MSB first */
+        int bpp = info->bitCount;
+        unsigned idxMask = (1u << bpp) - 1;
+        for (uint32_t x = 0; x < w; x++, dst += 3) {
+            size_t bit = (size_t)x * bpp;
+            unsigned idx = (src[bit >> 3] >> (8 - bpp - (bit & 7))) & idxMask;
+            memcpy(dst, r->palette[idx], 3);
+        }
+        break;
+    }
+    }
+}
+
+static const uint8_t *reader_row(RgbRowSource *src, uint32_t y, uint8_t *buf)
+{
+    convert_row((const DibRowReader *)src, y, buf);
+    return buf;
+}
+
+DibResult dib_reader_init(DibRowReader *r, const uint8_t *dib, size_t len)
+{
+    memset(r, 0, sizeof(*r));
+    DibResult res = dib_parse(dib, len, &r->info);
+    if (res != DIB_OK) return res;
+
+    const DibInfo *info = &r->info;
+    r->base.width = (uint32_t)info->width;
+    r->base.height = info->height < 0 ? (uint32_t)-info->height : (uint32_t)info->height;
+    r->base.row = reader_row;
+    r->dib = dib;
+    for (uint32_t i = 0; i < info->paletteCount; i++) {
+        const uint8_t *q = dib + info->paletteOffset + (size_t)i * 4;
+        r->palette[i][0] = q[2];
+        r->palette[i][1] = q[1];
+        r->palette[i][2] = q[0];
+    }
+    for (int c = 0; c < 3; c++) r->masks[c] = mask_channel(info->masks[c]);
+    r->stdMasks32 = info->bitCount == 32 && info->masks[0] == 0xFF0000 &&
+                    info->masks[1] == 0x00FF00 && info->masks[2] == 0x0000FF;
+    return DIB_OK;
+}
+
+DibResult dib_to_rgb(const uint8_t *dib, size_t len, RgbImage *out)
+{
+    DibRowReader r;
+    memset(out, 0, sizeof(*out));
+    DibResult res = dib_reader_init(&r, dib, len);
+    if (res != DIB_OK) return res;
+
+    uint32_t w = r.base.width, h = r.base.height;
+    size_t outStride = (size_t)w * 3;
+    uint8_t *pixels = (uint8_t *)arena_alloc(outStride * h);
+    if (!pixels) return DIB_ERR_NOMEM;
+
+    for (uint32_t y = 0; y < h; y++) convert_row(&r, y, pixels + outStride * y);
+
+    out->width = w;
+    out->height = h;
+    out->stride = outStride;
+    out->pixels = pixels;
+    return DIB_OK;
+}
+
+static const uint8_t *image_row(RgbRowSource *src, uint32_t y, uint8_t *buf)
+{
+    (void)buf;
+    const RgbImage *img = ((const RgbImageRows *)src)->img;
+    return img->pixels + img->stride * y;
+}
+
+void rgb_image_rows(RgbImageRows *rows, const RgbImage *img)
+{
+    rows->base.width = img->width;
+    rows->base.height = img->height;
+    rows->base.row = image_row;
+    rows->base.poll = NULL;
+    rows->img = img;
+}
+
+void rgb_image_free(RgbImage *img)
+{
+    arena_free(img->pixels);
+    memset(img, 0, sizeof(*img));
+}
+
+const char *dib_result_string(DibResult r)
+{
+    switch (r) {
+    case DIB_OK:              return "ok";
+    case DIB_ERR_TRUNCATED:   return "truncated DIB";
+    case DIB_ERR_HEADER:      return "invalid DIB header";
+    case DIB_ERR_UNSUPPORTED: return "unsupported DIB format";
+    case DIB_ERR_NOMEM:       return "out of memory";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,107 @@
+/*
+ * ImagePaster - dib.h
+ *
+ * Parser for packed clipboard DIBs (CF_DIB: a BITMAPINFOHEADER or one of its
+ * V4/V5 extensions, optional masks and colour table, then pixel rows) and
+ * conversion to top-down 8-bit RGB. Uncompressed 1/4/8/16/24/32 bpp and
+ * BI_BITFIELDS are handled; RLE and embedded JPEG/PNG report
+ * DIB_ERR_UNSUPPORTED so the caller can fall back to GDI+.
+ *
+ * Images can also be read a row at a time through an RgbRowSource, so an
+ * encoder can stream a DIB without ever holding it decoded in full.
+ *
+ * Plain C with no Win32 dependency; all header fields are read little-endian
+ * from the raw bytes.
+ */
+
+#ifndef DIB_H
+#define DIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DIB_BI_RGB       0
+#define DIB_BI_RLE8      1
+#define DIB_BI_RLE4      2
+#define DIB_BI_BITFIELDS 3
+#define DIB_BI_JPEG      4
+#define DIB_BI_PNG       5
+
+typedef enum {
+    DIB_OK = 0,
+    DIB_ERR_TRUNCATED,
+    DIB_ERR_HEADER,
+    DIB_ERR_UNSUPPORTED,
+    DIB_ERR_NOMEM
+} DibResult;
+
+typedef struct {
+    uint32_t headerSize;    /* biSize */
+    int32_t  width;
+    int32_t  height;        /* as stored; negative means top-down */
+    uint16_t bitCount;
+    uint32_t compression;
+    uint32_t clrUsed;
+    uint32_t masks[3];      /* R, G, B for 16/32 bpp */
+    uint32_t paletteCount;
+    size_t   paletteOffset; /* offset of RGBQUAD entries */
+    size_t   pixelOffset;   /* offset of the first stored row */
+    size_t   stride;        /* bytes per stored row (DWORD aligned) */
+} DibInfo;
+
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    size_t   stride;        /* bytes per row, >= 3 * width */
+    uint8_t *pixels;        /* top-down R,G,B */
+} RgbImage;
+
+/* Top-down RGB rows on demand. row() returns row y: either `buf` (3 * width
+ * bytes) after filling it, or memory of the source's own that stays valid
+ * while the source exists. Rows are requested in increasing order, each at
+ * most once per pass; a new pass may start from row 0. A source may return
+ * NULL to stop the pass (a cancelled conversion, pipeline.h); the reader
+ * then fails. Encoders also call poll(), if set, during long work between
+ * two rows; it returning 0 stops the pass the same way. */
+typedef struct RgbRowSource RgbRowSource;
+struct RgbRowSource {
+    uint32_t width;
+    uint32_t height;
+    const uint8_t *(*row)(RgbRowSource *src, uint32_t y, uint8_t *buf);
+    int (*poll)(RgbRowSource *src);     /* may be NULL */
+};
+
+/* An RgbImage as a row source; rows are returned in place. */
+typedef struct {
+    RgbRowSource   base;
+    const RgbImage *img;
+} RgbImageRows;
+
+typedef struct {
+    uint32_t mask;
+    int      shift;
+    int      bits;
+} DibMaskChannel;
+
+/* A packed DIB as a row source: each row is converted when requested. The
+ * DIB must stay valid while the reader is used. */
+typedef struct {
+    RgbRowSource   base;
+    const uint8_t *dib;
+    DibInfo        info;
+    uint8_t        palette[256][3];
+    DibMaskChannel masks[3];
+    int            stdMasks32;
+} DibRowReader;
+
+DibResult   dib_parse(const uint8_t *dib, size_t len, DibInfo *info);
+DibResult   dib_to_rgb(const uint8_t *dib, size_t len, RgbImage *out);
+void        rgb_image_free(RgbImage *img);
+const char *dib_result_string(DibResult r);
+
+/* Same checks as dib_to_rgb, without converting anything yet. */
+DibResult   dib_reader_init(DibRowReader *r, const uint8_t *dib, size_t len);
+
+void        rgb_image_rows(RgbImageRows *rows, const RgbImage *img);
+
+#endif // DIB_H
@@ -0,0 +1,329 @@
+/*
+ * ImagePaster - frame.c
+ *
+ * Framed text encoding, CRC32C and the incremental frame decoder
+ * (see frame.h).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "frame.h"
+#include "base64.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define FRAME_X86 1
+#endif
+
+#define FRAME_BEGIN   "-----BEGIN IMAGEPASTER "
+#define FRAME_END     "-----END IMAGEPASTER "
+#define FRAME_DASHES  "-----"
+
+/* ── CRC32C ────────────────────────────────────────────────────────────── */
+
+static uint32_t g_crcTable[8][256];
+static int      g_crcReady = 0;
+
+static void crc32c_init(void)
+{
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0x82F63B78u ^ (c >> 1) : c >> 1;
+        g_crcTable[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t c = g_crcTable[t - 1][n];
+            g_crcTable[t][n] = g_crcTable[0][c & 0xFF] ^ (c >> 8);
+        }
+    }
+    g_crcReady = 1;
+}
+
+/* Slicing-by-8, as crc32_update in deflate.c with the Castagnoli polynomial */
+uint32_t crc32c_update_scalar(uint32_t crc, const uint8_t *p, size_t len)
+{
+    if (!g_crcReady) crc32c_init();
+    crc = ~crc;
+    while (len >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                             (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 |
+                      (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+        crc = g_crcTable[7][lo & 0xFF] ^ g_crcTable[6][(lo >> 8) & 0xFF] ^
+              g_crcTable[5][(lo >> 16) & 0xFF] ^ g_crcTable[4][lo >> 24] ^
+              g_crcTable[3][hi & 0xFF] ^ g_crcTable[2][(hi >> 8) & 0xFF] ^
+              g_crcTable[1][(hi >> 16) & 0xFF] ^ g_crcTable[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) crc = g_crcTable[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+#ifdef FRAME_X86
+/* The CRC32 instruction computes exactly this polynomial, 8 bytes at a time */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len)
+{
+    crc = ~crc;
+#ifdef __x86_64__
+    uint64_t c = crc;
+    for (; len >= 8; len -= 8, p += 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (uint32_t)c;
+#endif
+    for (; len >= 4; len -= 4, p += 4) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        crc = _mm_crc32_u32(crc, v);
+    }
+    while (len--) crc = _mm_crc32_u8(crc, *p++);
+    return ~crc;
+}
+
+static int has_sse42(void)
+{
+    static int cached = -1;
+    if (cached < 0) cached = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+    return cached;
+}
+#endif
+
+uint32_t crc32c_update(uint32_t crc, const uint8_t *p, size_t len)
+{
+#ifdef FRAME_X86
+    if (has_sse42()) return crc32c_sse42(crc, p, len);
+#endif
+    return crc32c_update_scalar(crc, p, len);
+}
+
+/* ── Encoding ──────────────────────────────────────────────────────────── */
+
+static int header_line(char *out, const char *format, uint64_t len, uint32_t crc)
+{
+    return snprintf(out, FRAME_MAX_LINE, FRAME_BEGIN "%s %llu %08x" FRAME_DASHES "\r\n",
+                    format, (unsigned long long)len, (unsigned)crc);
+}
+
+static int trailer_line(char *out, uint32_t crc)
+{
+    return snprintf(out, FRAME_MAX_LINE, FRAME_END "%08x" FRAME_DASHES "\r\n", (unsigned)crc);
+}
+
+size_t frame_length(const char *format, uint64_t len)
+{
+    char line[FRAME_MAX_LINE];
+    size_t chars = BASE64_ENCODED_LEN(len);
+    size_t lines = (chars + FRAME_LINE_CHARS - 1) / FRAME_LINE_CHARS;
+    return (size_t)header_line(line, format, len, 0) + chars + 2 * lines
+         + (size_t)trailer_line(line, 0);
+}
+
+size_t frame_encode_to(const char *format, const uint8_t *data, size_t len, char *out)
+{
+    char line[FRAME_MAX_LINE];
+    uint32_t crc = crc32c_update(0, data, len);
+    char *p = out;
+
+    int n = header_line(line, format, len, crc);
+    memcpy(p, line, (size_t)n);
+    p += n;
+
+    /* 57 input bytes make one 76-character line */
+    const size_t chunk = FRAME_LINE_CHARS / 4 * 3;
+    for (size_t i = 0; i < len; i += chunk) {
+        size_t k = len - i < chunk ? len - i : chunk;
+        base64_encode_to(data + i, k, p);
+        p += BASE64_ENCODED_LEN(k);
+        *p++ = '\r';
+        *p++ = '\n';
+    }
+
+    n = trailer_line(line, crc);
+    memcpy(p, line, (size_t)n);
+    p += n;
+    return (size_t)(p - out);
+}
+
+/* ── Decoding ──────────────────────────────────────────────────────────── */
+
+void frame_decoder_init(FrameDecoder *d, FrameSinkFn sink, void *ctx)
+{
+    /* The buffers need no clearing */
+    memset(d, 0, offsetof(FrameDecoder, line));
+    d->sink = sink;
+    d->ctx = ctx;
+    d->simd = 1;
+    d->status = FRAME_MORE;
+    d->atLineStart = 1;
+}
+
+static int is_break(char c)
+{
+    return (unsigned char)c <= ' ';
+}
+
+/* The first whitespace or control character in [p, end), or end */
+static const char *find_break(const char *p, const char *end)
+{
+#if defined(FRAME_X86) && defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' ');
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(v, space), v));
+        if (m) return p + __builtin_ctz((unsigned)m);
+    }
+#endif
+    while (p < end && !is_break(*p)) p++;
+    return p;
+}
+
+/* Decodes the collected body characters. Until the end of the body, the last
+ * whole group is held back, so '=' padding is only accepted at the end. */
+static FrameStatus flush_text(FrameDecoder *d, int final)
+{
+    size_t n = d->textLen / 4 * 4;
+    if (final && n != d->textLen) return FRAME_ERR_LENGTH;
+    if (!final) n = n >= 4 ? n - 4 : 0;
+    if (n == 0) return FRAME_MORE;
+
+    size_t got = d->simd ? base64_decode_to(d->text, n, d->bytes)
+                         : base64_decode_to_scalar(d->text, n, d->bytes);
+    if (got == BASE64_DECODE_ERROR) return FRAME_ERR_BODY;
+    if (got > d->length - d->decoded) return FRAME_ERR_LENGTH;
+
+    d->crcRun = d->simd ? crc32c_update(d->crcRun, d->bytes, got)
+                        : crc32c_update_scalar(d->crcRun, d->bytes, got);
+    if (d->sink && got && !d->sink(d->ctx, d->bytes, got)) return FRAME_ERR_SINK;
+    d->decoded += got;
+
+    memmove(d->text, d->text + n, d->textLen - n);
+    d->textLen -= n;
+    return FRAME_MORE;
+}
+
+static FrameStatus parse_header(FrameDecoder *d, const char *s)
+{
+    unsigned long long len;
+    unsigned crc;
+    int end = -1;
+    /* %15 is FRAME_MAX_FORMAT */
+    if (sscanf(s, FRAME_BEGIN "%15[a-z0-9] %llu %8x" FRAME_DASHES "%n", d->format, &len, &crc, &end) != 3
+        || end < 0 || s[end] != '\0') return FRAME_ERR_HEADER;
+    d->length = len;
+    d->crc = crc;
+    d->haveHeader = 1;
+    return FRAME_MORE;
+}
+
+static FrameStatus parse_trailer(FrameDecoder *d, const char *s)
+{
+    unsigned crc;
+    int end = -1;
+    if (sscanf(s, FRAME_END "%8x" FRAME_DASHES "%n", &crc, &end) != 1 || end < 0 || s[end] != '\0')
+        return FRAME_ERR_TRAILER;
+
+    FrameStatus st = flush_text(d, 1);
+    if (st != FRAME_MORE) return st;
+    if (d->decoded != d->length) return FRAME_ERR_LENGTH;
+    if (crc != d->crc) return FRAME_ERR_TRAILER;
+    if (d->crcRun != d->crc) return FRAME_ERR_CRC;
+    return FRAME_DONE;
+}
+
+/* A complete header-search or trailer line */
+static FrameStatus end_line(FrameDecoder *d)
+{
+    size_t n = d->lineLen;
+    int skip = d->skipLine;
+    d->lineLen = 0;
+    d->skipLine = 0;
+    while (n > 0 && is_break(d->line[n - 1])) n--;
+    d->line[n] = '\0';
+
+    if (d->haveHeader) return parse_trailer(d, d->line);
+    if (skip) return FRAME_MORE;
+    /* Whatever precedes the header on its line (a prompt, say) is ignored */
+    const char *begin = strstr(d->line, FRAME_BEGIN);
+    if (!begin) return FRAME_MORE;
+    FrameStatus st = parse_header(d, begin);
+    d->inLine = 0;
+    d->atLineStart = 1;
+    return st;
+}
+
+FrameStatus frame_decode(FrameDecoder *d, const char *text, size_t len)
+{
+    const char *p = text, *end = text + len;
+
+    while (d->status == FRAME_MORE && p < end) {
+        if (!d->haveHeader || d->inLine) {
+            const char *e = p;
+            while (e < end && *e != '\n' && *e != '\r') e++;
+            size_t n = (size_t)(e - p);
+            if (n > FRAME_MAX_LINE - 1 - d->lineLen) {
+                if (d->haveHeader) {
+                    d->status = FRAME_ERR_TRAILER;
+                    break;
+                }
+                d->skipLine = 1;
+                n = FRAME_MAX_LINE - 1 - d->lineLen;
+            }
+            memcpy(d->line + d->lineLen, p, n);
+            d->lineLen += n;
+            p = e;
+            if (p < end) {
+                p++;
+                d->status = end_line(d);
+            }
+            continue;
+        }
+
+        /* Body: runs of base64 between whitespace, until a line starts with '-' */
+        if (is_break(*p)) {
+            d->atLineStart = 1;
+            p++;
+            continue;
+        }
+        if (*p == '-' && d->atLineStart) {
+            d->inLine = 1;
+            continue;
+        }
+        const char *e = find_break(p, end);
+        d->atLineStart = 0;
+        while (p < e && d->status == FRAME_MORE) {
+            size_t n = (size_t)(e - p);
+            if (n > FRAME_CHUNK - d->textLen) n = FRAME_CHUNK - d->textLen;
+            memcpy(d->text + d->textLen, p, n);
+            d->textLen += n;
+            p += n;
+            if (d->textLen == FRAME_CHUNK) d->status = flush_text(d, 0);
+        }
+    }
+    return d->status;
+}
+
+FrameStatus frame_decode_end(FrameDecoder *d)
+{
+    if (d->status == FRAME_MORE && d->haveHeader && d->inLine) d->status = end_line(d);
+    return d->status;
+}
+
+const char *frame_status_message(FrameStatus s)
+{
+    switch (s) {
+    case FRAME_MORE:        return "frame incomplete";
+    case FRAME_DONE:        return "ok";
+    case FRAME_ERR_HEADER:  return "malformed frame header";
+    case FRAME_ERR_BODY:    return "invalid character in the frame body";
+    case FRAME_ERR_LENGTH:  return "body length does not match the header (bytes lost or added)";
+    case FRAME_ERR_CRC:     return "CRC32C mismatch (the image was corrupted in transit)";
+    case FRAME_ERR_TRAILER: return "malformed frame trailer";
+    case FRAME_ERR_SINK:    return "writing the image failed";
+    }
+    return "unknown error";
+}
@@ -0,0 +1,96 @@
+/*
+ * ImagePaster - frame.h
+ *
+ * The framed text encoding: the base64 of an image between a header line
+ * and a trailer line, so that a receiver on the far side of a terminal knows
+ * where the payload ends and can tell whether any of it was lost.
+ *
+ *   -----BEGIN IMAGEPASTER png 48213 1a2b3c4d-----
+ *   iVBORw0KGgoAAAANSUhEUgAA...            76 characters per line, CRLF
+ *   -----END IMAGEPASTER 1a2b3c4d-----
+ *
+ * The header gives the image format, its length in bytes and the CRC32C
+ * (Castagnoli) of the image bytes; the trailer repeats the CRC. Receivers
+ * skip anything before the header and treat any whitespace in the body as
+ * a line break, since terminals and shells add and translate line endings.
+ *
+ * FrameDecoder decodes a frame incrementally from chunks of any size in
+ * constant memory, handing the image bytes to a callback as it goes. Plain
+ * C with no Win32 dependency; the CRC uses SSE4.2 and the base64 decoder
+ * SSSE3 when the CPU has them.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAME_LINE_CHARS  76
+#define FRAME_MAX_FORMAT  15            /* characters in the format name */
+#define FRAME_MAX_LINE    128           /* longest header or trailer line */
+#define FRAME_CHUNK       (64 * 1024)   /* base64 characters decoded at a time */
+
+/* Running CRC32C; start at 0. */
+uint32_t crc32c_update(uint32_t crc, const uint8_t *p, size_t len);
+
+/* The same without SSE4.2; the reference for benchmarks and cross-checks. */
+uint32_t crc32c_update_scalar(uint32_t crc, const uint8_t *p, size_t len);
+
+/* Characters in the frame of a `len`-byte image, header to trailer, CRLF
+ * after every line including the last. */
+size_t frame_length(const char *format, uint64_t len);
+
+/* Writes the frame (no terminator) and returns frame_length(). `format` is
+ * lower-case letters and digits, at most FRAME_MAX_FORMAT of them. */
+size_t frame_encode_to(const char *format, const uint8_t *data, size_t len, char *out);
+
+typedef enum {
+    FRAME_MORE,             /* no header yet, or the frame is incomplete */
+    FRAME_DONE,             /* trailer seen; length and CRC verified */
+    FRAME_ERR_HEADER,       /* malformed header line */
+    FRAME_ERR_BODY,         /* a character outside base64 in the body */
+    FRAME_ERR_LENGTH,       /* body longer or shorter than the header says */
+    FRAME_ERR_CRC,          /* image bytes do not match the header's CRC */
+    FRAME_ERR_TRAILER,      /* malformed trailer, or its CRC differs from the header's */
+    FRAME_ERR_SINK          /* the callback refused the bytes */
+} FrameStatus;
+
+/* Receives decoded image bytes in order; returns 0 to abort. */
+typedef int (*FrameSinkFn)(void *ctx, const uint8_t *data, size_t len);
+
+typedef struct {
+    FrameSinkFn sink;
+    void       *ctx;
+    int         simd;           /* 0 = scalar base64 and CRC, for comparison */
+    /* From the header, once seen */
+    int         haveHeader;
+    char        format[FRAME_MAX_FORMAT + 1];
+    uint64_t    length;
+    uint32_t    crc;
+    /* Progress */
+    uint64_t    decoded;        /* image bytes handed to the sink */
+    uint32_t    crcRun;
+    FrameStatus status;
+    int         inLine;         /* collecting a header or trailer line */
+    int         atLineStart;
+    int         skipLine;       /* overlong line before the header */
+    size_t      lineLen;
+    size_t      textLen;        /* body characters not yet decoded */
+    char        line[FRAME_MAX_LINE];
+    char        text[FRAME_CHUNK];
+    uint8_t     bytes[FRAME_CHUNK / 4 * 3];
+} FrameDecoder;
+
+void frame_decoder_init(FrameDecoder *d, FrameSinkFn sink, void *ctx);
+
+/* Feeds the next `len` characters. Returns FRAME_MORE until the frame is
+ * complete or fails; after that it keeps returning the same status. */
+FrameStatus frame_decode(FrameDecoder *d, const char *text, size_t len);
+
+/* End of input: finishes a trailer line that had no line break. */
+FrameStatus frame_decode_end(FrameDecoder *d);
+
+const char *frame_status_message(FrameStatus s);
+
+#endif // FRAME_H
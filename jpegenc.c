@@ -0,0 +1,385 @@
+/*
+ * ImagePaster - jpegenc.c
+ *
+ * RGB to baseline JPEG encoding (see jpegenc.h).
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jpegenc.h"
+#include "arena.h"
+
+/* Zigzag position k -> natural (row-major) coefficient index */
+static const uint8_t g_natural[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/* Annex K.1 quantization tables, natural order */
+static const uint8_t g_lumaQuant[64] = {
+    16, 11, 10, 16,  24,  40,  51,  61,  12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,  14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,  24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,  72, 92, 95, 98, 112, 100, 103,  99
+};
+
+static const uint8_t g_chromaQuant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,  18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,  47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,  99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,  99, 99, 99, 99, 99, 99, 99, 99
+};
+
+/* Annex K.3 Huffman tables: code counts per length 1..16, then symbols */
+static const uint8_t g_dcLumaBits[16]   = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t g_dcChromaBits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t g_dcVals[12]       = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t g_acLumaBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7D };
+static const uint8_t g_acLumaVals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1, 0xF0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7,
+    0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4, 0xC5,
+    0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE1, 0xE2,
+    0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA
+};
+
+static const uint8_t g_acChromaBits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t g_acChromaVals[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52, 0xF0,
+    0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1, 0x17, 0x18, 0x19, 0x1A, 0x26,
+    0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4A, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5,
+    0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3,
+    0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA,
+    0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8,
+    0xF9, 0xFA
+};
+
+/* AAN DCT output scale factors: cos(k*pi/16) * sqrt(2), k > 0 */
+static const float g_aanScale[8] = {
+    1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+    1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+};
+
+typedef struct {
+    uint16_t code[256];
+    uint8_t  size[256];
+} HuffTable;
+
+typedef struct {
+    ByteBuf  *out;
+    uint32_t  bits;
+    int       count;
+} BitWriter;
+
+/* ── Tables ────────────────────────────────────────────────────────────── */
+
+static void build_huffman(HuffTable *t, const uint8_t bits[16], const uint8_t *vals)
+{
+    uint16_t code = 0;
+    int k = 0;
+    memset(t, 0, sizeof(*t));
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++, k++) {
+            t->code[vals[k]] = code++;
+            t->size[vals[k]] = (uint8_t)len;
+        }
+        code <<= 1;
+    }
+}
+
+/* Scales a base table by the IJG quality curve; returns it in zigzag order
+ * for DQT and fills the DCT-domain divisors in natural order. */
+static void build_quant(const uint8_t base[64], int quality, uint8_t zigzag[64], float divisor[64])
+{
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    uint8_t q[64];
+    for (int i = 0; i < 64; i++) {
+        int v = (base[i] * scale + 50) / 100;
+        q[i] = (uint8_t)(v < 1 ? 1 : v > 255 ? 255 : v);
+    }
+    for (int k = 0; k < 64; k++) zigzag[k] = q[g_natural[k]];
+    for (int row = 0; row < 8; row++) {
+        for (int col = 0; col < 8; col++) {
+            divisor[row * 8 + col] =
+                1.0f / ((float)q[row * 8 + col] * g_aanScale[row] * g_aanScale[col] * 8.0f);
+        }
+    }
+}
+
+/* ── Bit output ────────────────────────────────────────────────────────── */
+
+static void put_bits(BitWriter *w, uint32_t value, int len)
+{
+    w->bits = (w->bits << len) | (value & ((1u << len) - 1));
+    w->count += len;
+    while (w->count >= 8) {
+        uint8_t b = (uint8_t)(w->bits >> (w->count - 8));
+        bb_put_u8(w->out, b);
+        if (b == 0xFF) bb_put_u8(w->out, 0);   /* byte stuffing */
+        w->count -= 8;
+    }
+    w->bits &= (1u << w->count) - 1;
+}
+
+static void flush_bits(BitWriter *w)
+{
+    if (w->count > 0) put_bits(w, 0x7F, 8 - w->count);   /* pad with 1s */
+}
+
+/* ── DCT and block coding ──────────────────────────────────────────────── */
+
+/* One 8-point AAN forward DCT (Arai, Agui, Nakajima) over d[0], d[s], ... */
+static void fdct8(float *d, int s)
+{
+    float t0 = d[0] + d[7 * s], t7 = d[0] - d[7 * s];
+    float t1 = d[s] + d[6 * s], t6 = d[s] - d[6 * s];
+    float t2 = d[2 * s] + d[5 * s], t5 = d[2 * s] - d[5 * s];
+    float t3 = d[3 * s] + d[4 * s], t4 = d[3 * s] - d[4 * s];
+
+    /* Even part */
+    float t10 = t0 + t3, t13 = t0 - t3;
+    float t11 = t1 + t2, t12 = t1 - t2;
+    d[0] = t10 + t11;
+    d[4 * s] = t10 - t11;
+    float z1 = (t12 + t13) * 0.707106781f;
+    d[2 * s] = t13 + z1;
+    d[6 * s] = t13 - z1;
+
+    /* Odd part */
+    t10 = t4 + t5;
+    t11 = t5 + t6;
+    t12 = t6 + t7;
+    float z5 = (t10 - t12) * 0.382683433f;
+    float z2 = t10 * 0.541196100f + z5;
+    float z4 = t12 * 1.306562965f + z5;
+    float z3 = t11 * 0.707106781f;
+    float z11 = t7 + z3, z13 = t7 - z3;
+    d[5 * s] = z13 + z2;
+    d[3 * s] = z13 - z2;
+    d[s] = z11 + z4;
+    d[7 * s] = z11 - z4;
+}
+
+static int bit_length(int v)
+{
+    int n = 0;
+    if (v < 0) v = -v;
+    while (v) { n++; v >>= 1; }
+    return n;
+}
+
+/* Transforms, quantizes and entropy-codes one level-shifted 8x8 block.
+ * Returns the block's DC value for the next prediction. */
+static int encode_block(BitWriter *w, float blk[64], const float divisor[64], int prevDc,
+                        const HuffTable *dc, const HuffTable *ac)
+{
+    int zz[64];
+
+    for (int r = 0; r < 8; r++) fdct8(blk + r * 8, 1);
+    for (int c = 0; c < 8; c++) fdct8(blk + c, 8);
+    for (int k = 0; k < 64; k++) {
+        float v = blk[g_natural[k]] * divisor[g_natural[k]];
+        zz[k] = (int)(v < 0 ? ceilf(v - 0.5f) : floorf(v + 0.5f));
+    }
+
+    int diff = zz[0] - prevDc;
+    int n = bit_length(diff);
+    put_bits(w, dc->code[n], dc->size[n]);
+    if (n) put_bits(w, (uint32_t)(diff < 0 ? diff - 1 : diff), n);
+
+    int last = 63;
+    while (last > 0 && zz[last] == 0) last--;
+    for (int k = 1, run = 0; k <= last; k++) {
+        if (zz[k] == 0) { run++; continue; }
+        while (run >= 16) {
+            put_bits(w, ac->code[0xF0], ac->size[0xF0]);   /* ZRL */
+            run -= 16;
+        }
+        n = bit_length(zz[k]);
+        int sym = (run << 4) | n;
+        put_bits(w, ac->code[sym], ac->size[sym]);
+        put_bits(w, (uint32_t)(zz[k] < 0 ? zz[k] - 1 : zz[k]), n);
+        run = 0;
+    }
+    if (last < 63) put_bits(w, ac->code[0x00], ac->size[0x00]);   /* EOB */
+    return zz[0];
+}
+
+/* ── Headers ───────────────────────────────────────────────────────────── */
+
+static void put_be16(ByteBuf *out, unsigned v)
+{
+    bb_put_u8(out, (uint8_t)(v >> 8));
+    bb_put_u8(out, (uint8_t)v);
+}
+
+static void put_dht(ByteBuf *out, int classId, const uint8_t bits[16], const uint8_t *vals)
+{
+    int count = 0;
+    for (int i = 0; i < 16; i++) count += bits[i];
+    bb_put_u8(out, (uint8_t)classId);
+    bb_append(out, bits, 16);
+    bb_append(out, vals, (size_t)count);
+}
+
+static void write_headers(ByteBuf *out, const RgbRowSource *img, int subsample,
+                          const uint8_t lumaQ[64], const uint8_t chromaQ[64])
+{
+    static const uint8_t jfif[] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+
+    put_be16(out, 0xFFD8);                          /* SOI */
+    put_be16(out, 0xFFE0);                          /* APP0 */
+    put_be16(out, 2 + sizeof(jfif));
+    bb_append(out, jfif, sizeof(jfif));
+
+    put_be16(out, 0xFFDB);                          /* DQT, both tables */
+    put_be16(out, 2 + 2 * 65);
+    bb_put_u8(out, 0);
+    bb_append(out, lumaQ, 64);
+    bb_put_u8(out, 1);
+    bb_append(out, chromaQ, 64);
+
+    put_be16(out, 0xFFC0);                          /* SOF0 */
+    put_be16(out, 8 + 3 * 3);
+    bb_put_u8(out, 8);
+    put_be16(out, img->height);
+    put_be16(out, img->width);
+    bb_put_u8(out, 3);
+    bb_put_u8(out, 1); bb_put_u8(out, subsample ? 0x22 : 0x11); bb_put_u8(out, 0);
+    bb_put_u8(out, 2); bb_put_u8(out, 0x11); bb_put_u8(out, 1);
+    bb_put_u8(out, 3); bb_put_u8(out, 0x11); bb_put_u8(out, 1);
+
+    put_be16(out, 0xFFC4);                          /* DHT, all four tables */
+    put_be16(out, 2 + 4 * 17 + 12 + 12 + 162 + 162);
+    put_dht(out, 0x00, g_dcLumaBits, g_dcVals);
+    put_dht(out, 0x10, g_acLumaBits, g_acLumaVals);
+    put_dht(out, 0x01, g_dcChromaBits, g_dcVals);
+    put_dht(out, 0x11, g_acChromaBits, g_acChromaVals);
+
+    put_be16(out, 0xFFDA);                          /* SOS */
+    put_be16(out, 6 + 2 * 3);
+    bb_put_u8(out, 3);
+    bb_put_u8(out, 1); bb_put_u8(out, 0x00);
+    bb_put_u8(out, 2); bb_put_u8(out, 0x11);
+    bb_put_u8(out, 3); bb_put_u8(out, 0x11);
+    bb_put_u8(out, 0); bb_put_u8(out, 63); bb_put_u8(out, 0);
+}
+
+/* ── Encoder ───────────────────────────────────────────────────────────── */
+
+#define JPEG_MAX_MCU 16
+#define JPEG_POLL_MCUS 64   /* MCUs between polls of the row source, within an MCU row */
+
+size_t jpeg_working_bytes(uint32_t width)
+{
+    return (size_t)width * 3 * JPEG_MAX_MCU;
+}
+
+int jpeg_encode_rgb(const RgbImage *img, int quality, ByteBuf *out)
+{
+    RgbImageRows rows;
+    rgb_image_rows(&rows, img);
+    return jpeg_encode_rows(&rows.base, quality, out);
+}
+
+int jpeg_encode_rows(RgbRowSource *img, int quality, ByteBuf *out)
+{
+    HuffTable dcY, acY, dcC, acC;
+    uint8_t lumaQ[64], chromaQ[64];
+    float lumaDiv[64], chromaDiv[64];
+    float y[256], cb[256], cr[256], blk[64];
+    BitWriter w = { out, 0, 0 };
+    int prevY = 0, prevCb = 0, prevCr = 0;
+
+    if (img->width == 0 || img->height == 0 ||
+        img->width > JPEG_MAX_DIMENSION || img->height > JPEG_MAX_DIMENSION) return 0;
+    if (quality < 1) quality = 1;
+    if (quality > 100) quality = 100;
+
+    int subsample = quality < 90;
+    unsigned mcu = subsample ? 16 : 8;
+
+    build_huffman(&dcY, g_dcLumaBits, g_dcVals);
+    build_huffman(&acY, g_acLumaBits, g_acLumaVals);
+    build_huffman(&dcC, g_dcChromaBits, g_dcVals);
+    build_huffman(&acC, g_acChromaBits, g_acChromaVals);
+    build_quant(g_lumaQuant, quality, lumaQ, lumaDiv);
+    build_quant(g_chromaQuant, quality, chromaQ, chromaDiv);
+    write_headers(out, img, subsample, lumaQ, chromaQ);
+
+    size_t rowBytes = (size_t)img->width * 3;
+    uint8_t *strip = (uint8_t *)arena_alloc(rowBytes * mcu);
+    const uint8_t *rows[JPEG_MAX_MCU];
+    if (!strip) return 0;
+
+    for (uint32_t my = 0; my < img->height; my += mcu) {
+        /* One MCU row of source lines, the last line repeated past the end */
+        for (unsigned py = 0; py < mcu; py++) {
+            rows[py] = my + py < img->height ? img->row(img, my + py, strip + rowBytes * py)
+                                             : rows[py - 1];
+            if (!rows[py]) {
+                arena_free(strip);
+                return 0;
+            }
+        }
+        for (uint32_t mx = 0; mx < img->width; mx += mcu) {
+            if (img->poll && mx && (mx / mcu) % JPEG_POLL_MCUS == 0 && !img->poll(img)) {
+                arena_free(strip);
+                return 0;
+            }
+            /* Colour-convert the MCU, replicating the last column */
+            for (unsigned py = 0; py < mcu; py++) {
+                const uint8_t *row = rows[py];
+                for (unsigned px = 0; px < mcu; px++) {
+                    uint32_t sx = mx + px < img->width ? mx + px : img->width - 1;
+                    const uint8_t *p = row + (size_t)sx * 3;
+                    float r = p[0], g = p[1], b = p[2];
+                    unsigned i = py * mcu + px;
+                    y[i]  =  0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+                    cb[i] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+                    cr[i] =  0.5f * r - 0.418688f * g - 0.081312f * b;
+                }
+            }
+
+            for (unsigned by = 0; by < mcu; by += 8) {
+                for (unsigned bx = 0; bx < mcu; bx += 8) {
+                    for (unsigned i = 0; i < 64; i++) blk[i] = y[(by + i / 8) * mcu + bx + i % 8];
+                    prevY = encode_block(&w, blk, lumaDiv, prevY, &dcY, &acY);
+                }
+            }
+
+            float *planes[2] = { cb, cr };
+            int *prev[2] = { &prevCb, &prevCr };
+            for (int c = 0; c < 2; c++) {
+                const float *src = planes[c];
+                for (unsigned i = 0; i < 64; i++) {
+                    unsigned r = i / 8, col = i % 8;
+                    blk[i] = subsample
+                        ? 0.25f * (src[(2 * r) * 16 + 2 * col] + src[(2 * r) * 16 + 2 * col + 1] +
+                                   src[(2 * r + 1) * 16 + 2 * col] + src[(2 * r + 1) * 16 + 2 * col + 1])
+                        : src[i];
+                }
+                *prev[c] = encode_block(&w, blk, chromaDiv, *prev[c], &dcC, &acC);
+            }
+        }
+    }
+
+    arena_free(strip);
+    flush_bits(&w);
+    put_be16(out, 0xFFD9);                          /* EOI */
+    return !out->failed;
+}
@@ -0,0 +1,32 @@
+/*
+ * ImagePaster - jpegenc.h
+ *
+ * Baseline JPEG (JFIF) encoder for 8-bit RGB images: YCbCr with the Annex K
+ * quantization tables scaled by quality, an AAN floating-point DCT and the
+ * standard Huffman tables. Chroma is subsampled 2x2 below quality 90 and
+ * kept at full resolution from 90 up, where text edges matter more.
+ *
+ * Rows are pulled from an RgbRowSource one MCU row (8 or 16 lines) at a time.
+ */
+
+#ifndef JPEGENC_H
+#define JPEGENC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bytebuf.h"
+#include "dib.h"
+
+#define JPEG_DEFAULT_QUALITY 85
+#define JPEG_MAX_DIMENSION   65535
+
+/* Appends a complete JPEG file to `out`; quality is 1..100. Returns 0 on
+ * failure (out of memory, or a side longer than JPEG_MAX_DIMENSION). */
+int jpeg_encode_rgb(const RgbImage *img, int quality, ByteBuf *out);
+int jpeg_encode_rows(RgbRowSource *src, int quality, ByteBuf *out);
+
+/* Memory the encoder allocates for an image `width` pixels wide, output
+ * excluded: one MCU row of source pixels. */
+size_t jpeg_working_bytes(uint32_t width);
+
+#endif // JPEGENC_H
@@ -0,0 +1,527 @@
+/*
+ * ImagePaster - json.c
+ *
+ * Streaming JSON writer and pull reader (see json.h).
+ */
+
+#include <string.h>
+#include "json.h"
+
+/* ── Writer ──────────────────────────────────────────────────────────── */
+
+void jw_init(JsonWriter *w, ByteBuf *out)
+{
+    memset(w, 0, sizeof(*w));
+    w->out = out;
+}
+
+/* Writes the separator a new value or key needs at the current position. */
+static void jw_separate(JsonWriter *w)
+{
+    if (w->afterKey) {
+        w->afterKey = 0;
+        return;
+    }
+    if (w->depth > 0) {
+        if (!w->empty[w->depth - 1]) bb_put_u8(w->out, ',');
+        w->empty[w->depth - 1] = 0;
+    }
+}
+
+static void jw_open(JsonWriter *w, uint8_t c)
+{
+    jw_separate(w);
+    if (w->depth >= JSON_MAX_DEPTH) {
+        w->error = 1;
+        return;
+    }
+    bb_put_u8(w->out, c);
+    w->empty[w->depth++] = 1;
+}
+
+static void jw_close(JsonWriter *w, uint8_t c)
+{
+    if (w->depth == 0 || w->afterKey) {
+        w->error = 1;
+        return;
+    }
+    w->depth--;
+    bb_put_u8(w->out, c);
+}
+
+void jw_begin_object(JsonWriter *w) { jw_open(w, '{'); }
+void jw_end_object(JsonWriter *w)   { jw_close(w, '}'); }
+void jw_begin_array(JsonWriter *w)  { jw_open(w, '['); }
+void jw_end_array(JsonWriter *w)    { jw_close(w, ']'); }
+
+/* Appends the string body with escapes. Runs of plain bytes are copied in
+ * one append. U+2028 and U+2029 are escaped too, so the output can be
+ * embedded in script source. */
+static void jw_escaped(ByteBuf *b, const uint8_t *s, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t run = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = s[i];
+        char esc[6];
+        size_t escLen = 2;
+        size_t skip = 0;
+
+        if (c >= 0x20 && c != '"' && c != '\\' && c != 0xE2) continue;
+        if (c == 0xE2) {
+            if (i + 2 >= len || s[i + 1] != 0x80 || (s[i + 2] != 0xA8 && s[i + 2] != 0xA9)) continue;
+            memcpy(esc, s[i + 2] == 0xA8 ? "\\u2028" : "\\u2029", 6);
+            escLen = 6;
+            skip = 2;
+        } else {
+            esc[0] = '\\';
+            switch (c) {
+            case '"':  esc[1] = '"'; break;
+            case '\\': esc[1] = '\\'; break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            case '\b': esc[1] = 'b'; break;
+            case '\f': esc[1] = 'f'; break;
+            default:
+                memcpy(esc, "\\u00", 4);
+                esc[4] = hex[c >> 4];
+                esc[5] = hex[c & 15];
+                escLen = 6;
+                break;
+            }
+        }
+        bb_append(b, s + run, i - run);
+        bb_append(b, esc, escLen);
+        i += skip;
+        run = i + 1;
+    }
+    bb_append(b, s + run, len - run);
+}
+
+void jw_key(JsonWriter *w, const char *key)
+{
+    if (w->afterKey) w->error = 1;
+    jw_separate(w);
+    bb_put_u8(w->out, '"');
+    jw_escaped(w->out, (const uint8_t *)key, strlen(key));
+    bb_append(w->out, "\":", 2);
+    w->afterKey = 1;
+}
+
+void jw_string_n(JsonWriter *w, const char *s, size_t len)
+{
+    jw_separate(w);
+    bb_put_u8(w->out, '"');
+    jw_escaped(w->out, (const uint8_t *)s, len);
+    bb_put_u8(w->out, '"');
+}
+
+void jw_string(JsonWriter *w, const char *s)
+{
+    jw_string_n(w, s, strlen(s));
+}
+
+/* Formats v right-aligned in buf[0..21); returns the first character. */
+static char *format_number(char buf[21], uint64_t v, int negative)
+{
+    char *p = buf + 21;
+    do {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (negative) *--p = '-';
+    return p;
+}
+
+void jw_uint(JsonWriter *w, uint64_t v)
+{
+    char buf[21];
+    char *p = format_number(buf, v, 0);
+    jw_separate(w);
+    bb_append(w->out, p, (size_t)(buf + 21 - p));
+}
+
+void jw_int(JsonWriter *w, int64_t v)
+{
+    char buf[21];
+    char *p = v < 0 ? format_number(buf, (uint64_t)0 - (uint64_t)v, 1)
+                    : format_number(buf, (uint64_t)v, 0);
+    jw_separate(w);
+    bb_append(w->out, p, (size_t)(buf + 21 - p));
+}
+
+void jw_bool(JsonWriter *w, int v)
+{
+    jw_separate(w);
+    if (v) bb_append(w->out, "true", 4);
+    else   bb_append(w->out, "false", 5);
+}
+
+void jw_null(JsonWriter *w)
+{
+    jw_separate(w);
+    bb_append(w->out, "null", 4);
+}
+
+void jw_raw(JsonWriter *w, const char *json, size_t len)
+{
+    jw_separate(w);
+    bb_append(w->out, json, len);
+}
+
+int jw_ok(const JsonWriter *w)
+{
+    return !w->error && !w->out->failed && w->depth == 0 && !w->afterKey;
+}
+
+/* ── Reader ──────────────────────────────────────────────────────────── */
+
+enum {
+    RS_VALUE,           /* a value: document start, after ':' or an array ',' */
+    RS_VALUE_OR_END,    /* after '[' */
+    RS_KEY_OR_END,      /* after '{' */
+    RS_KEY,             /* after an object ',' */
+    RS_COLON,           /* after a key */
+    RS_AFTER,           /* after a value */
+    RS_DONE,
+    RS_FAILED
+};
+
+void jr_init(JsonReader *r, const char *text, size_t len)
+{
+    memset(r, 0, sizeof(*r));
+    r->p = text;
+    r->end = text + len;
+    r->state = RS_VALUE;
+}
+
+static void jr_space(JsonReader *r)
+{
+    while (r->p < r->end && (*r->p == ' ' || *r->p == '\n' || *r->p == '\r' || *r->p == '\t'))
+        r->p++;
+}
+
+static int is_hex(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static int is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static JsonToken jr_fail(JsonReader *r)
+{
+    r->state = RS_FAILED;
+    return JSON_ERROR;
+}
+
+/* Scans a string starting at the opening quote. */
+static JsonToken jr_scan_string(JsonReader *r, JsonToken kind)
+{
+    const char *p = r->p + 1;
+    r->escaped = 0;
+    while (p < r->end && *p != '"') {
+        unsigned char c = (unsigned char)*p;
+        if (c < 0x20) return jr_fail(r);
+        if (c == '\\') {
+            if (++p >= r->end) return jr_fail(r);
+            r->escaped = 1;
+            if (*p == 'u') {
+                if (r->end - p < 5) return jr_fail(r);
+                for (int i = 1; i <= 4; i++)
+                    if (!is_hex(p[i])) return jr_fail(r);
+                p += 4;
+            } else if (!strchr("\"\\/bfnrt", *p) || *p == '\0') {
+                return jr_fail(r);
+            }
+        }
+        p++;
+    }
+    if (p >= r->end) return jr_fail(r);
+    r->tok = r->p + 1;
+    r->tokLen = (size_t)(p - r->tok);
+    r->p = p + 1;
+    return kind;
+}
+
+static JsonToken jr_scan_number(JsonReader *r)
+{
+    const char *p = r->p;
+    if (p < r->end && *p == '-') p++;
+    if (p >= r->end || !is_digit(*p)) return jr_fail(r);
+    if (*p == '0') p++;
+    else while (p < r->end && is_digit(*p)) p++;
+    if (p < r->end && *p == '.') {
+        p++;
+        if (p >= r->end || !is_digit(*p)) return jr_fail(r);
+        while (p < r->end && is_digit(*p)) p++;
+    }
+    if (p < r->end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < r->end && (*p == '+' || *p == '-')) p++;
+        if (p >= r->end || !is_digit(*p)) return jr_fail(r);
+        while (p < r->end && is_digit(*p)) p++;
+    }
+    r->tok = r->p;
+    r->tokLen = (size_t)(p - r->p);
+    r->p = p;
+    return JSON_NUMBER;
+}
+
+static JsonToken jr_scan_literal(JsonReader *r, const char *word, JsonToken kind)
+{
+    size_t n = strlen(word);
+    if ((size_t)(r->end - r->p) < n || memcmp(r->p, word, n) != 0) return jr_fail(r);
+    r->tok = r->p;
+    r->tokLen = n;
+    r->p += n;
+    return kind;
+}
+
+static JsonToken jr_value(JsonReader *r)
+{
+    if (r->p >= r->end) return jr_fail(r);
+    r->state = RS_AFTER;
+    switch (*r->p) {
+    case '{':
+    case '[':
+        if (r->depth >= JSON_MAX_DEPTH) return jr_fail(r);
+        r->stack[r->depth++] = (uint8_t)*r->p;
+        r->tok = r->p++;
+        r->tokLen = 1;
+        if (*r->tok == '{') {
+            r->state = RS_KEY_OR_END;
+            return JSON_OBJECT;
+        }
+        r->state = RS_VALUE_OR_END;
+        return JSON_ARRAY;
+    case '"': return jr_scan_string(r, JSON_STRING);
+    case 't': return jr_scan_literal(r, "true", JSON_TRUE);
+    case 'f': return jr_scan_literal(r, "false", JSON_FALSE);
+    case 'n': return jr_scan_literal(r, "null", JSON_NULL);
+    default:  return jr_scan_number(r);
+    }
+}
+
+/* Closes the innermost container if `c` matches it. */
+static JsonToken jr_close(JsonReader *r, char c)
+{
+    char open = c == '}' ? '{' : '[';
+    if (r->depth == 0 || r->stack[r->depth - 1] != (uint8_t)open) return jr_fail(r);
+    r->depth--;
+    r->tok = r->p++;
+    r->tokLen = 1;
+    r->state = RS_AFTER;
+    return c == '}' ? JSON_OBJECT_END : JSON_ARRAY_END;
+}
+
+static JsonToken jr_key(JsonReader *r)
+{
+    if (r->p >= r->end || *r->p != '"') return jr_fail(r);
+    JsonToken t = jr_scan_string(r, JSON_KEY);
+    if (t == JSON_KEY) r->state = RS_COLON;
+    return t;
+}
+
+JsonToken jr_next(JsonReader *r)
+{
+    jr_space(r);
+    switch (r->state) {
+    case RS_VALUE:
+        return jr_value(r);
+
+    case RS_VALUE_OR_END:
+        if (r->p < r->end && *r->p == ']') return jr_close(r, ']');
+        return jr_value(r);
+
+    case RS_KEY_OR_END:
+        if (r->p < r->end && *r->p == '}') return jr_close(r, '}');
+        return jr_key(r);
+
+    case RS_KEY:
+        return jr_key(r);
+
+    case RS_COLON:
+        if (r->p >= r->end || *r->p != ':') return jr_fail(r);
+        r->p++;
+        jr_space(r);
+        return jr_value(r);
+
+    case RS_AFTER:
+        if (r->depth == 0) {
+            if (r->p != r->end) return jr_fail(r);
+            r->state = RS_DONE;
+            return JSON_END;
+        }
+        if (r->p >= r->end) return jr_fail(r);
+        if (*r->p == '}' || *r->p == ']') return jr_close(r, *r->p);
+        if (*r->p != ',') return jr_fail(r);
+        r->p++;
+        jr_space(r);
+        if (r->stack[r->depth - 1] == '{') return jr_key(r);
+        return jr_value(r);
+
+    case RS_DONE:
+        return JSON_END;
+
+    default:
+        return JSON_ERROR;
+    }
+}
+
+int jr_skip(JsonReader *r, JsonToken t)
+{
+    if (t == JSON_ERROR) return 0;
+    if (t != JSON_OBJECT && t != JSON_ARRAY) return 1;
+    int depth = r->depth;
+    while (r->depth >= depth) {
+        JsonToken n = jr_next(r);
+        if (n == JSON_ERROR || n == JSON_END) return 0;
+    }
+    return 1;
+}
+
+JsonToken jr_find(JsonReader *r, const char *key)
+{
+    for (;;) {
+        JsonToken t = jr_next(r);
+        if (t == JSON_OBJECT_END) return t;
+        if (t != JSON_KEY) return JSON_ERROR;
+        int match = jr_equals(r, key);
+        JsonToken v = jr_next(r);
+        if (match || v == JSON_ERROR) return v;
+        if (!jr_skip(r, v)) return JSON_ERROR;
+    }
+}
+
+static unsigned hex4(const char *p)
+{
+    unsigned v = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        v = v * 16 + (unsigned)(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+    return v;
+}
+
+/* Decoded output: bytes are stored while they fit, cut back to a character
+ * boundary at the first that does not; the length counts everything. */
+typedef struct {
+    char  *out;
+    size_t cap;
+    size_t len;
+    size_t stored;
+    int    full;
+} StringSink;
+
+static void sink_put(StringSink *k, const char *s, size_t n)
+{
+    if (!k->full) {
+        size_t room = k->cap ? k->cap - 1 - k->stored : 0;
+        size_t take = n < room ? n : room;
+        if (take < n) {
+            while (take > 0 && ((unsigned char)s[take] & 0xC0) == 0x80) take--;
+            k->full = 1;
+        }
+        memcpy(k->out + k->stored, s, take);
+        k->stored += take;
+    }
+    k->len += n;
+}
+
+static size_t encode_utf8(unsigned cp, char u[4])
+{
+    if (cp < 0x80) {
+        u[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        u[0] = (char)(0xC0 | (cp >> 6));
+        u[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        u[0] = (char)(0xE0 | (cp >> 12));
+        u[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        u[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    u[0] = (char)(0xF0 | (cp >> 18));
+    u[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    u[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    u[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+size_t jr_string(const JsonReader *r, char *out, size_t cap)
+{
+    const char *p = r->tok, *end = r->tok + r->tokLen;
+    StringSink k = { out, cap, 0, 0, cap == 0 };
+
+    while (p < end) {
+        if (*p != '\\') {
+            const char *run = p;
+            while (p < end && *p != '\\') p++;
+            sink_put(&k, run, (size_t)(p - run));
+            continue;
+        }
+
+        char c = p[1];
+        p += 2;
+        if (c != 'u') {
+            char one = c == 'b' ? '\b' : c == 'f' ? '\f' : c == 'n' ? '\n'
+                     : c == 'r' ? '\r' : c == 't' ? '\t' : c;
+            sink_put(&k, &one, 1);
+            continue;
+        }
+
+        unsigned cp = hex4(p);
+        p += 4;
+        if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+            unsigned lo = hex4(p + 2);
+            if (lo >= 0xDC00 && lo < 0xE000) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                p += 6;
+            }
+        }
+        if (cp >= 0xD800 && cp < 0xE000) cp = 0xFFFD;   /* lone surrogate */
+
+        char u[4];
+        sink_put(&k, u, encode_utf8(cp, u));
+    }
+    if (cap) out[k.stored] = '\0';
+    return k.len;
+}
+
+int jr_equals(const JsonReader *r, const char *s)
+{
+    size_t n = strlen(s);
+    if (!r->escaped) return r->tokLen == n && memcmp(r->tok, s, n) == 0;
+
+    char buf[256];
+    if (n >= sizeof(buf)) return 0;
+    return jr_string(r, buf, sizeof(buf)) == n && memcmp(buf, s, n) == 0;
+}
+
+int jr_int64(const JsonReader *r, int64_t *out)
+{
+    const char *p = r->tok, *end = r->tok + r->tokLen;
+    int neg = 0;
+    uint64_t v = 0;
+
+    if (p < end && *p == '-') { neg = 1; p++; }
+    if (p >= end) return 0;
+    for (; p < end; p++) {
+        if (!is_digit(*p)) return 0;      /* fraction or exponent */
+        unsigned d = (unsigned)(*p - '0');
+        if (v > (UINT64_MAX - d) / 10) return 0;
+        v = v * 10 + d;
+    }
+    if (neg ? v > (uint64_t)INT64_MAX + 1 : v > (uint64_t)INT64_MAX) return 0;
+    *out = neg ? (int64_t)(0 - v) : (int64_t)v;
+    return 1;
+}
@@ -0,0 +1,108 @@
+/*
+ * ImagePaster - json.h
+ *
+ * Streaming JSON for the WebView2 bridge. The writer appends to a ByteBuf as
+ * values are produced, inserting separators and escapes itself; callers may
+ * drain the buffer between values. The reader is a pull parser over a UTF-8
+ * buffer: each jr_next() call returns the next token, with no tree built and
+ * nothing copied until the caller asks for a string's decoded value.
+ *
+ * Both follow RFC 8259. The reader rejects malformed input (trailing commas,
+ * unescaped control characters, bad escapes, unbalanced brackets) with
+ * JSON_ERROR instead of guessing. Plain C with no Win32 dependency.
+ */
+
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bytebuf.h"
+
+#define JSON_MAX_DEPTH 32
+
+/* ── Writer ──────────────────────────────────────────────────────────── */
+
+typedef struct {
+    ByteBuf *out;
+    int      depth;
+    int      error;                    /* misuse, e.g. nesting too deep */
+    uint8_t  empty[JSON_MAX_DEPTH];    /* no member written at this level yet */
+    uint8_t  afterKey;                 /* a key was written, its value is next */
+} JsonWriter;
+
+void jw_init(JsonWriter *w, ByteBuf *out);
+
+void jw_begin_object(JsonWriter *w);
+void jw_end_object(JsonWriter *w);
+void jw_begin_array(JsonWriter *w);
+void jw_end_array(JsonWriter *w);
+
+/* Object member name; the next call writes its value. */
+void jw_key(JsonWriter *w, const char *key);
+
+/* UTF-8 strings; bytes are passed through, only escapes are added. */
+void jw_string(JsonWriter *w, const char *s);
+void jw_string_n(JsonWriter *w, const char *s, size_t len);
+void jw_int(JsonWriter *w, int64_t v);
+void jw_uint(JsonWriter *w, uint64_t v);
+void jw_bool(JsonWriter *w, int v);
+void jw_null(JsonWriter *w);
+
+/* A value that is already JSON text. */
+void jw_raw(JsonWriter *w, const char *json, size_t len);
+
+/* True if everything was written, balanced and without running out of memory. */
+int  jw_ok(const JsonWriter *w);
+
+/* ── Reader ──────────────────────────────────────────────────────────── */
+
+typedef enum {
+    JSON_ERROR = -1,
+    JSON_END = 0,          /* the document is complete */
+    JSON_OBJECT,
+    JSON_OBJECT_END,
+    JSON_ARRAY,
+    JSON_ARRAY_END,
+    JSON_KEY,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL
+} JsonToken;
+
+typedef struct {
+    const char *p, *end;
+    int         depth;
+    int         state;
+    uint8_t     stack[JSON_MAX_DEPTH];   /* '{' or '[' per open container */
+    /* Current token: raw text, without the quotes for strings */
+    const char *tok;
+    size_t      tokLen;
+    int         escaped;                 /* string contains escapes */
+} JsonReader;
+
+void      jr_init(JsonReader *r, const char *text, size_t len);
+JsonToken jr_next(JsonReader *r);
+
+/* After JSON_OBJECT or JSON_ARRAY, consumes the rest of that container; any
+ * other token is already complete. Returns 0 on malformed input. */
+int       jr_skip(JsonReader *r, JsonToken t);
+
+/* Inside an object just entered (or after a member's value), skips members
+ * until `key` and returns its value's token. Returns JSON_OBJECT_END if the
+ * object has no such key, leaving the reader after the object. */
+JsonToken jr_find(JsonReader *r, const char *key);
+
+/* Decodes the current JSON_KEY or JSON_STRING as NUL-terminated UTF-8,
+ * truncated to fit `cap`. Returns the full decoded length. */
+size_t    jr_string(const JsonReader *r, char *out, size_t cap);
+
+/* True if the current key or string decodes to exactly `s`. */
+int       jr_equals(const JsonReader *r, const char *s);
+
+/* The current JSON_NUMBER, if it is an integer that fits. */
+int       jr_int64(const JsonReader *r, int64_t *out);
+
+#endif // JSON_H
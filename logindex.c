@@ -0,0 +1,424 @@
+/*
+ * ImagePaster - logindex.c
+ *
+ * Trigram index over the Activity Log (see logindex.h).
+ */
+
+#include "logindex.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define POSTING_BLOCK   6           /* entry offsets per block: 16-byte blocks */
+#define TABLE_MIN_BITS  10          /* trigram slots in a new segment: 1024 */
+#define BLOCKS_MIN      1024
+#define TRIGRAM_USED    0x1000000u  /* marks a table slot taken; trigrams are 24 bits */
+#define NO_BLOCK        0xFFFFFFFFu
+
+/* A posting list is a chain of blocks in its segment's pool; every block
+ * but the last is full. Offsets within the segment fit 16 bits. */
+typedef struct {
+    uint32_t next;
+    uint16_t item[POSTING_BLOCK];
+} PostingBlock;
+
+typedef struct {
+    uint32_t key;           /* trigram | TRIGRAM_USED, 0 = free */
+    uint32_t head;
+    uint32_t tail;
+    uint32_t count;
+} Posting;
+
+struct LogSegment {
+    uint32_t      firstSeq;
+    uint32_t      count;
+    uint64_t      minTime, maxTime;
+    Posting      *table;        /* open addressing, 1 << tableBits slots */
+    uint32_t      tableBits;
+    uint32_t      tableUsed;
+    PostingBlock *blocks;
+    uint32_t      blockCount;
+    uint32_t      blockCap;
+    uint64_t      times[LOG_INDEX_SEGMENT];
+};
+
+/* Reads one posting list in order */
+typedef struct {
+    const LogSegment *seg;
+    const Posting    *list;
+    uint32_t          block;
+    uint32_t          pos;      /* of the next item in the list */
+} Cursor;
+
+static unsigned char fold(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c + 32) : c;
+}
+
+static uint32_t slot_of(uint32_t key, uint32_t bits)
+{
+    return (key * 0x9E3779B1u) >> (32 - bits);
+}
+
+/* ── Segments ──────────────────────────────────────────────────────────── */
+
+static LogSegment *segment_new(uint32_t firstSeq)
+{
+    LogSegment *s = (LogSegment *)malloc(sizeof(LogSegment));
+    if (!s) return NULL;
+    memset(s, 0, offsetof(LogSegment, times));
+    s->firstSeq = firstSeq;
+    s->tableBits = TABLE_MIN_BITS;
+    s->table = (Posting *)calloc((size_t)1 << s->tableBits, sizeof(Posting));
+    s->blockCap = BLOCKS_MIN;
+    s->blocks = (PostingBlock *)malloc(s->blockCap * sizeof(PostingBlock));
+    if (!s->table || !s->blocks) {
+        free(s->table);
+        free(s->blocks);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static void segment_free(LogSegment *s)
+{
+    if (!s) return;
+    free(s->table);
+    free(s->blocks);
+    free(s);
+}
+
+static const Posting *segment_find(const LogSegment *s, uint32_t trigram)
+{
+    uint32_t key = trigram | TRIGRAM_USED, mask = (1u << s->tableBits) - 1;
+    for (uint32_t i = slot_of(key, s->tableBits);; i = (i + 1) & mask) {
+        if (s->table[i].key == key) return &s->table[i];
+        if (s->table[i].key == 0) return NULL;
+    }
+}
+
+/* Doubles the table once it is three quarters full */
+static int segment_grow_table(LogSegment *s)
+{
+    uint32_t bits = s->tableBits + 1, mask = (1u << bits) - 1;
+    Posting *table = (Posting *)calloc((size_t)1 << bits, sizeof(Posting));
+    if (!table) return 0;
+    for (uint32_t i = 0; i < (1u << s->tableBits); i++) {
+        if (!s->table[i].key) continue;
+        uint32_t j = slot_of(s->table[i].key, bits);
+        while (table[j].key) j = (j + 1) & mask;
+        table[j] = s->table[i];
+    }
+    free(s->table);
+    s->table = table;
+    s->tableBits = bits;
+    return 1;
+}
+
+static Posting *segment_posting(LogSegment *s, uint32_t trigram)
+{
+    if ((s->tableUsed + 1) * 4 > (3u << s->tableBits) && !segment_grow_table(s)) return NULL;
+    uint32_t key = trigram | TRIGRAM_USED, mask = (1u << s->tableBits) - 1;
+    uint32_t i = slot_of(key, s->tableBits);
+    while (s->table[i].key && s->table[i].key != key) i = (i + 1) & mask;
+    if (!s->table[i].key) {
+        s->table[i].key = key;
+        s->table[i].count = 0;
+        s->tableUsed++;
+    }
+    return &s->table[i];
+}
+
+static int posting_add(LogSegment *s, Posting *p, uint16_t item)
+{
+    uint32_t at = p->count % POSTING_BLOCK;
+    if (p->count && s->blocks[p->tail].item[(p->count - 1) % POSTING_BLOCK] == item)
+        return 1;   /* the trigram occurs twice in the entry */
+    if (at == 0) {
+        if (s->blockCount == s->blockCap) {
+            PostingBlock *grown = (PostingBlock *)realloc(s->blocks, 2 * s->blockCap * sizeof(PostingBlock));
+            if (!grown) return 0;
+            s->blocks = grown;
+            s->blockCap *= 2;
+        }
+        uint32_t b = s->blockCount++;
+        s->blocks[b].next = NO_BLOCK;
+        if (p->count) s->blocks[p->tail].next = b;
+        else p->head = b;
+        p->tail = b;
+    }
+    s->blocks[p->tail].item[at] = item;
+    p->count++;
+    return 1;
+}
+
+static int segment_add(LogSegment *s, uint64_t time, const char *text)
+{
+    uint16_t item = (uint16_t)s->count;
+    uint32_t trigram = 0;
+    int n = 0;
+
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+        trigram = ((trigram << 8) | fold(*c)) & 0xFFFFFFu;
+        if (++n < 3) continue;
+        Posting *p = segment_posting(s, trigram);
+        if (!p || !posting_add(s, p, item)) return 0;
+    }
+    s->times[item] = time;
+    if (s->count == 0 || time < s->minTime) s->minTime = time;
+    if (s->count == 0 || time > s->maxTime) s->maxTime = time;
+    s->count++;
+
+    /* Full: nothing more is added, so the pool gives back its slack */
+    if (s->count == LOG_INDEX_SEGMENT && s->blockCount < s->blockCap) {
+        PostingBlock *fit = (PostingBlock *)realloc(s->blocks, s->blockCount * sizeof(PostingBlock));
+        if (fit) {
+            s->blocks = fit;
+            s->blockCap = s->blockCount;
+        }
+    }
+    return 1;
+}
+
+/* ── Index ─────────────────────────────────────────────────────────────── */
+
+void log_index_init(LogIndex *ix)
+{
+    memset(ix, 0, sizeof(*ix));
+}
+
+static void log_index_clear(LogIndex *ix)
+{
+    for (size_t i = 0; i < ix->segCount; i++) segment_free(ix->segs[i]);
+    ix->segCount = 0;
+}
+
+void log_index_free(LogIndex *ix)
+{
+    log_index_clear(ix);
+    free(ix->segs);
+    log_index_init(ix);
+}
+
+int log_index_add(LogIndex *ix, uint32_t seq, uint64_t time, const char *text)
+{
+    if (ix->segCount && seq != ix->nextSeq) log_index_clear(ix);
+    if (!ix->segCount) ix->firstSeq = seq;
+
+    LogSegment *s = ix->segCount ? ix->segs[ix->segCount - 1] : NULL;
+    if (!s || s->count == LOG_INDEX_SEGMENT) {
+        if (ix->segCount == ix->segCap) {
+            size_t cap = ix->segCap ? ix->segCap * 2 : 8;
+            LogSegment **segs = (LogSegment **)realloc(ix->segs, cap * sizeof(LogSegment *));
+            if (!segs) goto fail;
+            ix->segs = segs;
+            ix->segCap = cap;
+        }
+        s = segment_new(seq);
+        if (!s) goto fail;
+        ix->segs[ix->segCount++] = s;
+    }
+    if (!segment_add(s, time, text)) goto fail;
+    ix->nextSeq = seq + 1;
+    return 1;
+
+fail:
+    log_index_clear(ix);
+    return 0;
+}
+
+void log_index_drop_before(LogIndex *ix, uint32_t seq)
+{
+    if (!ix->segCount || (int32_t)(seq - ix->firstSeq) <= 0) return;
+    if ((int32_t)(seq - ix->nextSeq) > 0) seq = ix->nextSeq;
+    ix->firstSeq = seq;
+
+    size_t gone = 0;
+    while (gone < ix->segCount && seq - ix->segs[gone]->firstSeq >= ix->segs[gone]->count) {
+        segment_free(ix->segs[gone]);
+        gone++;
+    }
+    memmove(ix->segs, ix->segs + gone, (ix->segCount - gone) * sizeof(LogSegment *));
+    ix->segCount -= gone;
+}
+
+size_t log_index_count(const LogIndex *ix)
+{
+    return ix->segCount ? ix->nextSeq - ix->firstSeq : 0;
+}
+
+size_t log_index_memory_bytes(const LogIndex *ix)
+{
+    size_t bytes = ix->segCap * sizeof(LogSegment *);
+    for (size_t i = 0; i < ix->segCount; i++) {
+        const LogSegment *s = ix->segs[i];
+        bytes += sizeof(LogSegment) + ((size_t)sizeof(Posting) << s->tableBits) +
+                 (size_t)s->blockCap * sizeof(PostingBlock);
+    }
+    return bytes;
+}
+
+/* ── Queries ───────────────────────────────────────────────────────────── */
+
+void log_query_parse(LogQuery *q, const char *text)
+{
+    memset(q, 0, sizeof(*q));
+    const char *p = text;
+    while (*p && q->termCount < LOG_QUERY_MAX_TERMS) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+        char end = ' ';
+        if (*p == '"') {
+            end = '"';
+            p++;
+        }
+        char *term = q->terms[q->termCount];
+        size_t len = 0;
+        for (; *p && *p != end && !(end == ' ' && *p == '\t'); p++) {
+            if (len < LOG_QUERY_TERM_MAX - 1) term[len++] = (char)fold((unsigned char)*p);
+        }
+        if (*p == '"') p++;
+        term[len] = '\0';
+        if (len) q->termCount++;
+    }
+}
+
+/* Case-insensitive substring test; `needle` is already folded */
+static int contains_folded(const char *hay, const char *needle)
+{
+    const unsigned char *n = (const unsigned char *)needle;
+    if (!n[0]) return 1;
+    unsigned char lower = n[0], upper = lower >= 'a' && lower <= 'z' ? (unsigned char)(lower - 32) : lower;
+    for (const unsigned char *h = (const unsigned char *)hay; *h; h++) {
+        if (*h != lower && *h != upper) continue;
+        size_t i = 1;
+        while (n[i] && fold(h[i]) == n[i]) i++;
+        if (!n[i]) return 1;
+    }
+    return 0;
+}
+
+static int hits_push(LogHits *h, uint32_t seq)
+{
+    if (h->count == h->cap) {
+        size_t cap = h->cap ? h->cap * 2 : 256;
+        uint32_t *seqs = (uint32_t *)realloc(h->seqs, cap * sizeof(uint32_t));
+        if (!seqs) return 0;
+        h->seqs = seqs;
+        h->cap = cap;
+    }
+    h->seqs[h->count++] = seq;
+    return 1;
+}
+
+static uint32_t cursor_item(const Cursor *c)
+{
+    return c->seg->blocks[c->block].item[c->pos % POSTING_BLOCK];
+}
+
+/* Moves to the first item >= `item`; returns 0 past the end */
+static int cursor_seek(Cursor *c, uint32_t item)
+{
+    while (c->pos < c->list->count) {
+        if (cursor_item(c) >= item) return 1;
+        c->pos++;
+        if (c->pos % POSTING_BLOCK == 0 && c->pos < c->list->count)
+            c->block = c->seg->blocks[c->block].next;
+    }
+    return 0;
+}
+
+static int compare_lists(const void *a, const void *b)
+{
+    uint32_t ca = (*(const Posting *const *)a)->count, cb = (*(const Posting *const *)b)->count;
+    return ca < cb ? -1 : ca > cb;
+}
+
+/* Checks one entry of a segment against the range, the ring and the text */
+static int check_entry(const LogIndex *ix, const LogSegment *s, uint32_t item, const LogQuery *q,
+                       LogTextFn text, void *ctx, LogHits *out)
+{
+    uint32_t seq = s->firstSeq + item;
+    if (seq - ix->firstSeq >= ix->nextSeq - ix->firstSeq) return 1;
+    if ((q->from && s->times[item] < q->from) || (q->to && s->times[item] > q->to)) return 1;
+    const char *message = text(ctx, seq);
+    if (!message) return 1;
+    for (int t = 0; t < q->termCount; t++) {
+        if (!contains_folded(message, q->terms[t])) return 1;
+    }
+    return hits_push(out, seq);
+}
+
+static int search_segment(const LogIndex *ix, const LogSegment *s, const LogQuery *q,
+                          LogTextFn text, void *ctx, LogHits *out)
+{
+    /* Each term is represented by its rarest trigram: the lists of one term
+     * mostly hold the same entries, and every further list costs a seek per
+     * candidate that the text check makes anyway. */
+    const Posting *lists[LOG_QUERY_MAX_TERMS];
+    int n = 0;
+
+    for (int t = 0; t < q->termCount; t++) {
+        const Posting *rarest = NULL;
+        uint32_t trigram = 0;
+        int len = 0;
+        for (const unsigned char *c = (const unsigned char *)q->terms[t]; *c; c++) {
+            trigram = ((trigram << 8) | *c) & 0xFFFFFFu;
+            if (++len < 3) continue;
+            const Posting *p = segment_find(s, trigram);
+            if (!p) return 1;       /* a trigram the segment never saw */
+            if (!rarest || p->count < rarest->count) rarest = p;
+        }
+        int dup = !rarest;
+        for (int i = 0; i < n && !dup; i++) dup = lists[i] == rarest;
+        if (!dup) lists[n++] = rarest;
+    }
+
+    if (n == 0) {
+        /* Only short terms, or none: every entry is a candidate */
+        for (uint32_t item = 0; item < s->count; item++) {
+            if (!check_entry(ix, s, item, q, text, ctx, out)) return 0;
+        }
+        return 1;
+    }
+
+    /* The shortest list drives; the others are only seeked forward */
+    qsort(lists, (size_t)n, sizeof(lists[0]), compare_lists);
+    Cursor cursors[LOG_QUERY_MAX_TERMS];
+    for (int i = 0; i < n; i++) {
+        cursors[i].seg = s;
+        cursors[i].list = lists[i];
+        cursors[i].block = lists[i]->head;
+        cursors[i].pos = 0;
+    }
+    for (; cursors[0].pos < lists[0]->count; ) {
+        uint32_t item = cursor_item(&cursors[0]);
+        int all = 1;
+        for (int i = 1; i < n && all; i++) {
+            if (!cursor_seek(&cursors[i], item)) return 1;
+            all = cursor_item(&cursors[i]) == item;
+        }
+        if (all && !check_entry(ix, s, item, q, text, ctx, out)) return 0;
+        if (!cursor_seek(&cursors[0], item + 1)) break;
+    }
+    return 1;
+}
+
+int log_index_search(const LogIndex *ix, const LogQuery *q, LogTextFn text, void *ctx,
+                     LogHits *out)
+{
+    for (size_t i = 0; i < ix->segCount; i++) {
+        const LogSegment *s = ix->segs[i];
+        if (q->from && s->maxTime < q->from) continue;
+        if (q->to && s->minTime > q->to) continue;
+        if (!search_segment(ix, s, q, text, ctx, out)) return 0;
+    }
+    return 1;
+}
+
+void log_hits_free(LogHits *h)
+{
+    free(h->seqs);
+    h->seqs = NULL;
+    h->count = h->cap = 0;
+}
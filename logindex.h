@@ -0,0 +1,80 @@
+/*
+ * ImagePaster - logindex.h
+ *
+ * Search over the Activity Log. Entries are indexed as they are logged, by
+ * the trigrams of their case-folded text, in segments of LOG_INDEX_SEGMENT
+ * consecutive entries. Each segment keeps a posting list per trigram and the
+ * time range it covers. A query is a list of terms that must all occur
+ * somewhere in the message, plus a time range. Segments outside the range
+ * are skipped, the posting lists of each term's rarest trigram are
+ * intersected, and the entries left are checked against their text. Terms
+ * shorter than a trigram are only checked against the text.
+ *
+ * Entries leave from the oldest end, as the log ring overwrites them, and a
+ * segment is freed once all of its entries have left. The index keeps no
+ * text: the caller's callback provides it for the check.
+ *
+ * Plain C with no Win32 dependency.
+ */
+
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_INDEX_SEGMENT    4096   /* entries per segment */
+#define LOG_QUERY_MAX_TERMS  8
+#define LOG_QUERY_TERM_MAX   64     /* bytes per term, longer ones are cut */
+
+typedef struct LogSegment LogSegment;
+
+typedef struct {
+    LogSegment **segs;          /* oldest first */
+    size_t       segCount;
+    size_t       segCap;
+    uint32_t     firstSeq;      /* oldest entry indexed */
+    uint32_t     nextSeq;       /* the entry after the newest */
+} LogIndex;
+
+typedef struct {
+    char     terms[LOG_QUERY_MAX_TERMS][LOG_QUERY_TERM_MAX];   /* case-folded */
+    int      termCount;
+    uint64_t from, to;          /* inclusive, in the caller's time unit; 0 = open */
+} LogQuery;
+
+/* Matching seqs, oldest first */
+typedef struct {
+    uint32_t *seqs;
+    size_t    count;
+    size_t    cap;
+} LogHits;
+
+/* The message of entry `seq`, or NULL if it is gone. */
+typedef const char *(*LogTextFn)(void *ctx, uint32_t seq);
+
+void   log_index_init(LogIndex *ix);
+void   log_index_free(LogIndex *ix);
+
+/* Indexes entry `seq`. Entries come in order; one that does not follow the
+ * previous one (after the log was cleared) starts the index again. Returns
+ * 0 when out of memory, in which case the index is emptied. */
+int    log_index_add(LogIndex *ix, uint32_t seq, uint64_t time, const char *text);
+
+/* Forgets the entries before `seq`. */
+void   log_index_drop_before(LogIndex *ix, uint32_t seq);
+
+size_t log_index_count(const LogIndex *ix);
+size_t log_index_memory_bytes(const LogIndex *ix);
+
+/* Splits `text` into terms at spaces; "double quotes" keep a phrase
+ * together. The time range is left open. */
+void   log_query_parse(LogQuery *q, const char *text);
+
+/* Appends the entries matching `q` to `out`. Returns 0 when out of memory. */
+int    log_index_search(const LogIndex *ix, const LogQuery *q, LogTextFn text, void *ctx,
+                        LogHits *out);
+
+void   log_hits_free(LogHits *h);
+
+#endif // LOGINDEX_H
@@ -2,14 +2,26 @@
  * ImagePaster - main.c
  *
  * System tray utility that intercepts Ctrl+V when a matching window is focused
- * and the clipboard contains an image. Converts the image to a raw base64-encoded
- * PNG string and pastes that instead.
+ * and the clipboard contains an image. Converts the image to base64-encoded
+ * PNG or JPEG text and pastes that instead.
  *
  * Features:
- *   - Configurable title matching (comma-separated keywords, registry-persisted)
+ *   - Per-application profiles (profile.c) matching the target by executable
+ *     path, window class and title, each rule list compiled into one
+ *     Aho–Corasick automaton by matcher.c, registry-persisted
+ *   - Per-profile encoder settings: format, effort, size budget, text encoding
  *   - WebView2-based configuration and activity log modals
+ *   - Dialog UI served from a precompressed resource pack (uipack.c) on a
+ *     virtual origin, kept loaded between dialogs
+ *   - Title match decided ahead of time on foreground/name-change WinEvents,
+ *     so the keyboard hook never talks to the target window
+ *   - Hook-less paste triggers: a Ctrl+Shift+V hotkey or keyboard Raw Input
  *   - System tray icon with context menu
  *   - In-memory log ring buffer pushed live to the Activity Log view
+ *   - Per-stage QPC latency histograms shown in the Statistics view
+ *   - Opt-in Chrome trace-event span recording (trace.c)
+ *   - Portable DIB -> PNG -> base64 pipeline (pipeline.c), GDI+ decode fallback
+ *   - Opt-in capture of pastes for offline replay (capture.c, tools/replay.c)
  *
  * Cross-compiled with MinGW-w64 using GDI+ flat C API.
  */
@@ -25,11 +37,24 @@
 #include <objbase.h>
 #include <shellapi.h>
 #include <shlobj.h>
+#include <psapi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <limits.h>
 #include "resource.h"
+#include "stats.h"
+#include "trace.h"
+#include "pipeline.h"
+#include "capture.h"
+#include "matcher.h"
+#include "profile.h"
+#include "uipack.h"
+#include "json.h"
+#include "base64.h"
+#include "thumb.h"
+#include "arena.h"
+#include "logindex.h"
 
 /* ── GDI+ flat API declarations ─────────────────────────────────────────── */
 
@@ -46,29 +71,28 @@ typedef struct {
 } GdiplusStartupInput;
 
 typedef struct {
-    CLSID Clsid;
-    GUID  FormatID;
-    const WCHAR *CodecName;
-    const WCHAR *DllName;
-    const WCHAR *FormatDescription;
-    const WCHAR *FilenameExtension;
-    const WCHAR *MimeType;
-    DWORD Flags;
-    DWORD Version;
-    DWORD SigCount;
-    DWORD SigSize;
-    const BYTE *SigPattern;
-    const BYTE *SigMask;
-} ImageCodecInfo;
+    INT X, Y, Width, Height;
+} GpRect;
+
+typedef struct {
+    UINT Width;
+    UINT Height;
+    INT  Stride;
+    INT  PixelFormat;
+    void *Scan0;
+    UINT_PTR Reserved;
+} BitmapData;
 #pragma pack(pop)
 
+#define GP_IMAGE_LOCK_MODE_READ   1
+#define GP_PIXEL_FORMAT_24BPP_RGB 0x00021808   /* B,G,R byte order */
+
 /* GDI+ flat API imports */
 GpStatus __stdcall GdiplusStartup(ULONG_PTR *token, const GdiplusStartupInput *input, void *output);
 void     __stdcall GdiplusShutdown(ULONG_PTR token);
 GpStatus __stdcall GdipCreateBitmapFromGdiDib(const BITMAPINFO *gdiBitmapInfo, void *gdiBitmapData, GpBitmap **bitmap);
-GpStatus __stdcall GdipGetImageEncodersSize(UINT *numEncoders, UINT *size);
-GpStatus __stdcall GdipGetImageEncoders(UINT numEncoders, UINT size, ImageCodecInfo *encoders);
-GpStatus __stdcall GdipSaveImageToStream(GpImage *image, IStream *stream, const CLSID *clsidEncoder, const void *encoderParams);
+GpStatus __stdcall GdipBitmapLockBits(GpBitmap *bitmap, const GpRect *rect, UINT flags, INT format, BitmapData *data);
+GpStatus __stdcall GdipBitmapUnlockBits(GpBitmap *bitmap, BitmapData *data);
 GpStatus __stdcall GdipDisposeImage(GpImage *image);
 GpStatus __stdcall GdipGetImageWidth(GpImage *image, UINT *width);
 GpStatus __stdcall GdipGetImageHeight(GpImage *image, UINT *height);
@@ -79,28 +103,114 @@ GpStatus __stdcall GdipGetImageHeight(GpImage *image, UINT *height);
 #define MUTEX_NAME        L"ImagePaster_SingleInstance"
 #define WM_TRAYICON       (WM_USER + 1)
 #define WM_DO_PASTE       (WM_APP + 1)
+#define WM_HOOK_SLOW      (WM_APP + 2)
+#define WM_CAPTURE_DONE   (WM_APP + 3)
+#define WM_TYPE_DONE      (WM_APP + 4)
+#define WM_JOB_DONE       (WM_APP + 5)
+#define WM_CONFIG_CHANGED (WM_APP + 6)
+#define WM_KEY_BENCH_DONE (WM_APP + 7)
 #define ID_TRAY_LOG       1001
 #define ID_TRAY_CONFIGURE 1002
 #define ID_TRAY_EXIT      1003
+#define ID_TRAY_STATS     1004
+#define ID_TRAY_TRACE     1007
+#define ID_TRAY_TRACE_SAVE 1008
+#define ID_TRAY_CAPTURE    1010
+#define ID_TRAY_CAPTURE_OPEN 1011
+#define ID_TIMER_WEBVIEW_IDLE    1012
+#define ID_TIMER_WEBVIEW_PREWARM 1013
+#define ID_TIMER_IDLE_TRIM       1014
+#define ID_TIMER_CONVERT_PROGRESS 1015
+#define ID_TIMER_HOTKEY_REARM    1016
+#define ID_HOTKEY_PASTE          1
+#define ID_HOTKEY_CANCEL         2      /* Esc, while a paste converts in hotkey mode */
+#define HOTKEY_REARM_MS          50     /* after passing the hotkey on to the window */
+#define IDLE_TRIM_DELAY_MS       30000  /* quiet time before the working set is trimmed */
+#define WEBVIEW_DEFAULT_IDLE_MINUTES 10
+#define WEBVIEW_MAX_IDLE_MINUTES     35791  /* USER_TIMER_MAXIMUM in minutes */
+#define WEBVIEW_PREWARM_DELAY_MS     3000   /* after startup, off the critical path */
+#define GALLERY_DEFAULT_KB 2048     /* about 30 thumbnails */
+#define GALLERY_MAX_KB     65536
+#define PASTE_DEFAULT_MAX_MB 256    /* working memory of one conversion */
+#define PASTE_MAX_MB         4096
+#define PASTE_ARENA_DEFAULT_MB 64   /* most kept committed between pastes */
+#define PASTE_ARENA_MAX_MB     512
+#define PASTE_ARENA_RESERVE  ((size_t)(sizeof(void *) == 8 ? 1024 : 256) * 1024 * 1024)
 #define ID_TIMER_WEBVIEW_SHOW_FALLBACK 1006
+#define UI_ORIGIN L"https://imagepaster.local/"   /* served from IDR_UI_PACK */
+#define WEBVIEW_SHARED_BUFFER_MIN (64 * 1024)     /* smaller payloads go as script */
+#define TRANSFER_BENCH_BYTES (5 * 1024 * 1024)
 #define WEBVIEW_SHOW_FALLBACK_DELAY_MS 350
+#define ID_TIMER_HOOK_WATCHDOG 1009
+#define HOOK_WATCHDOG_INTERVAL_MS   5000
+#define HOOK_PROBE_MIN_INTERVAL_MS  15000
+#define HOOK_SLOW_NOTIFY_INTERVAL_MS 60000
+#define HOOK_DEFAULT_TIMEOUT_MS     300     /* used when LowLevelHooksTimeout is unset */
+#define HOOK_PROBE_VK               0xE8    /* unassigned virtual-key code */
+#define HOOK_PROBE_MAGIC            0x49504B50  /* 'IPKP' in dwExtraInfo */
+#define KEY_BENCH_MAGIC             0x49504B42  /* 'IPKB', passed on by the hook */
+#define KEY_BENCH_KEYS              200     /* presses timed in each half */
+#define KEY_BENCH_TIMEOUT_MS        500     /* for one key to be processed */
 
 #define REG_KEY_PATH       "SOFTWARE\\JPIT\\ImagePaster"
 #define REG_VALUE_TITLE    "TitleMatch"
-
-#define LOG_RING_CAPACITY  500
-#define MAX_KEYWORDS       64
+#define REG_VALUE_TRACE    "TraceEnabled"
+#define REG_VALUE_CAPTURE  "CaptureEnabled"
+#define REG_VALUE_WEBVIEW_IDLE    "WebViewIdleMinutes"
+#define REG_VALUE_WEBVIEW_PREWARM "WebViewPrewarm"
+#define REG_VALUE_GALLERY_KB      "GalleryKB"
+#define REG_VALUE_EAGER_INIT      "EagerInit"
+#define REG_VALUE_MAX_PASTE_MB    "MaxPasteMB"
+#define REG_VALUE_PASTE_ARENA_MB  "PasteArenaMB"
+#define REG_VALUE_SPECULATE       "SpeculativeConvert"
+#define REG_VALUE_LOG_ENTRIES     "LogEntries"
+#define REG_VALUE_TRIGGER         "Trigger"
+
+/* Profiles live in sub-keys of REG_KEY_PROFILES; the default profile's
+ * values sit in REG_KEY_PATH itself, next to the global settings. */
+#define REG_KEY_PROFILES   REG_KEY_PATH "\\Profiles"
+#define REG_VALUE_EXE      "ExeMatch"
+#define REG_VALUE_CLASS    "ClassMatch"
+#define REG_VALUE_FORMAT   "Format"
+#define REG_VALUE_EFFORT   "Effort"
+#define REG_VALUE_QUALITY  "Quality"
+#define REG_VALUE_MAXBYTES "MaxBytes"
+#define REG_VALUE_TEXTENC  "TextEncoding"
+#define REG_VALUE_DELIVERY "Delivery"
+#define REG_VALUE_ROUTE    "Route"
+#define REG_VALUE_ORDER    "Order"
+#define MAX_PROFILES       64
+#define DEFAULT_PROFILE_NAME "Default"
+#define PROCESS_CACHE_SIZE 32
+
+#define LOG_RING_DEFAULT   5000
+#define LOG_RING_MIN       100
+#define LOG_RING_MAX       100000
+#define LOG_RING_INITIAL   32
+#define LOG_VIEW_ENTRIES   500      /* newest entries sent when the view opens */
+#define LOG_PAGE_MAX       1000     /* entries per getLogPage */
+#define DEFAULT_TITLE_MATCH "xshell"
 
 /* ── Log ring buffer ───────────────────────────────────────────────────── */
 
 typedef struct {
+    DWORD seq;         /* increases by one per entry, never reused */
+    DWORD thumb;       /* gallery thumbnail of a pasted image, 0 = none */
     char time[24];     /* HH:MM:SS.mmm */
     char message[512];
 } LogEntry;
 
-static LogEntry g_logRing[LOG_RING_CAPACITY];
+/* Grows to g_logMax entries as messages arrive, so an instance that has
+ * logged little holds little. */
+static LogEntry *g_logRing = NULL;
+static int g_logCap   = 0;   /* entries allocated */
 static int g_logHead  = 0;   /* next write position */
-static int g_logCount = 0;   /* total entries (capped at capacity) */
+static int g_logCount = 0;   /* total entries (capped at g_logCap) */
+static DWORD g_logSeq = 0;   /* seq of the next entry */
+static int g_logMax   = LOG_RING_DEFAULT;   /* LogEntries; the ring never shrinks */
+
+/* Trigram index over the entries in the ring, for the Activity Log search */
+static LogIndex g_logIndex;
 
 /* ── Globals ────────────────────────────────────────────────────────────── */
 
@@ -108,6 +218,8 @@ static HINSTANCE g_hInstance;
 static HWND      g_hWndMain;
 static HHOOK     g_hHook;
 static ULONG_PTR g_gdipToken;
+static BOOL      g_gdipStarted;
+static BOOL      g_comStarted;
 static HANDLE    g_hMutex;
 static HICON     g_hAppIcon;
 static NOTIFYICONDATAW g_nid;
@@ -115,10 +227,166 @@ static HMENU     g_hMenu;
 
 static volatile BOOL g_bSkipNextPaste = FALSE;
 
-/* Title-match configuration */
-static char g_configTitleMatch[2048] = "xshell";
-static WCHAR g_keywords[MAX_KEYWORDS][128];
-static int   g_keywordCount = 0;
+/* How a paste is noticed; see TriggerApply */
+typedef enum {
+    TRIGGER_HOOK,               /* WH_KEYBOARD_LL, Ctrl+V */
+    TRIGGER_HOTKEY,             /* RegisterHotKey, Ctrl+Shift+V */
+    TRIGGER_RAW_INPUT,          /* keyboard Raw Input, Ctrl+V */
+    TRIGGER_COUNT
+} TriggerMode;
+
+static const char *g_triggerNames[TRIGGER_COUNT] = { "hook", "hotkey", "rawinput" };
+static const char *g_triggerKeys[TRIGGER_COUNT] = { "Ctrl+V", "Ctrl+Shift+V", "Ctrl+V" };
+
+static TriggerMode g_triggerWanted = TRIGGER_HOOK;  /* from the registry */
+static TriggerMode g_trigger = TRIGGER_COUNT;       /* in place, TRIGGER_COUNT = none yet */
+
+/* ── Paste latency statistics ──────────────────────────────────────────── */
+
+typedef enum {
+    STAGE_TITLE_LOOKUP,     /* foreground match as seen by the hook         */
+    STAGE_CLIP_OPEN,        /* OpenClipboard for read, with retries         */
+    STAGE_CLIP_READ,        /* GetClipboardData(CF_DIB) + snapshot copy     */
+    STAGE_DIB_DECODE,       /* DIB -> RGB (dib.c, or GDI+ as fallback)      */
+    STAGE_THUMBNAIL,        /* gallery thumbnail of the decoded image       */
+    STAGE_CLASSIFY,         /* sampling the image for the format choice     */
+    STAGE_IMAGE_ENCODE,     /* pngenc.c or jpegenc.c, all budget attempts   */
+    STAGE_BASE64,
+    STAGE_CLIP_WRITE,       /* GlobalAlloc, OpenClipboard, SetClipboardData */
+    STAGE_CLIP_HOLD,        /* clipboard open, read and write together      */
+    STAGE_CONVERT,          /* Ctrl+V -> the worker's conversion done       */
+    STAGE_HOOK_TO_PASTE,    /* hook entry -> WM_DO_PASTE dispatched         */
+    STAGE_REINJECT,         /* SendInput -> Ctrl+V seen by hook, or queued  */
+    STAGE_END_TO_END,       /* hook entry -> re-injected Ctrl+V seen        */
+    STAGE_KEYBOARD_HOOK,    /* every LowLevelKeyboardProc invocation        */
+    STAGE_FG_REFRESH,       /* re-evaluating the foreground window's title  */
+    STAGE_DIALOG_COLD,      /* dialog open -> first paint, new WebView2     */
+    STAGE_DIALOG_WARM,      /* dialog open -> first paint, reused WebView2  */
+    STAGE_COUNT
+} PasteStage;
+
+static const char *g_stageNames[STAGE_COUNT] = {
+    "Title lookup",
+    "Clipboard open",
+    "Clipboard read",
+    "DIB decode",
+    "Thumbnail",
+    "Format choice",
+    "Image encode",
+    "Base64 encode",
+    "Clipboard write",
+    "Clipboard hold",
+    "Conversion total",
+    "Hook to WM_DO_PASTE",
+    "Ctrl+V re-injection",
+    "End to end",
+    "Keyboard hook (all keys)",
+    "Foreground refresh",
+    "Dialog first paint (cold)",
+    "Dialog first paint (warm)",
+};
+
+static StatHistogram g_stageStats[STAGE_COUNT];
+static ULONGLONG g_lastPasteMicros[STAGE_COUNT];  /* timings of the latest paste */
+static LONGLONG  g_qpcFreq = 1;
+static LONGLONG  g_pasteStartQpc = 0;   /* hook entry of the intercepted Ctrl+V */
+static LONGLONG  g_reinjectQpc   = 0;   /* SendInput of the re-injected Ctrl+V */
+
+/* Keyboard hook health (watchdog) */
+static DWORD         g_hookTimeoutMs = HOOK_DEFAULT_TIMEOUT_MS;
+static volatile LONG g_hookCallbacks = 0;      /* invocations since start */
+static LONG          g_hookCallbacksAtTick = 0;
+static DWORD         g_lastInputAtTick = 0;
+static DWORD         g_probeSentTick = 0;      /* 0 = no probe outstanding */
+static volatile BOOL g_probeSeen = FALSE;
+static DWORD         g_lastProbeTick = 0;
+static DWORD         g_lastSlowNotifyTick = 0;
+static DWORD         g_hookReinstalls = 0;
+static DWORD         g_hookNearTimeouts = 0;
+
+/* Paste capture (record-and-replay) */
+static BOOL           g_captureEnabled = FALSE;
+static CaptureRecord *g_capture = NULL;        /* record of the paste in flight */
+static WCHAR          g_pasteTitle[512];       /* matched window title, original case */
+
+/* Thumbnails of recent pastes for the Activity Log, allocated at the first
+ * paste; GalleryKB bounds its memory and 0 turns it off */
+static ThumbArena g_gallery;
+static DWORD      g_galleryKB = GALLERY_DEFAULT_KB;
+
+/* Conversion temporaries come from the paste arena (arena.h), reserved at
+ * the first paste and released by IdleTrim. PasteArenaMB bounds what it
+ * keeps committed between pastes; 0 leaves the conversion on the heap. */
+static PasteArena g_pasteArena;
+static DWORD      g_pasteArenaMB = PASTE_ARENA_DEFAULT_MB;
+
+/* Compressed PNG row bands of the last paste (pngenc.h), so the next capture
+ * of a screen that barely changed only compresses the bands that did. Heap
+ * memory, freed by IdleTrim */
+static PngBandCache g_bandCache;
+
+/* Page faults and time of converting, for pastes on the heap [0] and in
+ * the arena [1], so the two can be compared in the Statistics view */
+typedef struct {
+    DWORD     pastes;
+    ULONGLONG faults;
+    ULONGLONG micros;
+} PasteFaultStats;
+static PasteFaultStats g_pasteFaults[2];
+
+/* The configuration the registry describes: the profiles in match order,
+ * the last one being the default profile, with their rules compiled. A
+ * snapshot never changes once published; a reload publishes a new one (see
+ * "Configuration snapshots"). */
+typedef struct ConfigSnapshot ConfigSnapshot;
+struct ConfigSnapshot {
+    LONG            version;
+    Profile        *profiles;
+    int             count;
+    BOOL            use[PROFILE_FIELD_COUNT];   /* any profile has rules for it */
+    /* Cap on what one conversion allocates besides the clipboard's DIB;
+     * larger images are streamed, and a paste that cannot fit fails. 0 = no cap */
+    DWORD           maxPasteMB;
+    /* Compiling the rules, for the log */
+    size_t          rules, states, bytes;
+    int             compileFailures;
+    ULONGLONG       compileMicros;
+    ConfigSnapshot *nextRetired;
+};
+
+typedef enum { CONFIG_READER_UI, CONFIG_READER_WORKER, CONFIG_READER_COUNT } ConfigReader;
+
+static ConfigSnapshot *volatile g_config;           /* the latest published */
+static const ConfigSnapshot    *g_uiConfig;         /* the one the UI thread and the hook use */
+
+/* Match result for the foreground window, kept current by WinEvents */
+typedef struct {
+    HWND         hwnd;
+    BOOL         valid;
+    ProfileMatch match;
+    WCHAR        title[512];
+    WCHAR        className[256];
+    WCHAR        exePath[MAX_PATH];
+} ForegroundMatch;
+
+/* Executable path per process ID. The process handle is held open so the
+ * PID cannot be reused while the entry exists. */
+typedef struct {
+    DWORD  pid;
+    HANDLE hProcess;        /* NULL = free slot */
+    DWORD  lastUse;
+    WCHAR  path[MAX_PATH];
+} ProcessPathEntry;
+
+static ProcessPathEntry g_processCache[PROCESS_CACHE_SIZE];
+static DWORD            g_processCacheClock = 0;
+static DWORD            g_processCacheHits = 0;
+static DWORD            g_processCacheMisses = 0;
+
+static ForegroundMatch g_fgMatch;
+static HWINEVENTHOOK   g_hFgEventHook = NULL;
+static HWINEVENTHOOK   g_hNameEventHook = NULL;
+static DWORD           g_fgCacheMisses = 0;   /* hook found the cache stale */
 
 /* ── WebView2 COM interface definitions (minimal vtable approach) ─────── */
 
@@ -126,6 +394,8 @@ DEFINE_GUID(IID_ICoreWebView2Environment, 0xb96d755e,0x0319,0x4e92,0xa2,0x96,0x2
 DEFINE_GUID(IID_ICoreWebView2Controller, 0x4d00c0d1,0x9583,0x4f38,0x8e,0x50,0xa9,0xa6,0xb3,0x44,0x78,0xcd);
 DEFINE_GUID(IID_ICoreWebView2, 0x76eceacb,0x0462,0x4d94,0xac,0x83,0x42,0x3a,0x67,0x93,0x77,0x5e);
 DEFINE_GUID(IID_ICoreWebView2Settings, 0xe562e4f0,0xd7fa,0x43ac,0x8d,0x71,0xc0,0x51,0x50,0x49,0x9f,0x00);
+DEFINE_GUID(IID_ICoreWebView2Environment12, 0xf503db9b,0x739f,0x48dd,0xb1,0x51,0xfd,0xfc,0xf2,0x53,0xf5,0x4e);
+DEFINE_GUID(IID_ICoreWebView2_17, 0x702e75d4,0xfd44,0x434d,0x9d,0x70,0x1a,0x68,0xa6,0xb1,0x19,0x2a);
 
 typedef struct EventRegistrationToken { __int64 value; } EventRegistrationToken;
 
@@ -137,6 +407,16 @@ typedef struct ICoreWebView2WebMessageReceivedEventArgs ICoreWebView2WebMessageR
 typedef struct ICoreWebView2CreateCoreWebView2EnvironmentCompletedHandler ICoreWebView2CreateCoreWebView2EnvironmentCompletedHandler;
 typedef struct ICoreWebView2CreateCoreWebView2ControllerCompletedHandler ICoreWebView2CreateCoreWebView2ControllerCompletedHandler;
 typedef struct ICoreWebView2WebMessageReceivedEventHandler ICoreWebView2WebMessageReceivedEventHandler;
+typedef struct ICoreWebView2WebResourceRequest ICoreWebView2WebResourceRequest;
+typedef struct ICoreWebView2WebResourceResponse ICoreWebView2WebResourceResponse;
+typedef struct ICoreWebView2WebResourceRequestedEventArgs ICoreWebView2WebResourceRequestedEventArgs;
+typedef struct ICoreWebView2WebResourceRequestedEventHandler ICoreWebView2WebResourceRequestedEventHandler;
+typedef struct ICoreWebView2Environment12 ICoreWebView2Environment12;
+typedef struct ICoreWebView2_17 ICoreWebView2_17;
+typedef struct ICoreWebView2SharedBuffer ICoreWebView2SharedBuffer;
+
+#define COREWEBVIEW2_WEB_RESOURCE_CONTEXT_ALL 0
+#define COREWEBVIEW2_SHARED_BUFFER_ACCESS_READ_ONLY 0
 
 /* ICoreWebView2Environment vtable */
 typedef struct ICoreWebView2EnvironmentVtbl {
@@ -144,13 +424,35 @@ typedef struct ICoreWebView2EnvironmentVtbl {
     ULONG   (STDMETHODCALLTYPE *AddRef)(ICoreWebView2Environment*);
     ULONG   (STDMETHODCALLTYPE *Release)(ICoreWebView2Environment*);
     HRESULT (STDMETHODCALLTYPE *CreateCoreWebView2Controller)(ICoreWebView2Environment*, HWND, ICoreWebView2CreateCoreWebView2ControllerCompletedHandler*);
-    HRESULT (STDMETHODCALLTYPE *CreateWebResourceResponse)(ICoreWebView2Environment*, void*, int, LPCWSTR, LPCWSTR, void**);
+    HRESULT (STDMETHODCALLTYPE *CreateWebResourceResponse)(ICoreWebView2Environment*, IStream*, int, LPCWSTR, LPCWSTR, ICoreWebView2WebResourceResponse**);
     HRESULT (STDMETHODCALLTYPE *get_BrowserVersionString)(ICoreWebView2Environment*, LPWSTR*);
     HRESULT (STDMETHODCALLTYPE *add_NewBrowserVersionAvailable)(ICoreWebView2Environment*, void*, EventRegistrationToken*);
     HRESULT (STDMETHODCALLTYPE *remove_NewBrowserVersionAvailable)(ICoreWebView2Environment*, EventRegistrationToken);
 } ICoreWebView2EnvironmentVtbl;
 struct ICoreWebView2Environment { const ICoreWebView2EnvironmentVtbl *lpVtbl; };
 
+/* ICoreWebView2Environment12 vtable: the base interface, the methods added by
+ * Environment2 to Environment11 (unused here), then CreateSharedBuffer */
+typedef struct ICoreWebView2Environment12Vtbl {
+    ICoreWebView2EnvironmentVtbl base;
+    void *environment2To11[16];
+    HRESULT (STDMETHODCALLTYPE *CreateSharedBuffer)(ICoreWebView2Environment12*, UINT64, ICoreWebView2SharedBuffer**);
+} ICoreWebView2Environment12Vtbl;
+struct ICoreWebView2Environment12 { const ICoreWebView2Environment12Vtbl *lpVtbl; };
+
+/* ICoreWebView2SharedBuffer vtable */
+typedef struct ICoreWebView2SharedBufferVtbl {
+    HRESULT (STDMETHODCALLTYPE *QueryInterface)(ICoreWebView2SharedBuffer*, REFIID, void**);
+    ULONG   (STDMETHODCALLTYPE *AddRef)(ICoreWebView2SharedBuffer*);
+    ULONG   (STDMETHODCALLTYPE *Release)(ICoreWebView2SharedBuffer*);
+    HRESULT (STDMETHODCALLTYPE *get_Size)(ICoreWebView2SharedBuffer*, UINT64*);
+    HRESULT (STDMETHODCALLTYPE *get_Buffer)(ICoreWebView2SharedBuffer*, BYTE**);
+    HRESULT (STDMETHODCALLTYPE *OpenStream)(ICoreWebView2SharedBuffer*, IStream**);
+    HRESULT (STDMETHODCALLTYPE *get_FileMappingHandle)(ICoreWebView2SharedBuffer*, HANDLE*);
+    HRESULT (STDMETHODCALLTYPE *Close)(ICoreWebView2SharedBuffer*);
+} ICoreWebView2SharedBufferVtbl;
+struct ICoreWebView2SharedBuffer { const ICoreWebView2SharedBufferVtbl *lpVtbl; };
+
 /* ICoreWebView2Controller vtable */
 typedef struct ICoreWebView2ControllerVtbl {
     HRESULT (STDMETHODCALLTYPE *QueryInterface)(ICoreWebView2Controller*, REFIID, void**);
@@ -239,7 +541,7 @@ typedef struct ICoreWebView2Vtbl {
     HRESULT (STDMETHODCALLTYPE *add_ContainsFullScreenElementChanged)(ICoreWebView2*, void*, EventRegistrationToken*);
     HRESULT (STDMETHODCALLTYPE *remove_ContainsFullScreenElementChanged)(ICoreWebView2*, EventRegistrationToken);
     HRESULT (STDMETHODCALLTYPE *get_ContainsFullScreenElement)(ICoreWebView2*, BOOL*);
-    HRESULT (STDMETHODCALLTYPE *add_WebResourceRequested)(ICoreWebView2*, void*, EventRegistrationToken*);
+    HRESULT (STDMETHODCALLTYPE *add_WebResourceRequested)(ICoreWebView2*, ICoreWebView2WebResourceRequestedEventHandler*, EventRegistrationToken*);
     HRESULT (STDMETHODCALLTYPE *remove_WebResourceRequested)(ICoreWebView2*, EventRegistrationToken);
     HRESULT (STDMETHODCALLTYPE *AddWebResourceRequestedFilter)(ICoreWebView2*, LPCWSTR, int);
     HRESULT (STDMETHODCALLTYPE *RemoveWebResourceRequestedFilter)(ICoreWebView2*, LPCWSTR, int);
@@ -248,6 +550,15 @@ typedef struct ICoreWebView2Vtbl {
 } ICoreWebView2Vtbl;
 struct ICoreWebView2 { const ICoreWebView2Vtbl *lpVtbl; };
 
+/* ICoreWebView2_17 vtable: the base interface, the methods added by
+ * ICoreWebView2_2 to _16 (unused here), then PostSharedBufferToScript */
+typedef struct ICoreWebView2_17Vtbl {
+    ICoreWebView2Vtbl base;
+    void *webview2To16[55];
+    HRESULT (STDMETHODCALLTYPE *PostSharedBufferToScript)(ICoreWebView2_17*, ICoreWebView2SharedBuffer*, int, LPCWSTR);
+} ICoreWebView2_17Vtbl;
+struct ICoreWebView2_17 { const ICoreWebView2_17Vtbl *lpVtbl; };
+
 /* ICoreWebView2Settings vtable */
 typedef struct ICoreWebView2SettingsVtbl {
     HRESULT (STDMETHODCALLTYPE *QueryInterface)(ICoreWebView2Settings*, REFIID, void**);
@@ -285,6 +596,42 @@ typedef struct ICoreWebView2WebMessageReceivedEventArgsVtbl {
 } ICoreWebView2WebMessageReceivedEventArgsVtbl;
 struct ICoreWebView2WebMessageReceivedEventArgs { const ICoreWebView2WebMessageReceivedEventArgsVtbl *lpVtbl; };
 
+/* ICoreWebView2WebResourceRequest vtable */
+typedef struct ICoreWebView2WebResourceRequestVtbl {
+    HRESULT (STDMETHODCALLTYPE *QueryInterface)(ICoreWebView2WebResourceRequest*, REFIID, void**);
+    ULONG   (STDMETHODCALLTYPE *AddRef)(ICoreWebView2WebResourceRequest*);
+    ULONG   (STDMETHODCALLTYPE *Release)(ICoreWebView2WebResourceRequest*);
+    HRESULT (STDMETHODCALLTYPE *get_Uri)(ICoreWebView2WebResourceRequest*, LPWSTR*);
+    HRESULT (STDMETHODCALLTYPE *put_Uri)(ICoreWebView2WebResourceRequest*, LPCWSTR);
+    HRESULT (STDMETHODCALLTYPE *get_Method)(ICoreWebView2WebResourceRequest*, LPWSTR*);
+    HRESULT (STDMETHODCALLTYPE *put_Method)(ICoreWebView2WebResourceRequest*, LPCWSTR);
+    HRESULT (STDMETHODCALLTYPE *get_Content)(ICoreWebView2WebResourceRequest*, IStream**);
+    HRESULT (STDMETHODCALLTYPE *put_Content)(ICoreWebView2WebResourceRequest*, IStream*);
+    HRESULT (STDMETHODCALLTYPE *get_Headers)(ICoreWebView2WebResourceRequest*, void**);
+} ICoreWebView2WebResourceRequestVtbl;
+struct ICoreWebView2WebResourceRequest { const ICoreWebView2WebResourceRequestVtbl *lpVtbl; };
+
+/* ICoreWebView2WebResourceResponse: only created and handed back */
+typedef struct ICoreWebView2WebResourceResponseVtbl {
+    HRESULT (STDMETHODCALLTYPE *QueryInterface)(ICoreWebView2WebResourceResponse*, REFIID, void**);
+    ULONG   (STDMETHODCALLTYPE *AddRef)(ICoreWebView2WebResourceResponse*);
+    ULONG   (STDMETHODCALLTYPE *Release)(ICoreWebView2WebResourceResponse*);
+} ICoreWebView2WebResourceResponseVtbl;
+struct ICoreWebView2WebResourceResponse { const ICoreWebView2WebResourceResponseVtbl *lpVtbl; };
+
+/* ICoreWebView2WebResourceRequestedEventArgs vtable */
+typedef struct ICoreWebView2WebResourceRequestedEventArgsVtbl {
+    HRESULT (STDMETHODCALLTYPE *QueryInterface)(ICoreWebView2WebResourceRequestedEventArgs*, REFIID, void**);
+    ULONG   (STDMETHODCALLTYPE *AddRef)(ICoreWebView2WebResourceRequestedEventArgs*);
+    ULONG   (STDMETHODCALLTYPE *Release)(ICoreWebView2WebResourceRequestedEventArgs*);
+    HRESULT (STDMETHODCALLTYPE *get_Request)(ICoreWebView2WebResourceRequestedEventArgs*, ICoreWebView2WebResourceRequest**);
+    HRESULT (STDMETHODCALLTYPE *get_Response)(ICoreWebView2WebResourceRequestedEventArgs*, ICoreWebView2WebResourceResponse**);
+    HRESULT (STDMETHODCALLTYPE *put_Response)(ICoreWebView2WebResourceRequestedEventArgs*, ICoreWebView2WebResourceResponse*);
+    HRESULT (STDMETHODCALLTYPE *GetDeferral)(ICoreWebView2WebResourceRequestedEventArgs*, void**);
+    HRESULT (STDMETHODCALLTYPE *get_ResourceContext)(ICoreWebView2WebResourceRequestedEventArgs*, int*);
+} ICoreWebView2WebResourceRequestedEventArgsVtbl;
+struct ICoreWebView2WebResourceRequestedEventArgs { const ICoreWebView2WebResourceRequestedEventArgsVtbl *lpVtbl; };
+
 /* ── COM callback handler types ──────────────────────────────────────────── */
 
 typedef struct EnvironmentCompletedHandlerVtbl {
@@ -323,15 +670,67 @@ struct ICoreWebView2WebMessageReceivedEventHandler {
     ULONG refCount;
 };
 
+typedef struct WebResourceRequestedHandlerVtbl {
+    HRESULT (STDMETHODCALLTYPE *QueryInterface)(ICoreWebView2WebResourceRequestedEventHandler*, REFIID, void**);
+    ULONG   (STDMETHODCALLTYPE *AddRef)(ICoreWebView2WebResourceRequestedEventHandler*);
+    ULONG   (STDMETHODCALLTYPE *Release)(ICoreWebView2WebResourceRequestedEventHandler*);
+    HRESULT (STDMETHODCALLTYPE *Invoke)(ICoreWebView2WebResourceRequestedEventHandler*, ICoreWebView2*, ICoreWebView2WebResourceRequestedEventArgs*);
+} WebResourceRequestedHandlerVtbl;
+
+struct ICoreWebView2WebResourceRequestedEventHandler {
+    const WebResourceRequestedHandlerVtbl *lpVtbl;
+    ULONG refCount;
+};
+
 /* ── WebView2 globals ──────────────────────────────────────────────────── */
 
 static HWND g_webviewHwnd = NULL;
 static ICoreWebView2Environment *g_webviewEnv = NULL;
 static ICoreWebView2Controller *g_webviewController = NULL;
 static ICoreWebView2 *g_webviewView = NULL;
-static char g_pendingView[16] = "";
+static char g_pendingView[16] = "";      /* view on screen, "" while hidden */
 static BOOL g_webviewWindowShown = FALSE;
 
+/* The window, environment and controller outlive the dialog: closing hides
+ * the window, and the next dialog switches the loaded page to its view with
+ * a message. They are released after g_webviewIdleMinutes hidden. */
+static BOOL     g_webviewEnvPending = FALSE;   /* environment creation in flight */
+static BOOL     g_webviewReady = FALSE;        /* page loaded, bridge answering */
+static LONGLONG g_webviewStartQpc = 0;         /* environment creation started */
+static LONGLONG g_dialogOpenQpc = 0;           /* dialog awaiting its first paint */
+static BOOL     g_dialogCold = FALSE;          /* ... on a WebView2 still starting */
+static DWORD    g_webviewIdleMinutes = WEBVIEW_DEFAULT_IDLE_MINUTES;   /* 0 = release on close */
+static BOOL     g_webviewPrewarm = FALSE;
+
+/* The UI is served from IDR_UI_PACK under UI_ORIGIN; counters per page load */
+static UiPack        g_uiPack;
+static unsigned long g_uiRequests = 0;
+static unsigned long g_uiStoredBytes = 0;
+static unsigned long g_uiRawBytes = 0;
+
+/* Shared-buffer channel for large payloads; NULL on runtimes without it */
+static ICoreWebView2Environment12 *g_webviewEnv12 = NULL;
+static ICoreWebView2_17           *g_webviewView17 = NULL;
+
+/* Bridge transfer benchmark: one payload sent by each channel in turn */
+typedef enum {
+    TRANSFER_STRING,            /* ExecuteScript with a JSON literal */
+    TRANSFER_SHARED_JSON,       /* shared buffer, decoded and parsed by the page */
+    TRANSFER_SHARED_BINARY,     /* shared buffer, used as an ArrayBuffer */
+    TRANSFER_COUNT
+} TransferChannel;
+
+static const char *g_transferNames[TRANSFER_COUNT] = { "string", "shared JSON", "shared binary" };
+
+static struct {
+    BOOL      running;
+    int       channel;          /* TransferChannel in flight */
+    ByteBuf   json;             /* {"data":"..."} */
+    size_t    bytes;
+    LONGLONG  start;
+    LONGLONG  micros[TRANSFER_COUNT];   /* -1 = not available */
+} g_transferBench;
+
 typedef HRESULT (STDAPICALLTYPE *PFN_CreateCoreWebView2EnvironmentWithOptions)(
     LPCWSTR browserExecutableFolder, LPCWSTR userDataFolder, void* options,
     ICoreWebView2CreateCoreWebView2EnvironmentCompletedHandler* handler);
@@ -342,164 +741,272 @@ static WCHAR g_extractedDllPath[MAX_PATH] = {0};
 /* ── Forward declarations ──────────────────────────────────────────────── */
 
 static void LogMessage(const char *fmt, ...);
-static void ParseKeywords(void);
-static BOOL LoadConfigFromRegistry(void);
+static const ConfigSnapshot *ConfigAcquire(ConfigReader reader);
+static void ConfigRelease(ConfigReader reader);
 static void SaveConfigToRegistry(void);
 static void ShowWebViewDialog(const char* view, int width, int height);
-
-/* ── Base64 encoder ─────────────────────────────────────────────────────── */
-
-static const char b64_table[] =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-static char *Base64Encode(const BYTE *data, DWORD len, DWORD *outLen)
-{
-    DWORD i, j;
-    DWORD encLen = 4 * ((len + 2) / 3);
-    char *out = (char *)malloc(encLen + 1);
-    if (!out) return NULL;
-
-    for (i = 0, j = 0; i < len; ) {
-        DWORD a = i < len ? data[i++] : 0;
-        DWORD b = i < len ? data[i++] : 0;
-        DWORD c = i < len ? data[i++] : 0;
-        DWORD triple = (a << 16) | (b << 8) | c;
-
-        out[j++] = b64_table[(triple >> 18) & 0x3F];
-        out[j++] = b64_table[(triple >> 12) & 0x3F];
-        out[j++] = b64_table[(triple >>  6) & 0x3F];
-        out[j++] = b64_table[ triple        & 0x3F];
-    }
-
-    /* padding */
-    if (len % 3 >= 1) out[encLen - 1] = '=';
-    if (len % 3 == 1) out[encLen - 2] = '=';
-
-    out[encLen] = '\0';
-    if (outLen) *outLen = encLen;
-    return out;
-}
+static void webview_push_stats(BOOL init);
+static void webview_push_json(const char *fn, const ByteBuf *json);
+static void json_write_log_entry(JsonWriter *w, const LogEntry *entry);
+static void ShowTrayNotification(const WCHAR *title, const WCHAR *text, DWORD infoFlags);
+static const WCHAR *LookupProcessPath(DWORD pid);
+static BOOL SchedIdle(void);
+static void UpdateTooltip(void);
+static void RefreshForegroundMatch(HWND hwnd);
+static void TriggerApply(void);
 
 /* ── Logging (in-memory ring buffer) ───────────────────────────────────── */
 
 static void webview_execute_script(const wchar_t* script);
 
-static void LogMessage(const char *fmt, ...)
+/* Appends to the ring; `thumb` attaches a gallery thumbnail to the entry. */
+static void LogEntryV(DWORD thumb, const char *fmt, va_list args)
 {
     char buf[512];
     SYSTEMTIME st;
 
-    va_list args;
-    va_start(args, fmt);
-    wvsprintfA(buf, fmt, args);
-    va_end(args);
+    /* Bounded: rule lists and paths in the arguments have no length limit */
+    _vsnprintf(buf, sizeof(buf) - 1, fmt, args);
+    buf[sizeof(buf) - 1] = '\0';
 
     GetLocalTime(&st);
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+
+    /* Write into ring buffer. Whenever the head reaches the end, the entries
+     * are in order from index 0, so the ring can grow by reallocating. */
+    if (g_logHead == g_logCap) {
+        int cap = g_logCap ? g_logCap * 2 : LOG_RING_INITIAL;
+        if (cap > g_logMax) cap = g_logMax;
+        LogEntry *grown = cap > g_logCap ? (LogEntry *)realloc(g_logRing, (size_t)cap * sizeof(LogEntry))
+                                         : NULL;
+        if (grown) {
+            g_logRing = grown;
+            g_logCap = cap;
+        } else {
+            g_logHead = 0;
+        }
+    }
+    if (g_logCap == 0) return;
 
-    /* Write into ring buffer */
     LogEntry *entry = &g_logRing[g_logHead];
+    entry->seq = g_logSeq++;
+    entry->thumb = thumb;
     wsprintfA(entry->time, "%02d:%02d:%02d.%03d",
               st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
     strncpy(entry->message, buf, sizeof(entry->message) - 1);
     entry->message[sizeof(entry->message) - 1] = '\0';
 
-    g_logHead = (g_logHead + 1) % LOG_RING_CAPACITY;
-    if (g_logCount < LOG_RING_CAPACITY) g_logCount++;
+    g_logHead++;
+    if (g_logCount < g_logCap) g_logCount++;
+
+    /* Indexed by Unix time in ms, the unit the page filters by. Out of
+     * memory, the index starts again from the next entry. */
+    ULONGLONG unixMs = ((ULONGLONG)ft.dwHighDateTime << 32 | ft.dwLowDateTime) / 10000 - 11644473600000ULL;
+    if (log_index_add(&g_logIndex, entry->seq, unixMs, entry->message))
+        log_index_drop_before(&g_logIndex, g_logSeq - (DWORD)g_logCount);
 
     /* If Activity Log WebView is open, push the new entry live */
     if (g_webviewView && strcmp(g_pendingView, "log") == 0) {
-        wchar_t wTime[32], wMsg[1024], script[2048];
-        MultiByteToWideChar(CP_UTF8, 0, entry->time, -1, wTime, 32);
-
-        /* Escape the message for JSON embedding */
-        size_t j = 0;
-        for (size_t i = 0; entry->message[i] && j < 1020; i++) {
-            char c = entry->message[i];
-            if (c == '"' || c == '\\') {
-                wMsg[j++] = L'\\';
-                wMsg[j++] = (wchar_t)c;
-            } else if (c == '\n') {
-                wMsg[j++] = L'\\'; wMsg[j++] = L'n';
-            } else if (c == '\r') {
-                wMsg[j++] = L'\\'; wMsg[j++] = L'r';
-            } else {
-                wMsg[j++] = (wchar_t)(unsigned char)c;
-            }
-        }
-        wMsg[j] = L'\0';
-
-        swprintf(script, 2048,
-            L"window.onLogUpdate && window.onLogUpdate({\"time\":\"%s\",\"message\":\"%s\"})",
-            wTime, wMsg);
-        webview_execute_script(script);
+        ByteBuf b = {0};
+        JsonWriter w;
+        jw_init(&w, &b);
+        json_write_log_entry(&w, entry);
+        if (jw_ok(&w)) webview_push_json("onLogUpdate", &b);
+        bb_free(&b);
     }
 }
 
-/* ── PNG encoder CLSID lookup ───────────────────────────────────────────── */
-
-static BOOL GetPngEncoderClsid(CLSID *pClsid)
+static void LogMessage(const char *fmt, ...)
 {
-    UINT num = 0, size = 0;
-    ImageCodecInfo *codecs = NULL;
+    va_list args;
+    va_start(args, fmt);
+    LogEntryV(0, fmt, args);
+    va_end(args);
+}
 
-    GdipGetImageEncodersSize(&num, &size);
-    if (size == 0) return FALSE;
+static void LogThumbMessage(DWORD thumb, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    LogEntryV(thumb, fmt, args);
+    va_end(args);
+}
 
-    codecs = (ImageCodecInfo *)malloc(size);
-    if (!codecs) return FALSE;
+/* The entry `seq`, or NULL if the ring no longer holds it. */
+static const LogEntry *LogFind(DWORD seq)
+{
+    DWORD back = g_logSeq - 1 - seq;   /* 0 = the newest */
+    if (seq >= g_logSeq || back >= (DWORD)g_logCount) return NULL;
+    int pos = g_logHead - 1 - (int)back;
+    return &g_logRing[pos < 0 ? pos + g_logCap : pos];
+}
 
-    GdipGetImageEncoders(num, size, codecs);
+/* LogTextFn for the search: the index keeps no text of its own */
+static const char *LogText(void *ctx, uint32_t seq)
+{
+    (void)ctx;
+    const LogEntry *entry = LogFind(seq);
+    return entry ? entry->message : NULL;
+}
 
-    for (UINT i = 0; i < num; i++) {
-        if (codecs[i].MimeType && wcscmp(codecs[i].MimeType, L"image/png") == 0) {
-            *pClsid = codecs[i].Clsid;
-            free(codecs);
-            return TRUE;
-        }
-    }
+/* ── Stage timing (QPC) ────────────────────────────────────────────────── */
 
-    free(codecs);
-    return FALSE;
+static LONGLONG QpcNow(void)
+{
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return t.QuadPart;
 }
 
-/* ── Image-to-Base64 pipeline ───────────────────────────────────────────── */
+static ULONGLONG QpcMicros(LONGLONG from, LONGLONG to)
+{
+    if (to <= from) return 0;
+    return (ULONGLONG)(to - from) * 1000000ULL / (ULONGLONG)g_qpcFreq;
+}
 
-static BOOL ConvertClipboardImageToBase64(void)
+/* Records the time since `start` against a stage; returns the end timestamp
+ * so consecutive stages can be chained. `bytes` is the stage's input size. */
+static LONGLONG StageRecord(PasteStage stage, LONGLONG start, ULONGLONG bytes)
 {
-    HANDLE hDib = NULL;
-    BITMAPINFOHEADER *pBih = NULL;
-    BYTE *pBits = NULL;
-    GpBitmap *pBitmap = NULL;
-    IStream *pStream = NULL;
-    CLSID pngClsid;
-    BYTE *pPngData = NULL;
-    DWORD pngSize = 0;
-    char *base64 = NULL;
-    DWORD base64Len = 0;
-    HGLOBAL hClipMem = NULL;
-    BOOL success = FALSE;
-    UINT imgW = 0, imgH = 0;
+    LONGLONG now = QpcNow();
+    ULONGLONG us = QpcMicros(start, now);
+    g_lastPasteMicros[stage] = us;
+    stat_record(&g_stageStats[stage], us, bytes);
+    TRACE_SPAN(g_stageNames[stage], start, now);
+    return now;
+}
 
-    /* Step 1: Get DIB from clipboard */
-    if (!OpenClipboard(g_hWndMain)) {
-        LogMessage("ERROR: OpenClipboard failed (%lu)", GetLastError());
-        return FALSE;
+static void StatsChanged(void)
+{
+    if (g_webviewView && strcmp(g_pendingView, "stats") == 0) {
+        webview_push_stats(FALSE);
     }
+}
 
-    hDib = GetClipboardData(CF_DIB);
-    if (!hDib) {
-        LogMessage("ERROR: GetClipboardData(CF_DIB) returned NULL");
-        CloseClipboard();
+/* ── Lazily started subsystems ─────────────────────────────────────────── */
+
+/* Startup installs only the hook and the tray icon. COM is started for the
+ * first dialog or shell call, GDI+ for the first DIB that dib.c cannot
+ * decode; both then stay up until exit. EagerInit restores the previous
+ * startup, which started both in WinMain, for comparison. */
+static BOOL   g_eagerInit = FALSE;
+
+static BOOL EnsureCom(void)
+{
+    if (g_comStarted) return TRUE;
+    HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+    g_comStarted = SUCCEEDED(hr);
+    if (!g_comStarted) LogMessage("ERROR: CoInitializeEx failed (0x%08lX)", (unsigned long)hr);
+    return g_comStarted;
+}
+
+static BOOL EnsureGdiplus(void)
+{
+    GdiplusStartupInput gdipInput;
+
+    if (g_gdipStarted) return TRUE;
+    LONGLONG t = QpcNow();
+    ZeroMemory(&gdipInput, sizeof(gdipInput));
+    gdipInput.GdiplusVersion = 1;
+    if (GdiplusStartup(&g_gdipToken, &gdipInput, NULL) != 0) {
+        LogMessage("ERROR: Failed to initialize GDI+");
         return FALSE;
     }
+    g_gdipStarted = TRUE;
+    LogMessage("GDI+ initialized in %lu us", (unsigned long)QpcMicros(t, QpcNow()));
+    return TRUE;
+}
 
-    pBih = (BITMAPINFOHEADER *)GlobalLock(hDib);
-    if (!pBih) {
-        LogMessage("ERROR: GlobalLock on DIB failed");
-        CloseClipboard();
-        return FALSE;
+static void ShutdownSubsystems(void)
+{
+    if (g_gdipStarted) GdiplusShutdown(g_gdipToken);
+    if (g_comStarted) CoUninitialize();
+    g_gdipStarted = FALSE;
+    g_comStarted = FALSE;
+}
+
+/* ── Startup time and idle footprint ───────────────────────────────────── */
+
+static ULONGLONG g_startupMicros;    /* process creation -> hook and tray ready */
+static ULONGLONG g_winMainMicros;    /* the part of it spent in WinMain */
+static SIZE_T    g_idlePrivateBytes; /* after the latest idle trim, 0 = none yet */
+static DWORD     g_idleTrims;
+
+static void GetMemoryUsage(SIZE_T *privateBytes, SIZE_T *workingSet)
+{
+    PROCESS_MEMORY_COUNTERS_EX pmc;
+    ZeroMemory(&pmc, sizeof(pmc));
+    pmc.cb = sizeof(pmc);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&pmc, sizeof(pmc)))
+        ZeroMemory(&pmc, sizeof(pmc));
+    *privateBytes = pmc.PrivateUsage;
+    *workingSet = pmc.WorkingSetSize;
+}
+
+/* Time since the process was created, from the kernel's creation time, so
+ * loader and CRT startup count too. Resolution is that of the system clock. */
+static ULONGLONG MicrosSinceProcessStart(void)
+{
+    FILETIME created, exited, kernel, user, now;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0;
+    GetSystemTimeAsFileTime(&now);
+    ULONGLONG c = ((ULONGLONG)created.dwHighDateTime << 32) | created.dwLowDateTime;
+    ULONGLONG n = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+    return n > c ? (n - c) / 10 : 0;
+}
+
+/* Restarts the quiet period after which IdleTrim runs. */
+static void ScheduleIdleTrim(void)
+{
+    SetTimer(g_hWndMain, ID_TIMER_IDLE_TRIM, IDLE_TRIM_DELAY_MS, NULL);
+}
+
+/* Returns free heap memory and trims the working set once activity stops.
+ * Pages dropped from the working set stay on the standby list, so the next
+ * keystroke or paste brings them back with soft faults, not disk reads. */
+static void IdleTrim(void)
+{
+    SIZE_T privateBefore, wsBefore, privateAfter, wsAfter;
+
+    KillTimer(g_hWndMain, ID_TIMER_IDLE_TRIM);
+    if (g_webviewHwnd && IsWindowVisible(g_webviewHwnd)) return;   /* rescheduled on close */
+    if (!SchedIdle()) {
+        ScheduleIdleTrim();     /* the arena and band cache are in use */
+        return;
     }
 
+    GetMemoryUsage(&privateBefore, &wsBefore);
+    size_t arenaKB = g_pasteArena.committed / 1024;
+    size_t bandKB = g_bandCache.data.cap / 1024;
+    arena_release(&g_pasteArena);
+    png_band_cache_free(&g_bandCache);
+    HeapCompact(GetProcessHeap(), 0);
+    SetProcessWorkingSetSize(GetCurrentProcess(), (SIZE_T)-1, (SIZE_T)-1);
+    GetMemoryUsage(&privateAfter, &wsAfter);
+
+    g_idlePrivateBytes = privateAfter;
+    g_idleTrims++;
+    LogMessage("Idle: working set trimmed from %lu KB to %lu KB, private %lu KB (was %lu KB), "
+               "paste arena %lu KB and PNG band cache %lu KB released",
+               (unsigned long)(wsBefore / 1024), (unsigned long)(wsAfter / 1024),
+               (unsigned long)(privateAfter / 1024), (unsigned long)(privateBefore / 1024),
+               (unsigned long)arenaKB, (unsigned long)bandKB);
+}
+
+/* ── GDI+ fallback decoder ─────────────────────────────────────────────── */
+
+/* Decodes DIBs that dib.c does not handle (RLE, embedded JPEG/PNG) into the
+ * same top-down RGB layout the native path produces. Runs on the worker, so
+ * GDI+ must already be started and failures are returned in `error`. */
+static BOOL DecodeDibWithGdiplus(const BITMAPINFOHEADER *pBih, RgbImage *out, const char **error)
+{
+    GpBitmap *pBitmap = NULL;
+    BitmapData data;
+    GpRect rect;
+    UINT imgW = 0, imgH = 0;
+    BYTE *pBits;
+
     /* Calculate pointer to pixel data */
     {
         DWORD colorTableSize = 0;
@@ -512,285 +1019,2957 @@ static BOOL ConvertClipboardImageToBase64(void)
         pBits = (BYTE *)pBih + pBih->biSize + colorTableSize;
     }
 
-    LogMessage("DIB: %ldx%ld, %d bpp, compression=%lu",
-               pBih->biWidth, pBih->biHeight, pBih->biBitCount, pBih->biCompression);
-
-    /* Step 2: Create GDI+ bitmap from DIB */
     if (GdipCreateBitmapFromGdiDib((const BITMAPINFO *)pBih, pBits, &pBitmap) != 0) {
-        LogMessage("ERROR: GdipCreateBitmapFromGdiDib failed");
-        GlobalUnlock(hDib);
-        CloseClipboard();
+        *error = "GdipCreateBitmapFromGdiDib failed";
         return FALSE;
     }
-
     GdipGetImageWidth((GpImage *)pBitmap, &imgW);
     GdipGetImageHeight((GpImage *)pBitmap, &imgH);
-    LogMessage("GDI+ bitmap created: %ux%u", imgW, imgH);
-
-    GlobalUnlock(hDib);
-    CloseClipboard();
-
-    /* Step 3: Find PNG encoder */
-    if (!GetPngEncoderClsid(&pngClsid)) {
-        LogMessage("ERROR: PNG encoder CLSID not found");
-        GdipDisposeImage((GpImage *)pBitmap);
-        return FALSE;
-    }
 
-    /* Step 4: Create IStream and encode to PNG */
-    if (CreateStreamOnHGlobal(NULL, TRUE, &pStream) != S_OK) {
-        LogMessage("ERROR: CreateStreamOnHGlobal failed");
+    rect.X = 0; rect.Y = 0; rect.Width = (INT)imgW; rect.Height = (INT)imgH;
+    if (imgW == 0 || imgH == 0 ||
+        GdipBitmapLockBits(pBitmap, &rect, GP_IMAGE_LOCK_MODE_READ,
+                           GP_PIXEL_FORMAT_24BPP_RGB, &data) != 0) {
+        *error = "GdipBitmapLockBits failed";
         GdipDisposeImage((GpImage *)pBitmap);
         return FALSE;
     }
 
-    if (GdipSaveImageToStream((GpImage *)pBitmap, pStream, &pngClsid, NULL) != 0) {
-        LogMessage("ERROR: GdipSaveImageToStream failed");
-        IStream_Release(pStream);
-        GdipDisposeImage((GpImage *)pBitmap);
-        return FALSE;
+    out->width  = imgW;
+    out->height = imgH;
+    out->stride = (size_t)imgW * 3;
+    out->pixels = (uint8_t *)arena_alloc(out->stride * imgH);
+    if (out->pixels) {
+        for (UINT y = 0; y < imgH; y++) {
+            const BYTE *src = (const BYTE *)data.Scan0 + (ptrdiff_t)data.Stride * (INT)y;
+            uint8_t *dst = out->pixels + out->stride * y;
+            for (UINT x = 0; x < imgW; x++, src += 3, dst += 3) {
+                dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0];
+            }
+        }
     }
 
+    GdipBitmapUnlockBits(pBitmap, &data);
     GdipDisposeImage((GpImage *)pBitmap);
-    pBitmap = NULL;
-
-    /* Step 5: Read PNG bytes from stream */
-    {
-        STATSTG stat;
-        LARGE_INTEGER liZero;
-        ULONG bytesRead;
-
-        IStream_Stat(pStream, &stat, STATFLAG_NONAME);
-        pngSize = (DWORD)stat.cbSize.QuadPart;
-
-        pPngData = (BYTE *)malloc(pngSize);
-        if (!pPngData) {
-            LogMessage("ERROR: malloc for PNG data failed (%lu bytes)", pngSize);
-            IStream_Release(pStream);
-            return FALSE;
-        }
-
-        liZero.QuadPart = 0;
-        IStream_Seek(pStream, liZero, STREAM_SEEK_SET, NULL);
-        IStream_Read(pStream, pPngData, pngSize, &bytesRead);
-        IStream_Release(pStream);
+    return out->pixels != NULL;
+}
 
-        LogMessage("PNG encoded: %lu bytes", pngSize);
-    }
+/* ── Paste capture ─────────────────────────────────────────────────────── */
 
-    /* Step 6: Base64 encode */
-    base64 = Base64Encode(pPngData, pngSize, &base64Len);
-    free(pPngData);
+static BOOL GetCaptureDirectory(WCHAR *dir, size_t len)
+{
+    WCHAR base[MAX_PATH];
+    if (FAILED(SHGetFolderPathW(NULL, CSIDL_LOCAL_APPDATA, NULL, 0, base))) return FALSE;
+    swprintf(dir, len, L"%s\\ImagePaster", base);
+    CreateDirectoryW(dir, NULL);
+    swprintf(dir, len, L"%s\\ImagePaster\\captures", base);
+    CreateDirectoryW(dir, NULL);
+    return TRUE;
+}
 
-    if (!base64) {
-        LogMessage("ERROR: Base64 encoding failed");
-        return FALSE;
+/* Starts the record of a paste with the malloc'd copy of its DIB the worker
+ * made, which the record takes over. */
+static void CaptureBegin(uint8_t *dib, SIZE_T size)
+{
+    CaptureRecord *rec = (CaptureRecord *)calloc(1, sizeof(CaptureRecord));
+    if (!rec) {
+        free(dib);
+        return;
     }
+    rec->dib = dib;
+    rec->dibSize = size;
+
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    ULONGLONG t100ns = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    rec->timestampMs = (t100ns - 116444736000000000ULL) / 10000;   /* Unix epoch */
+    WideCharToMultiByte(CP_UTF8, 0, g_pasteTitle, -1, rec->title, sizeof(rec->title), NULL, NULL);
+
+    free(g_capture ? g_capture->dib : NULL);
+    free(g_capture);
+    g_capture = rec;
+}
 
-    LogMessage("Base64 encoded: %lu characters", base64Len);
-
-    /* Step 7: Place base64 text on clipboard */
-    hClipMem = GlobalAlloc(GMEM_MOVEABLE, base64Len + 1);
-    if (!hClipMem) {
-        LogMessage("ERROR: GlobalAlloc for clipboard failed");
-        free(base64);
-        return FALSE;
+static DWORD WINAPI CaptureWriterThread(LPVOID param)
+{
+    CaptureRecord *rec = (CaptureRecord *)param;
+    WCHAR dir[MAX_PATH], path[MAX_PATH];
+    long written = -1;
+
+    trace_set_thread_name("Capture writer");
+    TRACE_BEGIN("Capture write");
+    if (GetCaptureDirectory(dir, MAX_PATH)) {
+        SYSTEMTIME st;
+        GetLocalTime(&st);
+        swprintf(path, MAX_PATH, L"%s\\paste-%04d%02d%02d.ipcap",
+                 dir, st.wYear, st.wMonth, st.wDay);
+        FILE *f = _wfopen(path, L"ab");
+        if (f) {
+            written = capture_write(f, rec, CAPTURE_DEFAULT_LEVEL);
+            fclose(f);
+        }
     }
+    TRACE_END("Capture write");
 
-    {
-        char *pClip = (char *)GlobalLock(hClipMem);
-        memcpy(pClip, base64, base64Len + 1);
-        GlobalUnlock(hClipMem);
-    }
-    free(base64);
+    /* LogMessage is UI-thread only; report back through the message window */
+    PostMessage(g_hWndMain, WM_CAPTURE_DONE, (WPARAM)(written >= 0), (LPARAM)written);
+    free(rec->dib);
+    free(rec);
+    return 0;
+}
 
-    if (!OpenClipboard(g_hWndMain)) {
-        LogMessage("ERROR: OpenClipboard for write failed (%lu)", GetLastError());
-        GlobalFree(hClipMem);
-        return FALSE;
+/* Called once the paste's timings are final. Compressing and appending the
+ * record happens on a short-lived thread so the paste path never waits on
+ * disk. */
+static void CaptureFinish(BOOL failed)
+{
+    CaptureRecord *rec = g_capture;
+    if (!rec) return;
+    g_capture = NULL;
+
+    if (failed) rec->flags |= CAPTURE_FLAG_FAILED;
+    for (int i = 0; i < STAGE_COUNT && rec->stageCount < CAPTURE_MAX_STAGES; i++) {
+        if (i >= STAGE_KEYBOARD_HOOK) continue;   /* not timings of this paste */
+        strncpy(rec->stageNames[rec->stageCount], g_stageNames[i],
+                sizeof(rec->stageNames[0]) - 1);
+        rec->stageMicros[rec->stageCount++] = g_lastPasteMicros[i];
     }
 
-    EmptyClipboard();
-    if (!SetClipboardData(CF_TEXT, hClipMem)) {
-        LogMessage("ERROR: SetClipboardData failed (%lu)", GetLastError());
-        CloseClipboard();
-        return FALSE;
+    HANDLE hThread = CreateThread(NULL, 0, CaptureWriterThread, rec, 0, NULL);
+    if (hThread) {
+        CloseHandle(hThread);
+    } else {
+        LogMessage("ERROR: Failed to start capture writer (%lu)", GetLastError());
+        free(rec->dib);
+        free(rec);
     }
-
-    CloseClipboard();
-
-    LogMessage("Clipboard replaced with base64 text (%lu chars)", base64Len);
-    success = TRUE;
-
-    return success;
 }
 
-/* ── Paste re-injection ─────────────────────────────────────────────────── */
-
-static void SimulateCtrlV(void)
+static void OpenCaptureFolder(void)
 {
-    INPUT inputs[4];
-    ZeroMemory(inputs, sizeof(inputs));
-
-    g_bSkipNextPaste = TRUE;
+    WCHAR dir[MAX_PATH];
+    if (GetCaptureDirectory(dir, MAX_PATH) && EnsureCom())
+        ShellExecuteW(NULL, L"open", dir, NULL, NULL, SW_SHOWNORMAL);
+}
 
-    /* Ctrl key down */
-    inputs[0].type = INPUT_KEYBOARD;
-    inputs[0].ki.wVk = VK_CONTROL;
+/* ── Clipboard access ──────────────────────────────────────────────────── */
 
-    /* V key down */
-    inputs[1].type = INPUT_KEYBOARD;
-    inputs[1].ki.wVk = 'V';
+/* The clipboard is one lock shared by every process: while it is open here,
+ * every other application's OpenClipboard fails. It is held only to copy the
+ * DIB out or to hand the text over. A busy clipboard is retried with
+ * exponential backoff before the paste gives up, and the process holding it
+ * is named in the log. The worker opens it too, so the counters are
+ * interlocked and the holder's name is looked up on the UI thread. */
+#define CLIP_OPEN_ATTEMPTS    7     /* waits of 1, 2, 4 ... 32 ms between them */
+#define CLIP_BACKOFF_FIRST_MS 1
+#define CLIP_BACKOFF_MAX_MS   32
 
-    /* V key up */
-    inputs[2].type = INPUT_KEYBOARD;
-    inputs[2].ki.wVk = 'V';
-    inputs[2].ki.dwFlags = KEYEVENTF_KEYUP;
+typedef struct {
+    ULONGLONG waitMicros;       /* in OpenClipboard and backoff */
+    ULONGLONG holdMicros;       /* from OpenClipboard to CloseClipboard */
+    LONGLONG  openedAt;         /* QPC */
+    DWORD     retries;
+    DWORD     ownerPid;         /* holder at the first busy open, 0 = none seen */
+    char      owner[64];        /* its executable name, UTF-8; filled in by ClipOwnerName */
+} ClipAccess;
+
+static volatile LONG g_clipContended;   /* opens that needed a retry, since start */
+static volatile LONG g_clipFailures;    /* opens that gave up */
+
+/* Opens the clipboard for `owner` (NULL on the worker), trying `attempts`
+ * times. Safe on any thread. */
+static BOOL ClipTryOpen(ClipAccess *a, HWND owner, int attempts)
+{
+    LONGLONG t = QpcNow();
+    DWORD delay = CLIP_BACKOFF_FIRST_MS;
+
+    for (int attempt = 1; ; attempt++) {
+        if (OpenClipboard(owner)) {
+            a->openedAt = QpcNow();
+            a->waitMicros += QpcMicros(t, a->openedAt);
+            if (attempt > 1) InterlockedIncrement(&g_clipContended);
+            return TRUE;
+        }
+        if (attempt == 1) {
+            HWND hwnd = GetOpenClipboardWindow();
+            DWORD pid = 0;
+            if (hwnd) GetWindowThreadProcessId(hwnd, &pid);
+            a->ownerPid = pid;
+            a->owner[0] = '\0';
+        }
+        if (attempt >= attempts) break;
+        Sleep(delay);
+        a->retries++;
+        delay = delay * 2 < CLIP_BACKOFF_MAX_MS ? delay * 2 : CLIP_BACKOFF_MAX_MS;
+    }
 
-    /* Ctrl key up */
-    inputs[3].type = INPUT_KEYBOARD;
-    inputs[3].ki.wVk = VK_CONTROL;
-    inputs[3].ki.dwFlags = KEYEVENTF_KEYUP;
+    a->waitMicros += QpcMicros(t, QpcNow());
+    InterlockedIncrement(&g_clipFailures);
+    return FALSE;
+}
 
-    SendInput(4, inputs, sizeof(INPUT));
-    LogMessage("Simulated Ctrl+V (re-injection)");
+/* Names the process whose window had the clipboard open. UI thread: the
+ * process path cache belongs to it. */
+static const char *ClipOwnerName(ClipAccess *a)
+{
+    if (a->owner[0]) return a->owner;
+    const WCHAR *name = L"no window";
+    if (a->ownerPid) {
+        const WCHAR *path = LookupProcessPath(a->ownerPid);
+        const WCHAR *slash = wcsrchr(path, L'\\');
+        name = slash ? slash + 1 : *path ? path : L"unknown";
+    }
+    WideCharToMultiByte(CP_UTF8, 0, name, -1, a->owner, sizeof(a->owner), NULL, NULL);
+    a->owner[sizeof(a->owner) - 1] = '\0';
+    return a->owner;
 }
 
-/* ── Keyword parsing ───────────────────────────────────────────────────── */
+static BOOL ClipOpen(ClipAccess *a, const char *purpose)
+{
+    LONGLONG t = QpcNow();
+    if (ClipTryOpen(a, g_hWndMain, CLIP_OPEN_ATTEMPTS)) return TRUE;
+    LogMessage("ERROR: Clipboard busy for %s, held by %s (pid %lu); gave up after %d attempts "
+               "in %lu ms (%lu failures since start)", purpose, ClipOwnerName(a), a->ownerPid,
+               CLIP_OPEN_ATTEMPTS, (unsigned long)(QpcMicros(t, QpcNow()) / 1000),
+               (unsigned long)g_clipFailures);
+    return FALSE;
+}
 
-static void ParseKeywords(void)
+static void ClipClose(ClipAccess *a)
 {
-    g_keywordCount = 0;
-    char copy[2048];
-    strncpy(copy, g_configTitleMatch, sizeof(copy) - 1);
-    copy[sizeof(copy) - 1] = '\0';
+    CloseClipboard();
+    a->holdMicros += QpcMicros(a->openedAt, QpcNow());
+}
 
-    char *token = strtok(copy, ",");
-    while (token && g_keywordCount < MAX_KEYWORDS) {
-        /* Trim leading/trailing whitespace */
-        while (*token == ' ' || *token == '\t') token++;
-        char *end = token + strlen(token) - 1;
-        while (end > token && (*end == ' ' || *end == '\t')) *end-- = '\0';
+/* ── Typed delivery ────────────────────────────────────────────────────── */
+
+/* For targets that block clipboard pastes or mangle large CF_TEXT, a profile
+ * can have the text typed instead: every character becomes one
+ * KEYEVENTF_UNICODE key press and line breaks become Enter. Typing runs on
+ * its own thread, in batches of one SendInput call each, built in an INPUT
+ * array allocated at the first typed paste. After every batch a WM_NULL is
+ * sent to the target and its round trip sets the pace: a prompt answer
+ * doubles the batch, a slow one halves it and adds a growing pause, so the
+ * rate settles at what the target keeps up with. Esc, or the focus moving
+ * to another window, stops typing between batches. */
+
+#define TYPE_BATCH_MIN         16       /* key presses per SendInput */
+#define TYPE_BATCH_START       64
+#define TYPE_BATCH_MAX         2048
+#define TYPE_FAST_US           2000     /* round trip below this: speed up */
+#define TYPE_SLOW_US           30000    /* round trip above this: back off */
+#define TYPE_MAX_PAUSE_MS      250
+#define TYPE_PROBE_TIMEOUT_MS  5000     /* no answer: the target is hung */
+#define TYPE_RELEASE_WAIT_MS   3000     /* for the user to let go of Ctrl */
+
+typedef enum {
+    TYPE_OK,
+    TYPE_CANCEL_ESC,
+    TYPE_CANCEL_FOCUS,
+    TYPE_CANCEL_MODIFIER,
+    TYPE_FAIL_BLOCKED,
+    TYPE_FAIL_HUNG
+} TypeOutcome;
+
+static const char *g_typeOutcomeNames[] = {
+    "done", "Esc pressed", "focus moved to another window", "a modifier key was held down",
+    "SendInput was blocked, the target may run elevated", "the target stopped responding"
+};
 
-        if (*token) {
-            /* Convert to lowercase wide string */
-            MultiByteToWideChar(CP_UTF8, 0, token, -1,
-                                g_keywords[g_keywordCount], 128);
-            /* Lowercase it */
-            for (WCHAR *p = g_keywords[g_keywordCount]; *p; p++) {
-                if (*p >= L'A' && *p <= L'Z')
-                    *p = *p - L'A' + L'a';
-            }
-            g_keywordCount++;
-        }
-        token = strtok(NULL, ",");
+typedef struct {
+    char         *text;         /* the converted text, malloc'd */
+    size_t        len;
+    HWND          target;       /* foreground window when typing started */
+    INPUT        *inputs;       /* 2 * TYPE_BATCH_MAX events */
+    size_t       *ends;         /* text offset after each key press of a batch */
+    volatile LONG busy;
+    volatile LONG cancel;       /* a TypeOutcome, 0 = keep going */
+    /* Results, read by the UI thread after WM_TYPE_DONE */
+    TypeOutcome   outcome;
+    size_t        typed;        /* characters of text delivered */
+    ULONGLONG     micros;
+    unsigned      batches;
+    unsigned      backoffs;
+    UINT          finalBatch;
+    DWORD         finalPauseMs;
+    ULONGLONG     maxRoundTripUs;
+} Typer;
+
+static Typer g_typer;
+static DWORD g_typedCps;        /* rate of the last completed typing, chars/s */
+
+/* PasteIo sink for typed delivery: keeps the text for the typing thread
+ * instead of putting it on the clipboard. */
+static int Type_PublishText(void *ctx, const char *text, size_t len)
+{
+    (void)ctx;
+    char *copy = (char *)malloc(len + 1);
+    if (!copy) {
+        LogMessage("ERROR: Out of memory keeping %lu chars to type", (unsigned long)len);
+        return 0;
     }
+    memcpy(copy, text, len + 1);
+    free(g_typer.text);
+    g_typer.text = copy;
+    g_typer.len = len;
+    return 1;
 }
 
-/* ── Registry configuration ──────────────────────────────────────────── */
-
-static BOOL LoadConfigFromRegistry(void)
+static void TypeKey(INPUT *in, WORD vk, WORD scan, DWORD flags)
 {
-    HKEY hKey;
-    LONG result = RegOpenKeyExA(HKEY_CURRENT_USER, REG_KEY_PATH, 0, KEY_READ, &hKey);
-    if (result != ERROR_SUCCESS) return FALSE;
+    ZeroMemory(in, 2 * sizeof(INPUT));
+    in[0].type = in[1].type = INPUT_KEYBOARD;
+    in[0].ki.wVk = in[1].ki.wVk = vk;
+    in[0].ki.wScan = in[1].ki.wScan = scan;
+    in[0].ki.dwFlags = flags;
+    in[1].ki.dwFlags = flags | KEYEVENTF_KEYUP;
+}
 
-    DWORD type, size;
-    size = sizeof(g_configTitleMatch);
-    if (RegQueryValueExA(hKey, REG_VALUE_TITLE, NULL, &type,
-                         (LPBYTE)g_configTitleMatch, &size) != ERROR_SUCCESS
-        || type != REG_SZ) {
-        strcpy(g_configTitleMatch, "xshell");
+/* Key presses for up to `maxKeys` characters from `pos`; the text is ASCII.
+ * CRLF, CR and LF each become one Enter. */
+static UINT TypeFillBatch(Typer *t, size_t pos, UINT maxKeys)
+{
+    static WORD enterScan;
+    if (!enterScan) enterScan = (WORD)MapVirtualKeyW(VK_RETURN, MAPVK_VK_TO_VSC);
+
+    UINT k = 0;
+    while (k < maxKeys && pos < t->len) {
+        char c = t->text[pos++];
+        if (c == '\r' || c == '\n') {
+            if (c == '\r' && pos < t->len && t->text[pos] == '\n') pos++;
+            TypeKey(&t->inputs[2 * k], VK_RETURN, enterScan, 0);
+        } else {
+            TypeKey(&t->inputs[2 * k], 0, (WORD)(unsigned char)c, KEYEVENTF_UNICODE);
+        }
+        t->ends[k++] = pos;
     }
-
-    RegCloseKey(hKey);
-    return TRUE;
+    return k;
 }
 
-static void SaveConfigToRegistry(void)
+static BOOL ModifiersHeld(void)
 {
-    HKEY hKey;
-    DWORD disposition;
-    LONG result = RegCreateKeyExA(HKEY_CURRENT_USER, REG_KEY_PATH, 0, NULL,
-                                  REG_OPTION_NON_VOLATILE, KEY_WRITE, NULL,
-                                  &hKey, &disposition);
-    if (result != ERROR_SUCCESS) return;
-
-    RegSetValueExA(hKey, REG_VALUE_TITLE, 0, REG_SZ,
-                   (const BYTE*)g_configTitleMatch,
-                   (DWORD)(strlen(g_configTitleMatch) + 1));
-
-    RegCloseKey(hKey);
-    LogMessage("Configuration saved to registry: TitleMatch=%s", g_configTitleMatch);
+    static const int keys[] = { VK_CONTROL, VK_SHIFT, VK_MENU, VK_LWIN, VK_RWIN };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        if (GetAsyncKeyState(keys[i]) & 0x8000) return TRUE;
+    }
+    return FALSE;
 }
 
-/* ── Low-level keyboard hook ────────────────────────────────────────────── */
-
-static LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam)
+static DWORD WINAPI TypeThreadProc(LPVOID param)
 {
-    if (nCode == HC_ACTION && wParam == WM_KEYDOWN) {
-        KBDLLHOOKSTRUCT *pKb = (KBDLLHOOKSTRUCT *)lParam;
+    Typer *t = (Typer *)param;
+    UINT batch = TYPE_BATCH_START;
+    DWORD pause = 0;
+    size_t pos = 0;
 
-        if (pKb->vkCode == 'V') {
-            BOOL ctrlDown = (GetAsyncKeyState(VK_CONTROL) & 0x8000) != 0;
-            BOOL altDown  = (GetAsyncKeyState(VK_MENU) & 0x8000) != 0;
+    trace_set_thread_name("Typer");
 
-            if (ctrlDown && !altDown) {
-                /* Recursion guard: skip if this is our re-injected paste */
-                if (g_bSkipNextPaste) {
-                    g_bSkipNextPaste = FALSE;
-                    LogMessage("Re-injected Ctrl+V detected, passing through");
-                    return CallNextHookEx(g_hHook, nCode, wParam, lParam);
-                }
+    /* Typed while Ctrl is still down from the Ctrl+V, characters would be shortcuts */
+    for (DWORD waited = 0; ModifiersHeld() && waited < TYPE_RELEASE_WAIT_MS && !t->cancel; waited += 10)
+        Sleep(10);
+    if (ModifiersHeld()) InterlockedCompareExchange(&t->cancel, TYPE_CANCEL_MODIFIER, 0);
 
-                LogMessage("--- Ctrl+V detected ---");
-
-                /* Check if a matching window is focused */
-                BOOL matchFound = FALSE;
-                {
-                    HWND hFg = GetForegroundWindow();
-                    if (hFg) {
-                        WCHAR title[512];
-                        if (GetWindowTextW(hFg, title, 512) > 0) {
-                            /* Lowercase the title */
-                            for (WCHAR *p = title; *p; p++) {
-                                if (*p >= L'A' && *p <= L'Z')
-                                    *p = *p - L'A' + L'a';
-                            }
-                            /* Check each keyword */
-                            for (int i = 0; i < g_keywordCount; i++) {
-                                if (wcsstr(title, g_keywords[i]) != NULL) {
-                                    matchFound = TRUE;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                }
-                LogMessage("Title match: %s", matchFound ? "YES" : "NO");
+    LONGLONG start = QpcNow();
+    while (pos < t->len && !t->cancel) {
+        if (!g_hHook && (GetAsyncKeyState(VK_ESCAPE) & 0x8000)) {
+            /* No hook to swallow it: the target sees this Esc too */
+            InterlockedCompareExchange(&t->cancel, TYPE_CANCEL_ESC, 0);
+            break;
+        }
+        if (GetForegroundWindow() != t->target) {
+            InterlockedCompareExchange(&t->cancel, TYPE_CANCEL_FOCUS, 0);
+            break;
+        }
+
+        TRACE_BEGIN("Type batch");
+        UINT keys = TypeFillBatch(t, pos, batch);
+        UINT sent = SendInput(keys * 2, t->inputs, sizeof(INPUT));
+        if (sent % 2) SendInput(1, &t->inputs[sent], sizeof(INPUT));   /* never leave a key down */
+        TRACE_END("Type batch");
+        if (sent == 0) {
+            t->outcome = TYPE_FAIL_BLOCKED;
+            break;
+        }
+        pos = t->ends[(sent + 1) / 2 - 1];
+        t->batches++;
+
+        DWORD_PTR answer;
+        LONGLONG probe = QpcNow();
+        if (!SendMessageTimeoutW(t->target, WM_NULL, 0, 0, SMTO_ABORTIFHUNG, TYPE_PROBE_TIMEOUT_MS, &answer)) {
+            if (IsWindow(t->target)) t->outcome = TYPE_FAIL_HUNG;
+            else InterlockedCompareExchange(&t->cancel, TYPE_CANCEL_FOCUS, 0);
+            break;
+        }
+        ULONGLONG rtt = QpcMicros(probe, QpcNow());
+        if (rtt > t->maxRoundTripUs) t->maxRoundTripUs = rtt;
+        if (rtt > TYPE_SLOW_US) {
+            batch = batch / 2 > TYPE_BATCH_MIN ? batch / 2 : TYPE_BATCH_MIN;
+            pause = pause ? (pause * 2 < TYPE_MAX_PAUSE_MS ? pause * 2 : TYPE_MAX_PAUSE_MS) : 1;
+            t->backoffs++;
+        } else if (rtt < TYPE_FAST_US) {
+            if (pause) pause /= 2;
+            else batch = batch * 2 < TYPE_BATCH_MAX ? batch * 2 : TYPE_BATCH_MAX;
+        }
+        if (pause) Sleep(pause);
+    }
 
-                /* Check if clipboard has an image */
-                BOOL clipHasImage = IsClipboardFormatAvailable(CF_DIB);
-                LogMessage("Clipboard has image: %s", clipHasImage ? "YES" : "NO");
+    t->typed = pos;
+    t->micros = QpcMicros(start, QpcNow());
+    t->finalBatch = batch;
+    t->finalPauseMs = pause;
+    if (t->outcome == TYPE_OK && t->cancel) t->outcome = (TypeOutcome)t->cancel;
 
-                if (matchFound && clipHasImage) {
-                    LogMessage("Intercepting paste: converting image to base64...");
+    /* LogMessage is UI-thread only; report back through the message window */
+    PostMessage(g_hWndMain, WM_TYPE_DONE, 0, 0);
+    return 0;
+}
 
-                    if (ConvertClipboardImageToBase64()) {
-                        LogMessage("Conversion successful, deferring re-injection");
-                        PostMessage(g_hWndMain, WM_DO_PASTE, 0, 0);
-                    } else {
-                        LogMessage("Conversion FAILED, blocking paste");
-                    }
+static void TypeReset(Typer *t)
+{
+    free(t->text);
+    t->text = NULL;
+    t->len = 0;
+}
 
-                    /* Block original Ctrl+V */
-                    return 1;
-                }
-            }
+/* Starts typing the text Type_PublishText kept into the foreground window. */
+static void TypeStart(void)
+{
+    Typer *t = &g_typer;
+    if (!t->text) return;
+    if (!t->inputs) {
+        t->inputs = (INPUT *)calloc(2 * TYPE_BATCH_MAX, sizeof(INPUT));
+        t->ends = (size_t *)malloc(TYPE_BATCH_MAX * sizeof(size_t));
+        if (!t->inputs || !t->ends) {
+            free(t->inputs);
+            free(t->ends);
+            t->inputs = NULL;
+            t->ends = NULL;
+            LogMessage("ERROR: Out of memory for the typing buffers");
+            TypeReset(t);
+            return;
         }
     }
 
-    return CallNextHookEx(g_hHook, nCode, wParam, lParam);
+    t->target = GetForegroundWindow();
+    t->cancel = 0;
+    t->outcome = TYPE_OK;
+    t->typed = 0;
+    t->batches = 0;
+    t->backoffs = 0;
+    t->maxRoundTripUs = 0;
+    InterlockedExchange(&t->busy, 1);
+
+    HANDLE hThread = CreateThread(NULL, 0, TypeThreadProc, t, 0, NULL);
+    if (!hThread) {
+        LogMessage("ERROR: Failed to start typing (%lu)", GetLastError());
+        InterlockedExchange(&t->busy, 0);
+        TypeReset(t);
+        return;
+    }
+    CloseHandle(hThread);
+    LogMessage("Typing %lu chars (Esc or switching windows stops it)", (unsigned long)t->len);
+}
+
+/* WM_TYPE_DONE: the typing thread has finished or stopped. */
+static void TypeDone(void)
+{
+    Typer *t = &g_typer;
+    unsigned long ms = (unsigned long)(t->micros / 1000);
+    unsigned long cps = t->micros ? (unsigned long)((ULONGLONG)t->typed * 1000000 / t->micros) : 0;
+
+    if (t->outcome == TYPE_OK) {
+        if (cps) g_typedCps = cps;
+        LogMessage("Typed %lu chars in %lu ms: %lu chars/s over %u batches, ending at %u keys per "
+                   "batch and %lu ms pauses after %u back-offs; slowest target round trip %lu us",
+                   (unsigned long)t->typed, ms, cps, t->batches, t->finalBatch,
+                   t->finalPauseMs, t->backoffs, (unsigned long)t->maxRoundTripUs);
+    } else {
+        LogMessage("Typing stopped (%s) after %lu of %lu chars in %lu ms (%lu chars/s)",
+                   g_typeOutcomeNames[t->outcome], (unsigned long)t->typed,
+                   (unsigned long)t->len, ms, cps);
+        if (t->outcome == TYPE_FAIL_BLOCKED)
+            ShowTrayNotification(L"Typing blocked",
+                                 L"Windows refused the keystrokes. The target window may be running "
+                                 L"as administrator.", NIIF_WARNING);
+    }
+
+    TypeReset(t);
+    CaptureFinish(t->outcome != TYPE_OK);
+    StatsChanged();
+    InterlockedExchange(&t->busy, 0);
+}
+
+/* ── Image-to-Base64 pipeline ───────────────────────────────────────────── */
+
+/* Puts the text on the clipboard for the re-injected Ctrl+V. */
+static int Clip_PublishText(ClipAccess *access, const char *text, size_t len)
+{
+    HGLOBAL hClipMem = GlobalAlloc(GMEM_MOVEABLE, len + 1);
+    if (!hClipMem) {
+        LogMessage("ERROR: GlobalAlloc for clipboard failed");
+        return 0;
+    }
+
+    {
+        char *pClip = (char *)GlobalLock(hClipMem);
+        memcpy(pClip, text, len + 1);
+        GlobalUnlock(hClipMem);
+    }
+
+    if (!ClipOpen(access, "write")) {
+        GlobalFree(hClipMem);
+        return 0;
+    }
+
+    EmptyClipboard();
+    if (!SetClipboardData(CF_TEXT, hClipMem)) {
+        DWORD err = GetLastError();
+        ClipClose(access);
+        LogMessage("ERROR: SetClipboardData failed (%lu)", err);
+        GlobalFree(hClipMem);
+        return 0;
+    }
+
+    ClipClose(access);
+    return 1;
+}
+
+static DWORD GetPageFaultCount(void)
+{
+    PROCESS_MEMORY_COUNTERS pmc;
+    ZeroMemory(&pmc, sizeof(pmc));
+    pmc.cb = sizeof(pmc);
+    return GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)) ? pmc.PageFaultCount : 0;
+}
+
+/* Reserves the paste arena the first time a paste needs it. Returns how
+ * much of it a conversion may keep committed, 0 if pastes use the heap. */
+static size_t PasteArenaReserve(void)
+{
+    size_t keep = (size_t)g_pasteArenaMB * 1024 * 1024;
+
+    if (g_pasteArenaMB == 0) return 0;
+    if (!g_pasteArena.base && !arena_init(&g_pasteArena, PASTE_ARENA_RESERVE, keep)) {
+        LogMessage("WARNING: Could not reserve %lu MB for the paste arena, pastes use the heap",
+                   (unsigned long)(PASTE_ARENA_RESERVE / (1024 * 1024)));
+        g_pasteArenaMB = 0;
+        return 0;
+    }
+    return keep;
+}
+
+/* ── Format routing ────────────────────────────────────────────────────── */
+
+/* A profile whose Route is not "fixed" lets route.c choose the encoding
+ * from a sample of the image: the fast PNG, the profile's PNG effort, or
+ * JPEG where the policy allows it, whichever gives the shortest paste. The
+ * paste's length counts the text's delivery too, so a typed profile, which
+ * delivers a few thousand characters a second, leans toward the smallest
+ * text. Each routed paste logs the prediction next to the outcome and
+ * corrects the model, which lives for the session. */
+
+#define ROUTE_PASTE_BYTES_PER_SEC  (8u * 1024 * 1024)   /* target reading pasted text, roughly */
+#define ROUTE_TYPE_CPS_DEFAULT     2000                 /* until a typed paste measures it */
+
+static RouteModel g_routeModel;     /* UI thread; jobs take a copy */
+
+static void RouteOptions(const Profile *profile, PipeOptions *opt)
+{
+    opt->routeModel = &g_routeModel;
+    if (profile->delivery == PROFILE_DELIVER_TYPE)
+        opt->textBytesPerSec = g_typedCps ? g_typedCps : ROUTE_TYPE_CPS_DEFAULT;
+    else
+        opt->textBytesPerSec = ROUTE_PASTE_BYTES_PER_SEC;
+}
+
+/* Logs a routed paste, predicted against actual, and learns from it. The
+ * encode time is left out (0) when it was not measured in the foreground,
+ * and neither is learned from when the size budget forced another attempt. */
+static void RouteReport(const PipeResult *res, RoutePolicy policy, ULONGLONG encodeMicros)
+{
+    const RouteDecision *d = &res->route;
+    const RouteFeatures *f = &d->features;
+
+    LogMessage("Format choice (%s): %s; %lu colours in %lu samples, %u.%u%% flat, %u.%u%% edges, "
+               "entropy %u.%02u bits%s", route_policy_name(policy), route_choice_name(d->choice),
+               (unsigned long)f->colours, (unsigned long)f->samples, f->flat / 10, f->flat % 10,
+               f->edges / 10, f->edges % 10, f->entropy / 100, f->entropy % 100,
+               f->photo ? ", photographic" : "");
+    for (int c = 0; c < ROUTE_CHOICE_COUNT; c++) {
+        if (!(d->candidates & (1 << c))) continue;
+        LogMessage("  %s%s: predicted %lu KB, encode %lu ms, paste %lu ms", route_choice_name((RouteChoice)c),
+                   c == (int)d->choice ? " (chosen)" : "", (unsigned long)((d->bytes[c] + 1023) / 1024),
+                   (unsigned long)(d->encodeMicros[c] / 1000), (unsigned long)(d->totalMicros[c] / 1000));
+    }
+    if (encodeMicros) {
+        LogMessage("  Actual: %lu KB (predicted %lu), encode %lu ms (predicted %lu)",
+                   (unsigned long)((res->imageSize + 1023) / 1024),
+                   (unsigned long)((d->bytes[d->choice] + 1023) / 1024),
+                   (unsigned long)(encodeMicros / 1000), (unsigned long)(d->encodeMicros[d->choice] / 1000));
+    } else {
+        LogMessage("  Actual: %lu KB (predicted %lu)", (unsigned long)((res->imageSize + 1023) / 1024),
+                   (unsigned long)((d->bytes[d->choice] + 1023) / 1024));
+    }
+    if (res->attempts == 1) route_learn(&g_routeModel, d, res->imageSize, encodeMicros);
+}
+
+/* ── Conversion progress ───────────────────────────────────────────────── */
+
+/* The worker hears from the pipeline before each band of rows it encodes,
+ * and while deflate or the JPEG encoder works through a long stretch
+ * between rows. There it keeps the progress for the UI thread and stops if
+ * the job was cancelled; the pipeline then frees what it holds. A paste is
+ * cancelled by Esc, which the keyboard hook swallows, or once the
+ * foreground window no longer matches the paste's profile. With another
+ * paste trigger, Esc comes as a hotkey registered while the paste converts,
+ * or as Raw Input that the window receives too. While a paste converts, a
+ * UI timer checks the focus, and past CONVERT_PROGRESS_DELAY_MS it shows
+ * the progress in the tray tooltip and logs each quarter of it. */
+
+#define CONVERT_PROGRESS_DELAY_MS   250     /* quicker conversions show nothing */
+#define CONVERT_PROGRESS_EVERY_MS   100     /* timer: focus check and tooltip refresh */
+
+typedef enum {
+    CONVERT_RUNNING,
+    CONVERT_CANCEL_ESC,
+    CONVERT_CANCEL_FOCUS,
+    CONVERT_CANCEL_SUPERSEDED
+} ConvertCancel;
+
+static const char *g_convertCancelNames[] = {
+    "", "Esc pressed", "focus moved to a window without this profile",
+    "superseded, or of no use to the paste"
+};
+
+/* UI thread only */
+static struct {
+    HWND     target;        /* foreground window the paste is for */
+    char     profile[PROFILE_MAX_NAME];
+    BOOL     tipShown;      /* the tooltip needs restoring */
+    int      attempt;
+    int      quarters;      /* of this attempt, logged */
+} g_convert;
+
+static void ConvertBegin(const char *profile)
+{
+    ZeroMemory(&g_convert, sizeof(g_convert));
+    g_convert.target = GetForegroundWindow();
+    lstrcpynA(g_convert.profile, profile, sizeof(g_convert.profile));
+    SetTimer(g_hWndMain, ID_TIMER_CONVERT_PROGRESS, CONVERT_PROGRESS_EVERY_MS, NULL);
+    /* Without the hook the window would get the Esc; taken while converting */
+    if (g_trigger == TRIGGER_HOTKEY) RegisterHotKey(g_hWndMain, ID_HOTKEY_CANCEL, MOD_NOREPEAT, VK_ESCAPE);
+}
+
+static void ConvertEnd(void)
+{
+    KillTimer(g_hWndMain, ID_TIMER_CONVERT_PROGRESS);
+    UnregisterHotKey(g_hWndMain, ID_HOTKEY_CANCEL);
+    if (g_convert.tipShown) UpdateTooltip();
+    g_convert.tipShown = FALSE;
+}
+
+/* The foreground window moved to one without the paste's profile. */
+static BOOL ConvertFocusLost(void)
+{
+    /* NULL while activation is in flight */
+    HWND fg = GetForegroundWindow();
+    if (!fg || fg == g_convert.target) return FALSE;
+    if (!g_fgMatch.valid || g_fgMatch.hwnd != fg) RefreshForegroundMatch(fg);
+    const ProfileMatch *m = &g_fgMatch.match;
+    if (m->profile < 0 || strcmp(g_uiConfig->profiles[m->profile].name, g_convert.profile) != 0)
+        return TRUE;
+    g_convert.target = fg;
+    return FALSE;
+}
+
+/* Shows how far the paste's conversion is, `ms` after its Ctrl+V. */
+static void ConvertShowProgress(const PipeProgress *p, ULONGLONG ms)
+{
+    if (ms < CONVERT_PROGRESS_DELAY_MS || p->height == 0) return;
+
+    unsigned pct = (unsigned)((uint64_t)p->rows * 100 / p->height);
+    WCHAR tip[128];
+    if (p->stage == PIPE_STAGE_BASE64 || p->stage == PIPE_STAGE_PUBLISH) {
+        swprintf(tip, 128, L"Pasting %lu KB of text...", (unsigned long)(p->bytesOut / 1024));
+    } else {
+        swprintf(tip, 128, L"Converting image: %u%% (row %u of %u%s), %lu KB encoded. Esc cancels",
+                 pct, p->rows, p->height, p->attempt > 1 ? L", smaller" : L"",
+                 (unsigned long)(p->bytesOut / 1024));
+    }
+    tip[127] = L'\0';
+    wcscpy(g_nid.szTip, tip);
+    g_nid.uFlags = NIF_TIP;
+    Shell_NotifyIconW(NIM_MODIFY, &g_nid);
+    g_convert.tipShown = TRUE;
+
+    if (p->stage != PIPE_STAGE_IMAGE_ENCODE) return;
+    if (p->attempt != g_convert.attempt) {
+        g_convert.attempt = p->attempt;
+        g_convert.quarters = 0;
+    }
+    if ((int)(pct / 25) > g_convert.quarters) {
+        g_convert.quarters = pct / 25;
+        LogMessage("Converting: %u%% of attempt %d, row %u of %u, %lu KB encoded, %lu ms so far",
+                   pct, p->attempt, p->rows, p->height, (unsigned long)(p->bytesOut / 1024),
+                   (unsigned long)ms);
+    }
+}
+
+/* ── Conversion scheduler ──────────────────────────────────────────────── */
+
+/* Every conversion runs on one worker thread; the keyboard hook only hands
+ * the paste over and returns. When an image lands on the clipboard, or a
+ * window with a profile comes to the foreground while one is there, the
+ * image is converted ahead of the paste with that profile's settings (or
+ * the last paste's, when the foreground window has no profile). Such
+ * speculative jobs run at the lowest thread priority under EcoQoS, which
+ * lets Windows run them slowly and, on hybrid CPUs, on the efficiency
+ * cores. A Ctrl+V that finds its image converted pastes the text at once.
+ * One that finds the job still queued or running promotes it to
+ * interactive, which lifts the throttling and raises the priority on the
+ * spot; any other Ctrl+V queues an interactive job, and a speculative job
+ * still running then, or one superseded by a newer image or profile, is
+ * cancelled at its next band of rows. WM_JOB_DONE then finishes the paste
+ * on the UI thread. Every job logs the time it spent queued apart from the
+ * time it ran. */
+
+#define SCHED_SPECULATE_MAX_MB   64     /* larger DIBs are left for the paste */
+#define SCHED_CLIP_ATTEMPTS      3      /* speculation does not wait long for the clipboard */
+
+typedef enum { JOB_SPECULATIVE, JOB_INTERACTIVE } JobClass;
+typedef enum { JOB_QUEUED, JOB_RUNNING, JOB_DONE } JobState;
+
+static const char *g_jobClassNames[] = { "speculative", "interactive" };
+
+typedef struct ConvertJob ConvertJob;
+struct ConvertJob {
+    DWORD         id;
+    DWORD         clipSeq;      /* GetClipboardSequenceNumber() of the image */
+    PipeOptions   opt;          /* copied from the profile when queued */
+    RouteModel    routeModel;   /* g_routeModel when queued */
+    char          profile[PROFILE_MAX_NAME];
+    LONG          configVersion;    /* the snapshot the options came from */
+    const char   *reason;       /* what queued it, for the log */
+    uint8_t      *dib;          /* snapshot, while the pipeline needs it */
+    volatile LONG cls;          /* JobClass; the UI thread may promote it */
+    volatile LONG cancel;       /* ConvertCancel; the UI thread stops the job at its next progress call */
+    JobState      state;        /* under g_sched.lock */
+    PipeProgress  progress;     /* latest, under g_sched.lock */
+    LONGLONG      queuedAt, startedAt, endedAt;     /* QPC */
+    BOOL          reported;     /* timings logged */
+    ConvertJob   *nextOrphan;
+    /* Fixed by the UI thread when queued */
+    size_t        arenaKeep;    /* paste arena keep limit, 0 = the heap */
+    BOOL          gdiplus;      /* GDI+ was started, so the fallback decoder may run */
+    BOOL          thumbnail;    /* the gallery is on */
+    BOOL          capture;      /* keep a copy of the DIB for the paste capture */
+    /* Set when a Ctrl+V takes the job (UI thread) */
+    BOOL          paste;
+    int           delivery;     /* ProfileDelivery */
+    LONGLONG      pastedAt;     /* QPC of the Ctrl+V */
+    /* Results, read once the job is done */
+    BOOL          ranInteractive;   /* interactive from its start: its timings are the paste's */
+    PipeStatus    status;
+    const char   *skipped;      /* why nothing was converted, or NULL */
+    BOOL          needsGdiplus; /* the DIB needs the fallback decoder and GDI+ was not started */
+    ClipAccess    access;       /* reading the DIB */
+    LONGLONG      t;            /* end of the previous stage (QPC) */
+    ULONGLONG     stageMicros[STAGE_COUNT];
+    ULONGLONG     stageBytes[STAGE_COUNT];
+    DWORD         stagesDone;   /* bit per PasteStage timed */
+    BITMAPINFOHEADER bih;       /* zero if no DIB was read */
+    uint8_t      *captureDib;   /* malloc'd, for CaptureBegin */
+    size_t        captureSize;
+    DWORD         faults;       /* page faults while converting */
+    size_t        arenaUsed, arenaCommitted;
+    PipeResult    res;          /* text excluded */
+    char         *text;         /* malloc'd */
+    uint8_t      *thumb;        /* THUMB_SLOT_BYTES, malloc'd, or NULL */
+    ThumbInfo     thumbInfo;
+};
+
+typedef BOOL (WINAPI *PFN_SetThreadInformation)(HANDLE, int, LPVOID, DWORD);
+
+/* THREAD_POWER_THROTTLING_STATE and ThreadPowerThrottling, from SDKs newer
+ * than this build targets; the function is looked up at run time. */
+typedef struct {
+    ULONG Version;
+    ULONG ControlMask;
+    ULONG StateMask;
+} PowerThrottlingState;
+#define THREAD_INFO_POWER_THROTTLING   3
+#define POWER_THROTTLING_VERSION       1
+#define POWER_THROTTLING_EXECUTION     0x1
+
+static struct {
+    CRITICAL_SECTION         lock;
+    HANDLE                   thread;
+    HANDLE                   wake;       /* auto-reset: a job was queued */
+    ConvertJob              *queued;     /* at most one; a newer image replaces it */
+    ConvertJob              *running;
+    PFN_SetThreadInformation setThreadInformation;   /* NULL before Windows 8 */
+    DWORD                    lastId;
+} g_sched;
+
+/* Owned by the UI thread: the latest speculative job, whatever its state,
+ * the job a Ctrl+V is waiting for, and superseded jobs still running, freed
+ * when they report in */
+static ConvertJob  *g_specJob;
+static ConvertJob  *g_pasteJob;
+static ConvertJob  *g_orphanJobs;
+static DWORD        g_speculate = 1;
+static PipeOptions  g_lastPasteOpt;      /* settings of the last paste, for speculation */
+static char         g_lastPasteProfile[PROFILE_MAX_NAME];
+
+/* Priority and EcoQoS for a class of work; works on another thread's
+ * handle, which is how a running job is promoted. */
+static BOOL SchedApplyClass(HANDLE thread, JobClass cls)
+{
+    BOOL eco = FALSE;
+    SetThreadPriority(thread, cls == JOB_SPECULATIVE ? THREAD_PRIORITY_LOWEST
+                                                     : THREAD_PRIORITY_ABOVE_NORMAL);
+    if (g_sched.setThreadInformation) {
+        PowerThrottlingState pt;
+        pt.Version = POWER_THROTTLING_VERSION;
+        pt.ControlMask = POWER_THROTTLING_EXECUTION;
+        pt.StateMask = cls == JOB_SPECULATIVE ? POWER_THROTTLING_EXECUTION : 0;
+        eco = g_sched.setThreadInformation(thread, THREAD_INFO_POWER_THROTTLING, &pt, sizeof(pt))
+              && cls == JOB_SPECULATIVE;
+    }
+    return eco;
+}
+
+/* Times a stage into the job; the UI thread charges it to the histograms
+ * if the job turns out to be a paste's. */
+static void JobStage(ConvertJob *job, PasteStage stage, uint64_t bytes)
+{
+    LONGLONG now = QpcNow();
+    job->stageMicros[stage] = QpcMicros(job->t, now);
+    job->stageBytes[stage] = bytes;
+    job->stagesDone |= 1u << stage;
+    TRACE_SPAN(g_stageNames[stage], job->t, now);
+    job->t = now;
+}
+
+/* PasteIo for the worker. It logs nothing, since LogMessage belongs to the
+ * UI thread: failures are left in the job. Speculation reads the clipboard
+ * only if it still holds the image the job was queued for. */
+static PipeStatus Job_AcquireDib(void *ctx, size_t maxCopy, const uint8_t **dib, size_t *len)
+{
+    ConvertJob *job = (ConvertJob *)ctx;
+    BOOL speculative = job->cls == JOB_SPECULATIVE;
+
+    if (!ClipTryOpen(&job->access, NULL, speculative ? SCHED_CLIP_ATTEMPTS : CLIP_OPEN_ATTEMPTS)) {
+        job->skipped = "the clipboard was busy";
+        return PIPE_ERR_SOURCE;
+    }
+    JobStage(job, STAGE_CLIP_OPEN, 0);
+    if (speculative && GetClipboardSequenceNumber() != job->clipSeq) {
+        ClipClose(&job->access);
+        job->skipped = "the clipboard changed";
+        return PIPE_ERR_SOURCE;
+    }
+    HANDLE hDib = GetClipboardData(CF_DIB);
+    const BYTE *src = hDib ? (const BYTE *)GlobalLock(hDib) : NULL;
+    size_t size = src ? GlobalSize(hDib) : 0;
+    BOOL overCap = maxCopy && size > maxCopy;
+    uint8_t *copy = NULL;
+    if (!hDib) {
+        job->skipped = "GetClipboardData(CF_DIB) returned NULL";
+    } else if (!src) {
+        job->skipped = "GlobalLock on the DIB failed";
+    } else if (speculative && size > (size_t)SCHED_SPECULATE_MAX_MB * 1024 * 1024) {
+        job->skipped = "the image is too large to convert ahead";
+    } else if (overCap) {
+        job->skipped = "the DIB alone exceeds MaxPasteMB";
+    } else {
+        copy = (uint8_t *)arena_alloc(size);
+        if (copy) memcpy(copy, src, size);
+        else job->skipped = "out of memory copying the DIB";
+    }
+    if (src) GlobalUnlock(hDib);
+    ClipClose(&job->access);
+
+    if (copy && size >= sizeof(job->bih)) {
+        memcpy(&job->bih, copy, sizeof(job->bih));
+        job->captureDib = job->capture ? (uint8_t *)malloc(size) : NULL;
+        if (job->captureDib) {
+            memcpy(job->captureDib, copy, size);
+            job->captureSize = size;
+        }
+    }
+    job->dib = copy;
+    *dib = copy;
+    *len = size;
+    return copy ? PIPE_OK : overCap ? PIPE_ERR_MEMORY : PIPE_ERR_SOURCE;
+}
+
+static void Job_ReleaseDib(void *ctx)
+{
+    ConvertJob *job = (ConvertJob *)ctx;
+    arena_free(job->dib);
+    job->dib = NULL;
+}
+
+/* GDI+ is started on the UI thread. A job queued before that asks to be run
+ * again once it is. */
+static int Job_DecodeFallback(void *ctx, const uint8_t *dib, size_t len, RgbImage *out)
+{
+    ConvertJob *job = (ConvertJob *)ctx;
+    (void)len;
+    if (!job->gdiplus) {
+        job->needsGdiplus = TRUE;
+        return 0;
+    }
+    return DecodeDibWithGdiplus((const BITMAPINFOHEADER *)dib, out, &job->skipped);
+}
+
+/* The text is kept in the job; the UI thread publishes it. */
+static int Job_PublishText(void *ctx, const char *text, size_t len)
+{
+    ConvertJob *job = (ConvertJob *)ctx;
+    job->text = (char *)malloc(len + 1);
+    if (!job->text) return 0;
+    memcpy(job->text, text, len + 1);
+    return 1;
+}
+
+static void Job_OnStage(void *ctx, PipeStage stage, uint64_t bytes)
+{
+    static const PasteStage stageMap[PIPE_STAGE_COUNT] = {
+        STAGE_CLIP_READ, STAGE_DIB_DECODE, STAGE_CLASSIFY, STAGE_IMAGE_ENCODE, STAGE_BASE64,
+        STAGE_COUNT
+    };
+    ConvertJob *job = (ConvertJob *)ctx;
+    if (stageMap[stage] != STAGE_COUNT) JobStage(job, stageMap[stage], bytes);
+}
+
+/* The gallery belongs to the UI thread, so the thumbnail is made into the
+ * job and added when the image is pasted. */
+static void Job_OnDecoded(void *ctx, RgbRowSource *rows)
+{
+    ConvertJob *job = (ConvertJob *)ctx;
+    job->thumb = (uint8_t *)malloc(THUMB_SLOT_BYTES);
+    if (!job->thumb) return;
+    thumb_size(rows->width, rows->height, &job->thumbInfo.width, &job->thumbInfo.height);
+    thumb_downscale_rows(rows, job->thumb, job->thumbInfo.width, job->thumbInfo.height);
+    job->thumbInfo.srcWidth = rows->width;
+    job->thumbInfo.srcHeight = rows->height;
+    JobStage(job, STAGE_THUMBNAIL, (uint64_t)rows->width * rows->height * 3);
+}
+
+/* Leaves the progress for the UI thread's timer and stops a cancelled job. */
+static int Job_OnProgress(void *ctx, const PipeProgress *p)
+{
+    ConvertJob *job = (ConvertJob *)ctx;
+    EnterCriticalSection(&g_sched.lock);
+    job->progress = *p;
+    LeaveCriticalSection(&g_sched.lock);
+    return job->cancel == CONVERT_RUNNING;
+}
+
+static void SchedRunJob(ConvertJob *job)
+{
+    PasteIo io;
+    io.ctx = job;
+    io.acquireDib = Job_AcquireDib;
+    io.releaseDib = Job_ReleaseDib;
+    io.copiesDib = 1;
+    io.decodeFallback = Job_DecodeFallback;
+    io.publishText = Job_PublishText;
+
+    /* Cancelled while it waited in the queue */
+    if (job->cancel) {
+        job->status = PIPE_ERR_CANCELLED;
+        return;
+    }
+
+    /* Settings reloaded since speculation was queued may route the paste
+     * elsewhere; the next foreground change queues it again. A paste keeps
+     * the settings its Ctrl+V matched. */
+    if (job->cls == JOB_SPECULATIVE) {
+        LONG version = ConfigAcquire(CONFIG_READER_WORKER)->version;
+        ConfigRelease(CONFIG_READER_WORKER);
+        if (version != job->configVersion) {
+            job->skipped = "the settings changed";
+            job->status = PIPE_ERR_SOURCE;
+            return;
+        }
+    }
+
+    PipeOptions opt = job->opt;
+    opt.onStage = Job_OnStage;
+    opt.onDecoded = job->thumbnail ? Job_OnDecoded : NULL;
+    opt.routeModel = &job->routeModel;
+    opt.ctx = job;
+    opt.onProgress = Job_OnProgress;
+    opt.bandCache = &g_bandCache;
+
+    /* The UI thread reserves the arena at the first paste; until then, the heap */
+    if (job->arenaKeep) {
+        g_pasteArena.keepLimit = job->arenaKeep < g_pasteArena.reserved ? job->arenaKeep
+                                                                         : g_pasteArena.reserved;
+        arena_begin(&g_pasteArena);
+    }
+    job->t = job->startedAt;
+    DWORD faults = GetPageFaultCount();
+    job->status = pipeline_run(&io, &opt, &job->res);
+    job->faults = GetPageFaultCount() - faults;
+    arena_free(job->res.base64);    /* Job_PublishText kept a copy */
+    job->res.base64 = NULL;
+    if (job->arenaKeep) {
+        arena_end(&g_pasteArena);
+        job->arenaUsed = g_pasteArena.highWater;
+        job->arenaCommitted = g_pasteArena.committed;
+    }
+}
+
+static DWORD WINAPI SchedThreadProc(LPVOID param)
+{
+    (void)param;
+    trace_set_thread_name("Converter");
+
+    while (WaitForSingleObject(g_sched.wake, INFINITE) == WAIT_OBJECT_0) {
+        for (;;) {
+            EnterCriticalSection(&g_sched.lock);
+            ConvertJob *job = g_sched.queued;
+            g_sched.queued = NULL;
+            g_sched.running = job;
+            if (job) {
+                job->state = JOB_RUNNING;
+                job->startedAt = QpcNow();
+                job->ranInteractive = job->cls == JOB_INTERACTIVE;
+                SchedApplyClass(GetCurrentThread(), (JobClass)job->cls);
+            }
+            LeaveCriticalSection(&g_sched.lock);
+            if (!job) break;
+
+            TRACE_BEGIN("Conversion");
+            SchedRunJob(job);
+            TRACE_END("Conversion");
+
+            EnterCriticalSection(&g_sched.lock);
+            job->endedAt = QpcNow();
+            job->state = JOB_DONE;
+            g_sched.running = NULL;
+            LeaveCriticalSection(&g_sched.lock);
+            /* LogMessage is UI-thread only; report back through the message window */
+            PostMessage(g_hWndMain, WM_JOB_DONE, (WPARAM)job->id, 0);
+        }
+    }
+    return 0;
+}
+
+static BOOL SchedStart(void)
+{
+    if (g_sched.thread) return TRUE;
+    InitializeCriticalSection(&g_sched.lock);
+    g_sched.setThreadInformation = (PFN_SetThreadInformation)
+        GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetThreadInformation");
+    g_sched.wake = CreateEventW(NULL, FALSE, FALSE, NULL);
+    g_sched.thread = g_sched.wake ? CreateThread(NULL, 0, SchedThreadProc, NULL, 0, NULL) : NULL;
+    if (!g_sched.thread) {
+        LogMessage("ERROR: Could not start the conversion thread (%lu)", GetLastError());
+        if (g_sched.wake) CloseHandle(g_sched.wake);
+        g_sched.wake = NULL;
+        DeleteCriticalSection(&g_sched.lock);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void SchedFreeJob(ConvertJob *job)
+{
+    if (!job) return;
+    free(job->text);
+    free(job->thumb);
+    free(job->captureDib);
+    free(job);
+}
+
+static JobState SchedJobState(const ConvertJob *job)
+{
+    EnterCriticalSection(&g_sched.lock);
+    JobState state = job->state;
+    LeaveCriticalSection(&g_sched.lock);
+    return state;
+}
+
+/* Nothing queued and nothing running. */
+static BOOL SchedIdle(void)
+{
+    if (!g_sched.thread) return TRUE;
+    EnterCriticalSection(&g_sched.lock);
+    BOOL idle = !g_sched.queued && !g_sched.running;
+    LeaveCriticalSection(&g_sched.lock);
+    return idle;
+}
+
+/* A job for the clipboard image, with what the worker needs from the UI
+ * thread's state taken now. */
+static ConvertJob *SchedNewJob(DWORD clipSeq, const PipeOptions *opt, const char *profile,
+                               const char *reason, JobClass cls)
+{
+    ConvertJob *job = (ConvertJob *)calloc(1, sizeof(*job));
+    if (!job) return NULL;
+    job->id = ++g_sched.lastId;
+    job->clipSeq = clipSeq;
+    job->opt = *opt;
+    job->opt.maxMemory = (size_t)g_uiConfig->maxPasteMB * 1024 * 1024;
+    job->routeModel = g_routeModel;
+    lstrcpynA(job->profile, profile, sizeof(job->profile));
+    job->configVersion = g_uiConfig->version;
+    job->reason = reason;
+    job->cls = cls;
+    job->state = JOB_QUEUED;
+    job->queuedAt = QpcNow();
+    job->arenaKeep = g_pasteArena.base ? (size_t)g_pasteArenaMB * 1024 * 1024 : 0;
+    job->gdiplus = g_gdipStarted;
+    job->thumbnail = g_galleryKB != 0;
+    job->capture = g_captureEnabled;
+    return job;
+}
+
+/* Puts a job in the queue's one slot, which the caller has emptied of
+ * anything worth keeping. */
+static void SchedQueue(ConvertJob *job)
+{
+    EnterCriticalSection(&g_sched.lock);
+    g_sched.queued = job;
+    LeaveCriticalSection(&g_sched.lock);
+    SetEvent(g_sched.wake);
+}
+
+/* Raises a queued or running job to interactive at once. */
+static void SchedPromote(ConvertJob *job)
+{
+    EnterCriticalSection(&g_sched.lock);
+    JobState state = job->state;
+    BOOL promote = state != JOB_DONE && job->cls != JOB_INTERACTIVE;
+    if (promote) {
+        InterlockedExchange(&job->cls, JOB_INTERACTIVE);
+        if (state == JOB_RUNNING) SchedApplyClass(g_sched.thread, JOB_INTERACTIVE);
+    }
+    LeaveCriticalSection(&g_sched.lock);
+
+    if (promote)
+        LogMessage("Promoted the %s conversion of clipboard image #%lu to interactive after %lu ms",
+                   state == JOB_RUNNING ? "running" : "queued", job->clipSeq,
+                   (unsigned long)(QpcMicros(job->queuedAt, QpcNow()) / 1000));
+}
+
+/* Logs a finished job's queue wait and run time, once. */
+static void SchedReport(ConvertJob *job)
+{
+    if (job->reported) return;
+    job->reported = TRUE;
+    unsigned long waitMs = (unsigned long)(QpcMicros(job->queuedAt, job->startedAt) / 1000);
+    unsigned long runMs = (unsigned long)(QpcMicros(job->startedAt, job->endedAt) / 1000);
+    const char *cls = g_jobClassNames[job->cls];
+    const char *when = job->ranInteractive ? "for the paste" : "ahead of paste";
+
+    if (job->skipped) {
+        LogMessage("Conversion %s skipped (%s): %s, queued %lu ms, ran %lu ms",
+                   when, cls, job->skipped, waitMs, runMs);
+    } else if (job->status == PIPE_ERR_CANCELLED) {
+        LogMessage("Conversion %s cancelled (%s): %s, queued %lu ms, ran %lu ms",
+                   when, cls, g_convertCancelNames[job->cancel], waitMs, runMs);
+    } else if (job->status != PIPE_OK) {
+        LogMessage("Conversion %s failed (%s): %s, queued %lu ms, ran %lu ms",
+                   when, cls, pipeline_status_string(job->status), waitMs, runMs);
+    } else {
+        LogMessage("Converted clipboard image #%lu %s for profile \"%s\" (%s, %s): "
+                   "%ux%u -> %lu chars, queued %lu ms, ran %lu ms%s",
+                   job->clipSeq, when, job->profile, job->reason, cls, job->res.width,
+                   job->res.height, (unsigned long)job->res.base64Len, waitMs, runMs,
+                   job->res.bandsReused ? ", PNG bands reused" : "");
+    }
+}
+
+/* Drops the latest speculative job: now if it is queued or done, when it
+ * reports in if it is running, which it is told to stop. */
+static void SchedDropSpeculation(void)
+{
+    ConvertJob *job = g_specJob;
+    if (!job) return;
+    g_specJob = NULL;
+
+    EnterCriticalSection(&g_sched.lock);
+    if (g_sched.queued == job) g_sched.queued = NULL;
+    BOOL running = job->state == JOB_RUNNING;
+    LeaveCriticalSection(&g_sched.lock);
+    if (running) {
+        InterlockedCompareExchange(&job->cancel, CONVERT_CANCEL_SUPERSEDED, CONVERT_RUNNING);
+        job->nextOrphan = g_orphanJobs;
+        g_orphanJobs = job;
+    } else {
+        SchedFreeJob(job);
+    }
+}
+
+static BOOL SchedSameOutput(const PipeOptions *a, const PipeOptions *b)
+{
+    return a->format == b->format && a->level == b->level && a->quality == b->quality &&
+           a->text == b->text && a->maxTextBytes == b->maxTextBytes && a->route == b->route;
+}
+
+/* Queues a speculative conversion of the clipboard image with the foreground
+ * window's profile, unless one with the same result is already there. A
+ * paste being converted has the worker to itself. */
+static void SchedSpeculate(const char *reason)
+{
+    if (!g_speculate || g_pasteJob || !IsClipboardFormatAvailable(CF_DIB)) return;
+
+    const Profile *profile = g_fgMatch.valid && g_fgMatch.match.profile >= 0
+                           ? &g_uiConfig->profiles[g_fgMatch.match.profile] : NULL;
+    PipeOptions opt;
+    const char *name;
+    if (profile) {
+        profile_pipe_options(profile, &opt);
+        RouteOptions(profile, &opt);
+        name = profile->name;
+    } else if (g_lastPasteProfile[0]) {
+        opt = g_lastPasteOpt;
+        name = g_lastPasteProfile;
+    } else {
+        return;     /* nothing pasted yet, nothing to go by */
+    }
+
+    DWORD seq = GetClipboardSequenceNumber();
+    if (g_specJob && g_specJob->clipSeq == seq && SchedSameOutput(&g_specJob->opt, &opt)) return;
+    if (!SchedStart()) {
+        g_speculate = 0;
+        return;
+    }
+
+    ConvertJob *job = SchedNewJob(seq, &opt, name, reason, JOB_SPECULATIVE);
+    if (!job) return;
+    SchedDropSpeculation();
+    g_specJob = job;
+    SchedQueue(job);
+}
+
+/* Ctrl+V on a window with a profile while the clipboard holds an image:
+ * hands the conversion to the worker and returns at once, so the keyboard
+ * hook never waits for it. A speculative job for this image and these
+ * settings is promoted and kept; otherwise speculation is dropped and an
+ * interactive job queued, behind whatever the worker is finishing.
+ * SchedJobDone pastes the text. */
+static BOOL SchedPaste(const Profile *profile)
+{
+    PipeOptions opt;
+    profile_pipe_options(profile, &opt);
+    RouteOptions(profile, &opt);
+    if (!SchedStart()) return FALSE;
+
+    DWORD seq = GetClipboardSequenceNumber();
+    ConvertJob *job = g_specJob;
+    if (job && job->clipSeq == seq && SchedSameOutput(&job->opt, &opt) &&
+        (SchedJobState(job) != JOB_DONE || job->status == PIPE_OK)) {
+        g_specJob = NULL;
+        SchedPromote(job);
+    } else {
+        SchedDropSpeculation();
+        PasteArenaReserve();
+        job = SchedNewJob(seq, &opt, profile->name, "pasted", JOB_INTERACTIVE);
+        if (!job) {
+            LogMessage("ERROR: Out of memory queuing the conversion");
+            return FALSE;
+        }
+        /* Whatever still runs is of no use to the paste, which is queued
+         * behind it: it is cancelled and raised out of EcoQoS, so it
+         * reaches its next progress call soon */
+        EnterCriticalSection(&g_sched.lock);
+        ConvertJob *running = g_sched.running;
+        if (running) {
+            InterlockedCompareExchange(&running->cancel, CONVERT_CANCEL_SUPERSEDED, CONVERT_RUNNING);
+            SchedApplyClass(g_sched.thread, JOB_INTERACTIVE);
+        }
+        LeaveCriticalSection(&g_sched.lock);
+        SchedQueue(job);
+    }
+    job->paste = TRUE;
+    job->delivery = profile->delivery;
+    job->pastedAt = g_pasteStartQpc;
+    g_pasteJob = job;
+    ConvertBegin(job->profile);
+    if (SchedJobState(job) == JOB_DONE) PostMessage(g_hWndMain, WM_JOB_DONE, (WPARAM)job->id, 0);
+    return TRUE;
+}
+
+/* Logs why the paste's conversion failed; the job's own line said what
+ * failed. */
+static void PasteLogFailure(const ConvertJob *job)
+{
+    const PipeResult *res = &job->res;
+
+    if (job->status == PIPE_ERR_DECODE && res->dibResult != DIB_ERR_UNSUPPORTED) {
+        LogMessage("ERROR: DIB decode failed: %s", dib_result_string(res->dibResult));
+    } else if (job->status == PIPE_ERR_BUDGET) {
+        LogMessage("ERROR: %ux%u image does not fit the %lu byte budget of profile \"%s\" "
+                   "(%lu bytes at %ux%u after %d attempts)",
+                   res->width, res->height, (unsigned long)job->opt.maxTextBytes, job->profile,
+                   (unsigned long)pipeline_text_length(res->imageSize, res->format, job->opt.text),
+                   res->outWidth, res->outHeight, res->attempts);
+        ShowTrayNotification(L"Image too large",
+                             L"The image does not fit this application's size budget, even "
+                             L"scaled down. The paste was blocked.", NIIF_WARNING);
+    } else if (job->status == PIPE_ERR_MEMORY) {
+        if (res->width)
+            LogMessage("ERROR: Converting the %ux%u image needs more than MaxPasteMB (%lu MB), "
+                       "peak %lu KB with the DIB copy when it stopped", res->width, res->height,
+                       (unsigned long)(job->opt.maxMemory / (1024 * 1024)),
+                       (unsigned long)(res->peakBytes / 1024));
+        else
+            LogMessage("ERROR: The %lu KB DIB alone exceeds MaxPasteMB (%lu MB)",
+                       (unsigned long)(res->dibSize / 1024),
+                       (unsigned long)(job->opt.maxMemory / (1024 * 1024)));
+        ShowTrayNotification(L"Image too large",
+                             L"Converting this image would need more memory than allowed. "
+                             L"The paste was blocked.", NIIF_WARNING);
+    } else if (job->status == PIPE_ERR_CANCELLED) {
+        LogMessage("Conversion of the %ux%u image cancelled after %lu ms: %s", res->width, res->height,
+                   (unsigned long)(QpcMicros(job->pastedAt, job->endedAt) / 1000),
+                   g_convertCancelNames[job->cancel]);
+    } else if (job->status == PIPE_OK && !job->text) {
+        LogMessage("ERROR: Out of memory keeping the %lu chars of text",
+                   (unsigned long)res->base64Len);
+    }
+}
+
+/* Charges the worker's stage timings to the histograms and the capture,
+ * when the job ran for this paste from its start; a job that ran ahead only
+ * shows how long the paste waited for it, as the conversion total. */
+static void PasteRecordStages(const ConvertJob *job)
+{
+    if (job->ranInteractive) {
+        for (int s = 0; s < STAGE_COUNT; s++) {
+            if (!(job->stagesDone & (1u << s))) continue;
+            g_lastPasteMicros[s] = job->stageMicros[s];
+            stat_record(&g_stageStats[s], job->stageMicros[s], job->stageBytes[s]);
+        }
+    }
+    ULONGLONG waited = QpcMicros(job->pastedAt, job->endedAt);
+    g_lastPasteMicros[STAGE_CONVERT] = waited;
+    stat_record(&g_stageStats[STAGE_CONVERT], waited, job->res.dibSize);
+}
+
+/* Publishes the text of the paste's finished job and logs the conversion.
+ * Returns FALSE if there is nothing to paste. */
+static BOOL PasteDeliver(ConvertJob *job)
+{
+    const PipeResult *res = &job->res;
+    ClipAccess write;
+    ZeroMemory(&write, sizeof(write));
+
+    if (job->bih.biSize)
+        LogMessage("DIB: %ldx%ld, %d bpp, compression=%lu", job->bih.biWidth, job->bih.biHeight,
+                   job->bih.biBitCount, job->bih.biCompression);
+    if (job->captureDib) {
+        CaptureBegin(job->captureDib, job->captureSize);
+        job->captureDib = NULL;
+    }
+    PasteRecordStages(job);
+
+    BOOL ok = job->status == PIPE_OK && job->text;
+    if (ok) {
+        LONGLONG t = QpcNow();
+        ok = job->delivery == PROFILE_DELIVER_TYPE ? Type_PublishText(NULL, job->text, res->base64Len)
+                                                   : Clip_PublishText(&write, job->text, res->base64Len);
+        if (ok) StageRecord(STAGE_CLIP_WRITE, t, res->base64Len);
+    }
+
+    ClipAccess *ca = &job->access;
+    ULONGLONG hold = ca->holdMicros + write.holdMicros;
+    g_lastPasteMicros[STAGE_CLIP_HOLD] = hold;
+    if (hold) stat_record(&g_stageStats[STAGE_CLIP_HOLD], hold, res->dibSize);
+    if (!ca->ownerPid && !ca->retries) ca = &write;     /* the read was not contended */
+    if (ca->ownerPid || ca->retries) {
+        LogMessage("Clipboard: held %lu us, waited %lu us over %lu retries, busy with %s (pid %lu); "
+                   "%lu contended opens and %lu failures since start",
+                   (unsigned long)hold, (unsigned long)(job->access.waitMicros + write.waitMicros),
+                   job->access.retries + write.retries, ClipOwnerName(ca), ca->ownerPid,
+                   (unsigned long)g_clipContended, (unsigned long)g_clipFailures);
+    } else {
+        LogMessage("Clipboard: held %lu us, waited %lu us", (unsigned long)hold,
+                   (unsigned long)(job->access.waitMicros + write.waitMicros));
+    }
+
+    if (g_capture) {
+        g_capture->pngSize = res->imageSize;
+        g_capture->base64Len = res->base64Len;
+    }
+    if (!ok) {
+        PasteLogFailure(job);
+        return FALSE;
+    }
+
+    if (job->ranInteractive) {
+        BOOL inArena = job->arenaKeep != 0;
+        g_pasteFaults[inArena].pastes++;
+        g_pasteFaults[inArena].faults += job->faults;
+        g_pasteFaults[inArena].micros += QpcMicros(job->startedAt, job->endedAt);
+    }
+
+    LogMessage("Decoded image: %ux%u%s", res->width, res->height, res->usedFallback ? " (GDI+)" : "");
+    if (res->format == PIPE_FORMAT_JPEG) {
+        LogMessage("JPEG encoded: %lu bytes (quality %d)", (unsigned long)res->imageSize, res->quality);
+    } else {
+        LogMessage("PNG encoded: %lu bytes (effort %d)", (unsigned long)res->imageSize, res->level);
+        if (res->bandsReused)
+            LogMessage("PNG bands: %u of %u reused from the last paste, %u compressed",
+                       res->bandsReused, res->bands, res->bands - res->bandsReused);
+    }
+    if (res->attempts > 1) {
+        LogMessage("Size budget of %lu bytes met after %d attempts, at %ux%u",
+                   (unsigned long)job->opt.maxTextBytes, res->attempts, res->outWidth, res->outHeight);
+    }
+    /* Encode time at background priority says little about a paste's */
+    if (res->routed)
+        RouteReport(res, job->opt.route, job->ranInteractive ? job->stageMicros[STAGE_IMAGE_ENCODE] : 0);
+    if (job->delivery == PROFILE_DELIVER_TYPE) {
+        LogMessage("Kept %s text (%lu chars) to type; clipboard left as it was",
+                   pipeline_text_name(job->opt.text), (unsigned long)res->base64Len);
+    } else {
+        LogMessage("Clipboard replaced with %s text (%lu chars)",
+                   pipeline_text_name(job->opt.text), (unsigned long)res->base64Len);
+    }
+
+    /* The gallery entry: one line per paste, with its thumbnail */
+    DWORD thumb = 0;
+    if (job->thumb && (g_gallery.slotCount || thumb_arena_init(&g_gallery, (size_t)g_galleryKB * 1024))) {
+        thumb = thumb_arena_put(&g_gallery, job->thumb, &job->thumbInfo);
+    } else if (job->thumb) {
+        LogMessage("WARNING: Could not allocate a %lu KB thumbnail gallery, thumbnails disabled",
+                   (unsigned long)g_galleryKB);
+        g_galleryKB = 0;
+    }
+    LogThumbMessage(thumb, "Pasted %ux%u image: DIB %lu KB -> %s %lu KB -> text %lu KB",
+                    res->width, res->height, (unsigned long)(res->dibSize / 1024),
+                    res->format == PIPE_FORMAT_JPEG ? "JPEG" : "PNG",
+                    (unsigned long)((res->imageSize + 1023) / 1024),
+                    (unsigned long)((res->base64Len + 1023) / 1024));
+
+    if (job->ranInteractive) {
+        LogMessage("Peak memory %lu KB (%s), with the %lu KB DIB copy",
+                   (unsigned long)((res->peakBytes + 1023) / 1024),
+                   res->streamed ? "streamed" : "decoded in memory", (unsigned long)(res->dibSize / 1024));
+        LogMessage("Timings (us): open=%lu read=%lu decode=%lu thumb=%lu classify=%lu encode=%lu "
+                   "base64=%lu write=%lu total=%lu",
+                   (unsigned long)g_lastPasteMicros[STAGE_CLIP_OPEN],
+                   (unsigned long)g_lastPasteMicros[STAGE_CLIP_READ],
+                   (unsigned long)g_lastPasteMicros[STAGE_DIB_DECODE],
+                   (unsigned long)g_lastPasteMicros[STAGE_THUMBNAIL],
+                   (unsigned long)g_lastPasteMicros[STAGE_CLASSIFY],
+                   (unsigned long)g_lastPasteMicros[STAGE_IMAGE_ENCODE],
+                   (unsigned long)g_lastPasteMicros[STAGE_BASE64],
+                   (unsigned long)g_lastPasteMicros[STAGE_CLIP_WRITE],
+                   (unsigned long)g_lastPasteMicros[STAGE_CONVERT]);
+        if (job->arenaKeep) {
+            LogMessage("Page faults: %lu while converting, paste arena %lu KB used, %lu KB kept committed",
+                       job->faults, (unsigned long)(job->arenaUsed / 1024),
+                       (unsigned long)(job->arenaCommitted / 1024));
+        } else {
+            LogMessage("Page faults: %lu while converting, on the heap", job->faults);
+        }
+    } else {
+        LogMessage("Pasting the text converted ahead (waited %lu ms for it)",
+                   (unsigned long)(g_lastPasteMicros[STAGE_CONVERT] / 1000));
+    }
+    g_lastPasteOpt = job->opt;
+    lstrcpynA(g_lastPasteProfile, job->profile, sizeof(g_lastPasteProfile));
+    return TRUE;
+}
+
+/* The paste's job is done: pastes its text, or blocks the paste. A job that
+ * ran as speculation and gave up for a reason of its own, such as its size
+ * limit, and one that needs GDI+ now that it is started, run again as
+ * interactive jobs first. */
+static void SchedFinishPaste(void)
+{
+    ConvertJob *job = g_pasteJob;
+    SchedReport(job);
+
+    BOOL again = job->skipped && !job->ranInteractive && !job->cancel;
+    if (job->needsGdiplus && EnsureGdiplus()) {
+        LogMessage("DIB format not handled natively, converting again with GDI+");
+        again = TRUE;
+    }
+    ConvertJob *retry = again ? SchedNewJob(job->clipSeq, &job->opt, job->profile, "pasted",
+                                            JOB_INTERACTIVE) : NULL;
+    if (retry) {
+        retry->paste = TRUE;
+        retry->delivery = job->delivery;
+        retry->pastedAt = job->pastedAt;
+        g_pasteJob = retry;
+        SchedFreeJob(job);
+        SchedQueue(retry);
+        return;
+    }
+
+    g_pasteJob = NULL;
+    ConvertEnd();
+    if (PasteDeliver(job)) {
+        LogMessage("Conversion successful, deferring %s",
+                   job->delivery == PROFILE_DELIVER_TYPE ? "typing" : "re-injection");
+        PostMessage(g_hWndMain, WM_DO_PASTE, (WPARAM)job->delivery, 0);
+    } else {
+        LogMessage(job->status == PIPE_ERR_CANCELLED ? "Conversion cancelled, blocking paste"
+                                                     : "Conversion FAILED, blocking paste");
+        CaptureFinish(TRUE);
+        StatsChanged();
+    }
+    SchedFreeJob(job);
+}
+
+/* The worker stops the paste's job at its next check; the first reason wins. */
+static void SchedCancelPaste(ConvertCancel why)
+{
+    if (g_pasteJob) InterlockedCompareExchange(&g_pasteJob->cancel, why, CONVERT_RUNNING);
+}
+
+/* ID_TIMER_CONVERT_PROGRESS: the paste is still converting. */
+static void SchedProgressTick(void)
+{
+    ConvertJob *job = g_pasteJob;
+    if (!job) return;
+
+    PipeProgress p;
+    EnterCriticalSection(&g_sched.lock);
+    p = job->progress;
+    LeaveCriticalSection(&g_sched.lock);
+
+    if (ConvertFocusLost()) SchedCancelPaste(CONVERT_CANCEL_FOCUS);
+    ConvertShowProgress(&p, QpcMicros(job->pastedAt, QpcNow()) / 1000);
+}
+
+/* WM_JOB_DONE: a job finished on the worker. */
+static void SchedJobDone(DWORD id)
+{
+    for (ConvertJob **p = &g_orphanJobs; *p; p = &(*p)->nextOrphan) {
+        if ((*p)->id == id) {
+            ConvertJob *job = *p;
+            *p = job->nextOrphan;
+            SchedFreeJob(job);      /* superseded; its result is of no use */
+            return;
+        }
+    }
+    if (g_pasteJob && g_pasteJob->id == id) {
+        SchedFinishPaste();
+        return;
+    }
+    ConvertJob *job = g_specJob;
+    if (!job || job->id != id) return;      /* already pasted */
+    SchedReport(job);
+    if (job->status != PIPE_OK) SchedDropSpeculation();
+}
+
+/* WM_CLIPBOARDUPDATE: drops speculation on the old contents and converts
+ * a new image ahead. Our own text replacing the image changes it too. */
+static void SchedClipboardChanged(void)
+{
+    if (g_specJob && g_specJob->clipSeq != GetClipboardSequenceNumber()) SchedDropSpeculation();
+    SchedSpeculate("copied");
+}
+
+/* ── Paste re-injection ─────────────────────────────────────────────────── */
+
+/* Sends Ctrl+V, after letting go of a Shift still held for the paste
+ * hotkey. The hook sees it come back and ends the paste; without the hook
+ * the paste ends once the keys are queued. */
+static void SimulateCtrlV(void)
+{
+    INPUT inputs[5];
+    UINT n = 0;
+    ZeroMemory(inputs, sizeof(inputs));
+
+    if (GetAsyncKeyState(VK_SHIFT) & 0x8000) {
+        inputs[n].type = INPUT_KEYBOARD;
+        inputs[n].ki.wVk = VK_SHIFT;
+        inputs[n++].ki.dwFlags = KEYEVENTF_KEYUP;
+    }
+
+    g_reinjectQpc = QpcNow();
+    if (g_hHook) g_bSkipNextPaste = TRUE;
+
+    /* Ctrl key down */
+    inputs[n].type = INPUT_KEYBOARD;
+    inputs[n++].ki.wVk = VK_CONTROL;
+
+    /* V key down */
+    inputs[n].type = INPUT_KEYBOARD;
+    inputs[n++].ki.wVk = 'V';
+
+    /* V key up */
+    inputs[n].type = INPUT_KEYBOARD;
+    inputs[n].ki.wVk = 'V';
+    inputs[n++].ki.dwFlags = KEYEVENTF_KEYUP;
+
+    /* Ctrl key up */
+    inputs[n].type = INPUT_KEYBOARD;
+    inputs[n].ki.wVk = VK_CONTROL;
+    inputs[n++].ki.dwFlags = KEYEVENTF_KEYUP;
+
+    SendInput(n, inputs, sizeof(INPUT));
+    LogMessage("Simulated Ctrl+V (re-injection)");
+
+    if (!g_hHook) {
+        StageRecord(STAGE_REINJECT, g_reinjectQpc, 0);
+        StageRecord(STAGE_END_TO_END, g_pasteStartQpc, 0);
+        g_reinjectQpc = 0;
+        CaptureFinish(FALSE);
+        StatsChanged();
+    }
+}
+
+/* ── Profiles ──────────────────────────────────────────────────────────── */
+
+static void FreeProfiles(Profile *profiles, int count)
+{
+    for (int i = 0; i < count; i++) profile_free(&profiles[i]);
+    free(profiles);
+}
+
+/* A snapshot of `profiles`, which it takes ownership of, with each
+ * profile's rule lists compiled into the automata the foreground refresh
+ * scans. Logs nothing, so any thread can build one; a profile that fails to
+ * compile matches nothing. Returns NULL when out of memory. */
+static ConfigSnapshot *ConfigBuild(Profile *profiles, int count, DWORD maxPasteMB)
+{
+    ConfigSnapshot *s = (ConfigSnapshot *)calloc(1, sizeof(*s));
+    if (!s) {
+        FreeProfiles(profiles, count);
+        return NULL;
+    }
+    LONGLONG t = QpcNow();
+    s->profiles = profiles;
+    s->count = count;
+    s->maxPasteMB = maxPasteMB;
+    for (int i = 0; i < count; i++) {
+        Profile *p = &profiles[i];
+        if (!profile_compile(p)) {
+            s->compileFailures++;
+            continue;
+        }
+        for (int f = 0; f < PROFILE_FIELD_COUNT; f++) {
+            if (profile_uses(p, (ProfileField)f)) s->use[f] = TRUE;
+            s->rules += matcher_rule_count(p->matchers[f]);
+            s->states += matcher_state_count(p->matchers[f]);
+            s->bytes += matcher_memory_bytes(p->matchers[f]);
+        }
+    }
+    s->compileMicros = QpcMicros(t, QpcNow());
+    return s;
+}
+
+static void ConfigFree(ConfigSnapshot *s)
+{
+    if (!s) return;
+    FreeProfiles(s->profiles, s->count);
+    free(s);
+}
+
+static const Profile *DefaultProfile(void)
+{
+    return g_uiConfig->count > 0 ? &g_uiConfig->profiles[g_uiConfig->count - 1] : NULL;
+}
+
+/* A profile name is used as a registry key name */
+static BOOL IsValidProfileName(const char *name)
+{
+    if (!name[0] || strlen(name) >= PROFILE_MAX_NAME) return FALSE;
+    if (_stricmp(name, DEFAULT_PROFILE_NAME) == 0) return FALSE;
+    return strchr(name, '\\') == NULL;
+}
+
+static void LogProfiles(void)
+{
+    for (int i = 0; i < g_uiConfig->count; i++) {
+        const Profile *p = &g_uiConfig->profiles[i];
+        LogMessage("Profile \"%s\": %s, effort %d, quality %d, budget %lu, %s, %s, route %s",
+                   p->name, pipeline_format_name(p->format), p->level, p->quality,
+                   (unsigned long)p->maxTextBytes, pipeline_text_name(p->text),
+                   profile_delivery_name(p->delivery), route_policy_name(p->route));
+        /* One line per rule list, cut short where it would not fit the entry */
+        for (int f = 0; f < PROFILE_FIELD_COUNT; f++) {
+            if (p->rules[f][0])
+                LogMessage("  %s=\"%.400s\"%s", profile_field_name((ProfileField)f), p->rules[f],
+                           strlen(p->rules[f]) > 400 ? "..." : "");
+        }
+    }
+}
+
+/* ── Registry configuration ──────────────────────────────────────────── */
+
+/* Returns a malloc'd copy of a REG_SZ value, or NULL if it is absent. */
+static char *RegReadString(HKEY hKey, const char *name)
+{
+    DWORD type, size = 0;
+    if (RegQueryValueExA(hKey, name, NULL, &type, NULL, &size) != ERROR_SUCCESS
+        || type != REG_SZ) return NULL;
+    char *value = (char *)calloc(size + 1, 1);
+    if (value && RegQueryValueExA(hKey, name, NULL, &type, (LPBYTE)value, &size) != ERROR_SUCCESS) {
+        free(value);
+        value = NULL;
+    }
+    return value;
+}
+
+static BOOL RegReadDword(HKEY hKey, const char *name, DWORD *out)
+{
+    DWORD type, value = 0, size = sizeof(value);
+    if (RegQueryValueExA(hKey, name, NULL, &type, (LPBYTE)&value, &size) != ERROR_SUCCESS
+        || type != REG_DWORD) return FALSE;
+    *out = value;
+    return TRUE;
+}
+
+static void RegWriteString(HKEY hKey, const char *name, const char *value)
+{
+    RegSetValueExA(hKey, name, 0, REG_SZ, (const BYTE*)value, (DWORD)(strlen(value) + 1));
+}
+
+static void RegWriteDword(HKEY hKey, const char *name, DWORD value)
+{
+    RegSetValueExA(hKey, name, 0, REG_DWORD, (const BYTE*)&value, sizeof(value));
+}
+
+static const char *g_profileRuleValues[PROFILE_FIELD_COUNT] = {
+    REG_VALUE_EXE, REG_VALUE_CLASS, REG_VALUE_TITLE
+};
+
+/* Reads the rule lists and encoder settings of one profile; absent or
+ * invalid values keep the defaults profile_init() set. */
+static void LoadProfile(HKEY hKey, Profile *p)
+{
+    for (int f = 0; f < PROFILE_FIELD_COUNT; f++) {
+        char *rules = RegReadString(hKey, g_profileRuleValues[f]);
+        if (rules) profile_set_rules(p, (ProfileField)f, rules);
+        free(rules);
+    }
+
+    char *format = RegReadString(hKey, REG_VALUE_FORMAT);
+    if (format && pipeline_parse_format(format) >= 0) p->format = (PipeFormat)pipeline_parse_format(format);
+    free(format);
+
+    char *text = RegReadString(hKey, REG_VALUE_TEXTENC);
+    if (text && pipeline_parse_text(text) >= 0) p->text = (PipeTextEncoding)pipeline_parse_text(text);
+    free(text);
+
+    char *delivery = RegReadString(hKey, REG_VALUE_DELIVERY);
+    if (delivery && profile_parse_delivery(delivery) >= 0)
+        p->delivery = (ProfileDelivery)profile_parse_delivery(delivery);
+    free(delivery);
+
+    char *route = RegReadString(hKey, REG_VALUE_ROUTE);
+    if (route && route_parse_policy(route) >= 0) p->route = (RoutePolicy)route_parse_policy(route);
+    free(route);
+
+    DWORD value;
+    if (RegReadDword(hKey, REG_VALUE_EFFORT, &value) && value <= 9) p->level = (int)value;
+    if (RegReadDword(hKey, REG_VALUE_QUALITY, &value) && value >= 1 && value <= 100) p->quality = (int)value;
+    if (RegReadDword(hKey, REG_VALUE_MAXBYTES, &value)) p->maxTextBytes = value;
+}
+
+static void SaveProfile(HKEY hKey, const Profile *p)
+{
+    for (int f = 0; f < PROFILE_FIELD_COUNT; f++)
+        RegWriteString(hKey, g_profileRuleValues[f], p->rules[f]);
+    RegWriteString(hKey, REG_VALUE_FORMAT, pipeline_format_name(p->format));
+    RegWriteString(hKey, REG_VALUE_TEXTENC, pipeline_text_name(p->text));
+    RegWriteString(hKey, REG_VALUE_DELIVERY, profile_delivery_name(p->delivery));
+    RegWriteString(hKey, REG_VALUE_ROUTE, route_policy_name(p->route));
+    RegWriteDword(hKey, REG_VALUE_EFFORT, (DWORD)p->level);
+    RegWriteDword(hKey, REG_VALUE_QUALITY, (DWORD)p->quality);
+    RegWriteDword(hKey, REG_VALUE_MAXBYTES, (DWORD)p->maxTextBytes);
+}
+
+typedef struct {
+    DWORD   order;
+    Profile profile;
+} OrderedProfile;
+
+static int CompareProfileOrder(const void *a, const void *b)
+{
+    const OrderedProfile *pa = (const OrderedProfile *)a, *pb = (const OrderedProfile *)b;
+    if (pa->order != pb->order) return pa->order < pb->order ? -1 : 1;
+    return _stricmp(pa->profile.name, pb->profile.name);
+}
+
+/* Loads the Profiles sub-keys in Order, followed by the default profile from
+ * the root key, into a new list. A key without TitleMatch gets
+ * DEFAULT_TITLE_MATCH for the default profile, as before profiles existed,
+ * and so does a missing key (`hRoot` NULL). */
+static BOOL LoadProfilesFromRegistry(HKEY hRoot, Profile **out, int *outCount)
+{
+    OrderedProfile *list = (OrderedProfile *)calloc(MAX_PROFILES + 1, sizeof(OrderedProfile));
+    int count = 0;
+    if (!list) return FALSE;
+
+    HKEY hProfiles;
+    if (RegOpenKeyExA(HKEY_CURRENT_USER, REG_KEY_PROFILES, 0, KEY_READ, &hProfiles) == ERROR_SUCCESS) {
+        char name[256];
+        for (DWORD i = 0; count < MAX_PROFILES; i++) {
+            DWORD nameLen = sizeof(name);
+            LONG r = RegEnumKeyExA(hProfiles, i, name, &nameLen, NULL, NULL, NULL, NULL);
+            if (r == ERROR_NO_MORE_ITEMS) break;
+            if (r != ERROR_SUCCESS || !IsValidProfileName(name)) continue;
+
+            HKEY hProfile;
+            if (RegOpenKeyExA(hProfiles, name, 0, KEY_READ, &hProfile) != ERROR_SUCCESS) continue;
+            OrderedProfile *op = &list[count];
+            if (profile_init(&op->profile, name)) {
+                op->order = MAXDWORD;
+                RegReadDword(hProfile, REG_VALUE_ORDER, &op->order);
+                LoadProfile(hProfile, &op->profile);
+                count++;
+            }
+            RegCloseKey(hProfile);
+        }
+        RegCloseKey(hProfiles);
+    }
+    qsort(list, (size_t)count, sizeof(OrderedProfile), CompareProfileOrder);
+
+    Profile *profiles = (Profile *)calloc((size_t)count + 1, sizeof(Profile));
+    if (!profiles || !profile_init(&profiles[count], DEFAULT_PROFILE_NAME)) {
+        for (int i = 0; i < count; i++) profile_free(&list[i].profile);
+        free(list);
+        free(profiles);
+        return FALSE;
+    }
+    for (int i = 0; i < count; i++) profiles[i] = list[i].profile;
+    free(list);
+
+    profile_set_rules(&profiles[count], PROFILE_FIELD_TITLE, DEFAULT_TITLE_MATCH);
+    if (hRoot) LoadProfile(hRoot, &profiles[count]);
+    *out = profiles;
+    *outCount = count + 1;
+    return TRUE;
+}
+
+/* Reads the profiles and the per-paste settings into a new snapshot. Logs
+ * nothing, so the watcher can call it; returns NULL when out of memory. */
+static ConfigSnapshot *ConfigLoad(void)
+{
+    HKEY hKey;
+    if (RegOpenKeyExA(HKEY_CURRENT_USER, REG_KEY_PATH, 0, KEY_READ, &hKey) != ERROR_SUCCESS) hKey = NULL;
+
+    Profile *profiles = NULL;
+    int count = 0;
+    BOOL ok = LoadProfilesFromRegistry(hKey, &profiles, &count);
+
+    DWORD maxPasteMB = PASTE_DEFAULT_MAX_MB;
+    if (hKey && RegReadDword(hKey, REG_VALUE_MAX_PASTE_MB, &maxPasteMB) && maxPasteMB > PASTE_MAX_MB)
+        maxPasteMB = PASTE_MAX_MB;
+
+    if (hKey) RegCloseKey(hKey);
+    return ok ? ConfigBuild(profiles, count, maxPasteMB) : NULL;
+}
+
+/* The settings the UI thread applies itself, read at startup and again
+ * whenever the registry changes. */
+static void LoadSettingsFromRegistry(void)
+{
+    HKEY hKey;
+    LONG result = RegOpenKeyExA(HKEY_CURRENT_USER, REG_KEY_PATH, 0, KEY_READ, &hKey);
+    if (result != ERROR_SUCCESS) return;
+
+    DWORD traceEnabled = 0;
+    if (RegReadDword(hKey, REG_VALUE_TRACE, &traceEnabled)) {
+        trace_set_enabled(traceEnabled != 0);
+    }
+
+    DWORD captureEnabled = 0;
+    if (RegReadDword(hKey, REG_VALUE_CAPTURE, &captureEnabled)) {
+        g_captureEnabled = captureEnabled != 0;
+    }
+
+    DWORD idleMinutes = 0;
+    if (RegReadDword(hKey, REG_VALUE_WEBVIEW_IDLE, &idleMinutes)) {
+        /* SetTimer takes at most USER_TIMER_MAXIMUM (about 24 days) */
+        g_webviewIdleMinutes = idleMinutes < WEBVIEW_MAX_IDLE_MINUTES ? idleMinutes
+                                                                     : WEBVIEW_MAX_IDLE_MINUTES;
+    }
+
+    DWORD prewarm = 0;
+    if (RegReadDword(hKey, REG_VALUE_WEBVIEW_PREWARM, &prewarm)) {
+        g_webviewPrewarm = prewarm != 0;
+    }
+
+    /* Read once: the gallery is allocated at the first paste and keeps its size */
+    DWORD galleryKB = 0;
+    if (!g_gallery.slotCount && RegReadDword(hKey, REG_VALUE_GALLERY_KB, &galleryKB)) {
+        g_galleryKB = galleryKB < GALLERY_MAX_KB ? galleryKB : GALLERY_MAX_KB;
+    }
+
+    DWORD arenaMB = 0;
+    if (RegReadDword(hKey, REG_VALUE_PASTE_ARENA_MB, &arenaMB)) {
+        g_pasteArenaMB = arenaMB < PASTE_ARENA_MAX_MB ? arenaMB : PASTE_ARENA_MAX_MB;
+        if (g_pasteArenaMB == 0 && SchedIdle()) arena_release(&g_pasteArena);
+    }
+
+    DWORD speculate = 0;
+    if (RegReadDword(hKey, REG_VALUE_SPECULATE, &speculate)) {
+        g_speculate = speculate != 0;
+        if (!g_speculate) SchedDropSpeculation();
+    }
+
+    DWORD eagerInit = 0;
+    if (RegReadDword(hKey, REG_VALUE_EAGER_INIT, &eagerInit)) {
+        g_eagerInit = eagerInit != 0;
+    }
+
+    /* A larger ring takes effect as the log grows into it; a smaller one
+     * once the log is cleared */
+    DWORD logEntries = 0;
+    if (RegReadDword(hKey, REG_VALUE_LOG_ENTRIES, &logEntries)) {
+        g_logMax = logEntries < LOG_RING_MIN ? LOG_RING_MIN
+                 : logEntries > LOG_RING_MAX ? LOG_RING_MAX : (int)logEntries;
+    }
+
+    char *trigger = RegReadString(hKey, REG_VALUE_TRIGGER);
+    if (trigger) {
+        for (int i = 0; i < TRIGGER_COUNT; i++) {
+            if (strcmp(trigger, g_triggerNames[i]) == 0) g_triggerWanted = (TriggerMode)i;
+        }
+        free(trigger);
+    }
+
+    RegCloseKey(hKey);
+
+    /* At startup WinMain applies it once the window exists */
+    if (g_hWndMain) TriggerApply();
+}
+
+/* Writes the default profile to the root key and rewrites the Profiles
+ * sub-keys from scratch, so renamed and removed profiles disappear. */
+static void SaveConfigToRegistry(void)
+{
+    HKEY hKey;
+    DWORD disposition;
+    LONG result = RegCreateKeyExA(HKEY_CURRENT_USER, REG_KEY_PATH, 0, NULL,
+                                  REG_OPTION_NON_VOLATILE, KEY_READ | KEY_WRITE | DELETE, NULL,
+                                  &hKey, &disposition);
+    if (result != ERROR_SUCCESS) return;
+
+    const ConfigSnapshot *config = g_uiConfig;
+    if (config->count > 0) SaveProfile(hKey, DefaultProfile());
+    RegDeleteTreeA(hKey, "Profiles");
+    RegCloseKey(hKey);
+
+    for (int i = 0; i < config->count - 1; i++) {
+        char path[sizeof(REG_KEY_PROFILES) + PROFILE_MAX_NAME + 1];
+        snprintf(path, sizeof(path), "%s\\%s", REG_KEY_PROFILES, config->profiles[i].name);
+        if (RegCreateKeyExA(HKEY_CURRENT_USER, path, 0, NULL, REG_OPTION_NON_VOLATILE,
+                            KEY_WRITE, NULL, &hKey, &disposition) != ERROR_SUCCESS) {
+            LogMessage("ERROR: Could not save profile \"%s\"", config->profiles[i].name);
+            continue;
+        }
+        SaveProfile(hKey, &config->profiles[i]);
+        RegWriteDword(hKey, REG_VALUE_ORDER, (DWORD)i);
+        RegCloseKey(hKey);
+    }
+    LogMessage("Configuration saved to registry: %d profile(s)", config->count);
+}
+
+static void SaveFlagToRegistry(const char *name, BOOL enabled)
+{
+    HKEY hKey;
+    DWORD disposition;
+    if (RegCreateKeyExA(HKEY_CURRENT_USER, REG_KEY_PATH, 0, NULL,
+                        REG_OPTION_NON_VOLATILE, KEY_WRITE, NULL,
+                        &hKey, &disposition) != ERROR_SUCCESS) return;
+    DWORD value = enabled ? 1 : 0;
+    RegSetValueExA(hKey, name, 0, REG_DWORD, (const BYTE*)&value, sizeof(value));
+    RegCloseKey(hKey);
+}
+
+/* ── Configuration snapshots ───────────────────────────────────────────── */
+
+/* The UI thread, which also runs the keyboard hook, and the conversion
+ * worker read the configuration without taking a lock. g_config points to
+ * the latest snapshot and is swapped atomically when one is published.
+ * Each reading thread announces the snapshot it holds in its slot of
+ * g_configReaders; a replaced snapshot is retired and freed once no slot
+ * holds it. The UI thread holds g_uiConfig from one reload to the next and
+ * only moves on from the message loop, where nothing on its stack points
+ * into the old one, so the hook never sees profiles change under it. A
+ * watcher thread reloads the key whenever anything under it changes, from
+ * the fleet management tool, regedit or our own saves, and publishes a new
+ * snapshot if the profiles differ. */
+
+#define CONFIG_SETTLE_MS   250      /* editors write value by value; reload once they stop */
+
+static struct {
+    CRITICAL_SECTION lock;          /* between publishers; readers never take it */
+    LONG             version;
+    ConfigSnapshot  *retired;       /* replaced, freed once no reader holds them */
+    HANDLE           watchThread;
+    HANDLE           watchStop;     /* manual-reset */
+} g_configWriter;
+
+static PVOID volatile g_configReaders[CONFIG_READER_COUNT];   /* held snapshot per reader */
+
+static BOOL ConfigSame(const ConfigSnapshot *a, const ConfigSnapshot *b)
+{
+    if (a->count != b->count || a->maxPasteMB != b->maxPasteMB) return FALSE;
+    for (int i = 0; i < a->count; i++) {
+        if (!profile_equal(&a->profiles[i], &b->profiles[i])) return FALSE;
+    }
+    return TRUE;
+}
+
+/* The latest snapshot, valid until the reader's next ConfigRelease or
+ * ConfigAcquire. Once the slot is set, the pointer is read again: if it
+ * still matches, no publisher can have missed the slot. */
+static const ConfigSnapshot *ConfigAcquire(ConfigReader reader)
+{
+    ConfigSnapshot *s;
+    do {
+        s = g_config;
+        InterlockedExchangePointer(&g_configReaders[reader], s);
+    } while (s != g_config);
+    return s;
+}
+
+static void ConfigRelease(ConfigReader reader)
+{
+    InterlockedExchangePointer(&g_configReaders[reader], NULL);
+}
+
+/* Frees retired snapshots no reader holds. Under g_configWriter.lock. */
+static void ConfigReclaim(void)
+{
+    ConfigSnapshot **p = &g_configWriter.retired;
+    while (*p) {
+        ConfigSnapshot *s = *p;
+        BOOL held = FALSE;
+        for (int r = 0; r < CONFIG_READER_COUNT; r++) held |= g_configReaders[r] == s;
+        if (held) {
+            p = &s->nextRetired;
+        } else {
+            *p = s->nextRetired;
+            ConfigFree(s);
+        }
+    }
+}
+
+/* Makes `s` the current configuration, unless it is the same as the current
+ * one. Takes ownership of `s`. Any thread. */
+static BOOL ConfigPublish(ConfigSnapshot *s)
+{
+    EnterCriticalSection(&g_configWriter.lock);
+    ConfigSnapshot *old = g_config;
+    BOOL changed = !old || !ConfigSame(s, old);
+    if (changed) {
+        s->version = ++g_configWriter.version;
+        InterlockedExchangePointer((PVOID volatile *)&g_config, s);
+        if (old) {
+            old->nextRetired = g_configWriter.retired;
+            g_configWriter.retired = old;
+        }
+        ConfigReclaim();
+    } else {
+        ConfigFree(s);
+    }
+    LeaveCriticalSection(&g_configWriter.lock);
+    return changed;
+}
+
+/* Moves the UI thread, and with it the hook, to the latest snapshot.
+ * Returns FALSE if it already had it. */
+static BOOL ConfigAdopt(void)
+{
+    LONG was = g_uiConfig ? g_uiConfig->version : 0;
+    g_uiConfig = ConfigAcquire(CONFIG_READER_UI);
+    EnterCriticalSection(&g_configWriter.lock);
+    ConfigReclaim();
+    LeaveCriticalSection(&g_configWriter.lock);
+    if (g_uiConfig->version == was) return FALSE;
+
+    const ConfigSnapshot *s = g_uiConfig;
+    g_fgMatch.valid = FALSE;   /* profile and rule indexes refer to the old list */
+    if (s->compileFailures)
+        LogMessage("ERROR: Out of memory compiling the rules of %d profile(s), they match nothing",
+                   s->compileFailures);
+    LogMessage("Compiled %lu rule(s) in %d profile(s) into %lu states (%lu KB) in %lu us",
+               (unsigned long)s->rules, s->count, (unsigned long)s->states,
+               (unsigned long)((s->bytes + 1023) / 1024), (unsigned long)s->compileMicros);
+    return TRUE;
+}
+
+/* Loads and adopts the first snapshot, before any other thread runs. */
+static BOOL ConfigStart(void)
+{
+    InitializeCriticalSection(&g_configWriter.lock);
+    ConfigSnapshot *s = ConfigLoad();
+    if (!s) return FALSE;
+    ConfigPublish(s);
+    ConfigAdopt();
+    return TRUE;
+}
+
+/* Publishes a new snapshot whenever anything under the key changes and
+ * tells the UI thread, which re-reads its own settings and adopts it. */
+static DWORD WINAPI ConfigWatchProc(LPVOID param)
+{
+    (void)param;
+    trace_set_thread_name("Config watcher");
+
+    HANDLE changed = CreateEventW(NULL, FALSE, FALSE, NULL);
+    HANDLE waits[2] = { g_configWriter.watchStop, changed };
+    HKEY hKey = NULL;
+    BOOL armed = FALSE, pending = FALSE;
+    LONG error = changed ? ERROR_SUCCESS : (LONG)GetLastError();
+
+    while (error == ERROR_SUCCESS) {
+        /* Created if missing, so that there is a key to watch */
+        if (!hKey) {
+            error = RegCreateKeyExA(HKEY_CURRENT_USER, REG_KEY_PATH, 0, NULL, REG_OPTION_NON_VOLATILE,
+                                    KEY_READ | KEY_NOTIFY, NULL, &hKey, NULL);
+            if (error != ERROR_SUCCESS) break;
+            armed = FALSE;
+        }
+        if (!armed) {
+            error = RegNotifyChangeKeyValue(hKey, TRUE, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET,
+                                            changed, TRUE);
+            if (error == ERROR_KEY_DELETED) {
+                /* The defaults apply until it is written again */
+                RegCloseKey(hKey);
+                hKey = NULL;
+                pending = TRUE;
+                error = ERROR_SUCCESS;
+                continue;
+            }
+            if (error != ERROR_SUCCESS) break;
+            armed = TRUE;
+        }
+
+        DWORD w = WaitForMultipleObjects(2, waits, FALSE, pending ? CONFIG_SETTLE_MS : INFINITE);
+        if (w == WAIT_OBJECT_0 + 1) {
+            armed = FALSE;
+            pending = TRUE;
+        } else if (w == WAIT_TIMEOUT) {
+            pending = FALSE;
+            ConfigSnapshot *s = ConfigLoad();
+            if (s) {
+                ConfigPublish(s);
+                PostMessage(g_hWndMain, WM_CONFIG_CHANGED, 0, 0);
+            }
+        } else {
+            break;      /* stopping */
+        }
+    }
+
+    if (hKey) RegCloseKey(hKey);
+    if (changed) CloseHandle(changed);
+    /* LogMessage is UI-thread only; report back through the message window */
+    if (error != ERROR_SUCCESS) PostMessage(g_hWndMain, WM_CONFIG_CHANGED, 0, (LPARAM)error);
+    return 0;
+}
+
+static void ConfigWatchStart(void)
+{
+    g_configWriter.watchStop = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (g_configWriter.watchStop)
+        g_configWriter.watchThread = CreateThread(NULL, 0, ConfigWatchProc, NULL, 0, NULL);
+    if (!g_configWriter.watchThread)
+        LogMessage("WARNING: Could not watch the registry (%lu), configuration changes apply "
+                   "at the next start", GetLastError());
+}
+
+static void ConfigWatchStop(void)
+{
+    if (!g_configWriter.watchThread) return;
+    SetEvent(g_configWriter.watchStop);
+    WaitForSingleObject(g_configWriter.watchThread, 1000);
+    CloseHandle(g_configWriter.watchThread);
+    CloseHandle(g_configWriter.watchStop);
+    g_configWriter.watchThread = g_configWriter.watchStop = NULL;
+}
+
+/* WM_CONFIG_CHANGED: the watcher reloaded the key, or stopped on `error`. */
+static void ConfigChanged(LONG error)
+{
+    if (error != ERROR_SUCCESS) {
+        LogMessage("WARNING: Stopped watching the registry (%ld), configuration changes apply "
+                   "at the next start", error);
+        return;
+    }
+    LoadSettingsFromRegistry();
+    if (!ConfigAdopt()) return;
+    UpdateTooltip();
+    LogMessage("Configuration reloaded from the registry (version %ld):", g_uiConfig->version);
+    LogProfiles();
+}
+
+/* ── Process path cache ────────────────────────────────────────────────── */
+
+/* Full image path of a process, cached per PID. QueryFullProcessImageName
+ * costs a kernel round trip and an open handle; terminals keep their PID for
+ * the whole session, so the foreground refresh almost always hits. An entry
+ * whose process has exited is dropped (its PID may then be reused). Returns
+ * an empty string when the process cannot be opened, e.g. an elevated one. */
+static const WCHAR *LookupProcessPath(DWORD pid)
+{
+    ProcessPathEntry *victim = NULL;
+
+    for (int i = 0; i < PROCESS_CACHE_SIZE; i++) {
+        ProcessPathEntry *e = &g_processCache[i];
+        if (e->hProcess && e->pid == pid) {
+            if (WaitForSingleObject(e->hProcess, 0) == WAIT_TIMEOUT) {
+                g_processCacheHits++;
+                e->lastUse = ++g_processCacheClock;
+                return e->path;
+            }
+            CloseHandle(e->hProcess);
+            e->hProcess = NULL;
+        }
+        if (!e->hProcess) {
+            if (!victim || victim->hProcess) victim = e;
+        } else if (!victim || (victim->hProcess && e->lastUse < victim->lastUse)) {
+            victim = e;
+        }
+    }
+
+    g_processCacheMisses++;
+    HANDLE h = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | SYNCHRONIZE, FALSE, pid);
+    if (!h) return L"";
+    WCHAR path[MAX_PATH];
+    DWORD len = MAX_PATH;
+    if (!QueryFullProcessImageNameW(h, 0, path, &len)) {
+        CloseHandle(h);
+        return L"";
+    }
+
+    if (victim->hProcess) CloseHandle(victim->hProcess);
+    victim->pid = pid;
+    victim->hProcess = h;
+    victim->lastUse = ++g_processCacheClock;
+    memcpy(victim->path, path, (len + 1) * sizeof(WCHAR));
+    return victim->path;
+}
+
+static void FlushProcessCache(void)
+{
+    for (int i = 0; i < PROCESS_CACHE_SIZE; i++) {
+        if (g_processCache[i].hProcess) CloseHandle(g_processCache[i].hProcess);
+        g_processCache[i].hProcess = NULL;
+    }
+}
+
+/* ── Foreground match cache ────────────────────────────────────────────── */
+
+/* GetWindowTextW on another process's window sends it WM_GETTEXT; if that
+ * process is hung, the caller blocks, and inside the keyboard hook that
+ * freezes the whole system's keyboard. The window is instead matched when it
+ * comes to the foreground or renames itself, on the UI thread, using
+ * InternalGetWindowText and GetClassNameW, which read what the window manager
+ * already holds and never send a message. The executable path and class only
+ * change with the window, so a rename re-reads just the title. */
+static void RefreshForegroundMatch(HWND hwnd)
+{
+    LONGLONG t = QpcNow();
+    BOOL sameWindow = g_fgMatch.valid && hwnd && hwnd == g_fgMatch.hwnd;
+    ProfileTarget target;
+    int len = 0;
+
+    g_fgMatch.hwnd = hwnd;
+    g_fgMatch.valid = TRUE;
+    g_fgMatch.title[0] = L'\0';
+    if (!sameWindow) {
+        g_fgMatch.className[0] = L'\0';
+        g_fgMatch.exePath[0] = L'\0';
+    }
+    if (hwnd) {
+        len = InternalGetWindowText(hwnd, g_fgMatch.title, 512);
+        if (len < 0) len = 0;
+        g_fgMatch.title[len] = L'\0';
+        if (!sameWindow && g_uiConfig->use[PROFILE_FIELD_CLASS])
+            GetClassNameW(hwnd, g_fgMatch.className, 256);
+        if (!sameWindow && g_uiConfig->use[PROFILE_FIELD_EXE]) {
+            DWORD pid = 0;
+            GetWindowThreadProcessId(hwnd, &pid);
+            if (pid) wcscpy(g_fgMatch.exePath, LookupProcessPath(pid));
+        }
+    }
+
+    target.text[PROFILE_FIELD_EXE]   = (const uint16_t *)g_fgMatch.exePath;
+    target.len[PROFILE_FIELD_EXE]    = wcslen(g_fgMatch.exePath);
+    target.text[PROFILE_FIELD_CLASS] = (const uint16_t *)g_fgMatch.className;
+    target.len[PROFILE_FIELD_CLASS]  = wcslen(g_fgMatch.className);
+    target.text[PROFILE_FIELD_TITLE] = (const uint16_t *)g_fgMatch.title;
+    target.len[PROFILE_FIELD_TITLE]  = (size_t)len;
+    /* One pass per rule list, whatever the rule count */
+    profiles_match(g_uiConfig->profiles, g_uiConfig->count, &target, &g_fgMatch.match);
+    stat_record(&g_stageStats[STAGE_FG_REFRESH], QpcMicros(t, QpcNow()), 0);
+}
+
+static void CALLBACK ForegroundEventProc(HWINEVENTHOOK hook, DWORD event, HWND hwnd,
+                                         LONG idObject, LONG idChild,
+                                         DWORD idEventThread, DWORD dwmsEventTime)
+{
+    (void)hook; (void)idEventThread; (void)dwmsEventTime;
+    if (!hwnd || idObject != OBJID_WINDOW || idChild != CHILDID_SELF) return;
+
+    if (event == EVENT_SYSTEM_FOREGROUND) {
+        TRACE_BEGIN("Foreground refresh");
+        RefreshForegroundMatch(hwnd);
+        TRACE_END("Foreground refresh");
+        if (g_pasteJob && ConvertFocusLost()) SchedCancelPaste(CONVERT_CANCEL_FOCUS);
+        SchedSpeculate("window focused");
+    } else if (event == EVENT_OBJECT_NAMECHANGE && hwnd == g_fgMatch.hwnd) {
+        /* Name changes fire for every object system-wide; only the
+         * foreground window's own caption matters */
+        TRACE_BEGIN("Foreground refresh");
+        RefreshForegroundMatch(hwnd);
+        TRACE_END("Foreground refresh");
+    }
+}
+
+/* Out-of-context WinEvent hooks are delivered through this thread's message
+ * loop, the same thread that runs the keyboard hook, so the cache needs no
+ * locking. */
+static BOOL InstallForegroundHooks(void)
+{
+    g_hFgEventHook = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND,
+                                     NULL, ForegroundEventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+    g_hNameEventHook = SetWinEventHook(EVENT_OBJECT_NAMECHANGE, EVENT_OBJECT_NAMECHANGE,
+                                       NULL, ForegroundEventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+    RefreshForegroundMatch(GetForegroundWindow());
+    return g_hFgEventHook != NULL && g_hNameEventHook != NULL;
+}
+
+static void RemoveForegroundHooks(void)
+{
+    if (g_hFgEventHook) UnhookWinEvent(g_hFgEventHook);
+    if (g_hNameEventHook) UnhookWinEvent(g_hNameEventHook);
+    g_hFgEventHook = g_hNameEventHook = NULL;
+}
+
+/* ── Paste interception ────────────────────────────────────────────────── */
+
+/* The paste keys were pressed: hands the clipboard image to the worker for
+ * the foreground window's profile; SchedJobDone posts WM_DO_PASTE. Returns
+ * FALSE when there is nothing to convert and the keys should reach the
+ * window. */
+static BOOL InterceptPaste(void)
+{
+    const char *keys = g_triggerKeys[g_trigger < TRIGGER_COUNT ? g_trigger : TRIGGER_HOOK];
+
+    if (g_typer.busy) {
+        LogMessage("%s blocked: still typing the previous paste (Esc stops it)", keys);
+        return TRUE;
+    }
+    if (g_pasteJob) {
+        LogMessage("%s blocked: still converting the previous paste (Esc cancels it)", keys);
+        return TRUE;
+    }
+
+    /* A capture whose re-injection never came back is written as-is */
+    CaptureFinish(FALSE);
+    g_pasteStartQpc = QpcNow();
+    ZeroMemory(g_lastPasteMicros, sizeof(g_lastPasteMicros));
+    g_pasteTitle[0] = L'\0';
+    LogMessage("--- %s detected ---", keys);
+
+    /* Check if a matching window is focused. The answer was
+     * computed when the window came to the foreground; the
+     * target window itself is never asked for its title here. */
+    LONGLONG tLookup = QpcNow();
+    HWND hFg = GetForegroundWindow();
+    if (!g_fgMatch.valid || g_fgMatch.hwnd != hFg) {
+        /* The keys raced the foreground event, or rules changed */
+        g_fgCacheMisses++;
+        RefreshForegroundMatch(hFg);
+    }
+    const ProfileMatch *m = &g_fgMatch.match;
+    const Profile *profile = m->profile >= 0 ? &g_uiConfig->profiles[m->profile] : NULL;
+    BOOL matchFound = profile != NULL;
+    wcscpy(g_pasteTitle, g_fgMatch.title);
+    StageRecord(STAGE_TITLE_LOOKUP, tLookup, 0);
+    if (matchFound) {
+        char why[256] = "";
+        for (int f = 0; f < PROFILE_FIELD_COUNT; f++) {
+            if (m->rule[f] < 0) continue;
+            size_t n = strlen(why);
+            snprintf(why + n, sizeof(why) - n, "%s%s \"%s\"", n ? ", " : "",
+                     profile_field_name((ProfileField)f),
+                     matcher_rule_text(profile->matchers[f], m->rule[f]));
+        }
+        LogMessage("Profile match: \"%s\" (%s)", profile->name, why);
+    } else if (m->excludedProfile >= 0) {
+        const Profile *ex = &g_uiConfig->profiles[m->excludedProfile];
+        LogMessage("Profile match: NO (\"%s\" excluded by %s \"%s\")", ex->name,
+                   profile_field_name((ProfileField)m->excludedField),
+                   matcher_rule_text(ex->matchers[m->excludedField], m->excludedBy));
+    } else {
+        LogMessage("Profile match: NO");
+    }
+
+    /* Check if clipboard has an image */
+    BOOL clipHasImage = IsClipboardFormatAvailable(CF_DIB);
+    LogMessage("Clipboard has image: %s", clipHasImage ? "YES" : "NO");
+    if (!matchFound || !clipHasImage) return FALSE;
+
+    LogMessage("Intercepting paste: converting image to base64 on the worker...");
+    if (!SchedPaste(profile)) {
+        LogMessage("Conversion FAILED, blocking paste");
+        CaptureFinish(TRUE);
+        StatsChanged();
+    }
+    return TRUE;
+}
+
+/* ── Low-level keyboard hook ────────────────────────────────────────────── */
+
+static LRESULT HandleKeyboardEvent(int nCode, WPARAM wParam, LPARAM lParam)
+{
+    if (nCode == HC_ACTION) {
+        KBDLLHOOKSTRUCT *pKb = (KBDLLHOOKSTRUCT *)lParam;
+        if (pKb->vkCode == HOOK_PROBE_VK && pKb->dwExtraInfo == HOOK_PROBE_MAGIC) {
+            /* Watchdog probe: proves the hook is alive, never forwarded */
+            g_probeSeen = TRUE;
+            return 1;
+        }
+    }
+
+    if (nCode == HC_ACTION && wParam == WM_KEYDOWN) {
+        KBDLLHOOKSTRUCT *pKb = (KBDLLHOOKSTRUCT *)lParam;
+
+        if (g_typer.busy && pKb->vkCode == VK_ESCAPE && !(pKb->flags & LLKHF_INJECTED)) {
+            /* Stops typing at the next batch; the target never sees the Esc */
+            InterlockedCompareExchange(&g_typer.cancel, TYPE_CANCEL_ESC, 0);
+            return 1;
+        }
+        if (g_pasteJob && pKb->vkCode == VK_ESCAPE && !(pKb->flags & LLKHF_INJECTED)) {
+            /* The worker stops within one deflate poll; the paste is blocked */
+            SchedCancelPaste(CONVERT_CANCEL_ESC);
+            return 1;
+        }
+
+        if (pKb->vkCode == 'V') {
+            BOOL ctrlDown = (GetAsyncKeyState(VK_CONTROL) & 0x8000) != 0;
+            BOOL altDown  = (GetAsyncKeyState(VK_MENU) & 0x8000) != 0;
+
+            if (ctrlDown && !altDown) {
+                /* Recursion guard: skip if this is our re-injected paste */
+                if (g_bSkipNextPaste) {
+                    g_bSkipNextPaste = FALSE;
+                    if (g_reinjectQpc) {
+                        StageRecord(STAGE_REINJECT, g_reinjectQpc, 0);
+                        StageRecord(STAGE_END_TO_END, g_pasteStartQpc, 0);
+                        g_reinjectQpc = 0;
+                        CaptureFinish(FALSE);
+                        StatsChanged();
+                    }
+                    LogMessage("Re-injected Ctrl+V detected, passing through");
+                    return CallNextHookEx(g_hHook, nCode, wParam, lParam);
+                }
+
+                /* In the other modes the hook is only in place for the keystroke benchmark */
+                if (g_trigger == TRIGGER_HOOK && InterceptPaste()) return 1;
+            }
+        }
+    }
+
+    return CallNextHookEx(g_hHook, nCode, wParam, lParam);
+}
+
+static LRESULT CALLBACK LowLevelKeyboardProc(int nCode, WPARAM wParam, LPARAM lParam)
+{
+    LONGLONG t0 = QpcNow();
+    TRACE_BEGIN("Keyboard hook");
+    LRESULT result = HandleKeyboardEvent(nCode, wParam, lParam);
+    TRACE_END("Keyboard hook");
+
+    ULONGLONG us = QpcMicros(t0, QpcNow());
+    stat_record(&g_stageStats[STAGE_KEYBOARD_HOOK], us, 0);
+    InterlockedIncrement(&g_hookCallbacks);
+
+    /* Windows silently unhooks procedures that keep exceeding the timeout */
+    if (us > (ULONGLONG)g_hookTimeoutMs * 1000 / 2) {
+        g_hookNearTimeouts++;
+        PostMessage(g_hWndMain, WM_HOOK_SLOW, (WPARAM)(us / 1000), 0);
+    }
+    return result;
+}
+
+/* ── Keyboard hook watchdog ────────────────────────────────────────────── */
+
+static DWORD ReadLowLevelHooksTimeout(void)
+{
+    HKEY hKey;
+    DWORD timeout = HOOK_DEFAULT_TIMEOUT_MS;
+    if (RegOpenKeyExA(HKEY_CURRENT_USER, "Control Panel\\Desktop", 0, KEY_READ, &hKey) == ERROR_SUCCESS) {
+        DWORD type, value = 0, size = sizeof(value);
+        if (RegQueryValueExA(hKey, "LowLevelHooksTimeout", NULL, &type,
+                             (LPBYTE)&value, &size) == ERROR_SUCCESS
+            && type == REG_DWORD && value > 0) {
+            timeout = value;
+        }
+        RegCloseKey(hKey);
+    }
+    if (timeout > 1000) timeout = 1000;  /* Windows 7+ caps the timeout at 1 s */
+    return timeout;
+}
+
+static BOOL InstallKeyboardHook(void)
+{
+    g_hHook = SetWindowsHookExW(WH_KEYBOARD_LL, LowLevelKeyboardProc, g_hInstance, 0);
+    return g_hHook != NULL;
+}
+
+static void ReinstallKeyboardHook(const char *reason)
+{
+    if (g_hHook) UnhookWindowsHookEx(g_hHook);   /* may already be gone */
+    g_hHook = NULL;
+    g_hookReinstalls++;
+
+    if (InstallKeyboardHook()) {
+        LogMessage("WARNING: Keyboard hook lost (%s), reinstalled (#%lu)",
+                   reason, (unsigned long)g_hookReinstalls);
+        ShowTrayNotification(L"ImagePaster",
+            L"Windows removed the keyboard hook. It has been reinstalled.", NIIF_WARNING);
+    } else {
+        LogMessage("ERROR: Keyboard hook lost (%s), reinstall failed (%lu)",
+                   reason, GetLastError());
+        ShowTrayNotification(L"ImagePaster",
+            L"Windows removed the keyboard hook and it could not be reinstalled.", NIIF_ERROR);
+    }
+    StatsChanged();
+}
+
+static void SendHookProbe(void)
+{
+    INPUT probe;
+    ZeroMemory(&probe, sizeof(probe));
+    probe.type = INPUT_KEYBOARD;
+    probe.ki.wVk = HOOK_PROBE_VK;
+    probe.ki.dwFlags = KEYEVENTF_KEYUP;   /* a lone key-up is harmless if it leaks */
+    probe.ki.dwExtraInfo = HOOK_PROBE_MAGIC;
+
+    g_probeSeen = FALSE;
+    g_probeSentTick = GetTickCount();
+    g_lastProbeTick = g_probeSentTick;
+    SendInput(1, &probe, sizeof(INPUT));
+}
+
+/*
+ * Runs every HOOK_WATCHDOG_INTERVAL_MS. If the user produced input since the
+ * last tick but the hook saw nothing, the input may have been mouse-only, so
+ * a probe key confirms before the hook is reinstalled.
+ */
+static void HookWatchdogTick(void)
+{
+    if (g_probeSentTick) {
+        BOOL seen = g_probeSeen;
+        g_probeSentTick = 0;
+        if (!seen) {
+            ReinstallKeyboardHook("watchdog probe not received");
+        }
+    }
+
+    LASTINPUTINFO lii;
+    lii.cbSize = sizeof(lii);
+    if (!GetLastInputInfo(&lii)) return;
+
+    LONG callbacks = g_hookCallbacks;
+    BOOL inputSinceTick = lii.dwTime != g_lastInputAtTick;
+    BOOL hookSinceTick  = callbacks != g_hookCallbacksAtTick;
+    g_lastInputAtTick = lii.dwTime;
+    g_hookCallbacksAtTick = callbacks;
+
+    if (inputSinceTick && !hookSinceTick
+        && GetTickCount() - g_lastProbeTick >= HOOK_PROBE_MIN_INTERVAL_MS) {
+        SendHookProbe();
+    }
+}
+
+/* ── Paste trigger ─────────────────────────────────────────────────────── */
+
+/* The low-level hook sees every key pressed on the desktop before any
+ * window does, and each key waits for this thread to answer: whatever keeps
+ * it busy, a WebView push or a log update, delays typing in every program.
+ * Two modes do without it. The hotkey mode registers Ctrl+Shift+V; Windows
+ * takes the keys and posts WM_HOTKEY, and no other key comes here. When
+ * there is nothing to convert the keys are passed on to the window. The Raw
+ * Input mode keeps Ctrl+V: WM_INPUT is posted while the key goes on to its
+ * window, so nothing waits for this thread, but the original Ctrl+V cannot
+ * be held back and the text is pasted after it (a terminal pastes nothing
+ * for an image). Without the hook, Esc cancels a conversion as a second
+ * hotkey, registered only while it runs, or as Raw Input that the window
+ * gets as well; typing polls it. A mode that cannot be set up falls back to
+ * the hook. */
+
+static BOOL g_hotkeyRegistered;
+static UINT g_rawCtrl, g_rawAlt;    /* held down: 1 = left key, 2 = right key */
+
+/* The keystroke benchmark takes the hook in and out; see KeyBenchStart */
+enum { KEY_BENCH_HOOK, KEY_BENCH_NO_HOOK };
+
+static struct {
+    BOOL          running;
+    int           half;         /* KEY_BENCH_HOOK or KEY_BENCH_NO_HOOK, being timed */
+    StatHistogram latency[2];   /* key events, SendInput -> key state */
+    BOOL          ok[2];
+} g_keyBench;
+
+static BOOL RegisterPasteHotkey(void)
+{
+    g_hotkeyRegistered = RegisterHotKey(g_hWndMain, ID_HOTKEY_PASTE,
+                                        MOD_CONTROL | MOD_SHIFT | MOD_NOREPEAT, 'V');
+    return g_hotkeyRegistered;
+}
+
+static BOOL TriggerStart(TriggerMode mode)
+{
+    switch (mode) {
+    case TRIGGER_HOOK:
+        /* Also retries a hook that failed to install */
+        g_probeSentTick = 0;
+        SetTimer(g_hWndMain, ID_TIMER_HOOK_WATCHDOG, HOOK_WATCHDOG_INTERVAL_MS, NULL);
+        return InstallKeyboardHook();
+    case TRIGGER_HOTKEY:
+        return RegisterPasteHotkey();
+    case TRIGGER_RAW_INPUT: {
+        /* Generic desktop page, keyboard usage; in the background too */
+        RAWINPUTDEVICE rid = { 0x01, 0x06, RIDEV_INPUTSINK, g_hWndMain };
+        g_rawCtrl = g_rawAlt = 0;
+        return RegisterRawInputDevices(&rid, 1, sizeof(rid));
+    }
+    default:
+        return FALSE;
+    }
+}
+
+static void TriggerStop(TriggerMode mode)
+{
+    switch (mode) {
+    case TRIGGER_HOOK:
+        KillTimer(g_hWndMain, ID_TIMER_HOOK_WATCHDOG);
+        if (g_hHook) UnhookWindowsHookEx(g_hHook);
+        g_hHook = NULL;
+        break;
+    case TRIGGER_HOTKEY:
+        KillTimer(g_hWndMain, ID_TIMER_HOTKEY_REARM);
+        if (g_hotkeyRegistered) UnregisterHotKey(g_hWndMain, ID_HOTKEY_PASTE);
+        g_hotkeyRegistered = FALSE;
+        break;
+    case TRIGGER_RAW_INPUT: {
+        RAWINPUTDEVICE rid = { 0x01, 0x06, RIDEV_REMOVE, NULL };
+        RegisterRawInputDevices(&rid, 1, sizeof(rid));
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/* Puts g_triggerWanted in place: at startup, and when the setting changes */
+static void TriggerApply(void)
+{
+    TriggerMode mode = g_triggerWanted;
+    if (mode == g_trigger || g_keyBench.running) return;   /* the benchmark applies it when done */
+
+    TriggerStop(g_trigger);
+    DWORD error = TriggerStart(mode) ? ERROR_SUCCESS : GetLastError();
+    if (error != ERROR_SUCCESS && mode != TRIGGER_HOOK) {
+        LogMessage("ERROR: Could not set up the %s trigger (%lu), using the keyboard hook",
+                   g_triggerNames[mode], error);
+        ShowTrayNotification(L"ImagePaster", mode == TRIGGER_HOTKEY
+            ? L"Ctrl+Shift+V is taken by another program. The keyboard hook is used instead."
+            : L"Raw Input could not be registered. The keyboard hook is used instead.", NIIF_WARNING);
+        TriggerStop(mode);
+        mode = TRIGGER_HOOK;
+        error = TriggerStart(mode) ? ERROR_SUCCESS : GetLastError();
+    }
+    g_trigger = mode;
+
+    switch (mode) {
+    case TRIGGER_HOOK:
+        if (error == ERROR_SUCCESS)
+            LogMessage("Keyboard hook installed (WH_KEYBOARD_LL, timeout %lu ms)", g_hookTimeoutMs);
+        else
+            LogMessage("ERROR: Failed to install keyboard hook (%lu)", error);
+        break;
+    case TRIGGER_HOTKEY:
+        LogMessage("Paste hotkey Ctrl+Shift+V registered, no keyboard hook");
+        break;
+    default:
+        LogMessage("Keyboard Raw Input registered, no keyboard hook");
+        break;
+    }
+    LogMessage("Monitoring for %s with image clipboard...", g_triggerKeys[mode]);
+    StatsChanged();
+}
+
+/* From the Configure dialog: saved, then put in place */
+static void TriggerSave(const char *name)
+{
+    for (int i = 0; i < TRIGGER_COUNT; i++) {
+        if (strcmp(name, g_triggerNames[i]) != 0) continue;
+        HKEY hKey;
+        DWORD disposition;
+        if (RegCreateKeyExA(HKEY_CURRENT_USER, REG_KEY_PATH, 0, NULL, REG_OPTION_NON_VOLATILE,
+                            KEY_WRITE, NULL, &hKey, &disposition) == ERROR_SUCCESS) {
+            RegWriteString(hKey, REG_VALUE_TRIGGER, name);
+            RegCloseKey(hKey);
+        }
+        g_triggerWanted = (TriggerMode)i;
+        TriggerApply();
+        return;
+    }
+}
+
+/* Nothing to convert: the window gets its Ctrl+Shift+V after all. The
+ * hotkey is let go of meanwhile, or Windows would take the keys again. */
+static void PassHotkeyOn(void)
+{
+    static const WORD chord[] = { VK_CONTROL, VK_SHIFT, 'V' };
+    INPUT inputs[6];
+    UINT down = 0, n;
+    ZeroMemory(inputs, sizeof(inputs));
+
+    /* Modifiers already released are pressed again around the V; those still held are left alone */
+    for (int i = 0; i < 3; i++) {
+        if (chord[i] != 'V' && (GetAsyncKeyState(chord[i]) & 0x8000)) continue;
+        inputs[down].type = INPUT_KEYBOARD;
+        inputs[down++].ki.wVk = chord[i];
+    }
+    n = down;
+    for (UINT i = down; i-- > 0; ) {
+        inputs[n] = inputs[i];
+        inputs[n++].ki.dwFlags = KEYEVENTF_KEYUP;
+    }
+
+    UnregisterHotKey(g_hWndMain, ID_HOTKEY_PASTE);
+    g_hotkeyRegistered = FALSE;
+    SendInput(n, inputs, sizeof(INPUT));
+    SetTimer(g_hWndMain, ID_TIMER_HOTKEY_REARM, HOTKEY_REARM_MS, NULL);
+    LogMessage("Nothing to convert, Ctrl+Shift+V passed on to the window");
+}
+
+/* WM_HOTKEY */
+static void OnPasteHotkey(void)
+{
+    if (!InterceptPaste()) PassHotkeyOn();
+}
+
+/* ID_TIMER_HOTKEY_REARM: the passed-on keys have been processed */
+static void HotkeyRearm(void)
+{
+    KillTimer(g_hWndMain, ID_TIMER_HOTKEY_REARM);
+    if (g_trigger != TRIGGER_HOTKEY || g_hotkeyRegistered) return;
+    if (!RegisterPasteHotkey()) {
+        LogMessage("ERROR: Could not register Ctrl+Shift+V again (%lu)", GetLastError());
+        ShowTrayNotification(L"ImagePaster",
+            L"Ctrl+Shift+V was taken by another program. Image pasting is inactive.", NIIF_ERROR);
+    }
+}
+
+/* WM_INPUT: follows Ctrl and Alt, acts on V pressed with Ctrl alone and
+ * cancels a converting paste on Esc */
+static void OnRawKeyboard(HRAWINPUT hRaw)
+{
+    RAWINPUT in;
+    UINT size = sizeof(in);
+    if (GetRawInputData(hRaw, RID_INPUT, &in, &size, sizeof(RAWINPUTHEADER)) == (UINT)-1
+        || in.header.dwType != RIM_TYPEKEYBOARD) return;
+    /* Injected keys come from no device: the re-injected Ctrl+V, typing, probes */
+    if (!in.header.hDevice) return;
+
+    const RAWKEYBOARD *kb = &in.data.keyboard;
+    BOOL up = (kb->Flags & RI_KEY_BREAK) != 0;
+    UINT side = (kb->Flags & RI_KEY_E0) ? 2 : 1;
+    if (kb->VKey == VK_CONTROL) {
+        g_rawCtrl = up ? g_rawCtrl & ~side : g_rawCtrl | side;
+    } else if (kb->VKey == VK_MENU) {
+        g_rawAlt = up ? g_rawAlt & ~side : g_rawAlt | side;
+    } else if (kb->VKey == 'V' && !up && g_rawCtrl && !g_rawAlt && g_trigger == TRIGGER_RAW_INPUT) {
+        InterceptPaste();
+    } else if (kb->VKey == VK_ESCAPE && !up && g_trigger == TRIGGER_RAW_INPUT) {
+        SchedCancelPaste(CONVERT_CANCEL_ESC);     /* the window gets this Esc too */
+    }
+}
+
+/* ── Keystroke latency benchmark ───────────────────────────────────────── */
+
+/* What the trigger costs every key typed on the desktop. A worker thread
+ * presses and releases an unassigned key KEY_BENCH_KEYS times and times each
+ * event from SendInput until GetAsyncKeyState shows it. Windows updates the
+ * key state only once every low-level hook has returned, so with the hook
+ * installed the time includes the round trip through this thread. It is
+ * measured with the hook and without it, whichever mode is in use, and the
+ * mode's own setup is restored afterwards. The foreground window receives
+ * the key as well and ignores it. */
+
+static DWORD WINAPI KeyBenchThreadProc(LPVOID param)
+{
+    StatHistogram *h = (StatHistogram *)param;
+    BOOL ok = TRUE;
+    INPUT in;
+
+    trace_set_thread_name("Keystroke bench");
+    ZeroMemory(&in, sizeof(in));
+    in.type = INPUT_KEYBOARD;
+    in.ki.wVk = HOOK_PROBE_VK;
+    in.ki.dwExtraInfo = KEY_BENCH_MAGIC;
+
+    for (int i = 0; i < 2 * KEY_BENCH_KEYS && ok; i++) {
+        BOOL press = !(i & 1);
+        in.ki.dwFlags = press ? 0 : KEYEVENTF_KEYUP;
+        LONGLONG t0 = QpcNow();
+        if (SendInput(1, &in, sizeof(INPUT)) != 1) {
+            ok = FALSE;
+            break;
+        }
+        while (((GetAsyncKeyState(HOOK_PROBE_VK) & 0x8000) != 0) != press) {
+            if (QpcMicros(t0, QpcNow()) >= KEY_BENCH_TIMEOUT_MS * 1000ull) {
+                ok = FALSE;
+                break;
+            }
+            SwitchToThread();
+        }
+        if (ok) stat_record(h, QpcMicros(t0, QpcNow()), 0);
+    }
+    if (!ok) {
+        in.ki.dwFlags = KEYEVENTF_KEYUP;    /* never leave the key down */
+        SendInput(1, &in, sizeof(INPUT));
+    }
+    PostMessage(g_hWndMain, WM_KEY_BENCH_DONE, (WPARAM)ok, 0);
+    return 0;
+}
+
+static void KeyBenchRunHalf(int half)
+{
+    g_keyBench.half = half;
+    if (half == KEY_BENCH_HOOK) {
+        if (!g_hHook) InstallKeyboardHook();
+    } else if (g_hHook) {
+        UnhookWindowsHookEx(g_hHook);
+        g_hHook = NULL;
+    }
+
+    HANDLE thread = NULL;
+    if (half == KEY_BENCH_NO_HOOK || g_hHook)
+        thread = CreateThread(NULL, 0, KeyBenchThreadProc, &g_keyBench.latency[half], 0, NULL);
+    if (thread) CloseHandle(thread);
+    else PostMessage(g_hWndMain, WM_KEY_BENCH_DONE, FALSE, 0);
+}
+
+static void json_write_key_latency(JsonWriter *w, int half)
+{
+    const StatHistogram *h = &g_keyBench.latency[half];
+    if (!g_keyBench.ok[half] || !h->count) {
+        jw_null(w);
+        return;
+    }
+    jw_begin_object(w);
+    jw_key(w, "p50");
+    jw_uint(w, stat_percentile(h, 50));
+    jw_key(w, "p99");
+    jw_uint(w, stat_percentile(h, 99));
+    jw_key(w, "max");
+    jw_uint(w, h->maxMicros);
+    jw_end_object(w);
+}
+
+static void KeyBenchReport(void)
+{
+    static const char *halves[2] = { "with the keyboard hook", "without it" };
+    ByteBuf b = {0};
+    JsonWriter w;
+
+    for (int i = 0; i < 2; i++) {
+        const StatHistogram *h = &g_keyBench.latency[i];
+        if (g_keyBench.ok[i] && h->count) {
+            LogMessage("Keystroke latency %s: p50 %lu us, p99 %lu us, max %lu us (%lu key events)",
+                       halves[i], (unsigned long)stat_percentile(h, 50),
+                       (unsigned long)stat_percentile(h, 99), (unsigned long)h->maxMicros,
+                       (unsigned long)h->count);
+        } else {
+            LogMessage("Keystroke latency %s: not measured, the key did not come through", halves[i]);
+        }
+    }
+
+    jw_init(&w, &b);
+    jw_begin_object(&w);
+    jw_key(&w, "keys");
+    jw_uint(&w, 2 * KEY_BENCH_KEYS);
+    jw_key(&w, "hook");
+    json_write_key_latency(&w, KEY_BENCH_HOOK);
+    jw_key(&w, "noHook");
+    json_write_key_latency(&w, KEY_BENCH_NO_HOOK);
+    jw_end_object(&w);
+    if (jw_ok(&w)) webview_push_json("onKeystrokeBench", &b);
+    bb_free(&b);
+}
+
+static void KeyBenchStart(void)
+{
+    if (g_keyBench.running) return;
+    memset(&g_keyBench, 0, sizeof(g_keyBench));
+    if (g_pasteJob || g_typer.busy || g_bSkipNextPaste) {
+        LogMessage("Keystroke benchmark skipped: a paste is in progress");
+        KeyBenchReport();
+        return;
+    }
+    g_keyBench.running = TRUE;
+    LogMessage("Measuring keystroke latency with and without the keyboard hook...");
+    KeyBenchRunHalf(KEY_BENCH_HOOK);
+}
+
+/* WM_KEY_BENCH_DONE: one half finished, `ok` if every key came through */
+static void KeyBenchHalfDone(BOOL ok)
+{
+    if (!g_keyBench.running) return;
+    g_keyBench.ok[g_keyBench.half] = ok;
+    if (g_keyBench.half == KEY_BENCH_HOOK) {
+        KeyBenchRunHalf(KEY_BENCH_NO_HOOK);
+        return;
+    }
+
+    /* Back to the mode in use, or the one saved meanwhile */
+    if (g_trigger == TRIGGER_HOOK && !InstallKeyboardHook())
+        LogMessage("ERROR: Failed to reinstall keyboard hook (%lu)", GetLastError());
+    g_keyBench.running = FALSE;
+    TriggerApply();
+    KeyBenchReport();
+    StatsChanged();
+}
+
+/* ── Tracing ───────────────────────────────────────────────────────────── */
+
+static void SaveTraceFile(void)
+{
+    WCHAR tempDir[MAX_PATH], path[MAX_PATH];
+    DWORD tempLen = GetTempPathW(MAX_PATH, tempDir);
+    if (tempLen == 0 || tempLen >= MAX_PATH - 60) {
+        LogMessage("ERROR: Failed to get temp directory for trace");
+        return;
+    }
+    swprintf(path, MAX_PATH, L"%sImagePaster", tempDir);
+    CreateDirectoryW(path, NULL);
+
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+    swprintf(path, MAX_PATH, L"%sImagePaster\\trace-%04d%02d%02d-%02d%02d%02d.json",
+             tempDir, st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+
+    long events = trace_dump_json(path);
+    if (events < 0) {
+        LogMessage("ERROR: Failed to write trace file");
+        return;
+    }
+
+    char pathUtf8[MAX_PATH * 3];
+    WideCharToMultiByte(CP_UTF8, 0, path, -1, pathUtf8, sizeof(pathUtf8), NULL, NULL);
+    LogMessage("Trace saved: %s (%ld events)", pathUtf8, events);
+
+    WCHAR args[MAX_PATH + 16];
+    swprintf(args, MAX_PATH + 16, L"/select,\"%s\"", path);
+    if (EnsureCom()) ShellExecuteW(NULL, L"open", L"explorer.exe", args, NULL, SW_SHOWNORMAL);
 }
 
 /* ── System tray icon ──────────────────────────────────────────────────── */
@@ -808,14 +3987,46 @@ static void InitTrayIcon(HWND hwnd)
     Shell_NotifyIconW(NIM_ADD, &g_nid);
 }
 
+static void ShowTrayNotification(const WCHAR *title, const WCHAR *text, DWORD infoFlags)
+{
+    g_nid.uFlags = NIF_INFO;
+    g_nid.dwInfoFlags = infoFlags;
+    wcsncpy(g_nid.szInfoTitle, title, 63);
+    g_nid.szInfoTitle[63] = L'\0';
+    wcsncpy(g_nid.szInfo, text, 255);
+    g_nid.szInfo[255] = L'\0';
+    Shell_NotifyIconW(NIM_MODIFY, &g_nid);
+}
+
 static void UpdateTooltip(void)
 {
-    if (g_configTitleMatch[0] == '\0' || g_keywordCount == 0) {
+    /* Active profiles by name; the default profile alone shows its rules */
+    char desc[256] = "";
+    int active = 0;
+    for (int i = 0; i < g_uiConfig->count; i++) {
+        const Profile *p = &g_uiConfig->profiles[i];
+        BOOL used = FALSE;
+        for (int f = 0; f < PROFILE_FIELD_COUNT; f++) used |= profile_uses(p, (ProfileField)f);
+        if (!used) continue;
+        size_t n = strlen(desc);
+        snprintf(desc + n, sizeof(desc) - n, "%s%s", active++ ? ", " : "", p->name);
+    }
+    const Profile *def = DefaultProfile();
+    if (active == 1 && def && profile_uses(def, PROFILE_FIELD_TITLE)
+        && !profile_uses(def, PROFILE_FIELD_EXE) && !profile_uses(def, PROFILE_FIELD_CLASS)) {
+        snprintf(desc, sizeof(desc), "%s", def->rules[PROFILE_FIELD_TITLE]);
+    }
+
+    if (active == 0) {
         wcscpy(g_nid.szTip, L"Image pasting is inactive");
     } else {
-        WCHAR wMatch[128];
-        MultiByteToWideChar(CP_UTF8, 0, g_configTitleMatch, -1, wMatch, 128);
-        /* szTip is 128 wchars max; prefix is ~27 chars, leave room */
+        /* szTip is 128 wchars max; prefix is ~27 chars, the list is cut short */
+        WCHAR wMatch[96];
+        int n = MultiByteToWideChar(CP_UTF8, 0, desc, -1, wMatch, 96);
+        if (n == 0) {
+            n = MultiByteToWideChar(CP_UTF8, 0, desc, 92, wMatch, 92);
+            wcscpy(wMatch + n, L"...");
+        }
         WCHAR tip[128];
         swprintf(tip, 128, L"Image pasting active for %s", wMatch);
         tip[127] = L'\0';
@@ -829,8 +4040,14 @@ static void CreateContextMenu(void)
 {
     g_hMenu = CreatePopupMenu();
     AppendMenuW(g_hMenu, MF_STRING, ID_TRAY_LOG, L"Activity Log");
+    AppendMenuW(g_hMenu, MF_STRING, ID_TRAY_STATS, L"Statistics");
     AppendMenuW(g_hMenu, MF_STRING, ID_TRAY_CONFIGURE, L"Configuration");
     AppendMenuW(g_hMenu, MF_SEPARATOR, 0, NULL);
+    AppendMenuW(g_hMenu, MF_STRING, ID_TRAY_TRACE, L"Record Trace");
+    AppendMenuW(g_hMenu, MF_STRING, ID_TRAY_TRACE_SAVE, L"Save Trace");
+    AppendMenuW(g_hMenu, MF_STRING, ID_TRAY_CAPTURE, L"Capture Pastes");
+    AppendMenuW(g_hMenu, MF_STRING, ID_TRAY_CAPTURE_OPEN, L"Open Captures Folder");
+    AppendMenuW(g_hMenu, MF_SEPARATOR, 0, NULL);
     AppendMenuW(g_hMenu, MF_STRING, ID_TRAY_EXIT, L"Exit");
 }
 
@@ -852,175 +4069,932 @@ static BOOL load_webview2_loader(void)
             APP_NAME, MB_ICONERROR);
         return FALSE;
     }
-    WCHAR tempDir[MAX_PATH];
-    DWORD tempLen = GetTempPathW(MAX_PATH, tempDir);
-    if (tempLen == 0 || tempLen >= MAX_PATH - 50) {
-        MessageBoxW(NULL, L"Failed to get temp directory path.", APP_NAME, MB_ICONERROR);
-        return FALSE;
+    WCHAR tempDir[MAX_PATH];
+    DWORD tempLen = GetTempPathW(MAX_PATH, tempDir);
+    if (tempLen == 0 || tempLen >= MAX_PATH - 50) {
+        MessageBoxW(NULL, L"Failed to get temp directory path.", APP_NAME, MB_ICONERROR);
+        return FALSE;
+    }
+    swprintf(g_extractedDllPath, MAX_PATH, L"%sImagePaster", tempDir);
+    CreateDirectoryW(g_extractedDllPath, NULL);
+    swprintf(g_extractedDllPath, MAX_PATH, L"%sImagePaster\\WebView2Loader.dll", tempDir);
+
+    HMODULE hMod = LoadLibraryW(g_extractedDllPath);
+    if (!hMod) {
+        HANDLE hFile = CreateFileW(g_extractedDllPath, GENERIC_WRITE, 0, NULL,
+            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            MessageBoxW(NULL, L"Failed to write WebView2Loader.dll to temp directory.",
+                APP_NAME, MB_ICONERROR);
+            return FALSE;
+        }
+        DWORD written = 0;
+        WriteFile(hFile, dllBytes, dllSize, &written, NULL);
+        CloseHandle(hFile);
+        if (written != dllSize) {
+            MessageBoxW(NULL, L"Failed to write complete WebView2Loader.dll.",
+                APP_NAME, MB_ICONERROR);
+            return FALSE;
+        }
+        hMod = LoadLibraryW(g_extractedDllPath);
+    }
+    if (!hMod) {
+        MessageBoxW(NULL, L"Failed to load WebView2Loader.dll.", APP_NAME, MB_ICONERROR);
+        return FALSE;
+    }
+    fnCreateEnvironment = (PFN_CreateCoreWebView2EnvironmentWithOptions)
+        GetProcAddress(hMod, "CreateCoreWebView2EnvironmentWithOptions");
+    if (!fnCreateEnvironment) {
+        MessageBoxW(NULL, L"WebView2Loader.dll loaded but entry point not found.",
+            APP_NAME, MB_ICONERROR);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void webview_execute_script(const wchar_t* script)
+{
+    if (g_webviewView) {
+        TRACE_BEGIN("WebView push");
+        g_webviewView->lpVtbl->ExecuteScript(g_webviewView, script, NULL);
+        TRACE_END("WebView push");
+    }
+}
+
+static void webview_sync_controller_bounds(void)
+{
+    if (!g_webviewController || !g_webviewHwnd) return;
+    RECT bounds;
+    GetClientRect(g_webviewHwnd, &bounds);
+    g_webviewController->lpVtbl->put_Bounds(g_webviewController, bounds);
+    g_webviewController->lpVtbl->put_IsVisible(g_webviewController, TRUE);
+}
+
+/* ── JSON helpers ──────────────────────────────────────────────────────── */
+
+/* Reads the top-level string member `key` of a bridge message. */
+static BOOL json_get_string(const char *json, size_t len, const char *key, char *out, size_t outLen)
+{
+    JsonReader r;
+    jr_init(&r, json, len);
+    if (jr_next(&r) != JSON_OBJECT || jr_find(&r, key) != JSON_STRING) return FALSE;
+    jr_string(&r, out, outLen);
+    return TRUE;
+}
+
+static BOOL json_get_int(const char *json, size_t len, const char *key, int *out)
+{
+    JsonReader r;
+    int64_t v;
+    jr_init(&r, json, len);
+    if (jr_next(&r) != JSON_OBJECT || jr_find(&r, key) != JSON_NUMBER) return FALSE;
+    if (!jr_int64(&r, &v) || v < INT_MIN || v > INT_MAX) return FALSE;
+    *out = (int)v;
+    return TRUE;
+}
+
+static BOOL json_get_int64(const char *json, size_t len, const char *key, int64_t *out)
+{
+    JsonReader r;
+    jr_init(&r, json, len);
+    if (jr_next(&r) != JSON_OBJECT || jr_find(&r, key) != JSON_NUMBER) return FALSE;
+    return jr_int64(&r, out) != 0;
+}
+
+static const char *g_profileRuleKeys[PROFILE_FIELD_COUNT] = { "exeMatch", "classMatch", "titleMatch" };
+
+static void json_write_profile(JsonWriter *w, const Profile *p)
+{
+    jw_begin_object(w);
+    jw_key(w, "name");
+    jw_string(w, p->name);
+    for (int f = 0; f < PROFILE_FIELD_COUNT; f++) {
+        jw_key(w, g_profileRuleKeys[f]);
+        jw_string(w, p->rules[f]);
+    }
+    jw_key(w, "format");
+    jw_string(w, pipeline_format_name(p->format));
+    jw_key(w, "effort");
+    jw_int(w, p->level);
+    jw_key(w, "quality");
+    jw_int(w, p->quality);
+    jw_key(w, "maxBytes");
+    jw_uint(w, p->maxTextBytes);
+    jw_key(w, "textEncoding");
+    jw_string(w, pipeline_text_name(p->text));
+    jw_key(w, "delivery");
+    jw_string(w, profile_delivery_name(p->delivery));
+    jw_key(w, "route");
+    jw_string(w, route_policy_name(p->route));
+    jw_end_object(w);
+}
+
+/* Reads a profile object sent by ConfigView, the reader having just returned
+ * its JSON_OBJECT. Missing fields keep the defaults; the name goes to `name`
+ * untruncated, for validation. Returns FALSE when malformed or out of memory. */
+static BOOL json_read_profile(JsonReader *r, Profile *p, char *name, size_t nameLen)
+{
+    if (!profile_init(p, "")) return FALSE;
+    name[0] = '\0';
+
+    for (;;) {
+        JsonToken t = jr_next(r);
+        if (t == JSON_OBJECT_END) {
+            strncpy(p->name, name, PROFILE_MAX_NAME - 1);
+            return TRUE;
+        }
+        if (t != JSON_KEY) break;
+
+        char key[16];
+        jr_string(r, key, sizeof(key));
+        JsonToken v = jr_next(r);
+
+        if (v == JSON_STRING && strcmp(key, "name") == 0) {
+            jr_string(r, name, nameLen);
+        } else if (v == JSON_STRING) {
+            size_t len = jr_string(r, NULL, 0);
+            char *value = (char *)malloc(len + 1);
+            if (!value) break;
+            jr_string(r, value, len + 1);
+
+            BOOL ok = TRUE;
+            for (int f = 0; f < PROFILE_FIELD_COUNT; f++) {
+                if (strcmp(key, g_profileRuleKeys[f]) == 0)
+                    ok = profile_set_rules(p, (ProfileField)f, value);
+            }
+            if (strcmp(key, "format") == 0 && pipeline_parse_format(value) >= 0)
+                p->format = (PipeFormat)pipeline_parse_format(value);
+            if (strcmp(key, "textEncoding") == 0 && pipeline_parse_text(value) >= 0)
+                p->text = (PipeTextEncoding)pipeline_parse_text(value);
+            if (strcmp(key, "delivery") == 0 && profile_parse_delivery(value) >= 0)
+                p->delivery = (ProfileDelivery)profile_parse_delivery(value);
+            if (strcmp(key, "route") == 0 && route_parse_policy(value) >= 0)
+                p->route = (RoutePolicy)route_parse_policy(value);
+            free(value);
+            if (!ok) break;
+        } else if (v == JSON_NUMBER) {
+            int64_t n;
+            if (!jr_int64(r, &n)) continue;
+            if (strcmp(key, "effort") == 0 && n >= 0 && n <= 9) p->level = (int)n;
+            if (strcmp(key, "quality") == 0 && n >= 1 && n <= 100) p->quality = (int)n;
+            if (strcmp(key, "maxBytes") == 0 && n >= 0 && n <= INT_MAX) p->maxTextBytes = (size_t)n;
+        } else if (!jr_skip(r, v)) {
+            break;
+        }
+    }
+    profile_free(p);
+    return FALSE;
+}
+
+/* Publishes the profile list in a saveSettings message as a new snapshot and
+ * adopts it: {"profiles":[{...}, ...], "defaultProfile":{...}}. Profiles with
+ * an invalid or duplicate name are dropped. */
+static BOOL ApplyProfilesMessage(const char *msg, size_t len)
+{
+    Profile *profiles = (Profile *)calloc(MAX_PROFILES + 1, sizeof(Profile));
+    Profile def;
+    BOOL haveDefault = FALSE;
+    int count = 0;
+    JsonReader r;
+
+    jr_init(&r, msg, len);
+    BOOL ok = profiles && jr_next(&r) == JSON_OBJECT;
+    while (ok) {
+        JsonToken t = jr_next(&r);
+        if (t == JSON_OBJECT_END) break;
+        if (t != JSON_KEY) {
+            ok = FALSE;
+        } else if (jr_equals(&r, "profiles")) {
+            ok = jr_next(&r) == JSON_ARRAY;
+            while (ok && (t = jr_next(&r)) != JSON_ARRAY_END) {
+                Profile p;
+                char name[PROFILE_MAX_NAME * 2];
+                ok = t == JSON_OBJECT && json_read_profile(&r, &p, name, sizeof(name));
+                if (!ok) break;
+
+                BOOL unique = IsValidProfileName(name);
+                for (int i = 0; i < count && unique; i++)
+                    unique = _stricmp(profiles[i].name, name) != 0;
+                if (!unique) {
+                    LogMessage("WARNING: Profile name \"%s\" is empty, reserved or taken; profile dropped", name);
+                    profile_free(&p);
+                } else if (count < MAX_PROFILES) {
+                    profiles[count++] = p;
+                } else {
+                    profile_free(&p);
+                }
+            }
+        } else if (jr_equals(&r, "defaultProfile") && !haveDefault) {
+            char ignored[PROFILE_MAX_NAME];
+            ok = jr_next(&r) == JSON_OBJECT && json_read_profile(&r, &def, ignored, sizeof(ignored));
+            haveDefault = ok;
+        } else {
+            ok = jr_skip(&r, jr_next(&r));
+        }
+    }
+
+    if (!ok || !haveDefault) {
+        if (haveDefault) profile_free(&def);
+        if (profiles) FreeProfiles(profiles, count);
+        return FALSE;
+    }
+    strcpy(def.name, DEFAULT_PROFILE_NAME);
+    profiles[count] = def;
+    ConfigSnapshot *config = ConfigBuild(profiles, count + 1, g_uiConfig->maxPasteMB);
+    if (!config) return FALSE;
+    ConfigPublish(config);
+    ConfigAdopt();
+    return TRUE;
+}
+
+static void json_write_log_entry(JsonWriter *w, const LogEntry *entry)
+{
+    jw_begin_object(w);
+    jw_key(w, "seq");
+    jw_uint(w, entry->seq);
+    jw_key(w, "time");
+    jw_string(w, entry->time);
+    jw_key(w, "message");
+    jw_string(w, entry->message);
+
+    /* Only the size: the page fetches the pixels when the row is shown */
+    ThumbInfo info;
+    if (thumb_arena_get(&g_gallery, entry->thumb, &info)) {
+        jw_key(w, "thumb");
+        jw_begin_object(w);
+        jw_key(w, "id");
+        jw_uint(w, info.id);
+        jw_key(w, "width");
+        jw_uint(w, info.width);
+        jw_key(w, "height");
+        jw_uint(w, info.height);
+        jw_end_object(w);
+    }
+    jw_end_object(w);
+}
+
+/* ── Push functions (C -> JS) ──────────────────────────────────────────── */
+
+/* Calls window.<fn>(json) through ExecuteScript: the payload is converted to
+ * UTF-16 and parsed by the page as script source. */
+static void webview_push_script_json(const char *fn, const ByteBuf *json)
+{
+    ByteBuf script = {0};
+    bb_append(&script, "window.", 7);
+    bb_append(&script, fn, strlen(fn));
+    bb_append(&script, " && window.", 11);
+    bb_append(&script, fn, strlen(fn));
+    bb_put_u8(&script, '(');
+    bb_append(&script, json->data, json->len);
+    bb_append(&script, ")", 2);   /* with the NUL */
+
+    int wlen = script.failed ? 0 : MultiByteToWideChar(CP_UTF8, 0, (const char *)script.data, -1, NULL, 0);
+    wchar_t *wide = wlen > 0 ? (wchar_t *)malloc((size_t)wlen * sizeof(wchar_t)) : NULL;
+    if (wide && MultiByteToWideChar(CP_UTF8, 0, (const char *)script.data, -1, wide, wlen) > 0)
+        webview_execute_script(wide);
+    free(wide);
+    bb_free(&script);
+}
+
+/* Posts bytes to the page in a read-only shared buffer; `meta` (JSON) tells
+ * the page what they are. The page sees the same memory, nothing is
+ * converted or parsed on the way. Returns FALSE if the runtime lacks shared
+ * buffers or the buffer could not be created. */
+static BOOL webview_push_shared(const void *data, size_t len, const char *meta)
+{
+    if (!g_webviewEnv12 || !g_webviewView17) return FALSE;
+
+    ICoreWebView2SharedBuffer *buffer = NULL;
+    BYTE *mem = NULL;
+    if (FAILED(g_webviewEnv12->lpVtbl->CreateSharedBuffer(g_webviewEnv12, len ? len : 1, &buffer))
+        || !buffer) {
+        return FALSE;
+    }
+    BOOL ok = SUCCEEDED(buffer->lpVtbl->get_Buffer(buffer, &mem)) && mem;
+    if (ok) {
+        WCHAR wMeta[256];
+        memcpy(mem, data, len);
+        MultiByteToWideChar(CP_UTF8, 0, meta, -1, wMeta, 256);
+        TRACE_BEGIN("WebView push");
+        ok = SUCCEEDED(g_webviewView17->lpVtbl->PostSharedBufferToScript(g_webviewView17, buffer,
+                           COREWEBVIEW2_SHARED_BUFFER_ACCESS_READ_ONLY, wMeta));
+        TRACE_END("WebView push");
+    }
+    /* The page keeps its own view of the memory until it releases it */
+    buffer->lpVtbl->Close(buffer);
+    buffer->lpVtbl->Release(buffer);
+    return ok;
+}
+
+/* Calls window.<fn>(json). Large payloads go in a shared buffer when the
+ * runtime has them, small ones as script. */
+static void webview_push_json(const char *fn, const ByteBuf *json)
+{
+    if (json->failed) return;
+    if (json->len >= WEBVIEW_SHARED_BUFFER_MIN) {
+        char meta[96];
+        snprintf(meta, sizeof(meta), "{\"kind\":\"json\",\"call\":\"%s\"}", fn);
+        if (webview_push_shared(json->data, json->len, meta)) return;
+    }
+    webview_push_script_json(fn, json);
+}
+
+static void webview_push_init_config(void)
+{
+    ByteBuf b = {0};
+    JsonWriter w;
+
+    jw_init(&w, &b);
+    jw_begin_object(&w);
+    jw_key(&w, "view");
+    jw_string(&w, "config");
+    jw_key(&w, "config");
+    jw_begin_object(&w);
+    jw_key(&w, "defaultProfile");
+    if (g_uiConfig->count > 0) json_write_profile(&w, DefaultProfile());
+    else jw_null(&w);
+    jw_key(&w, "profiles");
+    jw_begin_array(&w);
+    for (int i = 0; i < g_uiConfig->count - 1; i++) json_write_profile(&w, &g_uiConfig->profiles[i]);
+    jw_end_array(&w);
+    jw_key(&w, "trigger");
+    jw_string(&w, g_triggerNames[g_triggerWanted]);
+    jw_end_object(&w);
+    jw_end_object(&w);
+
+    if (jw_ok(&w)) webview_push_json("onInit", &b);
+    bb_free(&b);
+}
+
+static void webview_push_init_log(void)
+{
+    ByteBuf b = {0};
+    JsonWriter w;
+
+    jw_init(&w, &b);
+    jw_begin_object(&w);
+    jw_key(&w, "view");
+    jw_string(&w, "log");
+    jw_key(&w, "log");
+    jw_begin_array(&w);
+    /* The newest entries, oldest first; the page searches for the rest */
+    int shown = g_logCount < LOG_VIEW_ENTRIES ? g_logCount : LOG_VIEW_ENTRIES;
+    for (int i = shown; i > 0; i--) json_write_log_entry(&w, LogFind(g_logSeq - (DWORD)i));
+    jw_end_array(&w);
+    jw_key(&w, "logTotal");
+    jw_uint(&w, (uint64_t)g_logCount);
+    jw_end_object(&w);
+
+    if (jw_ok(&w)) webview_push_json("onInit", &b);
+    bb_free(&b);
+}
+
+/* Answers a searchLog request with the seqs of the matching entries, oldest
+ * first; the page fetches the entries it shows with getLogPage. `from` and
+ * `to` are Unix times in ms, 0 for an open end. */
+static void webview_push_log_search(const char *msg, size_t len)
+{
+    char text[LOG_QUERY_MAX_TERMS * LOG_QUERY_TERM_MAX] = "";
+    int id = 0;
+    int64_t from = 0, to = 0;
+    LogQuery q;
+    LogHits hits = {0};
+
+    json_get_int(msg, len, "id", &id);
+    json_get_string(msg, len, "query", text, sizeof(text));
+    log_query_parse(&q, text);
+    if (json_get_int64(msg, len, "from", &from) && from > 0) q.from = (uint64_t)from;
+    if (json_get_int64(msg, len, "to", &to) && to > 0) q.to = (uint64_t)to;
+
+    LONGLONG start = QpcNow();
+    BOOL ok = log_index_search(&g_logIndex, &q, LogText, NULL, &hits);
+    ULONGLONG us = QpcMicros(start, QpcNow());
+    if (!ok) LogMessage("ERROR: Out of memory searching the log");
+
+    ByteBuf b = {0};
+    JsonWriter w;
+    jw_init(&w, &b);
+    jw_begin_object(&w);
+    jw_key(&w, "id");
+    jw_int(&w, id);
+    jw_key(&w, "seqs");
+    jw_begin_array(&w);
+    for (size_t i = 0; ok && i < hits.count; i++) jw_uint(&w, hits.seqs[i]);
+    jw_end_array(&w);
+    jw_key(&w, "micros");
+    jw_uint(&w, us);
+    jw_key(&w, "searched");
+    jw_uint(&w, log_index_count(&g_logIndex));
+    jw_end_object(&w);
+
+    if (jw_ok(&w)) webview_push_json("onLogSearch", &b);
+    bb_free(&b);
+    log_hits_free(&hits);
+}
+
+/* Answers a getLogPage request: the entries of the seqs asked for, leaving
+ * out those the ring has overwritten since. */
+static void webview_push_log_page(const char *msg, size_t len)
+{
+    int id = 0;
+    json_get_int(msg, len, "id", &id);
+
+    ByteBuf b = {0};
+    JsonWriter w;
+    jw_init(&w, &b);
+    jw_begin_object(&w);
+    jw_key(&w, "id");
+    jw_int(&w, id);
+    jw_key(&w, "entries");
+    jw_begin_array(&w);
+
+    JsonReader r;
+    jr_init(&r, msg, len);
+    if (jr_next(&r) == JSON_OBJECT && jr_find(&r, "seqs") == JSON_ARRAY) {
+        JsonToken t;
+        int64_t seq;
+        for (int n = 0; n < LOG_PAGE_MAX && (t = jr_next(&r)) == JSON_NUMBER; n++) {
+            const LogEntry *entry = jr_int64(&r, &seq) && seq >= 0 && seq <= 0xFFFFFFFF
+                                        ? LogFind((DWORD)seq) : NULL;
+            if (entry) json_write_log_entry(&w, entry);
+        }
+    }
+    jw_end_array(&w);
+    jw_end_object(&w);
+
+    if (jw_ok(&w)) webview_push_json("onLogPage", &b);
+    bb_free(&b);
+}
+
+/* Answers a getThumb request: the RGBA pixels of a gallery thumbnail, in a
+ * shared buffer, or base64 in window.onThumb() without one. A thumbnail
+ * whose slot was reused comes back with its id only. */
+static void webview_push_thumb(uint32_t id)
+{
+    ThumbInfo info;
+    const uint8_t *rgba = thumb_arena_get(&g_gallery, id, &info);
+    size_t len = rgba ? (size_t)info.width * info.height * 4 : 0;
+
+    if (rgba) {
+        char meta[96];
+        snprintf(meta, sizeof(meta), "{\"kind\":\"thumb\",\"id\":%u,\"width\":%u,\"height\":%u}",
+                 info.id, info.width, info.height);
+        if (webview_push_shared(rgba, len, meta)) return;
+    }
+
+    ByteBuf b = {0};
+    JsonWriter w;
+    jw_init(&w, &b);
+    jw_begin_object(&w);
+    jw_key(&w, "id");
+    jw_uint(&w, id);
+    if (rgba) {
+        char *text = base64_encode(rgba, len, NULL);
+        jw_key(&w, "width");
+        jw_uint(&w, info.width);
+        jw_key(&w, "height");
+        jw_uint(&w, info.height);
+        jw_key(&w, "rgba");
+        if (text) jw_string(&w, text);
+        else jw_null(&w);
+        free(text);
     }
-    swprintf(g_extractedDllPath, MAX_PATH, L"%sImagePaster", tempDir);
-    CreateDirectoryW(g_extractedDllPath, NULL);
-    swprintf(g_extractedDllPath, MAX_PATH, L"%sImagePaster\\WebView2Loader.dll", tempDir);
+    jw_end_object(&w);
+    if (jw_ok(&w)) webview_push_script_json("onThumb", &b);
+    bb_free(&b);
+}
 
-    HMODULE hMod = LoadLibraryW(g_extractedDllPath);
-    if (!hMod) {
-        HANDLE hFile = CreateFileW(g_extractedDllPath, GENERIC_WRITE, 0, NULL,
-            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-        if (hFile == INVALID_HANDLE_VALUE) {
-            MessageBoxW(NULL, L"Failed to write WebView2Loader.dll to temp directory.",
-                APP_NAME, MB_ICONERROR);
-            return FALSE;
-        }
-        DWORD written = 0;
-        WriteFile(hFile, dllBytes, dllSize, &written, NULL);
-        CloseHandle(hFile);
-        if (written != dllSize) {
-            MessageBoxW(NULL, L"Failed to write complete WebView2Loader.dll.",
-                APP_NAME, MB_ICONERROR);
-            return FALSE;
-        }
-        hMod = LoadLibraryW(g_extractedDllPath);
+static void webview_push_stats(BOOL init)
+{
+    ByteBuf b = {0};
+    JsonWriter w;
+
+    jw_init(&w, &b);
+    if (init) {
+        jw_begin_object(&w);
+        jw_key(&w, "view");
+        jw_string(&w, "stats");
+        jw_key(&w, "stats");
     }
-    if (!hMod) {
-        MessageBoxW(NULL, L"Failed to load WebView2Loader.dll.", APP_NAME, MB_ICONERROR);
-        return FALSE;
+    jw_begin_object(&w);
+    jw_key(&w, "stages");
+    jw_begin_array(&w);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const StatHistogram *h = &g_stageStats[i];
+        jw_begin_object(&w);
+        jw_key(&w, "name");
+        jw_string(&w, g_stageNames[i]);
+        jw_key(&w, "count");
+        jw_uint(&w, h->count);
+        jw_key(&w, "p50");
+        jw_uint(&w, stat_percentile(h, 50.0));
+        jw_key(&w, "p95");
+        jw_uint(&w, stat_percentile(h, 95.0));
+        jw_key(&w, "p99");
+        jw_uint(&w, stat_percentile(h, 99.0));
+        jw_key(&w, "max");
+        jw_uint(&w, h->maxMicros);
+        jw_key(&w, "mean");
+        jw_uint(&w, stat_mean(h));
+        jw_key(&w, "bytesPerSec");
+        jw_uint(&w, (uint64_t)stat_bytes_per_sec(h));
+        jw_end_object(&w);
     }
-    fnCreateEnvironment = (PFN_CreateCoreWebView2EnvironmentWithOptions)
-        GetProcAddress(hMod, "CreateCoreWebView2EnvironmentWithOptions");
-    if (!fnCreateEnvironment) {
-        MessageBoxW(NULL, L"WebView2Loader.dll loaded but entry point not found.",
-            APP_NAME, MB_ICONERROR);
-        return FALSE;
+    jw_end_array(&w);
+    jw_key(&w, "hook");
+    jw_begin_object(&w);
+    jw_key(&w, "timeoutMs");
+    jw_uint(&w, g_hookTimeoutMs);
+    jw_key(&w, "reinstalls");
+    jw_uint(&w, g_hookReinstalls);
+    jw_key(&w, "nearTimeouts");
+    jw_uint(&w, g_hookNearTimeouts);
+    jw_key(&w, "installed");
+    jw_bool(&w, g_hHook != NULL);
+    jw_key(&w, "trigger");
+    jw_string(&w, g_triggerNames[g_trigger < TRIGGER_COUNT ? g_trigger : TRIGGER_HOOK]);
+    jw_key(&w, "titleCacheMisses");
+    jw_uint(&w, g_fgCacheMisses);
+    jw_key(&w, "processCacheHits");
+    jw_uint(&w, g_processCacheHits);
+    jw_key(&w, "processCacheMisses");
+    jw_uint(&w, g_processCacheMisses);
+    jw_end_object(&w);
+
+    SIZE_T privateBytes, workingSet;
+    GetMemoryUsage(&privateBytes, &workingSet);
+    jw_key(&w, "process");
+    jw_begin_object(&w);
+    jw_key(&w, "startupMs");
+    jw_uint(&w, g_startupMicros / 1000);
+    jw_key(&w, "winMainUs");
+    jw_uint(&w, g_winMainMicros);
+    jw_key(&w, "eagerInit");
+    jw_bool(&w, g_eagerInit);
+    jw_key(&w, "privateKB");
+    jw_uint(&w, privateBytes / 1024);
+    jw_key(&w, "workingSetKB");
+    jw_uint(&w, workingSet / 1024);
+    jw_key(&w, "idlePrivateKB");
+    jw_uint(&w, g_idlePrivateBytes / 1024);
+    jw_key(&w, "idleTrims");
+    jw_uint(&w, g_idleTrims);
+    jw_end_object(&w);
+
+    jw_key(&w, "arena");
+    jw_begin_object(&w);
+    jw_key(&w, "limitKB");
+    jw_uint(&w, (uint64_t)g_pasteArenaMB * 1024);
+    jw_key(&w, "committedKB");
+    jw_uint(&w, g_pasteArena.committed / 1024);
+    jw_key(&w, "heapFallbacks");
+    jw_uint(&w, g_pasteArena.heapFallbacks);
+    jw_key(&w, "releases");
+    jw_uint(&w, g_pasteArena.releases);
+    for (int i = 0; i < 2; i++) {
+        const PasteFaultStats *f = &g_pasteFaults[i];
+        jw_key(&w, i ? "inArena" : "onHeap");
+        jw_begin_object(&w);
+        jw_key(&w, "pastes");
+        jw_uint(&w, f->pastes);
+        jw_key(&w, "meanFaults");
+        jw_uint(&w, f->pastes ? f->faults / f->pastes : 0);
+        jw_key(&w, "meanUs");
+        jw_uint(&w, f->pastes ? f->micros / f->pastes : 0);
+        jw_end_object(&w);
     }
-    return TRUE;
+    jw_end_object(&w);
+    jw_end_object(&w);
+    if (init) jw_end_object(&w);
+
+    if (jw_ok(&w)) webview_push_json(init ? "onInit" : "onStatsUpdate", &b);
+    bb_free(&b);
 }
 
-static void webview_execute_script(const wchar_t* script)
+/* ── Bridge transfer benchmark ─────────────────────────────────────────── */
+
+/* Sends the benchmark payload by the current channel; the page answers with
+ * a benchAck message, which ends the timing. Returns FALSE if the channel is
+ * unavailable (no shared buffers in this runtime). */
+static BOOL TransferBenchSend(void)
 {
-    if (g_webviewView) {
-        g_webviewView->lpVtbl->ExecuteScript(g_webviewView, script, NULL);
+    g_transferBench.start = QpcNow();
+    switch (g_transferBench.channel) {
+    case TRANSFER_STRING:
+        webview_push_script_json("onBenchPayload", &g_transferBench.json);
+        return TRUE;
+    case TRANSFER_SHARED_JSON:
+        return webview_push_shared(g_transferBench.json.data, g_transferBench.json.len,
+                                   "{\"kind\":\"json\",\"call\":\"onBenchPayload\"}");
+    case TRANSFER_SHARED_BINARY:
+        /* The string body of the JSON payload, as raw bytes */
+        return webview_push_shared(g_transferBench.json.data + 9, g_transferBench.bytes,
+                                   "{\"kind\":\"bench\"}");
     }
+    return FALSE;
 }
 
-static void webview_sync_controller_bounds(void)
+static void TransferBenchFinish(void)
 {
-    if (!g_webviewController || !g_webviewHwnd) return;
-    RECT bounds;
-    GetClientRect(g_webviewHwnd, &bounds);
-    g_webviewController->lpVtbl->put_Bounds(g_webviewController, bounds);
-    g_webviewController->lpVtbl->put_IsVisible(g_webviewController, TRUE);
+    ByteBuf b = {0};
+    JsonWriter w;
+
+    LogMessage("Bridge transfer of %lu KB: %s %ld ms, %s %ld ms, %s %ld ms (-1 = unavailable)",
+               (unsigned long)(g_transferBench.bytes / 1024),
+               g_transferNames[0], (long)(g_transferBench.micros[0] < 0 ? -1 : g_transferBench.micros[0] / 1000),
+               g_transferNames[1], (long)(g_transferBench.micros[1] < 0 ? -1 : g_transferBench.micros[1] / 1000),
+               g_transferNames[2], (long)(g_transferBench.micros[2] < 0 ? -1 : g_transferBench.micros[2] / 1000));
+
+    jw_init(&w, &b);
+    jw_begin_object(&w);
+    jw_key(&w, "bytes");
+    jw_uint(&w, g_transferBench.bytes);
+    jw_key(&w, "stringUs");
+    jw_int(&w, g_transferBench.micros[TRANSFER_STRING]);
+    jw_key(&w, "sharedJsonUs");
+    jw_int(&w, g_transferBench.micros[TRANSFER_SHARED_JSON]);
+    jw_key(&w, "sharedBinaryUs");
+    jw_int(&w, g_transferBench.micros[TRANSFER_SHARED_BINARY]);
+    jw_end_object(&w);
+    if (jw_ok(&w)) webview_push_script_json("onTransferBench", &b);
+    bb_free(&b);
+
+    bb_free(&g_transferBench.json);
+    g_transferBench.running = FALSE;
 }
 
-/* ── JSON helpers ──────────────────────────────────────────────────────── */
+/* Times one payload of `bytes` characters through each channel in turn:
+ * {"data":"<base64-like text>"} as a script literal, the same JSON in a
+ * shared buffer, and the text as a binary buffer. */
+static void TransferBenchStart(size_t bytes)
+{
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    if (g_transferBench.running || !g_webviewView) return;
+
+    memset(&g_transferBench, 0, sizeof(g_transferBench));
+    ByteBuf *b = &g_transferBench.json;
+    bb_append(b, "{\"data\":\"", 9);
+    if (bb_reserve(b, bytes + 2)) {
+        uint32_t x = 2463534242u;
+        for (size_t i = 0; i < bytes; i++) {
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+            b->data[b->len++] = (uint8_t)alphabet[x & 63];
+        }
+    }
+    bb_append(b, "\"}", 2);
+    if (b->failed) {
+        bb_free(b);
+        LogMessage("ERROR: Out of memory for the bridge transfer benchmark");
+        return;
+    }
 
-static BOOL json_get_string(const char *json, const char *key, char *out, size_t outLen)
-{
-    char search[128];
-    snprintf(search, sizeof(search), "\"%s\"", key);
-    const char *p = strstr(json, search);
-    if (!p) return FALSE;
-    p += strlen(search);
-    while (*p == ' ' || *p == ':') p++;
-    if (*p != '"') return FALSE;
-    p++;
-    size_t i = 0;
-    while (*p && *p != '"' && i < outLen - 1) {
-        out[i++] = *p++;
-    }
-    out[i] = '\0';
-    return TRUE;
+    g_transferBench.running = TRUE;
+    g_transferBench.bytes = bytes;
+    g_transferBench.channel = TRANSFER_STRING;
+    TransferBenchSend();
 }
 
-static BOOL json_get_int(const char *json, const char *key, int *out)
+/* A benchAck arrived for the payload in flight. */
+static void TransferBenchAck(void)
 {
-    char search[128];
-    snprintf(search, sizeof(search), "\"%s\"", key);
-    const char *p = strstr(json, search);
-    if (!p) return FALSE;
-    p += strlen(search);
-    while (*p == ' ' || *p == ':') p++;
-    *out = atoi(p);
-    return TRUE;
+    if (!g_transferBench.running || g_transferBench.channel >= TRANSFER_COUNT) return;
+    g_transferBench.micros[g_transferBench.channel] =
+        (LONGLONG)QpcMicros(g_transferBench.start, QpcNow());
+    while (++g_transferBench.channel < TRANSFER_COUNT) {
+        if (TransferBenchSend()) return;   /* wait for its ack */
+        g_transferBench.micros[g_transferBench.channel] = -1;
+    }
+    TransferBenchFinish();
 }
 
-static void json_escape_string(const char *in, wchar_t *out, size_t outLen)
-{
-    size_t j = 0;
-    for (size_t i = 0; in[i] && j < outLen - 2; i++) {
-        char c = in[i];
-        if (c == '"' || c == '\\') {
-            if (j + 2 >= outLen) break;
-            out[j++] = L'\\';
-            out[j++] = (wchar_t)c;
-        } else if (c == '\n') {
-            if (j + 2 >= outLen) break;
-            out[j++] = L'\\';
-            out[j++] = L'n';
-        } else if (c == '\r') {
-            if (j + 2 >= outLen) break;
-            out[j++] = L'\\';
-            out[j++] = L'r';
-        } else {
-            out[j++] = (wchar_t)(unsigned char)c;
-        }
+/* Sends the page the data for g_pendingView, which makes it show that view. */
+static void webview_push_init(void)
+{
+    if (strcmp(g_pendingView, "config") == 0) {
+        webview_push_init_config();
+    } else if (strcmp(g_pendingView, "log") == 0) {
+        webview_push_init_log();
+    } else if (strcmp(g_pendingView, "stats") == 0) {
+        webview_push_stats(TRUE);
     }
-    out[j] = L'\0';
 }
 
-/* ── Push functions (C -> JS) ──────────────────────────────────────────── */
+/* ── Packed UI resource ────────────────────────────────────────────────── */
 
-static void webview_push_init_config(void)
+/* Maps the UI pack resource once; entries point straight into the image. */
+static BOOL LoadUiPack(void)
 {
-    wchar_t wTitleMatch[4096];
-    json_escape_string(g_configTitleMatch, wTitleMatch, 4096);
+    if (g_uiPack.data) return TRUE;
+
+    HRSRC hRes = FindResource(NULL, MAKEINTRESOURCE(IDR_UI_PACK), RT_RCDATA);
+    HGLOBAL hData = hRes ? LoadResource(NULL, hRes) : NULL;
+    const uint8_t *data = hData ? (const uint8_t *)LockResource(hData) : NULL;
+    if (!data || !uipack_open(&g_uiPack, data, SizeofResource(NULL, hRes))) {
+        LogMessage("ERROR: UI resource is missing or corrupt");
+        return FALSE;
+    }
 
-    wchar_t script[8192];
-    swprintf(script, 8192,
-        L"window.onInit({\"view\":\"config\",\"config\":{\"titleMatch\":\"%s\"}})",
-        wTitleMatch);
-    webview_execute_script(script);
+    unsigned long stored = 0, raw = 0;
+    UiPackEntry e;
+    for (unsigned i = 0; uipack_entry(&g_uiPack, i, &e); i++) {
+        stored += e.size;
+        raw += e.rawSize;
+    }
+    LogMessage("UI pack: %u files, %lu KB stored, %lu KB decoded", g_uiPack.count,
+               stored / 1024, raw / 1024);
+    return TRUE;
 }
 
-static void webview_push_init_log(void)
-{
-    /* Build a JSON array of all log entries */
-    size_t bufLen = (size_t)g_logCount * 600 + 256;
-    if (bufLen < 1024) bufLen = 1024;
-    wchar_t *logJson = (wchar_t*)malloc(bufLen * sizeof(wchar_t));
-    if (!logJson) return;
+/* Read-only IStream over a pack entry. The bytes live in the mapped image
+ * for the life of the process, so nothing is copied or freed; WebView2 may
+ * read the stream from another thread, hence the interlocked count. */
+typedef struct {
+    const IStreamVtbl *lpVtbl;
+    LONG               refCount;
+    const BYTE        *data;
+    ULONG              size;
+    ULONG              pos;
+} ResourceStream;
+
+static IStream *ResourceStreamCreate(const BYTE *data, ULONG size, ULONG pos);
+
+static HRESULT STDMETHODCALLTYPE ResourceStream_QueryInterface(IStream *This, REFIID riid, void **ppv) {
+    if (IsEqualIID(riid, &IID_IUnknown) || IsEqualIID(riid, &IID_ISequentialStream)
+        || IsEqualIID(riid, &IID_IStream)) {
+        *ppv = This;
+        This->lpVtbl->AddRef(This);
+        return S_OK;
+    }
+    *ppv = NULL;
+    return E_NOINTERFACE;
+}
+static ULONG STDMETHODCALLTYPE ResourceStream_AddRef(IStream *This) {
+    return (ULONG)InterlockedIncrement(&((ResourceStream *)This)->refCount);
+}
+static ULONG STDMETHODCALLTYPE ResourceStream_Release(IStream *This) {
+    LONG rc = InterlockedDecrement(&((ResourceStream *)This)->refCount);
+    if (rc == 0) free(This);
+    return (ULONG)rc;
+}
+static HRESULT STDMETHODCALLTYPE ResourceStream_Read(IStream *This, void *pv, ULONG cb, ULONG *pcbRead) {
+    ResourceStream *s = (ResourceStream *)This;
+    ULONG n = s->size - s->pos < cb ? s->size - s->pos : cb;
+    memcpy(pv, s->data + s->pos, n);
+    s->pos += n;
+    if (pcbRead) *pcbRead = n;
+    return n == cb ? S_OK : S_FALSE;
+}
+static HRESULT STDMETHODCALLTYPE ResourceStream_Write(IStream *This, const void *pv, ULONG cb, ULONG *pcbWritten) {
+    (void)This; (void)pv; (void)cb;
+    if (pcbWritten) *pcbWritten = 0;
+    return STG_E_ACCESSDENIED;
+}
+static HRESULT STDMETHODCALLTYPE ResourceStream_Seek(IStream *This, LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPos) {
+    ResourceStream *s = (ResourceStream *)This;
+    LONGLONG base = origin == STREAM_SEEK_SET ? 0 : origin == STREAM_SEEK_CUR ? (LONGLONG)s->pos
+                  : origin == STREAM_SEEK_END ? (LONGLONG)s->size : -1;
+    if (base < 0) return STG_E_INVALIDFUNCTION;
+    LONGLONG target = base + move.QuadPart;
+    if (target < 0 || target > (LONGLONG)s->size) return STG_E_INVALIDFUNCTION;
+    s->pos = (ULONG)target;
+    if (newPos) newPos->QuadPart = s->pos;
+    return S_OK;
+}
+static HRESULT STDMETHODCALLTYPE ResourceStream_SetSize(IStream *This, ULARGE_INTEGER size) {
+    (void)This; (void)size;
+    return STG_E_ACCESSDENIED;
+}
+static HRESULT STDMETHODCALLTYPE ResourceStream_CopyTo(IStream *This, IStream *dest, ULARGE_INTEGER cb, ULARGE_INTEGER *pcbRead, ULARGE_INTEGER *pcbWritten) {
+    ResourceStream *s = (ResourceStream *)This;
+    ULONGLONG left = s->size - s->pos;
+    ULONG n = (ULONG)(cb.QuadPart < left ? cb.QuadPart : left);
+    ULONG written = 0;
+    HRESULT hr = dest->lpVtbl->Write(dest, s->data + s->pos, n, &written);
+    s->pos += n;
+    if (pcbRead) pcbRead->QuadPart = n;
+    if (pcbWritten) pcbWritten->QuadPart = written;
+    return hr;
+}
+static HRESULT STDMETHODCALLTYPE ResourceStream_Commit(IStream *This, DWORD flags) {
+    (void)This; (void)flags;
+    return S_OK;
+}
+static HRESULT STDMETHODCALLTYPE ResourceStream_Revert(IStream *This) {
+    (void)This;
+    return S_OK;
+}
+static HRESULT STDMETHODCALLTYPE ResourceStream_LockRegion(IStream *This, ULARGE_INTEGER offset, ULARGE_INTEGER cb, DWORD type) {
+    (void)This; (void)offset; (void)cb; (void)type;
+    return STG_E_INVALIDFUNCTION;
+}
+static HRESULT STDMETHODCALLTYPE ResourceStream_Stat(IStream *This, STATSTG *stat, DWORD flags) {
+    (void)flags;
+    memset(stat, 0, sizeof(*stat));
+    stat->type = STGTY_STREAM;
+    stat->cbSize.QuadPart = ((ResourceStream *)This)->size;
+    stat->grfMode = STGM_READ;
+    return S_OK;
+}
+static HRESULT STDMETHODCALLTYPE ResourceStream_Clone(IStream *This, IStream **clone) {
+    ResourceStream *s = (ResourceStream *)This;
+    *clone = ResourceStreamCreate(s->data, s->size, s->pos);
+    return *clone ? S_OK : E_OUTOFMEMORY;
+}
 
-    size_t pos = 0;
-    pos += swprintf(logJson + pos, bufLen - pos, L"[");
-    for (int i = 0; i < g_logCount && pos < bufLen - 600; i++) {
-        /* Display oldest first: index 0 = oldest */
-        int bufIdx;
-        if (g_logCount < LOG_RING_CAPACITY) {
-            bufIdx = i;
-        } else {
-            bufIdx = (g_logHead + i) % LOG_RING_CAPACITY;
-        }
-        LogEntry *entry = &g_logRing[bufIdx];
+static const IStreamVtbl g_resourceStreamVtbl = {
+    ResourceStream_QueryInterface,
+    ResourceStream_AddRef,
+    ResourceStream_Release,
+    ResourceStream_Read,
+    ResourceStream_Write,
+    ResourceStream_Seek,
+    ResourceStream_SetSize,
+    ResourceStream_CopyTo,
+    ResourceStream_Commit,
+    ResourceStream_Revert,
+    ResourceStream_LockRegion,
+    ResourceStream_LockRegion,   /* UnlockRegion */
+    ResourceStream_Stat,
+    ResourceStream_Clone,
+};
 
-        if (i > 0) pos += swprintf(logJson + pos, bufLen - pos, L",");
+static IStream *ResourceStreamCreate(const BYTE *data, ULONG size, ULONG pos)
+{
+    ResourceStream *s = malloc(sizeof(*s));
+    if (!s) return NULL;
+    s->lpVtbl = &g_resourceStreamVtbl;
+    s->refCount = 1;
+    s->data = data;
+    s->size = size;
+    s->pos = pos;
+    return (IStream *)s;
+}
 
-        wchar_t wTime[32], wMsg[1024];
-        MultiByteToWideChar(CP_UTF8, 0, entry->time, -1, wTime, 32);
-        json_escape_string(entry->message, wMsg, 1024);
+/* Maps a request URI under UI_ORIGIN to a pack path: query and fragment
+ * dropped, "/" meaning index.html. Returns FALSE for anything that cannot
+ * name a pack entry. */
+static BOOL UiPathFromUri(const WCHAR *uri, char *path, size_t cap)
+{
+    size_t originLen = wcslen(UI_ORIGIN);
+    if (wcsncmp(uri, UI_ORIGIN, originLen) != 0) return FALSE;
 
-        pos += swprintf(logJson + pos, bufLen - pos,
-            L"{\"time\":\"%s\",\"message\":\"%s\"}",
-            wTime, wMsg);
+    size_t n = 0;
+    for (const WCHAR *p = uri + originLen; *p && *p != L'?' && *p != L'#'; p++) {
+        if (*p >= 0x80 || *p == L'\\' || n + 1 >= cap) return FALSE;
+        path[n++] = (char)*p;
     }
-    if (pos < bufLen - 1) pos += swprintf(logJson + pos, bufLen - pos, L"]");
+    path[n] = '\0';
+    if (strstr(path, "..")) return FALSE;
+    if (n == 0) strcpy(path, "index.html");
+    return TRUE;
+}
 
-    size_t scriptLen = bufLen + 256;
-    wchar_t *script = (wchar_t*)malloc(scriptLen * sizeof(wchar_t));
-    if (!script) { free(logJson); return; }
-    swprintf(script, scriptLen,
-        L"window.onInit({\"view\":\"log\",\"log\":%s})", logJson);
-    webview_execute_script(script);
-    free(script);
-    free(logJson);
+static HRESULT STDMETHODCALLTYPE ResourceRequested_Invoke(ICoreWebView2WebResourceRequestedEventHandler *This, ICoreWebView2 *sender, ICoreWebView2WebResourceRequestedEventArgs *args) {
+    (void)This; (void)sender;
+    if (!g_webviewEnv) return S_OK;
+
+    ICoreWebView2WebResourceRequest *request = NULL;
+    LPWSTR uri = NULL;
+    args->lpVtbl->get_Request(args, &request);
+    if (request) {
+        request->lpVtbl->get_Uri(request, &uri);
+        request->lpVtbl->Release(request);
+    }
+    if (!uri) return S_OK;
+
+    char path[256];
+    UiPackEntry entry;
+    ICoreWebView2WebResourceResponse *response = NULL;
+    if (UiPathFromUri(uri, path, sizeof(path)) && uipack_find(&g_uiPack, path, &entry)) {
+        /* Hashed assets never change; index.html is revalidated */
+        WCHAR headers[256];
+        swprintf(headers, 256, L"Content-Type: %hs\r\nCache-Control: %s%s", entry.mime,
+                 (entry.flags & UIPACK_FLAG_IMMUTABLE) ? L"max-age=31536000, immutable" : L"no-cache",
+                 entry.encoding == UIPACK_ENCODING_DEFLATE ? L"\r\nContent-Encoding: deflate" : L"");
+        IStream *stream = ResourceStreamCreate(entry.data, entry.size, 0);
+        if (stream) {
+            g_webviewEnv->lpVtbl->CreateWebResourceResponse(g_webviewEnv, stream, 200, L"OK",
+                                                            headers, &response);
+            stream->lpVtbl->Release(stream);
+            g_uiRequests++;
+            g_uiStoredBytes += entry.size;
+            g_uiRawBytes += entry.rawSize;
+        }
+    } else {
+        char narrow[256];
+        WideCharToMultiByte(CP_UTF8, 0, uri, -1, narrow, sizeof(narrow), NULL, NULL);
+        narrow[sizeof(narrow) - 1] = '\0';
+        LogMessage("ERROR: UI resource not found: %s", narrow);
+        g_webviewEnv->lpVtbl->CreateWebResourceResponse(g_webviewEnv, NULL, 404, L"Not Found",
+                                                        L"", &response);
+    }
+    if (response) {
+        args->lpVtbl->put_Response(args, response);
+        response->lpVtbl->Release(response);
+    }
+    CoTaskMemFree(uri);
+    return S_OK;
 }
 
 /* ── COM callback handler implementations ────────────────────────────── */
@@ -1046,9 +5020,16 @@ static ULONG STDMETHODCALLTYPE EnvCompleted_Release(ICoreWebView2CreateCoreWebVi
 
 static HRESULT STDMETHODCALLTYPE EnvCompleted_Invoke(ICoreWebView2CreateCoreWebView2EnvironmentCompletedHandler *This, HRESULT result, ICoreWebView2Environment *env) {
     (void)This;
-    if (FAILED(result) || !env) return result;
+    g_webviewEnvPending = FALSE;
+    if (FAILED(result) || !env) {
+        LogMessage("ERROR: WebView2 environment creation failed (0x%08lX)", (unsigned long)result);
+        return result;
+    }
+    if (!g_webviewHwnd) return S_OK;   /* released while starting */
     g_webviewEnv = env;
     env->lpVtbl->AddRef(env);
+    LogMessage("WebView2 environment ready in %lu ms",
+               (unsigned long)(QpcMicros(g_webviewStartQpc, QpcNow()) / 1000));
 
     static ControllerCompletedHandlerVtbl ctrlVtbl = {0};
     static BOOL ctrlVtblInit = FALSE;
@@ -1078,21 +5059,40 @@ static EnvironmentCompletedHandlerVtbl g_envCompletedVtbl = {
 
 static HRESULT STDMETHODCALLTYPE CtrlCompleted_Invoke(ICoreWebView2CreateCoreWebView2ControllerCompletedHandler *This, HRESULT result, ICoreWebView2Controller *controller) {
     (void)This;
-    if (FAILED(result) || !controller) return result;
+    if (FAILED(result) || !controller) {
+        LogMessage("ERROR: WebView2 controller creation failed (0x%08lX)", (unsigned long)result);
+        return result;
+    }
+    if (!g_webviewHwnd || !g_webviewEnv) {
+        controller->lpVtbl->Close(controller);   /* released while starting */
+        return S_OK;
+    }
 
     g_webviewController = controller;
     controller->lpVtbl->AddRef(controller);
+    LogMessage("WebView2 controller ready in %lu ms",
+               (unsigned long)(QpcMicros(g_webviewStartQpc, QpcNow()) / 1000));
 
     RECT bounds;
     GetClientRect(g_webviewHwnd, &bounds);
     controller->lpVtbl->put_Bounds(controller, bounds);
-    controller->lpVtbl->put_IsVisible(controller, TRUE);
+    /* A prewarmed controller stays invisible until a dialog opens */
+    controller->lpVtbl->put_IsVisible(controller, g_pendingView[0] != '\0');
 
     ICoreWebView2 *webview = NULL;
     controller->lpVtbl->get_CoreWebView2(controller, &webview);
     if (!webview) return E_FAIL;
     g_webviewView = webview;
 
+    /* Shared buffers need runtime 114 or later; without them every payload
+     * goes as script */
+    g_webviewEnv->lpVtbl->QueryInterface(g_webviewEnv, &IID_ICoreWebView2Environment12,
+                                         (void **)&g_webviewEnv12);
+    webview->lpVtbl->QueryInterface(webview, &IID_ICoreWebView2_17, (void **)&g_webviewView17);
+    if (!g_webviewEnv12 || !g_webviewView17) {
+        LogMessage("WebView2 runtime has no shared buffers; large payloads go as script");
+    }
+
     ICoreWebView2Settings *settings = NULL;
     webview->lpVtbl->get_Settings(webview, &settings);
     if (settings) {
@@ -1121,24 +5121,32 @@ static HRESULT STDMETHODCALLTYPE CtrlCompleted_Invoke(ICoreWebView2CreateCoreWeb
     webview->lpVtbl->add_WebMessageReceived(webview, msgHandler, &token);
     msgHandler->lpVtbl->Release(msgHandler);
 
-    /* Load embedded HTML from resources */
-    HRSRC hRes = FindResource(NULL, MAKEINTRESOURCE(IDR_HTML_UI), RT_RCDATA);
-    if (hRes) {
-        HGLOBAL hData = LoadResource(NULL, hRes);
-        if (hData) {
-            DWORD htmlSize = SizeofResource(NULL, hRes);
-            const char *htmlUtf8 = (const char *)LockResource(hData);
-            if (htmlUtf8 && htmlSize > 0) {
-                int wLen = MultiByteToWideChar(CP_UTF8, 0, htmlUtf8, (int)htmlSize, NULL, 0);
-                wchar_t *wHtml = malloc((wLen + 1) * sizeof(wchar_t));
-                MultiByteToWideChar(CP_UTF8, 0, htmlUtf8, (int)htmlSize, wHtml, wLen);
-                wHtml[wLen] = L'\0';
-                webview->lpVtbl->NavigateToString(webview, wHtml);
-                free(wHtml);
-            }
-        }
+    /* Serve the UI from the packed resource; the browser fetches, inflates
+     * and caches it like any site */
+    if (!LoadUiPack()) return E_FAIL;
+
+    static WebResourceRequestedHandlerVtbl resVtbl = {0};
+    static BOOL resVtblInit = FALSE;
+    if (!resVtblInit) {
+        resVtbl.QueryInterface = (HRESULT (STDMETHODCALLTYPE *)(ICoreWebView2WebResourceRequestedEventHandler*, REFIID, void**))EnvCompleted_QueryInterface;
+        resVtbl.AddRef = (ULONG (STDMETHODCALLTYPE *)(ICoreWebView2WebResourceRequestedEventHandler*))EnvCompleted_AddRef;
+        resVtbl.Release = (ULONG (STDMETHODCALLTYPE *)(ICoreWebView2WebResourceRequestedEventHandler*))EnvCompleted_Release;
+        resVtbl.Invoke = ResourceRequested_Invoke;
+        resVtblInit = TRUE;
     }
 
+    ICoreWebView2WebResourceRequestedEventHandler *resHandler = malloc(sizeof(*resHandler));
+    resHandler->lpVtbl = &resVtbl;
+    resHandler->refCount = 1;
+
+    webview->lpVtbl->AddWebResourceRequestedFilter(webview, UI_ORIGIN L"*",
+                                                   COREWEBVIEW2_WEB_RESOURCE_CONTEXT_ALL);
+    webview->lpVtbl->add_WebResourceRequested(webview, resHandler, &token);
+    resHandler->lpVtbl->Release(resHandler);
+
+    g_uiRequests = g_uiStoredBytes = g_uiRawBytes = 0;
+    webview->lpVtbl->Navigate(webview, UI_ORIGIN L"index.html");
+
     return S_OK;
 }
 
@@ -1152,39 +5160,81 @@ static HRESULT STDMETHODCALLTYPE MsgReceived_Invoke(ICoreWebView2WebMessageRecei
     if (!wMsg) return S_OK;
 
     int len = WideCharToMultiByte(CP_UTF8, 0, wMsg, -1, NULL, 0, NULL, NULL);
-    char *msg = malloc(len);
-    WideCharToMultiByte(CP_UTF8, 0, wMsg, -1, msg, len, NULL, NULL);
+    char *msg = len > 0 ? malloc(len) : NULL;
+    if (msg) WideCharToMultiByte(CP_UTF8, 0, wMsg, -1, msg, len, NULL, NULL);
     CoTaskMemFree(wMsg);
+    if (!msg) return S_OK;
+    size_t msgLen = (size_t)len - 1;
 
     char action[64] = {0};
-    json_get_string(msg, "action", action, sizeof(action));
+    json_get_string(msg, msgLen, "action", action, sizeof(action));
 
     if (strcmp(action, "getInit") == 0) {
-        if (strcmp(g_pendingView, "config") == 0) {
-            webview_push_init_config();
-        } else if (strcmp(g_pendingView, "log") == 0) {
-            webview_push_init_log();
+        /* The page has loaded; a prewarmed one has no view to show yet */
+        if (!g_webviewReady) {
+            g_webviewReady = TRUE;
+            LogMessage("WebView2 page loaded %lu ms after environment creation started "
+                       "(%lu requests, %lu KB served, %lu KB decoded)",
+                       (unsigned long)(QpcMicros(g_webviewStartQpc, QpcNow()) / 1000),
+                       g_uiRequests, g_uiStoredBytes / 1024, g_uiRawBytes / 1024);
+        }
+        webview_push_init();
+    } else if (strcmp(action, "painted") == 0) {
+        char view[16] = "";
+        json_get_string(msg, msgLen, "view", view, sizeof(view));
+        if (g_dialogOpenQpc && strcmp(view, g_pendingView) == 0) {
+            ULONGLONG us = QpcMicros(g_dialogOpenQpc, QpcNow());
+            stat_record(&g_stageStats[g_dialogCold ? STAGE_DIALOG_COLD : STAGE_DIALOG_WARM], us, 0);
+            LogMessage("%s view painted %lu ms after opening (%s)", view,
+                       (unsigned long)(us / 1000), g_dialogCold ? "cold" : "warm");
+            g_dialogOpenQpc = 0;
+            StatsChanged();
         }
     } else if (strcmp(action, "saveSettings") == 0) {
-        char titleMatch[2048] = {0};
-        json_get_string(msg, "titleMatch", titleMatch, sizeof(titleMatch));
-        strncpy(g_configTitleMatch, titleMatch, sizeof(g_configTitleMatch) - 1);
-        g_configTitleMatch[sizeof(g_configTitleMatch) - 1] = '\0';
-        SaveConfigToRegistry();
-        ParseKeywords();
-        UpdateTooltip();
-        LogMessage("Configuration updated: TitleMatch=%s", g_configTitleMatch);
+        if (ApplyProfilesMessage(msg, msgLen)) {
+            char trigger[16];
+            SaveConfigToRegistry();
+            UpdateTooltip();
+            LogMessage("Configuration updated:");
+            LogProfiles();
+            if (json_get_string(msg, msgLen, "trigger", trigger, sizeof(trigger))) TriggerSave(trigger);
+        } else {
+            LogMessage("ERROR: Could not read the settings, configuration unchanged");
+        }
         PostMessage(g_webviewHwnd, WM_CLOSE, 0, 0);
     } else if (strcmp(action, "close") == 0) {
         PostMessage(g_webviewHwnd, WM_CLOSE, 0, 0);
     } else if (strcmp(action, "clearLog") == 0) {
+        free(g_logRing);
+        g_logRing = NULL;
+        g_logCap = 0;
         g_logCount = 0;
         g_logHead = 0;
-        /* Push empty log array back to JS */
-        webview_execute_script(L"window.onInit && window.onInit({\"view\":\"log\",\"log\":[]})");
+        log_index_free(&g_logIndex);
+        /* Push the empty log back to JS */
+        webview_push_init_log();
+    } else if (strcmp(action, "searchLog") == 0) {
+        webview_push_log_search(msg, msgLen);
+    } else if (strcmp(action, "getLogPage") == 0) {
+        webview_push_log_page(msg, msgLen);
+    } else if (strcmp(action, "resetStats") == 0) {
+        for (int i = 0; i < STAGE_COUNT; i++) stat_reset(&g_stageStats[i]);
+        g_hookNearTimeouts = 0;
+        ZeroMemory(g_pasteFaults, sizeof(g_pasteFaults));
+        LogMessage("Paste statistics reset");
+        webview_push_stats(FALSE);
+    } else if (strcmp(action, "getThumb") == 0) {
+        int id = 0;
+        if (json_get_int(msg, msgLen, "id", &id) && id > 0) webview_push_thumb((uint32_t)id);
+    } else if (strcmp(action, "benchTransfer") == 0) {
+        TransferBenchStart(TRANSFER_BENCH_BYTES);
+    } else if (strcmp(action, "benchKeystroke") == 0) {
+        KeyBenchStart();
+    } else if (strcmp(action, "benchAck") == 0) {
+        TransferBenchAck();
     } else if (strcmp(action, "resize") == 0) {
         int contentHeight = 0;
-        json_get_int(msg, "height", &contentHeight);
+        json_get_int(msg, msgLen, "height", &contentHeight);
         if (contentHeight > 0 && g_webviewHwnd) {
             RECT clientRect = {0}, windowRect = {0};
             GetClientRect(g_webviewHwnd, &clientRect);
@@ -1211,10 +5261,71 @@ static HRESULT STDMETHODCALLTYPE MsgReceived_Invoke(ICoreWebView2WebMessageRecei
 
 /* ── WebView2 window ───────────────────────────────────────────────────── */
 
+/* Closes the controller, releases the environment (which lets the browser
+ * processes exit) and destroys the window. */
+static void ReleaseWebView(void)
+{
+    if (g_webviewController) {
+        g_webviewController->lpVtbl->Close(g_webviewController);
+        g_webviewController->lpVtbl->Release(g_webviewController);
+        g_webviewController = NULL;
+    }
+    if (g_webviewView17) {
+        g_webviewView17->lpVtbl->base.Release((ICoreWebView2 *)g_webviewView17);
+        g_webviewView17 = NULL;
+    }
+    if (g_webviewView) {
+        g_webviewView->lpVtbl->Release(g_webviewView);
+        g_webviewView = NULL;
+    }
+    if (g_webviewEnv12) {
+        g_webviewEnv12->lpVtbl->base.Release((ICoreWebView2Environment *)g_webviewEnv12);
+        g_webviewEnv12 = NULL;
+    }
+    if (g_webviewEnv) {
+        g_webviewEnv->lpVtbl->Release(g_webviewEnv);
+        g_webviewEnv = NULL;
+    }
+    g_webviewReady = FALSE;
+    g_pendingView[0] = '\0';
+    g_dialogOpenQpc = 0;
+    KillTimer(g_hWndMain, ID_TIMER_WEBVIEW_IDLE);
+    if (g_webviewHwnd) DestroyWindow(g_webviewHwnd);
+}
+
+/* Closing a dialog only hides it; the idle timer releases WebView2 later. */
+static void HideWebViewDialog(void)
+{
+    KillTimer(g_webviewHwnd, ID_TIMER_WEBVIEW_SHOW_FALLBACK);
+    g_pendingView[0] = '\0';
+    g_dialogOpenQpc = 0;
+    g_webviewWindowShown = FALSE;
+    if (g_webviewIdleMinutes == 0) {
+        ReleaseWebView();
+        ScheduleIdleTrim();
+        return;
+    }
+    ShowWindow(g_webviewHwnd, SW_HIDE);
+    /* An invisible controller stops rendering and timers are throttled */
+    if (g_webviewController)
+        g_webviewController->lpVtbl->put_IsVisible(g_webviewController, FALSE);
+    SetTimer(g_hWndMain, ID_TIMER_WEBVIEW_IDLE, g_webviewIdleMinutes * 60000, NULL);
+    ScheduleIdleTrim();
+}
+
+static void WebViewIdleTimeout(void)
+{
+    KillTimer(g_hWndMain, ID_TIMER_WEBVIEW_IDLE);
+    if (!g_webviewHwnd || IsWindowVisible(g_webviewHwnd)) return;
+    ReleaseWebView();
+    LogMessage("WebView2 released after %lu idle minute(s)", g_webviewIdleMinutes);
+    ScheduleIdleTrim();
+}
+
 static LRESULT CALLBACK WebViewWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
         case WM_SIZE:
-            webview_sync_controller_bounds();
+            if (IsWindowVisible(hwnd) || g_pendingView[0]) webview_sync_controller_bounds();
             return 0;
 
         case WM_TIMER:
@@ -1231,22 +5342,7 @@ static LRESULT CALLBACK WebViewWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARA
             break;
 
         case WM_CLOSE:
-            g_webviewWindowShown = FALSE;
-            KillTimer(hwnd, ID_TIMER_WEBVIEW_SHOW_FALLBACK);
-            if (g_webviewController) {
-                g_webviewController->lpVtbl->Close(g_webviewController);
-                g_webviewController->lpVtbl->Release(g_webviewController);
-                g_webviewController = NULL;
-            }
-            if (g_webviewView) {
-                g_webviewView->lpVtbl->Release(g_webviewView);
-                g_webviewView = NULL;
-            }
-            if (g_webviewEnv) {
-                g_webviewEnv->lpVtbl->Release(g_webviewEnv);
-                g_webviewEnv = NULL;
-            }
-            DestroyWindow(hwnd);
+            HideWebViewDialog();
             return 0;
 
         case WM_DESTROY:
@@ -1258,21 +5354,10 @@ static LRESULT CALLBACK WebViewWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARA
     return DefWindowProcW(hwnd, msg, wParam, lParam);
 }
 
-static void ShowWebViewDialog(const char* view, int width, int height) {
-    if (g_webviewHwnd != NULL) {
-        SetForegroundWindow(g_webviewHwnd);
-        return;
-    }
-
-    CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
-
-    if (!fnCreateEnvironment && !load_webview2_loader()) {
-        return;
-    }
-
-    strncpy(g_pendingView, view, sizeof(g_pendingView) - 1);
-    g_pendingView[sizeof(g_pendingView) - 1] = '\0';
-
+/* Creates the dialog window, hidden; it is shown once the page reports the
+ * height of its view. */
+static BOOL CreateWebViewWindow(void)
+{
     /* Register window class (once) */
     static BOOL classRegistered = FALSE;
     if (!classRegistered) {
@@ -1291,26 +5376,24 @@ static void ShowWebViewDialog(const char* view, int width, int height) {
         classRegistered = TRUE;
     }
 
-    const wchar_t *title = L"Configuration";
-    if (strcmp(view, "log") == 0) title = L"Activity Log";
-
-    int screenW = GetSystemMetrics(SM_CXSCREEN);
-    int screenH = GetSystemMetrics(SM_CYSCREEN);
-    int posX = (screenW - width) / 2;
-    int posY = (screenH - height) / 2;
-
-    g_webviewHwnd = CreateWindowExW(0, L"ImagePasterWebViewWnd", title,
+    g_webviewHwnd = CreateWindowExW(0, L"ImagePasterWebViewWnd", APP_NAME,
         WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_MINIMIZEBOX,
-        posX, posY, width, height,
+        CW_USEDEFAULT, CW_USEDEFAULT, 480, 300,
         NULL, NULL, g_hInstance, NULL);
 
     if (!g_webviewHwnd) {
         LogMessage("ERROR: Failed to create WebView2 window.");
-        return;
+        return FALSE;
     }
     g_webviewWindowShown = FALSE;
-    SetTimer(g_webviewHwnd, ID_TIMER_WEBVIEW_SHOW_FALLBACK, WEBVIEW_SHOW_FALLBACK_DELAY_MS, NULL);
+    return TRUE;
+}
 
+/* Starts the asynchronous environment -> controller -> navigation chain.
+ * `interactive` reports a missing runtime with a message box rather than
+ * only in the log. */
+static BOOL StartWebViewEnvironment(BOOL interactive)
+{
     WCHAR userDataFolder[MAX_PATH];
     DWORD tempLen = GetTempPathW(MAX_PATH, userDataFolder);
     if (tempLen > 0 && tempLen < MAX_PATH - 30) {
@@ -1323,19 +5406,89 @@ static void ShowWebViewDialog(const char* view, int width, int height) {
     envHandler->lpVtbl = &g_envCompletedVtbl;
     envHandler->refCount = 1;
 
+    g_webviewStartQpc = QpcNow();
+    g_webviewEnvPending = TRUE;
     HRESULT hr = fnCreateEnvironment(NULL, userDataFolder[0] ? userDataFolder : NULL, NULL, envHandler);
     envHandler->lpVtbl->Release(envHandler);
 
     if (FAILED(hr)) {
+        g_webviewEnvPending = FALSE;
         LogMessage("ERROR: Failed to initialize WebView2 environment.");
-        MessageBoxW(NULL,
-            L"Failed to initialize WebView2.\n\n"
-            L"Please ensure the Microsoft Edge WebView2 Runtime is installed.\n"
-            L"Download from: https://developer.microsoft.com/en-us/microsoft-edge/webview2/",
-            APP_NAME, MB_ICONERROR | MB_OK);
+        if (interactive) {
+            MessageBoxW(NULL,
+                L"Failed to initialize WebView2.\n\n"
+                L"Please ensure the Microsoft Edge WebView2 Runtime is installed.\n"
+                L"Download from: https://developer.microsoft.com/en-us/microsoft-edge/webview2/",
+                APP_NAME, MB_ICONERROR | MB_OK);
+        }
         DestroyWindow(g_webviewHwnd);
-        g_webviewHwnd = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static void ShowWebViewDialog(const char* view, int width, int height) {
+    BOOL visible = g_webviewHwnd && IsWindowVisible(g_webviewHwnd);
+    if (visible && strcmp(g_pendingView, view) == 0) {
+        SetForegroundWindow(g_webviewHwnd);
+        return;
+    }
+
+    if (!EnsureCom()) return;
+    if (!fnCreateEnvironment && !load_webview2_loader()) {
+        return;
+    }
+    if (!g_webviewHwnd && !CreateWebViewWindow()) {
+        return;
+    }
+
+    KillTimer(g_hWndMain, ID_TIMER_WEBVIEW_IDLE);
+    strncpy(g_pendingView, view, sizeof(g_pendingView) - 1);
+    g_pendingView[sizeof(g_pendingView) - 1] = '\0';
+    g_dialogOpenQpc = QpcNow();
+    g_dialogCold = !g_webviewReady;
+
+    const wchar_t *title = L"Configuration";
+    if (strcmp(view, "log") == 0) title = L"Activity Log";
+    else if (strcmp(view, "stats") == 0) title = L"Statistics";
+    SetWindowTextW(g_webviewHwnd, title);
+
+    if (visible) {
+        /* Switching views in place; the page reports the new height */
+        RECT rc;
+        GetWindowRect(g_webviewHwnd, &rc);
+        SetWindowPos(g_webviewHwnd, NULL, 0, 0, width, rc.bottom - rc.top,
+                     SWP_NOMOVE | SWP_NOZORDER);
+        SetForegroundWindow(g_webviewHwnd);
+    } else {
+        int screenW = GetSystemMetrics(SM_CXSCREEN);
+        int screenH = GetSystemMetrics(SM_CYSCREEN);
+        SetWindowPos(g_webviewHwnd, NULL, (screenW - width) / 2, (screenH - height) / 2,
+                     width, height, SWP_NOZORDER | SWP_NOACTIVATE);
+        g_webviewWindowShown = FALSE;
+        SetTimer(g_webviewHwnd, ID_TIMER_WEBVIEW_SHOW_FALLBACK, WEBVIEW_SHOW_FALLBACK_DELAY_MS, NULL);
+    }
+
+    if (g_webviewReady) {
+        /* Warm: the loaded page switches to the view on a message */
+        webview_sync_controller_bounds();
+        webview_push_init();
+    } else if (!g_webviewEnv && !g_webviewEnvPending) {
+        StartWebViewEnvironment(TRUE);
     }
+    /* Otherwise the page is still loading and asks for its view with getInit */
+}
+
+/* Creates the environment and a hidden, navigated controller ahead of the
+ * first dialog. The idle timer applies from here on. */
+static void PrewarmWebView(void)
+{
+    if (g_webviewHwnd || !EnsureCom()) return;
+    if (!fnCreateEnvironment && !load_webview2_loader()) return;
+    if (!CreateWebViewWindow()) return;
+    LogMessage("Prewarming WebView2");
+    if (StartWebViewEnvironment(FALSE) && g_webviewIdleMinutes > 0)
+        SetTimer(g_hWndMain, ID_TIMER_WEBVIEW_IDLE, g_webviewIdleMinutes * 60000, NULL);
 }
 
 /* ── Window procedure (hidden message window) ──────────────────────────── */
@@ -1348,8 +5501,10 @@ static LRESULT CALLBACK WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lPara
             POINT pt;
             GetCursorPos(&pt);
             SetForegroundWindow(hWnd);
-            EnableMenuItem(g_hMenu, ID_TRAY_LOG, g_webviewHwnd ? MF_GRAYED : MF_ENABLED);
-            EnableMenuItem(g_hMenu, ID_TRAY_CONFIGURE, g_webviewHwnd ? MF_GRAYED : MF_ENABLED);
+            /* Dialog items stay enabled: a hidden dialog is reused, an open one switches view */
+            CheckMenuItem(g_hMenu, ID_TRAY_TRACE, g_traceEnabled ? MF_CHECKED : MF_UNCHECKED);
+            EnableMenuItem(g_hMenu, ID_TRAY_TRACE_SAVE, g_traceEnabled ? MF_ENABLED : MF_GRAYED);
+            CheckMenuItem(g_hMenu, ID_TRAY_CAPTURE, g_captureEnabled ? MF_CHECKED : MF_UNCHECKED);
             TrackPopupMenu(g_hMenu, TPM_RIGHTBUTTON, pt.x, pt.y, 0, hWnd, NULL);
         }
         return 0;
@@ -1360,20 +5515,49 @@ static LRESULT CALLBACK WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lPara
             LogMessage("Opening Activity Log dialog");
             ShowWebViewDialog("log", 700, 500);
             break;
+        case ID_TRAY_STATS:
+            LogMessage("Opening Statistics dialog");
+            ShowWebViewDialog("stats", 640, 420);
+            break;
         case ID_TRAY_CONFIGURE:
             LogMessage("Opening Configuration dialog");
-            ShowWebViewDialog("config", 480, 300);
+            ShowWebViewDialog("config", 640, 300);
+            break;
+        case ID_TRAY_TRACE:
+            if (g_traceEnabled) {
+                trace_set_enabled(FALSE);
+                LogMessage("Tracing disabled");
+            } else {
+                trace_clear();
+                trace_set_enabled(TRUE);
+                LogMessage("Tracing enabled");
+            }
+            SaveFlagToRegistry(REG_VALUE_TRACE, g_traceEnabled != 0);
+            break;
+        case ID_TRAY_TRACE_SAVE:
+            SaveTraceFile();
+            break;
+        case ID_TRAY_CAPTURE:
+            g_captureEnabled = !g_captureEnabled;
+            SaveFlagToRegistry(REG_VALUE_CAPTURE, g_captureEnabled);
+            LogMessage("Paste capture %s", g_captureEnabled ? "enabled" : "disabled");
+            break;
+        case ID_TRAY_CAPTURE_OPEN:
+            OpenCaptureFolder();
             break;
         case ID_TRAY_EXIT:
             LogMessage("User selected Exit");
-            /* Close WebView if open */
-            if (g_webviewHwnd) SendMessage(g_webviewHwnd, WM_CLOSE, 0, 0);
+            /* Release WebView2, open or kept warm */
+            ReleaseWebView();
             Shell_NotifyIconW(NIM_DELETE, &g_nid);
             if (g_hAppIcon) DestroyIcon(g_hAppIcon);
             if (g_hMenu) DestroyMenu(g_hMenu);
-            if (g_hHook) UnhookWindowsHookEx(g_hHook);
-            GdiplusShutdown(g_gdipToken);
-            CoUninitialize();
+            TriggerStop(g_trigger);
+            if (g_hHook) UnhookWindowsHookEx(g_hHook);   /* the keystroke benchmark's */
+            RemoveForegroundHooks();
+            ConfigWatchStop();
+            FlushProcessCache();
+            ShutdownSubsystems();
             if (g_hMutex) {
                 ReleaseMutex(g_hMutex);
                 CloseHandle(g_hMutex);
@@ -1384,10 +5568,101 @@ static LRESULT CALLBACK WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lPara
         return 0;
 
     case WM_DO_PASTE:
-        LogMessage("WM_DO_PASTE received, simulating Ctrl+V now");
-        SimulateCtrlV();
+        TRACE_BEGIN("WM_DO_PASTE");
+        if (g_pasteStartQpc) StageRecord(STAGE_HOOK_TO_PASTE, g_pasteStartQpc, 0);
+        if (wParam == PROFILE_DELIVER_TYPE) {
+            LogMessage("WM_DO_PASTE received, typing the text now");
+            TypeStart();
+        } else {
+            LogMessage("WM_DO_PASTE received, simulating Ctrl+V now");
+            SimulateCtrlV();
+        }
+        ScheduleIdleTrim();
+        TRACE_END("WM_DO_PASTE");
+        return 0;
+
+    case WM_HOOK_SLOW: {
+        DWORD ms = (DWORD)wParam;
+        LogMessage("WARNING: Keyboard hook took %lu ms (LowLevelHooksTimeout %lu ms)",
+                   ms, g_hookTimeoutMs);
+        if (GetTickCount() - g_lastSlowNotifyTick >= HOOK_SLOW_NOTIFY_INTERVAL_MS
+            || g_lastSlowNotifyTick == 0) {
+            WCHAR text[256];
+            swprintf(text, 256,
+                L"The keyboard hook took %lu ms (limit %lu ms). "
+                L"Windows may remove the hook if this keeps happening.",
+                ms, g_hookTimeoutMs);
+            ShowTrayNotification(L"ImagePaster", text, NIIF_WARNING);
+            g_lastSlowNotifyTick = GetTickCount();
+        }
+        StatsChanged();
+        return 0;
+    }
+
+    case WM_HOTKEY:
+        if (wParam == ID_HOTKEY_PASTE) OnPasteHotkey();
+        else if (wParam == ID_HOTKEY_CANCEL) SchedCancelPaste(CONVERT_CANCEL_ESC);
+        return 0;
+
+    case WM_INPUT:
+        OnRawKeyboard((HRAWINPUT)lParam);
+        break;      /* DefWindowProc cleans up */
+
+    case WM_KEY_BENCH_DONE:
+        KeyBenchHalfDone((BOOL)wParam);
+        return 0;
+
+    case WM_TYPE_DONE:
+        TypeDone();
+        return 0;
+
+    case WM_JOB_DONE:
+        SchedJobDone((DWORD)wParam);
+        return 0;
+
+    case WM_CLIPBOARDUPDATE:
+        SchedClipboardChanged();
+        return 0;
+
+    case WM_CONFIG_CHANGED:
+        ConfigChanged((LONG)lParam);
         return 0;
 
+    case WM_CAPTURE_DONE:
+        if (wParam)
+            LogMessage("Paste captured (%ld bytes appended)", (long)lParam);
+        else
+            LogMessage("ERROR: Failed to write paste capture");
+        return 0;
+
+    case WM_TIMER:
+        if (wParam == ID_TIMER_HOOK_WATCHDOG) {
+            if (!g_keyBench.running) HookWatchdogTick();
+            return 0;
+        }
+        if (wParam == ID_TIMER_HOTKEY_REARM) {
+            HotkeyRearm();
+            return 0;
+        }
+        if (wParam == ID_TIMER_WEBVIEW_IDLE) {
+            WebViewIdleTimeout();
+            return 0;
+        }
+        if (wParam == ID_TIMER_WEBVIEW_PREWARM) {
+            KillTimer(hWnd, ID_TIMER_WEBVIEW_PREWARM);
+            PrewarmWebView();
+            return 0;
+        }
+        if (wParam == ID_TIMER_IDLE_TRIM) {
+            IdleTrim();
+            return 0;
+        }
+        if (wParam == ID_TIMER_CONVERT_PROGRESS) {
+            SchedProgressTick();
+            return 0;
+        }
+        break;
+
     case WM_DESTROY:
         PostQuitMessage(0);
         return 0;
@@ -1402,13 +5677,20 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                    LPSTR lpCmdLine, int nCmdShow)
 {
     MSG msg;
-    GdiplusStartupInput gdipInput;
 
     (void)hPrevInstance;
     (void)lpCmdLine;
     (void)nCmdShow;
 
     g_hInstance = hInstance;
+    trace_set_thread_name("Main (UI + hook)");
+
+    {
+        LARGE_INTEGER freq;
+        if (QueryPerformanceFrequency(&freq) && freq.QuadPart > 0)
+            g_qpcFreq = freq.QuadPart;
+    }
+    LONGLONG tWinMain = QpcNow();
 
     /* Single-instance check */
     g_hMutex = CreateMutexW(NULL, TRUE, MUTEX_NAME);
@@ -1418,20 +5700,21 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
         return 0;
     }
 
-    /* Initialize COM (needed for IStream and WebView2) */
-    CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
-
-    /* Initialize GDI+ */
-    ZeroMemory(&gdipInput, sizeof(gdipInput));
-    gdipInput.GdiplusVersion = 1;
-    if (GdiplusStartup(&g_gdipToken, &gdipInput, NULL) != 0) {
-        MessageBoxW(NULL, L"Failed to initialize GDI+.", APP_NAME, MB_OK | MB_ICONERROR);
+    /* Load configuration */
+    LoadSettingsFromRegistry();
+    if (!ConfigStart()) {
+        MessageBoxW(NULL, L"Out of memory loading the configuration.", APP_NAME, MB_OK | MB_ICONERROR);
         return 1;
     }
 
-    /* Load configuration */
-    LoadConfigFromRegistry();
-    ParseKeywords();
+    /* COM and GDI+ otherwise start on first use (see EnsureCom) */
+    if (g_eagerInit) {
+        EnsureCom();
+        if (!EnsureGdiplus()) {
+            MessageBoxW(NULL, L"Failed to initialize GDI+.", APP_NAME, MB_OK | MB_ICONERROR);
+            return 1;
+        }
+    }
 
     /* Load application icon */
     g_hAppIcon = (HICON)LoadImageW(hInstance, MAKEINTRESOURCEW(IDI_APPICON),
@@ -1453,7 +5736,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
                                   0, 0, 0, 0, HWND_MESSAGE, NULL, hInstance, NULL);
     if (!g_hWndMain) {
         MessageBoxW(NULL, L"Failed to create message window.", APP_NAME, MB_OK | MB_ICONERROR);
-        GdiplusShutdown(g_gdipToken);
+        ShutdownSubsystems();
         return 1;
     }
 
@@ -1463,17 +5746,36 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
     UpdateTooltip();
 
     LogMessage("ImagePaster started");
-    LogMessage("GDI+ initialized");
-    LogMessage("Title match keywords: %s", g_configTitleMatch);
+    LogProfiles();
+    if (g_captureEnabled) LogMessage("Paste capture is enabled");
+
+    /* Install the paste trigger */
+    g_hookTimeoutMs = ReadLowLevelHooksTimeout();
+    if (!InstallForegroundHooks()) {
+        LogMessage("WARNING: Foreground WinEvent hooks failed (%lu), titles are matched on Ctrl+V",
+                   GetLastError());
+    }
+    if (!AddClipboardFormatListener(g_hWndMain)) {
+        LogMessage("WARNING: Clipboard listener failed (%lu), images are converted on Ctrl+V only",
+                   GetLastError());
+    }
+    ConfigWatchStart();
+    TriggerApply();
+    if (g_webviewPrewarm) SetTimer(g_hWndMain, ID_TIMER_WEBVIEW_PREWARM, WEBVIEW_PREWARM_DELAY_MS, NULL);
 
-    /* Install keyboard hook */
-    g_hHook = SetWindowsHookExW(WH_KEYBOARD_LL, LowLevelKeyboardProc, hInstance, 0);
-    if (!g_hHook) {
-        LogMessage("ERROR: Failed to install keyboard hook (%lu)", GetLastError());
-    } else {
-        LogMessage("Keyboard hook installed (WH_KEYBOARD_LL)");
-        LogMessage("Monitoring for Ctrl+V with image clipboard...");
+    /* Hooked and ready */
+    {
+        SIZE_T privateBytes, workingSet;
+        g_winMainMicros = QpcMicros(tWinMain, QpcNow());
+        g_startupMicros = MicrosSinceProcessStart();
+        GetMemoryUsage(&privateBytes, &workingSet);
+        LogMessage("Ready %lu ms after process start (%lu us in WinMain, %s startup), "
+                   "private %lu KB, working set %lu KB",
+                   (unsigned long)(g_startupMicros / 1000), (unsigned long)g_winMainMicros,
+                   g_eagerInit ? "eager" : "lazy",
+                   (unsigned long)(privateBytes / 1024), (unsigned long)(workingSet / 1024));
     }
+    ScheduleIdleTrim();
 
     /* Message loop */
     while (GetMessageW(&msg, NULL, 0, 0)) {
@@ -0,0 +1,557 @@
+/*
+ * ImagePaster - matcher.c
+ *
+ * Aho–Corasick window-title matcher (see matcher.h).
+ *
+ * Every rule contributes one literal key: the whole pattern for plain and
+ * anchored rules, the longest literal run for globs. Keys are inserted into a
+ * trie that is then turned into a dense DFA: the code units that occur in any
+ * key are numbered into a small alphabet (everything else is class 0), and
+ * each state gets a full row of next states with failure transitions already
+ * folded in. Matching is one table lookup per title unit. A state that ends a
+ * key checks the rules owning it; anchors are a position test, globs are
+ * verified against the whole title only when their literal run occurs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "matcher.h"
+
+/* Upper bound on DFA cells (states * classes); ~64 MB. */
+#define MATCHER_MAX_CELLS (1u << 24)
+
+#define GLOB_STAR 0x10000u
+#define GLOB_ANY  0x10001u
+
+typedef enum {
+    RULE_CONTAINS,
+    RULE_PREFIX,
+    RULE_SUFFIX,
+    RULE_EXACT,
+    RULE_GLOB
+} RuleKind;
+
+typedef struct {
+    uint8_t   kind;
+    uint8_t   negated;
+    uint32_t  keyLen;
+    int32_t   nextSameKey;  /* next rule sharing this key's final state */
+    uint32_t *glob;         /* folded units plus GLOB_STAR / GLOB_ANY */
+    size_t    globLen;
+    char     *text;
+} MatchRule;
+
+struct TitleMatcher {
+    MatchRule *rules;
+    size_t     ruleCount;
+    size_t     positiveCount;
+    size_t     negativeCount;
+    int32_t   *unkeyed;         /* globs without a literal, checked per title */
+    size_t     unkeyedCount;
+
+    uint16_t   pageIndex[256];  /* high byte of a unit -> page of class ids */
+    uint16_t  *classPages;      /* 256 ids per page; page 0 is all class 0 */
+    size_t     pageCount;
+    uint32_t   classCount;
+
+    uint32_t   stateCount;
+    uint32_t  *delta;           /* stateCount rows of classCount next states */
+    int32_t   *outRule;         /* first rule whose key ends here, or -1 */
+    uint32_t  *dictLink;        /* nearest failure ancestor with output, 0 = none */
+};
+
+/* ── Case folding ──────────────────────────────────────────────────────── */
+
+uint16_t matcher_fold(uint16_t c)
+{
+    if (c < 0x80) return (c >= 'A' && c <= 'Z') ? (uint16_t)(c + 32) : c;
+    if (c >= 0xC0 && c <= 0xDE && c != 0xD7) return (uint16_t)(c + 32);
+    if (c >= 0x0100 && c <= 0x017F) {
+        if (c == 0x0178) return 0x00FF;
+        if ((c <= 0x0137 || (c >= 0x014A && c <= 0x0177)) && !(c & 1)) return (uint16_t)(c + 1);
+        if (((c >= 0x0139 && c <= 0x0148) || (c >= 0x0179 && c <= 0x017E)) && (c & 1))
+            return (uint16_t)(c + 1);
+        return c;
+    }
+    if (c >= 0x0391 && c <= 0x03A9 && c != 0x03A2) return (uint16_t)(c + 32);
+    if (c == 0x03C2) return 0x03C3;                      /* final sigma */
+    if (c >= 0x0400 && c <= 0x040F) return (uint16_t)(c + 80);
+    if (c >= 0x0410 && c <= 0x042F) return (uint16_t)(c + 32);
+    if (c >= 0xFF21 && c <= 0xFF3A) return (uint16_t)(c + 32);
+    return c;
+}
+
+/* ── Rule parsing ──────────────────────────────────────────────────────── */
+
+/* Decodes one UTF-8 sequence; invalid input yields U+FFFD and one byte. */
+static uint32_t utf8_next(const unsigned char **p, const unsigned char *end)
+{
+    const unsigned char *s = *p;
+    uint32_t c = *s++;
+    int extra = 0;
+
+    if (c >= 0xF0 && c <= 0xF4) { extra = 3; c &= 0x07; }
+    else if (c >= 0xE0 && c < 0xF0) { extra = 2; c &= 0x0F; }
+    else if (c >= 0xC2 && c < 0xE0) { extra = 1; c &= 0x1F; }
+    else if (c >= 0x80)         { *p = s; return 0xFFFD; }
+
+    if (end - s < extra) { *p = *p + 1; return 0xFFFD; }
+    for (int i = 0; i < extra; i++) {
+        if ((s[i] & 0xC0) != 0x80) { *p = *p + 1; return 0xFFFD; }
+        c = (c << 6) | (s[i] & 0x3F);
+    }
+    if ((extra == 2 && (c < 0x800 || (c >= 0xD800 && c <= 0xDFFF))) ||
+        (extra == 3 && (c < 0x10000 || c > 0x10FFFF))) {
+        *p = *p + 1;
+        return 0xFFFD;
+    }
+    *p = s + extra;
+    return c;
+}
+
+typedef struct {
+    uint32_t *units;    /* pattern tokens: folded UTF-16 units or GLOB_* */
+    size_t    len;
+    size_t    cap;
+    int       failed;
+} TokenBuf;
+
+static void tok_push(TokenBuf *b, uint32_t t)
+{
+    if (b->failed) return;
+    if (b->len == b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 32;
+        uint32_t *p = (uint32_t *)realloc(b->units, cap * sizeof(uint32_t));
+        if (!p) { b->failed = 1; return; }
+        b->units = p;
+        b->cap = cap;
+    }
+    b->units[b->len++] = t;
+}
+
+static void tok_push_codepoint(TokenBuf *b, uint32_t cp)
+{
+    if (cp >= 0x10000) {
+        cp -= 0x10000;
+        tok_push(b, 0xD800 + (cp >> 10));
+        tok_push(b, 0xDC00 + (cp & 0x3FF));
+    } else {
+        tok_push(b, matcher_fold((uint16_t)cp));
+    }
+}
+
+static int is_space(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* Parses one trimmed rule [s, end) into tokens and flags. Returns 0 for an
+ * empty pattern. */
+static int parse_rule(const unsigned char *s, const unsigned char *end, TokenBuf *tok,
+                      int *negated, int *anchorStart, int *anchorEnd, int *isGlob)
+{
+    *negated = *anchorStart = *anchorEnd = *isGlob = 0;
+    tok->len = 0;
+
+    if (s < end && *s == '!') {
+        *negated = 1;
+        s++;
+        while (s < end && is_space(*s)) s++;
+    }
+    if (s < end && *s == '^') { *anchorStart = 1; s++; }
+
+    while (s < end) {
+        if (*s == '\\' && s + 1 < end) {
+            s++;
+            tok_push_codepoint(tok, utf8_next(&s, end));
+        } else if (*s == '$' && s + 1 == end) {
+            *anchorEnd = 1;
+            s++;
+        } else if (*s == '*' || *s == '?') {
+            tok_push(tok, *s == '*' ? GLOB_STAR : GLOB_ANY);
+            *isGlob = 1;
+            s++;
+        } else {
+            tok_push_codepoint(tok, utf8_next(&s, end));
+        }
+    }
+    return tok->len > 0;
+}
+
+/* Longest run of literal tokens in a glob: [*start, *start + *len). */
+static void longest_literal(const TokenBuf *tok, size_t *start, size_t *len)
+{
+    size_t runStart = 0;
+    *start = 0;
+    *len = 0;
+    for (size_t i = 0; i <= tok->len; i++) {
+        if (i == tok->len || tok->units[i] >= GLOB_STAR) {
+            if (i - runStart > *len) { *start = runStart; *len = i - runStart; }
+            runStart = i + 1;
+        }
+    }
+}
+
+/* ── Trie construction ─────────────────────────────────────────────────── */
+
+typedef struct {
+    uint32_t firstChild;
+    uint32_t nextSibling;
+    uint32_t cls;
+} TrieNode;
+
+typedef struct {
+    TrieNode *nodes;
+    int32_t  *outRule;
+    uint32_t  count;
+    uint32_t  cap;
+} Trie;
+
+static uint32_t trie_add_node(Trie *t, uint32_t cls)
+{
+    if (t->count == t->cap) {
+        uint32_t cap = t->cap ? t->cap * 2 : 256;
+        TrieNode *n = (TrieNode *)realloc(t->nodes, cap * sizeof(TrieNode));
+        if (!n) return 0;
+        t->nodes = n;
+        int32_t *o = (int32_t *)realloc(t->outRule, cap * sizeof(int32_t));
+        if (!o) return 0;
+        t->outRule = o;
+        t->cap = cap;
+    }
+    uint32_t id = t->count++;
+    t->nodes[id].firstChild = 0;
+    t->nodes[id].nextSibling = 0;
+    t->nodes[id].cls = cls;
+    t->outRule[id] = -1;
+    return id;
+}
+
+static uint32_t class_of(const TitleMatcher *m, uint16_t u)
+{
+    return m->classPages[(size_t)m->pageIndex[u >> 8] * 256 + (u & 0xFF)];
+}
+
+/* Numbers a unit into the alphabet if it is new. Returns 0 on failure. */
+static int class_assign(TitleMatcher *m, uint16_t u)
+{
+    unsigned page = u >> 8;
+    if (m->pageIndex[page] == 0) {
+        uint16_t *p = (uint16_t *)realloc(m->classPages, (m->pageCount + 1) * 256 * sizeof(uint16_t));
+        if (!p) return 0;
+        memset(p + m->pageCount * 256, 0, 256 * sizeof(uint16_t));
+        m->classPages = p;
+        m->pageIndex[page] = (uint16_t)m->pageCount++;
+    }
+    uint16_t *slot = &m->classPages[(size_t)m->pageIndex[page] * 256 + (u & 0xFF)];
+    if (*slot == 0) *slot = (uint16_t)m->classCount++;
+    return 1;
+}
+
+/* Inserts a key and returns its final node, or 0 when out of memory. */
+static uint32_t trie_insert(Trie *t, const TitleMatcher *m, const uint32_t *key, size_t len)
+{
+    uint32_t node = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint32_t cls = class_of(m, (uint16_t)key[i]);
+        uint32_t child = t->nodes[node].firstChild;
+        while (child && t->nodes[child].cls != cls) child = t->nodes[child].nextSibling;
+        if (!child) {
+            child = trie_add_node(t, cls);
+            if (!child) return 0;
+            t->nodes[child].nextSibling = t->nodes[node].firstChild;
+            t->nodes[node].firstChild = child;
+        }
+        node = child;
+    }
+    return node;
+}
+
+/* Builds delta and dictLink breadth-first from the trie. */
+static int build_dfa(TitleMatcher *m, Trie *t)
+{
+    uint32_t n = t->count, k = m->classCount;
+    if ((uint64_t)n * k > MATCHER_MAX_CELLS) return 0;
+
+    m->stateCount = n;
+    m->delta = (uint32_t *)malloc((size_t)n * k * sizeof(uint32_t));
+    m->dictLink = (uint32_t *)calloc(n, sizeof(uint32_t));
+    uint32_t *fail = (uint32_t *)calloc(n, sizeof(uint32_t));
+    uint32_t *queue = (uint32_t *)malloc(n * sizeof(uint32_t));
+    if (!m->delta || !m->dictLink || !fail || !queue) {
+        free(fail);
+        free(queue);
+        return 0;
+    }
+
+    uint32_t head = 0, tail = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        uint32_t s = queue[head++];
+        uint32_t *row = m->delta + (size_t)s * k;
+        const uint32_t *failRow = m->delta + (size_t)fail[s] * k;
+
+        if (s == 0) memset(row, 0, k * sizeof(uint32_t));
+        else memcpy(row, failRow, k * sizeof(uint32_t));
+
+        for (uint32_t c = t->nodes[s].firstChild; c; c = t->nodes[c].nextSibling) {
+            uint32_t f = s == 0 ? 0 : failRow[t->nodes[c].cls];
+            row[t->nodes[c].cls] = c;
+            fail[c] = f;
+            m->dictLink[c] = t->outRule[f] >= 0 ? f : m->dictLink[f];
+            queue[tail++] = c;
+        }
+    }
+
+    free(fail);
+    free(queue);
+    m->outRule = t->outRule;
+    t->outRule = NULL;
+    return 1;
+}
+
+/* ── Compile ───────────────────────────────────────────────────────────── */
+
+static int add_rule(TitleMatcher *m, size_t *cap)
+{
+    if (m->ruleCount == *cap) {
+        size_t newCap = *cap ? *cap * 2 : 16;
+        MatchRule *r = (MatchRule *)realloc(m->rules, newCap * sizeof(MatchRule));
+        if (!r) return 0;
+        m->rules = r;
+        *cap = newCap;
+    }
+    memset(&m->rules[m->ruleCount], 0, sizeof(MatchRule));
+    return 1;
+}
+
+TitleMatcher *matcher_compile(const char *rules)
+{
+    TitleMatcher *m = (TitleMatcher *)calloc(1, sizeof(TitleMatcher));
+    Trie trie = {0};
+    TokenBuf tok = {0};
+    uint32_t **keys = NULL;
+    size_t *keyLens = NULL;
+    size_t ruleCap = 0;
+    const unsigned char *p = (const unsigned char *)(rules ? rules : "");
+    const unsigned char *end = p + strlen((const char *)p);
+
+    if (!m) return NULL;
+    /* Page 0 stays all zero for units no key uses */
+    m->classPages = (uint16_t *)calloc(256, sizeof(uint16_t));
+    m->pageCount = 1;
+    m->classCount = 1;
+    if (!m->classPages || (trie_add_node(&trie, 0), trie.count == 0)) goto fail_keys;
+
+    /* Pass 1: split, parse, store rules and their keys */
+    while (p < end) {
+        const unsigned char *s = p;
+        while (p < end && *p != ',') p += (*p == '\\' && p + 1 < end) ? 2 : 1;
+        const unsigned char *e = p;
+        if (p < end) p++;
+
+        while (s < e && is_space(*s)) s++;
+        while (e > s && is_space(e[-1]) && !(e - 1 > s && e[-2] == '\\')) e--;
+
+        int negated, anchorStart, anchorEnd, isGlob;
+        if (!parse_rule(s, e, &tok, &negated, &anchorStart, &anchorEnd, &isGlob)) continue;
+        if (tok.failed || !add_rule(m, &ruleCap)) goto fail_keys;
+
+        uint32_t **k2 = (uint32_t **)realloc(keys, ruleCap * sizeof(*keys));
+        if (!k2) goto fail_keys;
+        keys = k2;
+        size_t *l2 = (size_t *)realloc(keyLens, ruleCap * sizeof(*keyLens));
+        if (!l2) goto fail_keys;
+        keyLens = l2;
+
+        MatchRule *r = &m->rules[m->ruleCount];
+        size_t keyStart = 0, keyLen = tok.len;
+        r->negated = (uint8_t)negated;
+        r->text = (char *)malloc((size_t)(e - s) + 1);
+        keys[m->ruleCount] = NULL;
+        keyLens[m->ruleCount] = 0;
+        m->ruleCount++;
+        if (!r->text) goto fail_keys;
+        memcpy(r->text, s, (size_t)(e - s));
+        r->text[e - s] = '\0';
+
+        if (isGlob) {
+            /* Anchors are implied: a glob always spans the whole title */
+            r->kind = RULE_GLOB;
+            r->glob = (uint32_t *)malloc(tok.len * sizeof(uint32_t));
+            if (!r->glob) goto fail_keys;
+            memcpy(r->glob, tok.units, tok.len * sizeof(uint32_t));
+            r->globLen = tok.len;
+            longest_literal(&tok, &keyStart, &keyLen);
+        } else {
+            r->kind = anchorStart && anchorEnd ? RULE_EXACT
+                    : anchorStart ? RULE_PREFIX
+                    : anchorEnd ? RULE_SUFFIX : RULE_CONTAINS;
+        }
+        if (negated) m->negativeCount++;
+        else m->positiveCount++;
+
+        r->keyLen = (uint32_t)keyLen;
+        if (keyLen > 0) {
+            keys[m->ruleCount - 1] = (uint32_t *)malloc(keyLen * sizeof(uint32_t));
+            if (!keys[m->ruleCount - 1]) goto fail_keys;
+            memcpy(keys[m->ruleCount - 1], tok.units + keyStart, keyLen * sizeof(uint32_t));
+            keyLens[m->ruleCount - 1] = keyLen;
+            for (size_t i = 0; i < keyLen; i++) {
+                if (!class_assign(m, (uint16_t)tok.units[keyStart + i])) goto fail_keys;
+            }
+        }
+    }
+
+    /* Pass 2: trie (rules chained per final node, in rule order) */
+    m->unkeyed = (int32_t *)malloc((m->ruleCount ? m->ruleCount : 1) * sizeof(int32_t));
+    if (!m->unkeyed) goto fail_keys;
+    for (size_t i = m->ruleCount; i-- > 0; ) {
+        if (!keys[i]) {
+            m->unkeyed[m->unkeyedCount++] = (int32_t)i;
+            continue;
+        }
+        uint32_t node = trie_insert(&trie, m, keys[i], keyLens[i]);
+        if (!node) goto fail_keys;
+        m->rules[i].nextSameKey = trie.outRule[node];
+        trie.outRule[node] = (int32_t)i;
+    }
+
+    if (!build_dfa(m, &trie)) goto fail_keys;
+
+    for (size_t i = 0; i < m->ruleCount; i++) free(keys[i]);
+    free(keys);
+    free(keyLens);
+    free(trie.nodes);
+    free(trie.outRule);
+    free(tok.units);
+    return m;
+
+fail_keys:
+    for (size_t i = 0; keys && i < m->ruleCount; i++) free(keys[i]);
+    free(keys);
+    free(keyLens);
+    free(trie.nodes);
+    free(trie.outRule);
+    free(tok.units);
+    matcher_free(m);
+    return NULL;
+}
+
+void matcher_free(TitleMatcher *m)
+{
+    if (!m) return;
+    for (size_t i = 0; i < m->ruleCount; i++) {
+        free(m->rules[i].glob);
+        free(m->rules[i].text);
+    }
+    free(m->rules);
+    free(m->unkeyed);
+    free(m->classPages);
+    free(m->delta);
+    free(m->outRule);
+    free(m->dictLink);
+    free(m);
+}
+
+/* ── Matching ──────────────────────────────────────────────────────────── */
+
+static int glob_match(const uint32_t *pat, size_t plen, const uint16_t *title, size_t len)
+{
+    size_t p = 0, t = 0, starP = (size_t)-1, starT = 0;
+
+    while (t < len) {
+        if (p < plen && (pat[p] == GLOB_ANY || pat[p] == matcher_fold(title[t]))) {
+            p++;
+            t++;
+        } else if (p < plen && pat[p] == GLOB_STAR) {
+            starP = p++;
+            starT = t;
+        } else if (starP != (size_t)-1) {
+            p = starP + 1;
+            t = ++starT;
+        } else {
+            return 0;
+        }
+    }
+    while (p < plen && pat[p] == GLOB_STAR) p++;
+    return p == plen;
+}
+
+/* Whether a rule whose key just ended at title[last] matches the title. */
+static int rule_hit(const MatchRule *r, const uint16_t *title, size_t len, size_t last)
+{
+    switch (r->kind) {
+    case RULE_PREFIX: return last + 1 == r->keyLen;
+    case RULE_SUFFIX: return last + 1 == len;
+    case RULE_EXACT:  return last + 1 == r->keyLen && last + 1 == len;
+    case RULE_GLOB:   return glob_match(r->glob, r->globLen, title, len);
+    default:          return 1;
+    }
+}
+
+int matcher_match(const TitleMatcher *m, const uint16_t *title, size_t len, int *excludedBy)
+{
+    int matched = -1;
+
+    if (excludedBy) *excludedBy = -1;
+    if (!m || m->positiveCount == 0) return -1;
+
+    const uint32_t k = m->classCount;
+    uint32_t state = 0;
+    for (size_t i = 0; i < len; i++) {
+        state = m->delta[(size_t)state * k + class_of(m, matcher_fold(title[i]))];
+        uint32_t s = m->outRule[state] >= 0 ? state : m->dictLink[state];
+        for (; s; s = m->dictLink[s]) {
+            for (int32_t r = m->outRule[s]; r >= 0; r = m->rules[r].nextSameKey) {
+                const MatchRule *rule = &m->rules[r];
+                if (!rule->negated && matched >= 0) continue;
+                if (!rule_hit(rule, title, len, i)) continue;
+                if (rule->negated) {
+                    if (excludedBy) *excludedBy = r;
+                    return -1;
+                }
+                matched = r;
+                if (m->negativeCount == 0) return matched;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < m->unkeyedCount; i++) {
+        const MatchRule *rule = &m->rules[m->unkeyed[i]];
+        if (!rule->negated && matched >= 0) continue;
+        if (!glob_match(rule->glob, rule->globLen, title, len)) continue;
+        if (rule->negated) {
+            if (excludedBy) *excludedBy = m->unkeyed[i];
+            return -1;
+        }
+        matched = m->unkeyed[i];
+    }
+    return matched;
+}
+
+/* ── Introspection ─────────────────────────────────────────────────────── */
+
+size_t matcher_rule_count(const TitleMatcher *m)     { return m ? m->ruleCount : 0; }
+size_t matcher_positive_count(const TitleMatcher *m) { return m ? m->positiveCount : 0; }
+size_t matcher_state_count(const TitleMatcher *m)    { return m ? m->stateCount : 0; }
+
+size_t matcher_memory_bytes(const TitleMatcher *m)
+{
+    if (!m) return 0;
+    size_t bytes = sizeof(*m)
+                 + m->ruleCount * (sizeof(MatchRule) + sizeof(int32_t))
+                 + m->pageCount * 256 * sizeof(uint16_t)
+                 + (size_t)m->stateCount * m->classCount * sizeof(uint32_t)
+                 + (size_t)m->stateCount * (sizeof(int32_t) + sizeof(uint32_t));
+    for (size_t i = 0; i < m->ruleCount; i++) {
+        bytes += m->rules[i].globLen * sizeof(uint32_t) + strlen(m->rules[i].text) + 1;
+    }
+    return bytes;
+}
+
+const char *matcher_rule_text(const TitleMatcher *m, int index)
+{
+    if (!m || index < 0 || (size_t)index >= m->ruleCount) return "";
+    return m->rules[index].text;
+}
@@ -0,0 +1,56 @@
+/*
+ * ImagePaster - matcher.h
+ *
+ * Compiled window-title matcher. The comma-separated TitleMatch setting is
+ * compiled once, when the configuration is loaded or saved, into a single
+ * Aho–Corasick automaton over case-folded UTF-16, so a title is scanned once
+ * no matter how many rules there are.
+ *
+ * Rule syntax (whitespace around each rule is trimmed):
+ *
+ *   xshell        title contains "xshell"
+ *   ^xshell       title starts with "xshell"
+ *   xshell$       title ends with "xshell"
+ *   ^xshell$      title is exactly "xshell"
+ *   ssh*prod?     glob over the whole title: * is any run, ? any one unit
+ *   !putty-admin  negated: a title matching it never matches, whatever other
+ *                 rules say (combines with all of the above)
+ *   \,  \*  \?    a backslash takes the next character literally
+ *
+ * Comparison uses simple case folding for ASCII, Latin-1, Latin Extended-A,
+ * Greek, Cyrillic and fullwidth Latin letters.
+ *
+ * Plain C with no Win32 dependency (titles are UTF-16 code units) so host
+ * tools can share it.
+ */
+
+#ifndef MATCHER_H
+#define MATCHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct TitleMatcher TitleMatcher;
+
+/* Compiles a UTF-8 rule list. Returns NULL only when out of memory; an empty
+ * list compiles to a matcher that matches nothing. */
+TitleMatcher *matcher_compile(const char *rules);
+void          matcher_free(TitleMatcher *m);
+
+/* Returns the index of a positive rule the title matches, or -1. When a
+ * negated rule vetoes the title, -1 is returned and *excludedBy (if not NULL)
+ * receives that rule's index; otherwise it is set to -1. */
+int           matcher_match(const TitleMatcher *m, const uint16_t *title, size_t len,
+                            int *excludedBy);
+
+size_t        matcher_rule_count(const TitleMatcher *m);
+size_t        matcher_positive_count(const TitleMatcher *m);
+size_t        matcher_state_count(const TitleMatcher *m);
+size_t        matcher_memory_bytes(const TitleMatcher *m);
+
+/* The rule as written, without surrounding whitespace. */
+const char   *matcher_rule_text(const TitleMatcher *m, int index);
+
+uint16_t      matcher_fold(uint16_t c);
+
+#endif // MATCHER_H
@@ -0,0 +1,614 @@
+/*
+ * ImagePaster - pipeline.c
+ *
+ * DIB to PNG/JPEG to base64 text conversion (see pipeline.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pipeline.h"
+#include "pngenc.h"
+#include "jpegenc.h"
+#include "base64.h"
+#include "frame.h"
+#include "arena.h"
+
+#define MIME_LINE_CHARS 76
+
+static const char *g_dataUriPrefix[PIPE_FORMAT_COUNT] = {
+    "data:image/png;base64,", "data:image/jpeg;base64,"
+};
+
+static void stage_done(const PipeOptions *opt, PipeStage stage, uint64_t bytes)
+{
+    if (opt->onStage) opt->onStage(opt->ctx, stage, bytes);
+}
+
+size_t pipeline_text_length(size_t imageBytes, PipeFormat format, PipeTextEncoding text)
+{
+    if (text == PIPE_TEXT_FRAMED) return frame_length(pipeline_format_name(format), imageBytes);
+    size_t n = BASE64_ENCODED_LEN(imageBytes);
+    if (text == PIPE_TEXT_BASE64_LINES && n > 0) n += 2 * ((n - 1) / MIME_LINE_CHARS);
+    if (text == PIPE_TEXT_DATA_URI) n += strlen(g_dataUriPrefix[format]);
+    return n;
+}
+
+/* Image bytes between two progress calls: whole MIME lines, about 1 MB */
+#define PIPE_TEXT_SLICE (MIME_LINE_CHARS / 4 * 3 * 18396)
+
+static int text_progress(const PipeOptions *opt, const PipeResult *res, size_t done)
+{
+    PipeProgress p = { PIPE_STAGE_BASE64, res->attempts, res->outHeight, res->outHeight, done };
+    return !opt->onProgress || opt->onProgress(opt->ctx, &p);
+}
+
+/* Sets res->base64; a slice at a time, so a large image can be cancelled. */
+static PipeStatus encode_text(const ByteBuf *image, PipeTextEncoding text, const PipeOptions *opt,
+                              PipeResult *res)
+{
+    size_t len = pipeline_text_length(image->len, res->format, text);
+    char *out = (char *)arena_alloc(len + 1);
+    char *p = out;
+    if (!out) return PIPE_ERR_ENCODE;
+
+    if (text == PIPE_TEXT_FRAMED) {
+        frame_encode_to(pipeline_format_name(res->format), image->data, image->len, out);
+        p += len;
+    } else {
+        if (text == PIPE_TEXT_DATA_URI) {
+            size_t n = strlen(g_dataUriPrefix[res->format]);
+            memcpy(p, g_dataUriPrefix[res->format], n);
+            p += n;
+        }
+        for (size_t at = 0; at < image->len; at += PIPE_TEXT_SLICE) {
+            if (at > 0 && !text_progress(opt, res, (size_t)(p - out))) {
+                arena_free(out);
+                return PIPE_ERR_CANCELLED;
+            }
+            const uint8_t *data = image->data + at;
+            size_t left = image->len - at < PIPE_TEXT_SLICE ? image->len - at : PIPE_TEXT_SLICE;
+            if (text == PIPE_TEXT_BASE64_LINES) {
+                /* 57 input bytes make one 76-character line */
+                const size_t chunk = MIME_LINE_CHARS / 4 * 3;
+                for (size_t i = 0; i < left; i += chunk) {
+                    size_t n = left - i < chunk ? left - i : chunk;
+                    if (at + i > 0) { *p++ = '\r'; *p++ = '\n'; }
+                    base64_encode_to(data + i, n, p);
+                    p += BASE64_ENCODED_LEN(n);
+                }
+            } else {
+                base64_encode_to(data, left, p);
+                p += BASE64_ENCODED_LEN(left);
+            }
+        }
+    }
+    *p = '\0';
+    res->base64 = out;
+    res->base64Len = len;
+    return PIPE_OK;
+}
+
+/* ── Memory accounting ─────────────────────────────────────────────────── */
+
+/* The conversion's own allocations: decoded image, encoder state, row
+ * buffers, encoded image and text, and the source DIB while the source
+ * holds a copy of it. Transient copies inside realloc are not counted. */
+typedef struct {
+    size_t cur;
+    size_t peak;
+    size_t cap;     /* 0 = none */
+} MemTally;
+
+/* Returns 0, counting nothing, if `n` more bytes would exceed the cap. */
+static int tally_add(MemTally *m, size_t n)
+{
+    if (m->cap && (n > m->cap || m->cur > m->cap - n)) return 0;
+    m->cur += n;
+    if (m->cur > m->peak) m->peak = m->cur;
+    return 1;
+}
+
+static void tally_sub(MemTally *m, size_t n)
+{
+    m->cur -= n;
+}
+
+/* ── Budget downscaling ────────────────────────────────────────────────── */
+
+#define PIPE_MAX_HALVINGS 12    /* DIB_MAX_DIMENSION down to PIPELINE_MIN_SIDE */
+
+/* 2x2 box-filter reduction; an odd last row or column is dropped. */
+static void halve_row(const uint8_t *r0, const uint8_t *r1, uint32_t width, uint8_t *out)
+{
+    for (uint32_t x = 0; x < width; x++, out += 3, r0 += 6, r1 += 6) {
+        for (int c = 0; c < 3; c++) {
+            out[c] = (uint8_t)((r0[c] + r0[c + 3] + r1[c] + r1[c + 3] + 2) >> 2);
+        }
+    }
+}
+
+static int rgb_halve(const RgbImage *src, RgbImage *dst)
+{
+    dst->width = src->width / 2;
+    dst->height = src->height / 2;
+    dst->stride = (size_t)dst->width * 3;
+    dst->pixels = (uint8_t *)arena_alloc(dst->stride * dst->height);
+    if (!dst->pixels) return 0;
+
+    for (uint32_t y = 0; y < dst->height; y++) {
+        const uint8_t *r0 = src->pixels + (size_t)(2 * y) * src->stride;
+        halve_row(r0, r0 + src->stride, dst->width, dst->pixels + (size_t)y * dst->stride);
+    }
+    return 1;
+}
+
+/* The same reduction of another source, a row at a time, for images that
+ * are not held in memory; two parent rows of buffer per level. */
+typedef struct {
+    RgbRowSource  base;
+    RgbRowSource *parent;
+    uint8_t      *rows;
+} HalfRows;
+
+static const uint8_t *half_row(RgbRowSource *src, uint32_t y, uint8_t *buf)
+{
+    HalfRows *h = (HalfRows *)src;
+    size_t parentBytes = (size_t)h->parent->width * 3;
+    const uint8_t *r0 = h->parent->row(h->parent, 2 * y, h->rows);
+    const uint8_t *r1 = h->parent->row(h->parent, 2 * y + 1, h->rows + parentBytes);
+    halve_row(r0, r1, src->width, buf);
+    return buf;
+}
+
+/* ── Routing ───────────────────────────────────────────────────────────── */
+
+/* Samples `src` and lets the route model pick format and effort. Left at
+ * the fixed settings if the sampling rows do not fit the memory cap. */
+static void route_image(RgbRowSource *src, const PipeOptions *opt, PipeResult *res, MemTally *mem,
+                        PipeTextEncoding text, PipeFormat *format, int *level, int quality)
+{
+    size_t rowsBytes = (size_t)src->width * 6;
+    if (!tally_add(mem, rowsBytes)) return;
+    uint8_t *rows = (uint8_t *)arena_alloc(rowsBytes);
+    if (rows) {
+        RouteFeatures f;
+        route_classify(src, rows, &f);
+        arena_free(rows);
+
+        /* Base64 and its framing are near enough linear in the image size */
+        double textPerByte = (double)pipeline_text_length(1u << 20, PIPE_FORMAT_PNG, text) / (1u << 20);
+        route_decide(opt->routeModel, &f, opt->route, src->width, src->height, *level, quality,
+                     textPerByte, opt->maxTextBytes, opt->textBytesPerSec, &res->route);
+        res->routed = 1;
+        *format = res->route.choice == ROUTE_JPEG ? PIPE_FORMAT_JPEG : PIPE_FORMAT_PNG;
+        if (res->route.choice == ROUTE_PNG_FAST) *level = ROUTE_FAST_LEVEL;
+    }
+    tally_sub(mem, rowsBytes);
+    if (res->routed) stage_done(opt, PIPE_STAGE_CLASSIFY, rowsBytes);
+}
+
+/* ── Progress ──────────────────────────────────────────────────────────── */
+
+/* Passes rows through, calling onProgress every band and whenever the
+ * encoder polls between rows. Once it returns 0 every row is NULL and
+ * every poll fails, so the encoder stops where it is. */
+typedef struct {
+    RgbRowSource       base;
+    RgbRowSource      *inner;
+    const PipeOptions *opt;
+    const ByteBuf     *enc;
+    PipeProgress       p;
+    uint32_t           band;
+    uint32_t           next;    /* row at which to call next */
+    int                cancelled;
+} ProgressRows;
+
+static const uint8_t *progress_row(RgbRowSource *src, uint32_t y, uint8_t *buf)
+{
+    ProgressRows *pr = (ProgressRows *)src;
+    if (pr->cancelled) return NULL;
+    if (y >= pr->next) {
+        pr->p.rows = y;
+        pr->p.bytesOut = pr->enc->len;
+        if (!pr->opt->onProgress(pr->opt->ctx, &pr->p)) {
+            pr->cancelled = 1;
+            return NULL;
+        }
+        pr->next = y + pr->band;
+    }
+    return pr->inner->row(pr->inner, y, buf);
+}
+
+static int progress_poll(RgbRowSource *src)
+{
+    ProgressRows *pr = (ProgressRows *)src;
+    if (pr->cancelled) return 0;
+    pr->p.bytesOut = pr->enc->len;
+    if (!pr->opt->onProgress(pr->opt->ctx, &pr->p)) pr->cancelled = 1;
+    return !pr->cancelled;
+}
+
+/* `src` itself when there is no progress callback. */
+static RgbRowSource *progress_rows(ProgressRows *pr, RgbRowSource *src, const PipeOptions *opt,
+                                   int attempt, const ByteBuf *enc)
+{
+    memset(pr, 0, sizeof(*pr));
+    if (!opt->onProgress) return src;
+    pr->base.width = src->width;
+    pr->base.height = src->height;
+    pr->base.row = progress_row;
+    pr->base.poll = progress_poll;
+    pr->inner = src;
+    pr->opt = opt;
+    pr->enc = enc;
+    pr->p.stage = PIPE_STAGE_IMAGE_ENCODE;
+    pr->p.attempt = attempt;
+    pr->p.height = src->height;
+    pr->band = src->width ? PIPELINE_PROGRESS_PIXELS / src->width : 1;
+    if (pr->band == 0) pr->band = 1;
+    return &pr->base;
+}
+
+/* ── Encoding ──────────────────────────────────────────────────────────── */
+
+/* Encodes `src` into `enc` until the text fits the budget. `img` is the
+ * same pixels when they are in memory, so halved copies can be kept too;
+ * otherwise every attempt reads `src` again through HalfRows. */
+static PipeStatus encode_image(RgbRowSource *src, const RgbImage *img, const PipeOptions *opt,
+                               PipeResult *res, MemTally *mem, ByteBuf *enc)
+{
+    HalfRows halves[PIPE_MAX_HALVINGS];
+    int depth = 0;
+    RgbImage scaled = {0};
+    RgbImageRows scaledRows;
+    RgbRowSource *cur = src;
+    const RgbImage *curImg = img;
+    PipeFormat format = (unsigned)opt->format < PIPE_FORMAT_COUNT ? opt->format : PIPE_FORMAT_PNG;
+    PipeTextEncoding text = (unsigned)opt->text < PIPE_TEXT_COUNT ? opt->text : PIPE_TEXT_BASE64;
+    int level = opt->level;
+    int quality = opt->quality > 0 ? opt->quality : JPEG_DEFAULT_QUALITY;
+    PipeStatus status = PIPE_OK;
+
+    res->width = src->width;
+    res->height = src->height;
+    if (opt->route != ROUTE_FIXED && (unsigned)opt->route < ROUTE_POLICY_COUNT)
+        route_image(src, opt, res, mem, text, &format, &level, quality);
+    res->format = format;
+
+    for (;;) {
+        /* Only the first attempt is at the settings the cache was filled with */
+        PngBandCache *cache = format == PIPE_FORMAT_PNG && res->attempts == 0 ? opt->bandCache : NULL;
+        size_t working = format == PIPE_FORMAT_JPEG ? jpeg_working_bytes(cur->width)
+                                                    : png_working_bytes(cur->width);
+        if (cache) working += png_band_working_bytes(cur->width);
+        if (!tally_add(mem, working)) { status = PIPE_ERR_MEMORY; break; }
+
+        /* The output may grow into whatever the cap leaves */
+        tally_sub(mem, enc->cap);
+        enc->len = 0;
+        enc->failed = 0;
+        enc->limit = mem->cap ? mem->cap - mem->cur : 0;
+        ProgressRows progress;
+        RgbRowSource *in = progress_rows(&progress, cur, opt, res->attempts + 1, enc);
+        int ok = format == PIPE_FORMAT_JPEG ? jpeg_encode_rows(in, quality, enc)
+               : cache                      ? png_encode_rows_cached(in, level, cache, enc)
+                                            : png_encode_rows(in, level, enc);
+        if (ok && cache) {
+            res->bands = cache->lastBands;
+            res->bandsReused = cache->lastReused;
+        }
+        tally_add(mem, enc->cap);
+        tally_sub(mem, working);
+        res->attempts++;
+        if (!ok) {
+            status = progress.cancelled        ? PIPE_ERR_CANCELLED
+                   : enc->failed && enc->limit ? PIPE_ERR_MEMORY
+                                               : PIPE_ERR_ENCODE;
+            break;
+        }
+        if (!opt->maxTextBytes || pipeline_text_length(enc->len, format, text) <= opt->maxTextBytes)
+            break;
+
+        /* Over budget: cheaper settings first, then fewer pixels */
+        if (format == PIPE_FORMAT_PNG && level < 9) {
+            level = 9;
+        } else if (format == PIPE_FORMAT_JPEG && quality > PIPELINE_BUDGET_MIN_QUALITY) {
+            quality = quality - 15 > PIPELINE_BUDGET_MIN_QUALITY ? quality - 15
+                                                                 : PIPELINE_BUDGET_MIN_QUALITY;
+        } else if (cur->width / 2 >= PIPELINE_MIN_SIDE && cur->height / 2 >= PIPELINE_MIN_SIDE) {
+            size_t halfBytes = (size_t)(cur->width / 2) * 3 * (cur->height / 2);
+            RgbImage half;
+            if (curImg && tally_add(mem, halfBytes)) {
+                if (!rgb_halve(curImg, &half)) { status = PIPE_ERR_ENCODE; break; }
+                tally_sub(mem, scaled.stride * scaled.height);
+                rgb_image_free(&scaled);
+                scaled = half;
+                curImg = &scaled;
+                rgb_image_rows(&scaledRows, &scaled);
+                cur = &scaledRows.base;
+                continue;
+            }
+            size_t rowsBytes = (size_t)cur->width * 3 * 2;
+            if (depth == PIPE_MAX_HALVINGS || !tally_add(mem, rowsBytes)) {
+                status = PIPE_ERR_MEMORY;
+                break;
+            }
+            HalfRows *h = &halves[depth];
+            h->rows = (uint8_t *)arena_alloc(rowsBytes);
+            if (!h->rows) { tally_sub(mem, rowsBytes); status = PIPE_ERR_ENCODE; break; }
+            h->base.width = cur->width / 2;
+            h->base.height = cur->height / 2;
+            h->base.row = half_row;
+            h->base.poll = NULL;
+            h->parent = cur;
+            depth++;
+            cur = &h->base;
+            curImg = NULL;
+        } else {
+            status = PIPE_ERR_BUDGET;
+            break;
+        }
+    }
+
+    res->outWidth = cur->width;
+    res->outHeight = cur->height;
+    res->level = level;
+    res->quality = quality;
+    res->imageSize = enc->len;
+    while (depth > 0) {
+        HalfRows *h = &halves[--depth];
+        tally_sub(mem, (size_t)h->parent->width * 3 * 2);
+        arena_free(h->rows);
+    }
+    tally_sub(mem, scaled.stride * scaled.height);
+    rgb_image_free(&scaled);
+    if (status == PIPE_OK)
+        stage_done(opt, PIPE_STAGE_IMAGE_ENCODE, (uint64_t)src->width * src->height * 3);
+    return status;
+}
+
+/* Turns the encoded image into the final text and frees it. */
+static PipeStatus finish_text(ByteBuf *enc, const PipeOptions *opt, PipeResult *res, MemTally *mem)
+{
+    PipeTextEncoding text = (unsigned)opt->text < PIPE_TEXT_COUNT ? opt->text : PIPE_TEXT_BASE64;
+    size_t textBytes = pipeline_text_length(enc->len, res->format, text) + 1;
+
+    if (!tally_add(mem, textBytes)) return PIPE_ERR_MEMORY;
+    PipeStatus st = encode_text(enc, text, opt, res);
+    tally_sub(mem, enc->cap);
+    bb_free(enc);
+    if (st != PIPE_OK) return st;
+    stage_done(opt, PIPE_STAGE_BASE64, res->imageSize);
+    return PIPE_OK;
+}
+
+PipeStatus pipeline_encode_rows(RgbRowSource *src, const PipeOptions *opt, PipeResult *res)
+{
+    MemTally mem = { 0, 0, opt->maxMemory };
+    ByteBuf enc = { .arena = 1 };
+    PipeStatus st = encode_image(src, NULL, opt, res, &mem, &enc);
+    if (st == PIPE_OK) st = finish_text(&enc, opt, res, &mem);
+    bb_free(&enc);
+    res->peakBytes = mem.peak;
+    return st;
+}
+
+PipeStatus pipeline_encode_rgb(const RgbImage *img, const PipeOptions *opt, PipeResult *res)
+{
+    MemTally mem = { 0, 0, opt->maxMemory };
+    ByteBuf enc = { .arena = 1 };
+    RgbImageRows rows;
+    rgb_image_rows(&rows, img);
+    PipeStatus st = encode_image(&rows.base, img, opt, res, &mem, &enc);
+    if (st == PIPE_OK) st = finish_text(&enc, opt, res, &mem);
+    bb_free(&enc);
+    res->peakBytes = mem.peak;
+    return st;
+}
+
+/* Decodes and encodes one DIB. Large DIBs, and any whose RGB would take
+ * more than half the memory left under the cap, are streamed instead of
+ * decoded. `io`, if given, supplies the fallback decoder and is released
+ * as soon as the pixels are no longer needed; the `held` bytes of a copied
+ * DIB are counted until then. */
+static PipeStatus convert(const uint8_t *dib, size_t len, const PasteIo *io, size_t held,
+                          const PipeOptions *opt, PipeResult *res)
+{
+    MemTally mem = { 0, 0, opt->maxMemory };
+    DibRowReader reader;
+    RgbImage img = {0};
+    ByteBuf enc = { .arena = 1 };
+    PipeStatus st;
+
+    res->dibSize = len;
+    if (!tally_add(&mem, held)) {
+        if (io) io->releaseDib(io->ctx);
+        res->peakBytes = held;
+        return PIPE_ERR_MEMORY;
+    }
+    DibResult r = dib_reader_init(&reader, dib, len);
+    size_t rgbBytes = r == DIB_OK ? (size_t)reader.base.width * reader.base.height * 3 : 0;
+    size_t streamAbove = opt->streamAbove ? opt->streamAbove : PIPELINE_STREAM_DEFAULT;
+
+    if (r == DIB_OK && (rgbBytes >= streamAbove || (mem.cap && rgbBytes > (mem.cap - mem.cur) / 2))) {
+        /* Rows are converted as the encoder reads them, so the DIB is held until then */
+        res->streamed = 1;
+        res->dibResult = DIB_OK;
+        stage_done(opt, PIPE_STAGE_DIB_DECODE, len);
+        if (opt->onDecoded) opt->onDecoded(opt->ctx, &reader.base);
+        st = encode_image(&reader.base, NULL, opt, res, &mem, &enc);
+        if (io) io->releaseDib(io->ctx);
+        tally_sub(&mem, held);
+    } else {
+        if (r == DIB_OK) r = dib_to_rgb(dib, len, &img);
+        if (r == DIB_ERR_UNSUPPORTED && io && io->decodeFallback &&
+            io->decodeFallback(io->ctx, dib, len, &img)) {
+            r = DIB_OK;
+            res->usedFallback = 1;
+        }
+        res->dibResult = r;
+
+        /* The pixels and the DIB they came from are held together until here */
+        rgbBytes = r == DIB_OK ? img.stride * img.height : 0;
+        int fits = r == DIB_OK && tally_add(&mem, rgbBytes);
+        if (io) io->releaseDib(io->ctx);
+        if (fits) tally_sub(&mem, held);
+        if (r != DIB_OK) return PIPE_ERR_DECODE;
+        if (!fits) {
+            res->width = img.width;
+            res->height = img.height;
+            rgb_image_free(&img);
+            res->peakBytes = mem.peak;
+            return PIPE_ERR_MEMORY;
+        }
+        stage_done(opt, PIPE_STAGE_DIB_DECODE, len);
+
+        RgbImageRows rows;
+        rgb_image_rows(&rows, &img);
+        if (opt->onDecoded) opt->onDecoded(opt->ctx, &rows.base);
+        st = encode_image(&rows.base, &img, opt, res, &mem, &enc);
+        rgb_image_free(&img);
+        tally_sub(&mem, rgbBytes);
+    }
+
+    if (st == PIPE_OK) st = finish_text(&enc, opt, res, &mem);
+    bb_free(&enc);
+    res->peakBytes = mem.peak;
+    return st;
+}
+
+PipeStatus pipeline_run(const PasteIo *io, const PipeOptions *opt, PipeResult *res)
+{
+    const uint8_t *dib = NULL;
+    size_t len = 0;
+
+    memset(res, 0, sizeof(*res));
+    PipeStatus st = io->acquireDib(io->ctx, opt->maxMemory, &dib, &len);
+    if (st != PIPE_OK) {
+        res->dibSize = len;
+        return st;
+    }
+    stage_done(opt, PIPE_STAGE_ACQUIRE, len);
+
+    st = convert(dib, len, io, io->copiesDib ? len : 0, opt, res);
+    if (st != PIPE_OK) return st;
+
+    PipeProgress last = { PIPE_STAGE_PUBLISH, res->attempts, res->outHeight, res->outHeight,
+                          res->base64Len };
+    if (opt->onProgress && !opt->onProgress(opt->ctx, &last)) {
+        arena_free(res->base64);
+        res->base64 = NULL;
+        res->base64Len = 0;
+        return PIPE_ERR_CANCELLED;
+    }
+
+    if (!io->publishText(io->ctx, res->base64, res->base64Len)) return PIPE_ERR_PUBLISH;
+    stage_done(opt, PIPE_STAGE_PUBLISH, res->base64Len);
+    return PIPE_OK;
+}
+
+PipeStatus pipeline_convert_dib(const uint8_t *dib, size_t len, const PipeOptions *opt,
+                                PipeResult *res)
+{
+    memset(res, 0, sizeof(*res));
+    return convert(dib, len, NULL, 0, opt, res);
+}
+
+void pipeline_result_free(PipeResult *res)
+{
+    arena_free(res->base64);
+    memset(res, 0, sizeof(*res));
+}
+
+/* ── In-memory source and sink ─────────────────────────────────────────── */
+
+static PipeStatus mem_acquire(void *ctx, size_t maxCopy, const uint8_t **dib, size_t *len)
+{
+    MemoryPasteIo *mem = (MemoryPasteIo *)ctx;
+    (void)maxCopy;      /* borrowed, not copied */
+    *dib = mem->dib;
+    *len = mem->dibLen;
+    return mem->dib ? PIPE_OK : PIPE_ERR_SOURCE;
+}
+
+static void mem_release(void *ctx)
+{
+    (void)ctx;
+}
+
+static int mem_publish(void *ctx, const char *text, size_t len)
+{
+    MemoryPasteIo *mem = (MemoryPasteIo *)ctx;
+    mem->text.len = 0;
+    bb_append(&mem->text, text, len + 1);
+    return !mem->text.failed;
+}
+
+void memory_paste_io_init(MemoryPasteIo *mem, PasteIo *io, const uint8_t *dib, size_t len)
+{
+    memset(mem, 0, sizeof(*mem));
+    mem->dib = dib;
+    mem->dibLen = len;
+    memset(io, 0, sizeof(*io));
+    io->ctx = mem;
+    io->acquireDib = mem_acquire;
+    io->releaseDib = mem_release;
+    io->publishText = mem_publish;
+}
+
+void memory_paste_io_free(MemoryPasteIo *mem)
+{
+    bb_free(&mem->text);
+}
+
+/* ── Names ─────────────────────────────────────────────────────────────── */
+
+const char *pipeline_stage_name(PipeStage stage)
+{
+    static const char *names[PIPE_STAGE_COUNT] = {
+        "Acquire DIB", "DIB decode", "Format choice", "Image encode", "Base64 encode", "Publish text"
+    };
+    return (unsigned)stage < PIPE_STAGE_COUNT ? names[stage] : "?";
+}
+
+const char *pipeline_status_string(PipeStatus status)
+{
+    switch (status) {
+    case PIPE_OK:          return "ok";
+    case PIPE_ERR_SOURCE:  return "image source unavailable";
+    case PIPE_ERR_DECODE:  return "DIB decode failed";
+    case PIPE_ERR_ENCODE:  return "image/base64 encoding failed (out of memory or too large)";
+    case PIPE_ERR_BUDGET:  return "image does not fit the size budget";
+    case PIPE_ERR_PUBLISH: return "publishing the text failed";
+    case PIPE_ERR_MEMORY:  return "conversion would exceed the memory cap";
+    case PIPE_ERR_CANCELLED: return "cancelled";
+    }
+    return "unknown error";
+}
+
+static const char *g_formatNames[PIPE_FORMAT_COUNT] = { "png", "jpeg" };
+static const char *g_textNames[PIPE_TEXT_COUNT] = { "base64", "base64-lines", "data-uri", "framed" };
+
+const char *pipeline_format_name(PipeFormat format)
+{
+    return (unsigned)format < PIPE_FORMAT_COUNT ? g_formatNames[format] : "?";
+}
+
+const char *pipeline_text_name(PipeTextEncoding text)
+{
+    return (unsigned)text < PIPE_TEXT_COUNT ? g_textNames[text] : "?";
+}
+
+int pipeline_parse_format(const char *name)
+{
+    for (int i = 0; i < PIPE_FORMAT_COUNT; i++)
+        if (strcmp(name, g_formatNames[i]) == 0) return i;
+    return -1;
+}
+
+int pipeline_parse_text(const char *name)
+{
+    for (int i = 0; i < PIPE_TEXT_COUNT; i++)
+        if (strcmp(name, g_textNames[i]) == 0) return i;
+    return -1;
+}
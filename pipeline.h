@@ -0,0 +1,197 @@
+/*
+ * ImagePaster - pipeline.h
+ *
+ * The platform-independent half of the paste conversion: DIB -> RGB -> PNG or
+ * JPEG -> base64 text, optionally shrunk to fit a size budget. The image source and the text sink are reached through PasteIo, so
+ * the same code runs against the Win32 clipboard (main.c) and against memory
+ * (tools/replay.c, bench/bench.c). An optional callback fires as each stage
+ * completes so callers can time stages with their own clock.
+ *
+ * Large DIBs are streamed: rows are converted as the encoder asks for them,
+ * and budget downscaling reads them through a chain of 2x2 reducers, so the
+ * working memory beyond the encoded image and its text is a few rows. The
+ * conversion accounts for its own allocations and can be capped.
+ *
+ * A progress callback hears about every band of rows the encoder reads and
+ * can cancel the conversion there; it then frees what it holds and returns
+ * PIPE_ERR_CANCELLED.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bytebuf.h"
+#include "dib.h"
+#include "pngenc.h"
+#include "route.h"
+
+#define PIPELINE_DEFAULT_LEVEL 6
+#define PIPELINE_MIN_SIDE      16   /* budget downscaling stops here */
+#define PIPELINE_BUDGET_MIN_QUALITY 40
+#define PIPELINE_STREAM_DEFAULT (32u * 1024 * 1024)  /* decoded bytes from which DIBs stream */
+#define PIPELINE_PROGRESS_PIXELS 4096   /* pixels per band between progress calls */
+
+typedef enum {
+    PIPE_STAGE_ACQUIRE,     /* source hands over the packed DIB */
+    PIPE_STAGE_DIB_DECODE,
+    PIPE_STAGE_CLASSIFY,    /* content-aware format choice, when routed */
+    PIPE_STAGE_IMAGE_ENCODE,/* PNG or JPEG, all budget attempts */
+    PIPE_STAGE_BASE64,      /* the final text in its encoding */
+    PIPE_STAGE_PUBLISH,     /* sink takes the base64 text */
+    PIPE_STAGE_COUNT
+} PipeStage;
+
+typedef enum {
+    PIPE_OK = 0,
+    PIPE_ERR_SOURCE,
+    PIPE_ERR_DECODE,
+    PIPE_ERR_ENCODE,
+    PIPE_ERR_BUDGET,
+    PIPE_ERR_PUBLISH,
+    PIPE_ERR_MEMORY,        /* the conversion would exceed maxMemory */
+    PIPE_ERR_CANCELLED      /* onProgress asked to stop */
+} PipeStatus;
+
+typedef enum {
+    PIPE_FORMAT_PNG,
+    PIPE_FORMAT_JPEG,
+    PIPE_FORMAT_COUNT
+} PipeFormat;
+
+typedef enum {
+    PIPE_TEXT_BASE64,       /* one unbroken line */
+    PIPE_TEXT_BASE64_LINES, /* MIME style: 76 characters per line, CRLF */
+    PIPE_TEXT_DATA_URI,     /* data:image/png;base64,... */
+    PIPE_TEXT_FRAMED,       /* header, 76-character lines, trailer (frame.h) */
+    PIPE_TEXT_COUNT
+} PipeTextEncoding;
+
+/* `bytes` is the stage's input size. */
+typedef void (*PipeStageFn)(void *ctx, PipeStage stage, uint64_t bytes);
+
+/* The decoded image as rows, before encoding; valid only during the call.
+ * For a streamed DIB, reading a row converts it. */
+typedef void (*PipeDecodedFn)(void *ctx, RgbRowSource *rows);
+
+typedef struct {
+    PipeStage stage;        /* PIPE_STAGE_IMAGE_ENCODE, _BASE64, then _PUBLISH once */
+    int       attempt;      /* 1 for the first encode, more to meet the budget */
+    uint32_t  rows;         /* rows of this attempt read so far */
+    uint32_t  height;       /* rows of this attempt's image */
+    uint64_t  bytesOut;     /* encoded bytes so far; then characters of text */
+} PipeProgress;
+
+/* Called before the first row and then every band of rows (about
+ * PIPELINE_PROGRESS_PIXELS pixels) and whenever the encoder polls inside a
+ * band, every megabyte of image turned into text (not for framed text),
+ * and once before the text is published. Returning 0 cancels the
+ * conversion. */
+typedef int (*PipeProgressFn)(void *ctx, const PipeProgress *p);
+
+/* Fields after ctx may be left zero: PNG, default JPEG quality, no budget,
+ * plain base64, no decoded-image callback, no memory cap, streaming from
+ * PIPELINE_STREAM_DEFAULT, the format as given (ROUTE_FIXED), no progress. */
+typedef struct {
+    int              level;         /* PNG deflate level (effort), 0..9 */
+    PipeStageFn      onStage;       /* may be NULL */
+    void            *ctx;
+    PipeFormat       format;
+    int              quality;       /* JPEG 1..100, 0 = JPEG_DEFAULT_QUALITY */
+    size_t           maxTextBytes;  /* size budget for the text, 0 = none */
+    PipeTextEncoding text;
+    PipeDecodedFn    onDecoded;     /* may be NULL */
+    size_t           maxMemory;     /* cap on the conversion's own allocations, 0 = none */
+    size_t           streamAbove;   /* stream DIBs whose RGB would take this many bytes */
+    PngBandCache    *bandCache;     /* PNG bands kept from the last paste; may be NULL */
+    RoutePolicy      route;         /* let the content pick format and effort (route.h) */
+    const RouteModel *routeModel;   /* learned corrections; may be NULL */
+    uint64_t         textBytesPerSec; /* how fast the target takes the text, 0 = instantly */
+    PipeProgressFn   onProgress;    /* may be NULL */
+} PipeOptions;
+
+/* Image source and text sink. The DIB returned by acquireDib stays valid
+ * until releaseDib. The pipeline calls it as soon as it is done with the
+ * pixels: after decoding, or after encoding when the DIB is streamed.
+ * acquireDib returns PIPE_OK, PIPE_ERR_SOURCE, or PIPE_ERR_MEMORY when the
+ * DIB is larger than `maxCopy` (0 = no limit) and `copiesDib` is set: a
+ * source that copies the DIB has the copy counted against maxMemory and in
+ * peakBytes until releaseDib. */
+
+typedef struct {
+    void *ctx;
+    PipeStatus (*acquireDib)(void *ctx, size_t maxCopy, const uint8_t **dib, size_t *len);
+    void (*releaseDib)(void *ctx);
+    int  copiesDib;             /* the DIB is a private copy, not borrowed */
+    /* Optional decoder for DIBs dib.c reports as DIB_ERR_UNSUPPORTED. */
+    int  (*decodeFallback)(void *ctx, const uint8_t *dib, size_t len, RgbImage *out);
+    int  (*publishText)(void *ctx, const char *text, size_t len);
+} PasteIo;
+
+typedef struct {
+    uint32_t   width;           /* source image */
+    uint32_t   height;
+    uint32_t   outWidth;        /* encoded image, smaller if the budget required */
+    uint32_t   outHeight;
+    size_t     dibSize;
+    DibResult  dibResult;       /* detail for PIPE_ERR_DECODE */
+    int        usedFallback;    /* decoded by PasteIo.decodeFallback */
+    PipeFormat format;
+    int        level;           /* settings of the final attempt */
+    int        quality;
+    int        attempts;        /* encodes needed to meet the budget */
+    size_t     imageSize;       /* PNG or JPEG bytes */
+    char      *base64;          /* malloc'd, NUL-terminated text */
+    size_t     base64Len;
+    int        streamed;        /* rows were converted from the DIB while encoding */
+    size_t     peakBytes;       /* most memory the conversion held at once, with a copied DIB */
+    uint32_t   bands;           /* PNG row bands, with a band cache */
+    uint32_t   bandsReused;     /* of those, spliced from the cache */
+    int        routed;          /* format and level were chosen by `route` */
+    RouteDecision route;
+} PipeResult;
+
+/* In-memory PasteIo: serves one DIB and copies the published text into
+ * `text` (reset on each publish). */
+typedef struct {
+    const uint8_t *dib;
+    size_t         dibLen;
+    ByteBuf        text;
+} MemoryPasteIo;
+
+/* Runs the whole conversion: acquire, decode, encode, base64, publish. */
+PipeStatus pipeline_run(const PasteIo *io, const PipeOptions *opt, PipeResult *res);
+
+/* Encodes an already decoded image, or the rows of any source. When the
+ * text would exceed the budget, PNG is retried at level 9 and JPEG at lower
+ * quality (down to PIPELINE_BUDGET_MIN_QUALITY), then the image is halved
+ * until it fits or a side would drop below PIPELINE_MIN_SIDE
+ * (PIPE_ERR_BUDGET). */
+PipeStatus pipeline_encode_rgb(const RgbImage *img, const PipeOptions *opt, PipeResult *res);
+PipeStatus pipeline_encode_rows(RgbRowSource *src, const PipeOptions *opt, PipeResult *res);
+
+/* Decode, encode and text of a packed DIB, with no source or sink. */
+PipeStatus pipeline_convert_dib(const uint8_t *dib, size_t len, const PipeOptions *opt,
+                                PipeResult *res);
+
+/* Length of the text for `imageBytes` of encoded image, without NUL. */
+size_t     pipeline_text_length(size_t imageBytes, PipeFormat format, PipeTextEncoding text);
+
+void       pipeline_result_free(PipeResult *res);
+
+void       memory_paste_io_init(MemoryPasteIo *mem, PasteIo *io, const uint8_t *dib, size_t len);
+void       memory_paste_io_free(MemoryPasteIo *mem);
+
+/* Matches the stage names main.c records, so captures can be compared. */
+const char *pipeline_stage_name(PipeStage stage);
+const char *pipeline_status_string(PipeStatus status);
+
+/* Short names used in the registry and the UI ("png", "base64-lines", ...);
+ * the parsers return -1 for unknown names. */
+const char *pipeline_format_name(PipeFormat format);
+const char *pipeline_text_name(PipeTextEncoding text);
+int         pipeline_parse_format(const char *name);
+int         pipeline_parse_text(const char *name);
+
+#endif // PIPELINE_H
@@ -0,0 +1,469 @@
+/*
+ * ImagePaster - pngenc.c
+ *
+ * RGB to PNG encoding (see pngenc.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pngenc.h"
+#include "deflate.h"
+#include "arena.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define PNG_SSE2 1
+#endif
+
+#define PNG_BPP     3     /* bytes per pixel for filtering */
+#define FILTER_SPAN 512   /* bytes filtered between checks against the best sum */
+
+enum { FILTER_NONE, FILTER_SUB, FILTER_UP, FILTER_AVG, FILTER_PAETH, FILTER_COUNT };
+
+static void put_be32_at(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);  p[3] = (uint8_t)v;
+}
+
+/* Writes the length placeholder and type; returns the offset of the type. */
+static size_t chunk_begin(ByteBuf *out, const char *type)
+{
+    bb_put_be32(out, 0);
+    size_t start = out->len;
+    bb_append(out, type, 4);
+    return start;
+}
+
+#define PNG_CRC_POLL_BYTES (1024 * 1024)
+
+/* Checksums the chunk a slice at a time, polling `src` (may be NULL) in
+ * between: the IDAT of a large image takes milliseconds. */
+static int chunk_end(ByteBuf *out, size_t start, RgbRowSource *src)
+{
+    if (out->failed) return 0;
+    size_t dataLen = out->len - start - 4;
+    if (dataLen > 0x7FFFFFFFu) return 0;
+    put_be32_at(out->data + start - 4, (uint32_t)dataLen);
+    uint32_t crc = 0;
+    for (size_t at = start; at < out->len; at += PNG_CRC_POLL_BYTES) {
+        if (src && src->poll && at > start && !src->poll(src)) return 0;
+        size_t n = out->len - at < PNG_CRC_POLL_BYTES ? out->len - at : PNG_CRC_POLL_BYTES;
+        crc = crc32_update(crc, out->data + at, n);
+    }
+    bb_put_be32(out, crc);
+    return !out->failed;
+}
+
+static inline uint8_t paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc) return (uint8_t)a;
+    return (uint8_t)(pb <= pc ? b : c);
+}
+
+#ifdef PNG_SSE2
+static inline __m128i abs16(__m128i v)
+{
+    return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+static inline __m128i select16(__m128i mask, __m128i yes, __m128i no)
+{
+    return _mm_or_si128(_mm_and_si128(mask, yes), _mm_andnot_si128(mask, no));
+}
+
+/* Paeth predictor for eight pixels' bytes widened to 16 bits. */
+static inline __m128i paeth_lanes(__m128i a, __m128i b, __m128i c)
+{
+    __m128i bc = _mm_sub_epi16(b, c), ac = _mm_sub_epi16(a, c);
+    __m128i pa = abs16(bc), pb = abs16(ac), pc = abs16(_mm_add_epi16(bc, ac));
+    __m128i notA = _mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc));
+    __m128i pick = select16(_mm_cmpgt_epi16(pb, pc), c, b);
+    return select16(notA, pick, a);
+}
+
+static inline __m128i paeth_bytes(__m128i a, __m128i b, __m128i c)
+{
+    const __m128i z = _mm_setzero_si128();
+    __m128i lo = paeth_lanes(_mm_unpacklo_epi8(a, z), _mm_unpacklo_epi8(b, z), _mm_unpacklo_epi8(c, z));
+    __m128i hi = paeth_lanes(_mm_unpackhi_epi8(a, z), _mm_unpackhi_epi8(b, z), _mm_unpackhi_epi8(c, z));
+    return _mm_packus_epi16(lo, hi);
+}
+
+#define LOAD(p)     _mm_loadu_si128((const __m128i *)(p))
+#define STORE(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+#endif
+
+/* Filters row[from..to) into dst[from..to) with the given type. `prev` is
+ * the row above, all zeros for the first row. */
+static void filter_span(int type, const uint8_t *row, const uint8_t *prev,
+                        size_t from, size_t to, uint8_t *dst)
+{
+    size_t i = from;
+    for (; i < to && i < PNG_BPP; i++) {     /* no pixel to the left */
+        int b = prev[i];
+        if (type == FILTER_AVG) b >>= 1;
+        else if (type != FILTER_UP && type != FILTER_PAETH) b = 0;
+        dst[i] = (uint8_t)(row[i] - b);
+    }
+
+    switch (type) {
+    case FILTER_SUB:
+#ifdef PNG_SSE2
+        for (; i + 16 <= to; i += 16)
+            STORE(dst + i, _mm_sub_epi8(LOAD(row + i), LOAD(row + i - PNG_BPP)));
+#endif
+        for (; i < to; i++) dst[i] = (uint8_t)(row[i] - row[i - PNG_BPP]);
+        break;
+    case FILTER_UP:
+#ifdef PNG_SSE2
+        for (; i + 16 <= to; i += 16)
+            STORE(dst + i, _mm_sub_epi8(LOAD(row + i), LOAD(prev + i)));
+#endif
+        for (; i < to; i++) dst[i] = (uint8_t)(row[i] - prev[i]);
+        break;
+    case FILTER_AVG:
+#ifdef PNG_SSE2
+        for (; i + 16 <= to; i += 16) {
+            /* _mm_avg_epu8 rounds up; take the odd sums back down */
+            __m128i a = LOAD(row + i - PNG_BPP), b = LOAD(prev + i);
+            __m128i odd = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+            STORE(dst + i, _mm_sub_epi8(LOAD(row + i), _mm_sub_epi8(_mm_avg_epu8(a, b), odd)));
+        }
+#endif
+        for (; i < to; i++) dst[i] = (uint8_t)(row[i] - ((row[i - PNG_BPP] + prev[i]) >> 1));
+        break;
+    case FILTER_PAETH:
+#ifdef PNG_SSE2
+        for (; i + 16 <= to; i += 16) {
+            __m128i pred = paeth_bytes(LOAD(row + i - PNG_BPP), LOAD(prev + i),
+                                       LOAD(prev + i - PNG_BPP));
+            STORE(dst + i, _mm_sub_epi8(LOAD(row + i), pred));
+        }
+#endif
+        for (; i < to; i++)
+            dst[i] = (uint8_t)(row[i] - paeth(row[i - PNG_BPP], prev[i], prev[i - PNG_BPP]));
+        break;
+    default:
+        if (to > i) memcpy(dst + i, row + i, to - i);
+        break;
+    }
+}
+
+/* Sum of the bytes read as signed values, the libpng selection heuristic. */
+static uint32_t abs_sum(const uint8_t *v, size_t n)
+{
+    uint32_t sum = 0;
+    size_t i = 0;
+#ifdef PNG_SSE2
+    const __m128i z = _mm_setzero_si128();
+    __m128i acc = z;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = LOAD(v + i);
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_min_epu8(x, _mm_sub_epi8(z, x)), z));
+    }
+    sum = (uint32_t)_mm_cvtsi128_si32(acc) + (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#endif
+    for (; i < n; i++) sum += v[i] < 128 ? v[i] : 256u - v[i];
+    return sum;
+}
+
+/*
+ * Picks the filter with the smallest sum for `row` and returns its output,
+ * type byte first, in one of the candidate slots of `scratch`. The winner of
+ * the row above is tried first, and a candidate is dropped as soon as its
+ * running sum passes the best so far; ties still go to the lowest type, so
+ * the choice is the same as filtering the whole row five times.
+ */
+static const uint8_t *filter_best(const uint8_t *row, const uint8_t *prev, size_t n,
+                                  uint8_t *scratch, int *hint)
+{
+    const uint8_t *best = NULL;
+    uint32_t bestSum = UINT32_MAX;
+    int bestType = FILTER_COUNT;
+
+    for (int k = 0; k < FILTER_COUNT; k++) {
+        int f = k == 0 ? *hint : (k <= *hint ? k - 1 : k);
+        uint8_t *cand = scratch + (size_t)(f + 1) * (n + 1);
+        uint32_t sum = 0;
+        size_t done = 0;
+        cand[0] = (uint8_t)f;
+        while (done < n && sum <= bestSum) {
+            size_t end = n - done > FILTER_SPAN ? done + FILTER_SPAN : n;
+            filter_span(f, row, prev, done, end, cand + 1);
+            sum += abs_sum(cand + 1 + done, end - done);
+            done = end;
+        }
+        if (done == n && (sum < bestSum || (sum == bestSum && f < bestType))) {
+            best = cand;
+            bestSum = sum;
+            bestType = f;
+        }
+    }
+    *hint = bestType;
+    return best;
+}
+
+/* Filter candidates, the current and previous source rows, and a row of
+ * zeros standing in above the first row. */
+static size_t scratch_bytes(size_t rowBytes)
+{
+    return (rowBytes + 1) * (FILTER_COUNT + 1) + 3 * rowBytes;
+}
+
+static uint8_t *zero_row(uint8_t *scratch, size_t rowBytes)
+{
+    return scratch + (rowBytes + 1) * (FILTER_COUNT + 1) + 2 * rowBytes;
+}
+
+size_t png_working_bytes(uint32_t width)
+{
+    return scratch_bytes((size_t)width * 3) + deflate_working_bytes();
+}
+
+int png_encode_rgb(const RgbImage *img, int level, ByteBuf *out)
+{
+    RgbImageRows rows;
+    rgb_image_rows(&rows, img);
+    return png_encode_rows(&rows.base, level, out);
+}
+
+/* Filters `row` with the filter the heuristic picks and feeds it to `z`.
+ * `hint` carries the previous row's filter from call to call. */
+static int write_row(DeflateStream *z, int level, const uint8_t *row, const uint8_t *prev,
+                     size_t rowBytes, uint8_t *scratch, int *hint)
+{
+    if (level == 0) {
+        scratch[0] = FILTER_NONE;
+        memcpy(scratch + 1, row, rowBytes);
+        return deflate_write(z, scratch, rowBytes + 1);
+    }
+    if (!prev) prev = zero_row(scratch, rowBytes);
+    return deflate_write(z, filter_best(row, prev, rowBytes, scratch, hint), rowBytes + 1);
+}
+
+static int write_rows(RgbRowSource *src, int level, DeflateStream *z, uint8_t *scratch)
+{
+    size_t rowBytes = (size_t)src->width * 3;
+    /* Source rows alternate between two buffers, so `prev` stays valid */
+    uint8_t *rowBuf[2] = { scratch + (rowBytes + 1) * (FILTER_COUNT + 1), NULL };
+    rowBuf[1] = rowBuf[0] + rowBytes;
+
+    int ok = 1, hint = FILTER_NONE;
+    const uint8_t *prev = NULL;
+    for (uint32_t y = 0; y < src->height && ok; y++) {
+        const uint8_t *row = src->row(src, y, rowBuf[y & 1]);
+        if (!row) return 0;
+        ok = write_row(z, level, row, prev, rowBytes, scratch, &hint);
+        prev = row;
+    }
+    return ok;
+}
+
+/* ── Band cache ────────────────────────────────────────────────────────── */
+
+#define HASH_M1 0x9E3779B97F4A7C15ull
+#define HASH_M2 0xC2B2AE3D27D4EB4Full
+
+static inline uint64_t hash_mix(uint64_t h, uint64_t v)
+{
+    h ^= v * HASH_M1;
+    return ((h << 29) | (h >> 35)) * HASH_M2;
+}
+
+/* 64-bit hash of `n` bytes; four independent lanes keep it near memory speed. */
+static uint64_t hash_bytes(uint64_t seed, const uint8_t *p, size_t n)
+{
+    uint64_t h[4] = { seed, seed ^ HASH_M1, seed ^ HASH_M2, seed + HASH_M1 };
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        uint64_t v[4];
+        memcpy(v, p + i, sizeof(v));
+        for (int k = 0; k < 4; k++) h[k] = hash_mix(h[k], v[k]);
+    }
+    for (int k = 0; i < n; k = (k + 1) & 3) {
+        uint64_t v = 0;
+        size_t take = n - i < 8 ? n - i : 8;
+        memcpy(&v, p + i, take);
+        h[k] = hash_mix(h[k], v);
+        i += take;
+    }
+    uint64_t r = hash_mix(n, h[0]);
+    for (int k = 1; k < 4; k++) r = hash_mix(r, h[k]);
+    return r ^ (r >> 31);
+}
+
+static uint32_t band_rows(size_t rowBytes)
+{
+    size_t rows = PNG_BAND_BYTES / (rowBytes + 1);
+    return rows ? (uint32_t)rows : 1;
+}
+
+size_t png_band_working_bytes(uint32_t width)
+{
+    size_t rowBytes = (size_t)width * 3;
+    return (band_rows(rowBytes) + 1) * rowBytes;   /* a band and the row above it */
+}
+
+void png_band_cache_free(PngBandCache *cache)
+{
+    free(cache->bands);
+    cache->bands = NULL;
+    cache->count = 0;
+    bb_free(&cache->data);
+}
+
+static const PngBand *find_band(const PngBandCache *c, size_t hint, uint64_t key, uint64_t rawLen)
+{
+    if (hint < c->count && c->bands[hint].key == key && c->bands[hint].rawLen == rawLen)
+        return &c->bands[hint];
+    for (size_t i = 0; i < c->count; i++) {
+        if (c->bands[i].key == key && c->bands[i].rawLen == rawLen) return &c->bands[i];
+    }
+    return NULL;
+}
+
+/* Compresses the image band by band into `z`, splicing in the bands `cache`
+ * already has, and leaves `cache` holding this image's bands. A band is keyed
+ * by its raw rows and the row above it, which is all its filtered bytes
+ * depend on, so unchanged bands are neither filtered nor compressed. */
+static int write_bands(RgbRowSource *src, int level, DeflateStream *z, uint8_t *scratch,
+                       PngBandCache *cache, ByteBuf *out)
+{
+    size_t rowBytes = (size_t)src->width * 3;
+    uint32_t perBand = band_rows(rowBytes);
+    size_t nBands = src->height ? (src->height - 1) / perBand + 1 : 0;
+    size_t maxBytes = cache->maxBytes ? cache->maxBytes : PNG_BAND_CACHE_MAX;
+
+    /* Row 0 is the last row of the previous band, rows 1.. this band's */
+    uint8_t *rows = (uint8_t *)arena_alloc((perBand + 1) * rowBytes);
+    PngBandCache next = { 0 };
+    next.bands = (PngBand *)malloc((nBands ? nBands : 1) * sizeof(PngBand));
+    if (!rows || !next.bands) {
+        arena_free(rows);
+        free(next.bands);
+        return 0;
+    }
+
+    int ok = 1, hint = FILTER_NONE;
+    uint32_t reused = 0;
+    uint64_t seed = hash_mix(hash_mix(src->width, (uint64_t)level), perBand);
+    for (size_t b = 0; b < nBands && ok; b++) {
+        uint32_t y0 = (uint32_t)(b * perBand);
+        uint32_t n = src->height - y0 < perBand ? src->height - y0 : perBand;
+        for (uint32_t i = 0; i < n && ok; i++) {
+            uint8_t *dst = rows + (size_t)(i + 1) * rowBytes;
+            const uint8_t *row = src->row(src, y0 + i, dst);
+            if (!row) ok = 0;
+            else if (row != dst) memcpy(dst, row, rowBytes);
+        }
+        if (!ok) break;
+
+        uint64_t key = b ? hash_bytes(seed, rows, (size_t)(n + 1) * rowBytes)
+                         : hash_bytes(~seed, rows + rowBytes, (size_t)n * rowBytes);
+        uint64_t rawLen = (uint64_t)n * (rowBytes + 1);
+        const PngBand *hit = find_band(cache, b, key, rawLen);
+        if (!hit && next.count > 0 && next.bands[next.count - 1].key == key &&
+            next.bands[next.count - 1].rawLen == rawLen)
+            hit = &next.bands[next.count - 1];      /* repeats the band before, as blank bands do */
+
+        PngBand band = { key, rawLen, 0, next.data.len, 0 };
+        const uint8_t *segment;
+        int fromNext = hit && hit >= next.bands && hit < next.bands + nBands;
+        /* Copying within next.data below must not move it */
+        if (fromNext && !bb_reserve(&next.data, hit->size)) hit = NULL;
+        if (hit) {
+            segment = (fromNext ? next.data.data : cache->data.data) + hit->offset;
+            band.adler = hit->adler;
+            band.size = hit->size;
+            ok = deflate_splice(z, segment, band.size, band.adler, rawLen);
+            reused++;
+        } else {
+            size_t segStart = out->len;
+            for (uint32_t i = 0; i < n && ok; i++) {
+                const uint8_t *prev = i ? rows + (size_t)i * rowBytes : (b ? rows : NULL);
+                ok = write_row(z, level, rows + (size_t)(i + 1) * rowBytes, prev, rowBytes,
+                               scratch, &hint);
+            }
+            uint64_t len;
+            if (ok) ok = deflate_flush_segment(z, &band.adler, &len);
+            segment = out->data + segStart;
+            band.size = out->len - segStart;
+        }
+        if (ok && next.data.len + band.size <= maxBytes) {
+            bb_append(&next.data, segment, band.size);
+            if (!next.data.failed) next.bands[next.count++] = band;
+        }
+        memcpy(rows, rows + (size_t)n * rowBytes, rowBytes);
+    }
+    arena_free(rows);
+
+    if (!ok) {
+        png_band_cache_free(&next);
+        return 0;
+    }
+    next.maxBytes = cache->maxBytes;
+    next.lastBands = (uint32_t)nBands;
+    next.lastReused = reused;
+    png_band_cache_free(cache);
+    *cache = next;
+    return 1;
+}
+
+/* ── Encoder ───────────────────────────────────────────────────────────── */
+
+/* Lets the source stop a long stretch of deflate, such as a whole band. */
+static int poll_source(void *ctx)
+{
+    RgbRowSource *src = (RgbRowSource *)ctx;
+    return src->poll(src);
+}
+
+static int encode(RgbRowSource *src, int level, PngBandCache *cache, ByteBuf *out)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    size_t rowBytes = (size_t)src->width * 3;
+
+    bb_append(out, signature, sizeof(signature));
+
+    size_t start = chunk_begin(out, "IHDR");
+    bb_put_be32(out, src->width);
+    bb_put_be32(out, src->height);
+    bb_put_u8(out, 8);    /* bit depth */
+    bb_put_u8(out, 2);    /* colour type: truecolour */
+    bb_put_u8(out, 0);    /* compression */
+    bb_put_u8(out, 0);    /* filter method */
+    bb_put_u8(out, 0);    /* no interlace */
+    if (!chunk_end(out, start, NULL)) return 0;
+
+    uint8_t *scratch = (uint8_t *)arena_alloc(scratch_bytes(rowBytes));
+    if (!scratch) return 0;
+    memset(zero_row(scratch, rowBytes), 0, rowBytes);
+
+    start = chunk_begin(out, "IDAT");
+    DeflateStream *z = deflate_create(level, out);
+    if (!z) { arena_free(scratch); return 0; }
+    if (src->poll) deflate_set_poll(z, poll_source, src);
+
+    int ok = cache ? write_bands(src, level, z, scratch, cache, out)
+                   : write_rows(src, level, z, scratch);
+    if (ok) ok = deflate_finish(z);
+    deflate_destroy(z);
+    arena_free(scratch);
+    if (!ok || !chunk_end(out, start, src)) return 0;
+
+    start = chunk_begin(out, "IEND");
+    return chunk_end(out, start, NULL);
+}
+
+int png_encode_rows(RgbRowSource *src, int level, ByteBuf *out)
+{
+    return encode(src, level, NULL, out);
+}
+
+int png_encode_rows_cached(RgbRowSource *src, int level, PngBandCache *cache, ByteBuf *out)
+{
+    return encode(src, level, cache, out);
+}
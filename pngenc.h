@@ -0,0 +1,68 @@
+/*
+ * ImagePaster - pngenc.h
+ *
+ * PNG encoder for 8-bit RGB images: one IHDR, a single IDAT produced by the
+ * in-tree deflate (deflate.h), and IEND. Level 0 writes unfiltered stored
+ * blocks; higher levels pick a per-row filter by the minimum-sum-of-absolute
+ * differences heuristic used by libpng.
+ *
+ * Rows are pulled from an RgbRowSource one at a time, so besides the output
+ * the encoder holds only a few rows and the deflate state.
+ *
+ * With a PngBandCache the IDAT is compressed in bands of rows, each a
+ * deflate segment that stands on its own (deflate_flush_segment), and the
+ * cache keeps the compressed bands of the last image. A band whose pixels,
+ * and the row above it, hash the same as a cached one is spliced in without
+ * being filtered or compressed again, so a capture of a screen that barely
+ * changed costs little more than reading it. The output is the same PNG
+ * whether bands came from the cache or not.
+ */
+
+#ifndef PNGENC_H
+#define PNGENC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bytebuf.h"
+#include "dib.h"
+
+/* Appends a complete PNG file to `out`; returns 0 on failure. */
+int png_encode_rgb(const RgbImage *img, int level, ByteBuf *out);
+int png_encode_rows(RgbRowSource *src, int level, ByteBuf *out);
+
+#define PNG_BAND_BYTES      (256 * 1024)          /* raw bytes per band, about */
+#define PNG_BAND_CACHE_MAX  (32u * 1024 * 1024)    /* default cap on cached bands */
+
+typedef struct {
+    uint64_t key;           /* hash of the rows, the row above, width and level */
+    uint64_t rawLen;        /* filtered bytes the segment decompresses to */
+    uint32_t adler;
+    size_t   offset;        /* of the segment in PngBandCache.data */
+    size_t   size;
+} PngBand;
+
+/* Compressed bands of the last image encoded with the cache. Plain heap
+ * memory, not the paste arena, since it outlives the paste. */
+typedef struct {
+    PngBand *bands;
+    size_t   count;
+    ByteBuf  data;
+    size_t   maxBytes;      /* bands past this are not kept; 0 = PNG_BAND_CACHE_MAX */
+    /* The last encode */
+    uint32_t lastBands;
+    uint32_t lastReused;
+} PngBandCache;
+
+void png_band_cache_free(PngBandCache *cache);
+
+/* png_encode_rows() in cached bands; the cache then holds this image's. */
+int png_encode_rows_cached(RgbRowSource *src, int level, PngBandCache *cache, ByteBuf *out);
+
+/* Memory the encoder allocates for an image `width` pixels wide, output
+ * excluded. */
+size_t png_working_bytes(uint32_t width);
+
+/* What png_encode_rows_cached() allocates on top, cache excluded. */
+size_t png_band_working_bytes(uint32_t width);
+
+#endif // PNGENC_H
@@ -0,0 +1,161 @@
+/*
+ * ImagePaster - profile.c
+ *
+ * Per-application profiles: rule lists per window attribute, compiled with
+ * matcher.c, plus the encoder settings used for a matching window.
+ */
+
+#include "profile.h"
+#include "jpegenc.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *g_fieldNames[PROFILE_FIELD_COUNT] = { "exe", "class", "title" };
+static const char *g_deliveryNames[PROFILE_DELIVER_COUNT] = { "paste", "type" };
+
+static char *dup_string(const char *s)
+{
+    size_t len = strlen(s);
+    char *copy = (char *)malloc(len + 1);
+    if (copy) memcpy(copy, s, len + 1);
+    return copy;
+}
+
+int profile_init(Profile *p, const char *name)
+{
+    memset(p, 0, sizeof(*p));
+    strncpy(p->name, name, PROFILE_MAX_NAME - 1);
+    for (int f = 0; f < PROFILE_FIELD_COUNT; f++) {
+        p->rules[f] = dup_string("");
+        if (!p->rules[f]) {
+            profile_free(p);
+            return 0;
+        }
+    }
+    p->format = PIPE_FORMAT_PNG;
+    p->level = PIPELINE_DEFAULT_LEVEL;
+    p->quality = JPEG_DEFAULT_QUALITY;
+    p->maxTextBytes = 0;
+    p->text = PIPE_TEXT_BASE64;
+    p->delivery = PROFILE_DELIVER_PASTE;
+    p->route = ROUTE_FIXED;
+    return 1;
+}
+
+void profile_free(Profile *p)
+{
+    for (int f = 0; f < PROFILE_FIELD_COUNT; f++) {
+        free(p->rules[f]);
+        matcher_free(p->matchers[f]);
+        p->rules[f] = NULL;
+        p->matchers[f] = NULL;
+    }
+}
+
+int profile_set_rules(Profile *p, ProfileField field, const char *rules)
+{
+    char *copy = dup_string(rules);
+    if (!copy) return 0;
+    free(p->rules[field]);
+    p->rules[field] = copy;
+    return 1;
+}
+
+int profile_compile(Profile *p)
+{
+    TitleMatcher *m[PROFILE_FIELD_COUNT] = {0};
+    for (int f = 0; f < PROFILE_FIELD_COUNT; f++) {
+        m[f] = matcher_compile(p->rules[f] ? p->rules[f] : "");
+        if (!m[f]) {
+            while (f-- > 0) matcher_free(m[f]);
+            return 0;
+        }
+    }
+    for (int f = 0; f < PROFILE_FIELD_COUNT; f++) {
+        matcher_free(p->matchers[f]);
+        p->matchers[f] = m[f];
+    }
+    return 1;
+}
+
+int profile_uses(const Profile *p, ProfileField field)
+{
+    return p->matchers[field] && matcher_positive_count(p->matchers[field]) > 0;
+}
+
+int profile_equal(const Profile *a, const Profile *b)
+{
+    if (strcmp(a->name, b->name) != 0) return 0;
+    for (int f = 0; f < PROFILE_FIELD_COUNT; f++) {
+        if (strcmp(a->rules[f], b->rules[f]) != 0) return 0;
+    }
+    return a->format == b->format && a->level == b->level && a->quality == b->quality &&
+           a->maxTextBytes == b->maxTextBytes && a->text == b->text && a->delivery == b->delivery &&
+           a->route == b->route;
+}
+
+int profiles_match(const Profile *profiles, int count, const ProfileTarget *target,
+                   ProfileMatch *out)
+{
+    out->profile = -1;
+    out->excludedProfile = -1;
+    out->excludedField = -1;
+    out->excludedBy = -1;
+
+    for (int i = 0; i < count; i++) {
+        const Profile *p = &profiles[i];
+        int used = 0, matched = 1;
+
+        for (int f = 0; f < PROFILE_FIELD_COUNT && matched; f++) {
+            out->rule[f] = -1;
+            if (!profile_uses(p, (ProfileField)f)) continue;
+            used = 1;
+
+            int excludedBy = -1;
+            out->rule[f] = matcher_match(p->matchers[f], target->text[f], target->len[f],
+                                         &excludedBy);
+            if (out->rule[f] < 0) {
+                matched = 0;
+                if (excludedBy >= 0 && out->excludedProfile < 0) {
+                    out->excludedProfile = i;
+                    out->excludedField = f;
+                    out->excludedBy = excludedBy;
+                }
+            }
+        }
+        if (used && matched) {
+            out->profile = i;
+            return i;
+        }
+    }
+    for (int f = 0; f < PROFILE_FIELD_COUNT; f++) out->rule[f] = -1;
+    return -1;
+}
+
+void profile_pipe_options(const Profile *p, PipeOptions *opt)
+{
+    memset(opt, 0, sizeof(*opt));
+    opt->level = p->level;
+    opt->format = p->format;
+    opt->quality = p->quality;
+    opt->maxTextBytes = p->maxTextBytes;
+    opt->text = p->text;
+    opt->route = p->route;
+}
+
+const char *profile_field_name(ProfileField field)
+{
+    return field >= 0 && field < PROFILE_FIELD_COUNT ? g_fieldNames[field] : "?";
+}
+
+const char *profile_delivery_name(ProfileDelivery delivery)
+{
+    return (unsigned)delivery < PROFILE_DELIVER_COUNT ? g_deliveryNames[delivery] : "?";
+}
+
+int profile_parse_delivery(const char *name)
+{
+    for (int i = 0; i < PROFILE_DELIVER_COUNT; i++)
+        if (strcmp(name, g_deliveryNames[i]) == 0) return i;
+    return -1;
+}
@@ -0,0 +1,101 @@
+/*
+ * ImagePaster - profile.h
+ *
+ * Per-application profiles. A profile names its target by up to three rule
+ * lists, each in matcher.h syntax: the executable's full path, the window
+ * class and the window title. A window matches a profile when every list
+ * the profile uses matches; unused (empty) lists are ignored, and a profile
+ * with no lists at all matches nothing. Each profile carries the encoder
+ * settings for its target: format, compression effort, size budget, text
+ * encoding and how far the content may change the format (route.h), and
+ * how the text is delivered: pasted through the clipboard, or
+ * typed as keystrokes for targets that block or mangle clipboard pastes.
+ *
+ * Profiles are tried in order and the first match wins. Plain C with no
+ * Win32 dependency so host tools can share it.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "matcher.h"
+#include "pipeline.h"
+
+#define PROFILE_MAX_NAME 64
+
+typedef enum {
+    PROFILE_FIELD_EXE,
+    PROFILE_FIELD_CLASS,
+    PROFILE_FIELD_TITLE,
+    PROFILE_FIELD_COUNT
+} ProfileField;
+
+typedef enum {
+    PROFILE_DELIVER_PASTE,    /* clipboard text, then a re-injected Ctrl+V */
+    PROFILE_DELIVER_TYPE,     /* typed as Unicode keystrokes; clipboard untouched */
+    PROFILE_DELIVER_COUNT
+} ProfileDelivery;
+
+typedef struct {
+    char              name[PROFILE_MAX_NAME];
+    char             *rules[PROFILE_FIELD_COUNT];      /* UTF-8 rule lists, never NULL */
+    TitleMatcher     *matchers[PROFILE_FIELD_COUNT];   /* NULL until compiled, or unused */
+    PipeFormat        format;
+    int               level;          /* deflate effort 0-9 (PNG) */
+    int               quality;        /* 1-100 (JPEG) */
+    size_t            maxTextBytes;   /* 0 = no budget */
+    PipeTextEncoding  text;
+    ProfileDelivery   delivery;
+    RoutePolicy       route;          /* ROUTE_FIXED = always `format` */
+} Profile;
+
+/* The window being matched, as UTF-16 strings indexed by ProfileField. */
+typedef struct {
+    const uint16_t *text[PROFILE_FIELD_COUNT];
+    size_t          len[PROFILE_FIELD_COUNT];
+} ProfileTarget;
+
+typedef struct {
+    int profile;                      /* matching profile, or -1 */
+    int rule[PROFILE_FIELD_COUNT];    /* rule that matched per field, -1 if unused */
+    /* First negated rule that vetoed a profile, for the log */
+    int excludedProfile;              /* -1 if none */
+    int excludedField;
+    int excludedBy;
+} ProfileMatch;
+
+/* Fills in the default encoder settings and empty rule lists. Returns 0 when
+ * out of memory. */
+int   profile_init(Profile *p, const char *name);
+void  profile_free(Profile *p);
+
+/* Replaces one rule list. Returns 0 when out of memory (the old list stays). */
+int   profile_set_rules(Profile *p, ProfileField field, const char *rules);
+
+/* Compiles the rule lists. Returns 0 when out of memory, in which case the
+ * previously compiled matchers are kept. */
+int   profile_compile(Profile *p);
+
+/* True if the profile uses the field, i.e. its rule list has a positive rule. */
+int   profile_uses(const Profile *p, ProfileField field);
+
+/* True if both have the same name, rule lists and settings; the compiled
+ * matchers are not compared. */
+int   profile_equal(const Profile *a, const Profile *b);
+
+int   profiles_match(const Profile *profiles, int count, const ProfileTarget *target,
+                     ProfileMatch *out);
+
+/* Encoder settings for pipeline_run(); onStage and ctx are left NULL. */
+void  profile_pipe_options(const Profile *p, PipeOptions *opt);
+
+/* "exe", "class", "title" */
+const char *profile_field_name(ProfileField field);
+
+/* "paste", "type"; parse returns -1 for an unknown name. */
+const char *profile_delivery_name(ProfileDelivery delivery);
+int         profile_parse_delivery(const char *name);
+
+#endif // PROFILE_H
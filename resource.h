@@ -2,7 +2,7 @@
 #define RESOURCE_H
 
 #define IDI_APPICON      100
-#define IDR_HTML_UI      200
+#define IDR_UI_PACK      200
 #define IDR_WEBVIEW2_DLL 201
 
 #endif // RESOURCE_H
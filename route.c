@@ -0,0 +1,224 @@
+/*
+ * ImagePaster - route.c
+ *
+ * Sampled image classifier and encoding cost model (see route.h).
+ */
+
+#include "route.h"
+#include <math.h>
+#include <string.h>
+
+#define EDGE_STEP       48          /* a channel step this large is an edge */
+#define COLOUR_SLOTS    8192        /* > ROUTE_GRID_ROWS * ROUTE_GRID_COLS, a power of two */
+#define PHOTO_COLOURS   300         /* per mille of samples with a colour of their own */
+#define PHOTO_FLAT      150         /* per mille of flat blocks, at most */
+#define LEARN_RATE      0.25
+#define SCALE_MIN       0.25        /* corrections are kept within these */
+#define SCALE_MAX       4.0
+
+/* ── Classifier ────────────────────────────────────────────────────────── */
+
+static int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = p > a ? p - a : a - p, pb = p > b ? p - b : b - p, pc = p > c ? p - c : c - p;
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+static int step(const uint8_t *p, const uint8_t *q)
+{
+    int m = 0;
+    for (int k = 0; k < 3; k++) {
+        int d = p[k] > q[k] ? p[k] - q[k] : q[k] - p[k];
+        if (d > m) m = d;
+    }
+    return m;
+}
+
+/* Each sample is a 2x2 block: c b on the upper row, a x on the lower, and
+ * x is predicted from the other three as PNG's Paeth filter would. */
+void route_classify(RgbRowSource *src, uint8_t *rowBuf, RouteFeatures *out)
+{
+    uint32_t colours[COLOUR_SLOTS];     /* colour + 1, 0 = free */
+    uint32_t hist[256] = {0};
+    uint32_t flat = 0, edges = 0, n = 0, distinct = 0;
+    const uint32_t W = src->width, H = src->height;
+
+    memset(out, 0, sizeof(*out));
+    if (W < 2 || H < 2) return;
+    memset(colours, 0, sizeof(colours));
+
+    uint32_t rows = H / 2 < ROUTE_GRID_ROWS ? H / 2 : ROUTE_GRID_ROWS;
+    uint32_t cols = W / 2 < ROUTE_GRID_COLS ? W / 2 : ROUTE_GRID_COLS;
+    for (uint32_t i = 0; i < rows; i++) {
+        /* Rows are read in increasing order, two at a time */
+        uint32_t y = (uint32_t)(((uint64_t)(2 * i + 1) * (H - 1)) / (2 * rows));
+        const uint8_t *upper = src->row(src, y, rowBuf);
+        const uint8_t *lower = src->row(src, y + 1, rowBuf + (size_t)W * 3);
+
+        for (uint32_t j = 0; j < cols; j++) {
+            uint32_t x = (uint32_t)(((uint64_t)(2 * j + 1) * (W - 1)) / (2 * cols));
+            const uint8_t *c = upper + (size_t)x * 3, *b = c + 3;
+            const uint8_t *a = lower + (size_t)x * 3, *px = a + 3;
+
+            for (int k = 0; k < 3; k++) hist[(uint8_t)(px[k] - paeth(a[k], b[k], c[k]))]++;
+            if (memcmp(a, px, 3) == 0 && memcmp(c, b, 3) == 0) flat++;
+            if (step(px, a) >= EDGE_STEP || step(px, b) >= EDGE_STEP) edges++;
+
+            uint32_t key = ((uint32_t)px[0] << 16 | (uint32_t)px[1] << 8 | px[2]) + 1;
+            uint32_t slot = (key * 0x9E3779B1u) >> (32 - 13);
+            while (colours[slot] && colours[slot] != key) slot = (slot + 1) & (COLOUR_SLOTS - 1);
+            if (!colours[slot]) {
+                colours[slot] = key;
+                distinct++;
+            }
+            n++;
+        }
+    }
+
+    double entropy = 0;
+    for (int v = 0; v < 256; v++) {
+        if (!hist[v]) continue;
+        double p = (double)hist[v] / (3.0 * n);
+        entropy -= p * log2(p);
+    }
+
+    out->samples = n;
+    out->colours = distinct;
+    out->flat = (uint16_t)(flat * 1000 / n);
+    out->edges = (uint16_t)(edges * 1000 / n);
+    out->entropy = (uint16_t)(entropy * 100 + 0.5);
+    out->photo = distinct * 1000 >= PHOTO_COLOURS * n && out->flat <= PHOTO_FLAT;
+}
+
+/* ── Cost model ────────────────────────────────────────────────────────── */
+
+/* Coefficients fitted on screenshots, terminals, charts and photos from
+ * 720p to 4K (bench/route_bench.c), in bytes and nanoseconds per pixel.
+ * `own` is the share of samples with a colour of their own. */
+
+/* How far from level 1 toward level 6 each deflate level's time goes; its
+ * size stops at level 6's */
+static const double g_levelWeight[10] = { 0, 0, 0.3, 0.4, 0.6, 0.8, 1.0, 1.3, 2.5, 5.0 };
+
+static double clampd(double v, double lo, double hi)
+{
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+static void predict_png(const RouteFeatures *f, int level, double *bytesPerPixel, double *nsPerPixel)
+{
+    double flat = f->flat / 1000.0, h = f->entropy / 100.0;
+    double own = f->samples ? (double)f->colours / f->samples : 1.0;
+
+    if (level <= 0) {                   /* stored */
+        *bytesPerPixel = 3.0;
+        *nsPerPixel = 20;
+        return;
+    }
+    double size6 = 3.0 * h / 8.0 * (0.45 + 0.3 * own);
+    if (size6 < 0.025) size6 = 0.025;       /* headers, filters and run codes */
+    double size1 = size6 * (1.1 + 0.6 * (1.0 - own));
+    double time6 = 90 + 600 * (1.0 - flat), time1 = 60 + 90 * (1.0 - flat);
+    double w = g_levelWeight[level > 9 ? 9 : level];
+
+    *bytesPerPixel = (size1 + (size6 - size1) * (w < 1.0 ? w : 1.0)) * (level > 6 ? 0.95 : 1.0);
+    *nsPerPixel = time1 + (time6 - time1) * w;
+}
+
+static void predict_jpeg(const RouteFeatures *f, int quality, double *bytesPerPixel, double *nsPerPixel)
+{
+    double edges = f->edges / 1000.0, h = f->entropy / 100.0;
+    int q = quality < 1 ? 1 : quality > 100 ? 100 : quality;
+
+    *bytesPerPixel = (0.03 + 1.3 * edges + 0.08 * (h > 2.5 ? h - 2.5 : 0)) * sqrt(16.0 / (101 - q));
+    *nsPerPixel = 35 + 30 * edges;
+}
+
+static double scale_of(double s)
+{
+    return s > 0 ? s : 1.0;
+}
+
+void route_decide(const RouteModel *model, const RouteFeatures *f, RoutePolicy policy,
+                  uint32_t w, uint32_t h, int level, int quality, double textPerByte,
+                  size_t maxTextBytes, uint64_t textBytesPerSec, RouteDecision *out)
+{
+    static const RouteModel none;
+    const double pixels = (double)w * h;
+
+    if (!model) model = &none;
+    memset(out, 0, sizeof(*out));
+    out->features = *f;
+    out->candidates = 1 << ROUTE_PNG_FAST;
+    if (level > ROUTE_FAST_LEVEL) out->candidates |= 1 << ROUTE_PNG;
+    if (policy == ROUTE_ANY || (policy == ROUTE_PHOTOS && f->photo)) out->candidates |= 1 << ROUTE_JPEG;
+
+    int best = -1, bestFits = 0;
+    for (int c = 0; c < ROUTE_CHOICE_COUNT; c++) {
+        if (!(out->candidates & (1 << c))) continue;
+        double bpp, ns;
+        if (c == ROUTE_JPEG) predict_jpeg(f, quality, &bpp, &ns);
+        else predict_png(f, c == ROUTE_PNG ? level : ROUTE_FAST_LEVEL, &bpp, &ns);
+
+        double bytes = pixels * bpp * scale_of(model->sizeScale[c]);
+        double encodeUs = pixels * ns * scale_of(model->timeScale[c]) / 1000.0;
+        double text = bytes * textPerByte;
+        double deliverUs = textBytesPerSec ? text * 1e6 / (double)textBytesPerSec : 0;
+        out->bytes[c] = (uint64_t)bytes;
+        out->encodeMicros[c] = (uint64_t)encodeUs;
+        out->totalMicros[c] = (uint64_t)(encodeUs + deliverUs);
+
+        /* A choice that fits the budget beats any that does not */
+        int fits = !maxTextBytes || text <= (double)maxTextBytes;
+        if (best < 0 || fits > bestFits ||
+            (fits == bestFits && out->totalMicros[c] < out->totalMicros[best])) {
+            best = c;
+            bestFits = fits;
+        }
+    }
+    out->choice = (RouteChoice)best;
+}
+
+void route_learn(RouteModel *model, const RouteDecision *d, uint64_t actualBytes,
+                 uint64_t actualEncodeMicros)
+{
+    RouteChoice c = d->choice;
+    if ((unsigned)c >= ROUTE_CHOICE_COUNT) return;
+
+    /* Predictions already include the correction, so it is scaled by how far off they were */
+    if (d->bytes[c] && actualBytes) {
+        double s = scale_of(model->sizeScale[c]);
+        s *= 1.0 + LEARN_RATE * ((double)actualBytes / (double)d->bytes[c] - 1.0);
+        model->sizeScale[c] = clampd(s, SCALE_MIN, SCALE_MAX);
+    }
+    if (d->encodeMicros[c] && actualEncodeMicros) {
+        double s = scale_of(model->timeScale[c]);
+        s *= 1.0 + LEARN_RATE * ((double)actualEncodeMicros / (double)d->encodeMicros[c] - 1.0);
+        model->timeScale[c] = clampd(s, SCALE_MIN, SCALE_MAX);
+    }
+    model->pastes[c]++;
+}
+
+/* ── Names ─────────────────────────────────────────────────────────────── */
+
+static const char *g_policyNames[ROUTE_POLICY_COUNT] = { "fixed", "lossless", "photos", "any" };
+static const char *g_choiceNames[ROUTE_CHOICE_COUNT] = { "PNG fast", "PNG", "JPEG" };
+
+const char *route_policy_name(RoutePolicy policy)
+{
+    return (unsigned)policy < ROUTE_POLICY_COUNT ? g_policyNames[policy] : "?";
+}
+
+int route_parse_policy(const char *name)
+{
+    for (int i = 0; i < ROUTE_POLICY_COUNT; i++) {
+        if (strcmp(name, g_policyNames[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char *route_choice_name(RouteChoice choice)
+{
+    return (unsigned)choice < ROUTE_CHOICE_COUNT ? g_choiceNames[choice] : "?";
+}
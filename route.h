@@ -0,0 +1,97 @@
+/*
+ * ImagePaster - route.h
+ *
+ * Content-aware choice of the output encoding. A classifier reads a sparse
+ * grid of 2x2 pixel blocks from the decoded image, a few dozen rows of it,
+ * and estimates how many colours it has, how much of it is flat or sharp
+ * edges, and the entropy of what a PNG filter leaves to compress. A model
+ * turns those into the size and encode time of each encoding, and the one
+ * with the shortest paste, encoding and delivering the text together, is
+ * chosen among those the fidelity policy allows.
+ *
+ * The model starts from coefficients fitted on screenshots and photos and
+ * corrects itself from the size and time of each paste it routed.
+ *
+ * Plain C with no Win32 dependency.
+ */
+
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dib.h"
+
+#define ROUTE_GRID_ROWS     32      /* row pairs sampled */
+#define ROUTE_GRID_COLS     96      /* blocks per row pair */
+#define ROUTE_FAST_LEVEL    1       /* deflate level of the fast PNG */
+
+/* How far the choice may stray from the profile's format */
+typedef enum {
+    ROUTE_FIXED,            /* always the profile's format and settings */
+    ROUTE_LOSSLESS,         /* PNG, at the profile's effort or the fast one */
+    ROUTE_PHOTOS,           /* as lossless, and JPEG for photographic images */
+    ROUTE_ANY,              /* whichever is fastest, JPEG included */
+    ROUTE_POLICY_COUNT
+} RoutePolicy;
+
+typedef enum {
+    ROUTE_PNG_FAST,         /* PNG at ROUTE_FAST_LEVEL */
+    ROUTE_PNG,              /* PNG at the profile's effort */
+    ROUTE_JPEG,             /* JPEG at the profile's quality */
+    ROUTE_CHOICE_COUNT
+} RouteChoice;
+
+typedef struct {
+    uint32_t samples;       /* blocks read */
+    uint32_t colours;       /* distinct colours among them */
+    uint16_t flat;          /* per mille of blocks whose pixels all match their left neighbours */
+    uint16_t edges;         /* per mille with a sharp step to a neighbour */
+    uint16_t entropy;       /* of the Paeth residual, hundredths of a bit per byte */
+    uint8_t  photo;         /* many colours, little flat: photographic */
+} RouteFeatures;
+
+/* Corrections learned from pastes, per choice. Zeroed, the model uses its
+ * built-in coefficients. */
+typedef struct {
+    double   sizeScale[ROUTE_CHOICE_COUNT];    /* actual / predicted bytes */
+    double   timeScale[ROUTE_CHOICE_COUNT];    /* actual / predicted encode time */
+    uint32_t pastes[ROUTE_CHOICE_COUNT];
+} RouteModel;
+
+typedef struct {
+    RouteFeatures features;
+    RouteChoice   choice;
+    int           candidates;                      /* bit per RouteChoice considered */
+    uint64_t      bytes[ROUTE_CHOICE_COUNT];       /* predicted encoded image */
+    uint64_t      encodeMicros[ROUTE_CHOICE_COUNT];
+    uint64_t      totalMicros[ROUTE_CHOICE_COUNT]; /* encode, text and delivery */
+} RouteDecision;
+
+/* Samples `src` in one pass over 2 * ROUTE_GRID_ROWS rows. `rowBuf` holds
+ * two rows (6 * width bytes). */
+void route_classify(RgbRowSource *src, uint8_t *rowBuf, RouteFeatures *out);
+
+/* Predicts every choice the policy allows for a w x h image and picks the
+ * fastest. `level` is the profile's PNG effort (ROUTE_PNG is left out when
+ * it is ROUTE_FAST_LEVEL or less), `quality` its JPEG quality.
+ * `textBytesPerSec` is how fast the target takes the text, 0 for
+ * instantly. A size budget, if any, rules out choices predicted not to fit
+ * unless none does. `textPerByte` is the text length per encoded byte. */
+void route_decide(const RouteModel *model, const RouteFeatures *f, RoutePolicy policy,
+                  uint32_t w, uint32_t h, int level, int quality, double textPerByte,
+                  size_t maxTextBytes, uint64_t textBytesPerSec, RouteDecision *out);
+
+/* Folds one paste's actual size and encode time into the model; a zero
+ * time is not used. Corrections move a quarter of the way each time. */
+void route_learn(RouteModel *model, const RouteDecision *d, uint64_t actualBytes,
+                 uint64_t actualEncodeMicros);
+
+/* "fixed", "lossless", "photos", "any"; parse returns -1 for an unknown name. */
+const char *route_policy_name(RoutePolicy policy);
+int         route_parse_policy(const char *name);
+
+/* "PNG fast", "PNG", "JPEG" */
+const char *route_choice_name(RouteChoice choice);
+
+#endif // ROUTE_H
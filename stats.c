@@ -0,0 +1,83 @@
+/*
+ * ImagePaster - stats.c
+ *
+ * Log-linear latency histograms (see stats.h).
+ */
+
+#include <string.h>
+#include "stats.h"
+
+static int stat_magnitude(uint64_t v)
+{
+    int m = 0;
+    while (v >>= 1) m++;
+    return m;
+}
+
+static unsigned stat_bucket_index(uint64_t v)
+{
+    if (v < 2 * STAT_SUB_COUNT) return (unsigned)v;
+    int m = stat_magnitude(v);
+    if (m >= STAT_MAX_MAGNITUDE) return STAT_BUCKET_COUNT - 1;
+    unsigned sub = (unsigned)(v >> (m - STAT_SUB_BITS)) - STAT_SUB_COUNT;
+    return 2 * STAT_SUB_COUNT + (unsigned)(m - STAT_SUB_BITS - 1) * STAT_SUB_COUNT + sub;
+}
+
+/* Highest value that still maps into bucket idx. */
+static uint64_t stat_bucket_upper(unsigned idx)
+{
+    if (idx < 2 * STAT_SUB_COUNT) return idx;
+    unsigned k = idx - 2 * STAT_SUB_COUNT;
+    int m = (int)(k / STAT_SUB_COUNT) + STAT_SUB_BITS + 1;
+    uint64_t sub = k % STAT_SUB_COUNT;
+    uint64_t lower = (STAT_SUB_COUNT + sub) << (m - STAT_SUB_BITS);
+    return lower + ((uint64_t)1 << (m - STAT_SUB_BITS)) - 1;
+}
+
+void stat_reset(StatHistogram *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+void stat_record(StatHistogram *h, uint64_t micros, uint64_t bytes)
+{
+    h->buckets[stat_bucket_index(micros)]++;
+    if (h->count == 0 || micros < h->minMicros) h->minMicros = micros;
+    if (micros > h->maxMicros) h->maxMicros = micros;
+    h->count++;
+    h->totalMicros += micros;
+    h->totalBytes  += bytes;
+}
+
+uint64_t stat_percentile(const StatHistogram *h, double pct)
+{
+    if (h->count == 0) return 0;
+    if (pct < 0.0) pct = 0.0;
+    if (pct > 100.0) pct = 100.0;
+
+    uint64_t target = (uint64_t)(pct / 100.0 * (double)h->count + 0.5);
+    if (target == 0) target = 1;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < STAT_BUCKET_COUNT; i++) {
+        seen += h->buckets[i];
+        if (seen >= target) {
+            uint64_t v = stat_bucket_upper(i);
+            if (v > h->maxMicros) v = h->maxMicros;
+            if (v < h->minMicros) v = h->minMicros;
+            return v;
+        }
+    }
+    return h->maxMicros;
+}
+
+uint64_t stat_mean(const StatHistogram *h)
+{
+    return h->count ? h->totalMicros / h->count : 0;
+}
+
+double stat_bytes_per_sec(const StatHistogram *h)
+{
+    if (h->totalMicros == 0 || h->totalBytes == 0) return 0.0;
+    return (double)h->totalBytes * 1000000.0 / (double)h->totalMicros;
+}
@@ -0,0 +1,42 @@
+/*
+ * ImagePaster - stats.h
+ *
+ * HDR-style latency histograms for the paste pipeline. Durations are recorded
+ * in microseconds into log-linear buckets (16 sub-buckets per power of two, so
+ * any reported percentile is within ~6% of the true value) together with the
+ * number of bytes the stage processed, which gives a throughput figure.
+ *
+ * Plain C with no Win32 dependency so host-side tools can share it.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#define STAT_SUB_BITS     4
+#define STAT_SUB_COUNT    (1u << STAT_SUB_BITS)
+#define STAT_MAX_MAGNITUDE 40   /* values up to 2^40 us (~12 days) */
+#define STAT_BUCKET_COUNT \
+    (2 * STAT_SUB_COUNT + (STAT_MAX_MAGNITUDE - STAT_SUB_BITS - 1) * STAT_SUB_COUNT)
+
+typedef struct {
+    uint32_t buckets[STAT_BUCKET_COUNT];
+    uint64_t count;
+    uint64_t totalMicros;
+    uint64_t totalBytes;
+    uint64_t minMicros;
+    uint64_t maxMicros;
+} StatHistogram;
+
+void     stat_reset(StatHistogram *h);
+void     stat_record(StatHistogram *h, uint64_t micros, uint64_t bytes);
+
+/* Value at the given percentile (0..100), clamped to the recorded maximum. */
+uint64_t stat_percentile(const StatHistogram *h, double pct);
+uint64_t stat_mean(const StatHistogram *h);
+
+/* Aggregate throughput: total bytes over total time. 0 if nothing recorded. */
+double   stat_bytes_per_sec(const StatHistogram *h);
+
+#endif // STATS_H
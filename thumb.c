@@ -0,0 +1,262 @@
+/*
+ * ImagePaster - thumb.c
+ *
+ * Area-averaging thumbnail downscaler and the thumbnail arena (see thumb.h).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "thumb.h"
+#include "arena.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define THUMB_SSE2 1
+#endif
+
+void thumb_size(uint32_t w, uint32_t h, uint32_t *tw, uint32_t *th)
+{
+    if (w <= THUMB_MAX_SIDE && h <= THUMB_MAX_SIDE) {
+        *tw = w ? w : 1;
+        *th = h ? h : 1;
+    } else if (w >= h) {
+        *tw = THUMB_MAX_SIDE;
+        *th = (uint32_t)(((uint64_t)h * THUMB_MAX_SIDE + w / 2) / w);
+    } else {
+        *th = THUMB_MAX_SIDE;
+        *tw = (uint32_t)(((uint64_t)w * THUMB_MAX_SIDE + h / 2) / h);
+    }
+    if (*tw == 0) *tw = 1;
+    if (*th == 0) *th = 1;
+}
+
+/* acc[i] = sum of rows[k][i] over n rows; n <= THUMB_MAX_TAPS keeps the sums
+ * within 16 bits. */
+static void sum_rows_scalar(const uint8_t *const *rows, int n, size_t count, uint16_t *acc)
+{
+    for (size_t i = 0; i < count; i++) {
+        unsigned s = 0;
+        for (int k = 0; k < n; k++) s += rows[k][i];
+        acc[i] = (uint16_t)s;
+    }
+}
+
+/* Per-channel sums of w pixels of row sums. */
+static inline void sum_block_scalar(const uint16_t *a, uint32_t w, uint32_t rgb[3])
+{
+    uint32_t r = 0, g = 0, b = 0;
+    for (const uint16_t *end = a + (size_t)w * 3; a < end; a += 3) {
+        r += a[0];
+        g += a[1];
+        b += a[2];
+    }
+    rgb[0] = r;
+    rgb[1] = g;
+    rgb[2] = b;
+}
+
+#ifdef THUMB_SSE2
+static void sum_rows_sse2(const uint8_t *const *rows, int n, size_t count, uint16_t *acc)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i lo = zero, hi = zero;
+        for (int k = 0; k < n; k++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(rows[k] + i));
+            lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+            hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        }
+        _mm_storeu_si128((__m128i *)(acc + i), lo);
+        _mm_storeu_si128((__m128i *)(acc + i + 8), hi);
+    }
+    const uint8_t *tail[THUMB_MAX_TAPS];
+    for (int k = 0; k < n; k++) tail[k] = rows[k] + i;
+    sum_rows_scalar(tail, n, count - i, acc + i);
+}
+
+/* Two pixels per load: an unaligned load at pixel p holds p and p + 1 in
+ * lanes 0-5, so loads two pixels apart accumulate even and odd pixels side
+ * by side. The loads may read two lanes past the block (acc is padded).
+ * Lanes are flushed to 32 bits before 65 additions of at most
+ * THUMB_MAX_TAPS * 255 could overflow them. */
+static inline void sum_block_sse2(const uint16_t *a, uint32_t w, uint32_t rgb[3])
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = zero, hi = zero;   /* 32-bit lanes 0-3 and 4-7 */
+    uint32_t p = 0;
+
+    while (p + 2 <= w) {
+        /* Two chains, so consecutive additions do not wait on each other */
+        __m128i s0 = zero, s1 = zero;
+        for (int k = 0; k < 32 && p + 4 <= w; k++, p += 4) {
+            s0 = _mm_add_epi16(s0, _mm_loadu_si128((const __m128i *)(a + (size_t)p * 3)));
+            s1 = _mm_add_epi16(s1, _mm_loadu_si128((const __m128i *)(a + (size_t)p * 3 + 6)));
+        }
+        if (p + 4 > w && p + 2 <= w) {
+            s0 = _mm_add_epi16(s0, _mm_loadu_si128((const __m128i *)(a + (size_t)p * 3)));
+            p += 2;
+        }
+        lo = _mm_add_epi32(lo, _mm_add_epi32(_mm_unpacklo_epi16(s0, zero), _mm_unpacklo_epi16(s1, zero)));
+        hi = _mm_add_epi32(hi, _mm_add_epi32(_mm_unpackhi_epi16(s0, zero), _mm_unpackhi_epi16(s1, zero)));
+    }
+    /* Lanes 0-2: even pixels' RGB plus odd pixels' R (lane 3) and G, B (lanes 4, 5) */
+    __m128i t = _mm_add_epi32(_mm_add_epi32(lo, _mm_slli_si128(hi, 4)), _mm_srli_si128(lo, 12));
+    rgb[0] = (uint32_t)_mm_cvtsi128_si32(t);
+    rgb[1] = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(t, 4));
+    rgb[2] = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(t, 8));
+    if (p < w) {
+        rgb[0] += a[(size_t)p * 3];
+        rgb[1] += a[(size_t)p * 3 + 1];
+        rgb[2] += a[(size_t)p * 3 + 2];
+    }
+}
+#endif
+
+static void downscale(RgbRowSource *src, uint8_t *rgba, uint32_t tw, uint32_t th, int simd)
+{
+    const uint32_t W = src->width, H = src->height;
+    const size_t rowBytes = (size_t)W * 3;
+    uint16_t *acc = (uint16_t *)arena_calloc(rowBytes + 8, sizeof(uint16_t));
+    uint32_t *xs = (uint32_t *)arena_alloc(((size_t)tw + 1) * sizeof(uint32_t));
+    uint8_t *rowBuf = (uint8_t *)arena_alloc(rowBytes * THUMB_MAX_TAPS);
+    if (!acc || !xs || !rowBuf || tw == 0 || th == 0 || tw > W || th > H) {
+        arena_free(rowBuf);
+        arena_free(xs);
+        arena_free(acc);
+        return;
+    }
+
+    /* Column block boundaries; every block is q or q + 1 wide */
+    for (uint32_t x = 0; x <= tw; x++) xs[x] = (uint32_t)((uint64_t)x * W / tw);
+    const uint32_t q = W / tw;
+
+    for (uint32_t ty = 0; ty < th; ty++) {
+        uint32_t y0 = (uint32_t)((uint64_t)ty * H / th);
+        uint32_t y1 = (uint32_t)((uint64_t)(ty + 1) * H / th);
+        uint32_t band = y1 - y0;
+        int n = band < THUMB_MAX_TAPS ? (int)band : THUMB_MAX_TAPS;
+
+        const uint8_t *rows[THUMB_MAX_TAPS];
+        for (int k = 0; k < n; k++) {
+            uint32_t y = y0 + (uint32_t)(((uint64_t)(2 * k + 1) * band) / (2 * (uint32_t)n));
+            rows[k] = src->row(src, y, rowBuf + rowBytes * (size_t)k);
+        }
+#ifdef THUMB_SSE2
+        if (simd) sum_rows_sse2(rows, n, rowBytes, acc);
+        else
+#endif
+        sum_rows_scalar(rows, n, rowBytes, acc);
+
+        /* Fixed-point reciprocals of the two block sizes, so no division per pixel */
+        uint64_t recip[2];
+        for (int i = 0; i < 2; i++) {
+            uint64_t count = (uint64_t)(q + (uint32_t)i) * (uint32_t)n;
+            recip[i] = count ? ((1ull << 24) + count / 2) / count : 0;
+        }
+
+        uint8_t *out = rgba + (size_t)ty * tw * 4;
+        for (uint32_t tx = 0; tx < tw; tx++, out += 4) {
+            uint32_t sum[3];
+#ifdef THUMB_SSE2
+            if (simd) sum_block_sse2(acc + (size_t)xs[tx] * 3, xs[tx + 1] - xs[tx], sum);
+            else
+#endif
+            sum_block_scalar(acc + (size_t)xs[tx] * 3, xs[tx + 1] - xs[tx], sum);
+            uint64_t m = recip[xs[tx + 1] - xs[tx] - q];
+            out[0] = (uint8_t)((sum[0] * m + (1u << 23)) >> 24);
+            out[1] = (uint8_t)((sum[1] * m + (1u << 23)) >> 24);
+            out[2] = (uint8_t)((sum[2] * m + (1u << 23)) >> 24);
+            out[3] = 255;
+        }
+    }
+    arena_free(rowBuf);
+    arena_free(xs);
+    arena_free(acc);
+}
+
+void thumb_downscale_rows(RgbRowSource *src, uint8_t *rgba, uint32_t tw, uint32_t th)
+{
+    downscale(src, rgba, tw, th, 1);
+}
+
+void thumb_downscale(const RgbImage *src, uint8_t *rgba, uint32_t tw, uint32_t th)
+{
+    RgbImageRows rows;
+    rgb_image_rows(&rows, src);
+    downscale(&rows.base, rgba, tw, th, 1);
+}
+
+void thumb_downscale_scalar(const RgbImage *src, uint8_t *rgba, uint32_t tw, uint32_t th)
+{
+    RgbImageRows rows;
+    rgb_image_rows(&rows, src);
+    downscale(&rows.base, rgba, tw, th, 0);
+}
+
+/* ── Arena ─────────────────────────────────────────────────────────────── */
+
+int thumb_arena_init(ThumbArena *a, size_t maxBytes)
+{
+    memset(a, 0, sizeof(*a));
+    size_t slots = maxBytes / (THUMB_SLOT_BYTES + sizeof(ThumbInfo));
+    if (slots == 0) return 0;
+    if (slots > 65536) slots = 65536;
+
+    a->pixels = (uint8_t *)malloc(slots * THUMB_SLOT_BYTES);
+    a->info = (ThumbInfo *)calloc(slots, sizeof(ThumbInfo));
+    if (!a->pixels || !a->info) {
+        thumb_arena_free(a);
+        return 0;
+    }
+    a->slotCount = (unsigned)slots;
+    return 1;
+}
+
+void thumb_arena_free(ThumbArena *a)
+{
+    free(a->pixels);
+    free(a->info);
+    memset(a, 0, sizeof(*a));
+}
+
+uint32_t thumb_arena_add(ThumbArena *a, RgbRowSource *src)
+{
+    ThumbInfo *info = &a->info[a->next];
+    uint8_t *pixels = a->pixels + (size_t)a->next * THUMB_SLOT_BYTES;
+
+    thumb_size(src->width, src->height, &info->width, &info->height);
+    thumb_downscale_rows(src, pixels, info->width, info->height);
+    info->srcWidth = src->width;
+    info->srcHeight = src->height;
+    if (++a->lastId == 0) a->lastId = 1;
+    info->id = a->lastId;
+
+    a->next = (a->next + 1) % a->slotCount;
+    return info->id;
+}
+
+uint32_t thumb_arena_put(ThumbArena *a, const uint8_t *rgba, const ThumbInfo *made)
+{
+    ThumbInfo *info = &a->info[a->next];
+
+    memcpy(a->pixels + (size_t)a->next * THUMB_SLOT_BYTES, rgba, (size_t)made->width * made->height * 4);
+    *info = *made;
+    if (++a->lastId == 0) a->lastId = 1;
+    info->id = a->lastId;
+
+    a->next = (a->next + 1) % a->slotCount;
+    return info->id;
+}
+
+const uint8_t *thumb_arena_get(const ThumbArena *a, uint32_t id, ThumbInfo *info)
+{
+    if (id == 0) return NULL;
+    for (unsigned i = 0; i < a->slotCount; i++) {
+        if (a->info[i].id == id) {
+            if (info) *info = a->info[i];
+            return a->pixels + (size_t)i * THUMB_SLOT_BYTES;
+        }
+    }
+    return NULL;
+}
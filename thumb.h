@@ -0,0 +1,76 @@
+/*
+ * ImagePaster - thumb.h
+ *
+ * Thumbnails of pasted images for the Activity Log gallery. They are made
+ * from the rows the conversion decodes anyway, by area averaging:
+ * each thumbnail pixel is the mean of the source block it covers, over every
+ * column of the block and up to THUMB_MAX_TAPS rows spread evenly through it.
+ * Sampling rows bounds the memory read for very large images; the vertical
+ * sums use SSE2 where available.
+ *
+ * Thumbnails are kept in a ThumbArena: one allocation of fixed-size RGBA
+ * slots, reused oldest first, so the gallery never grows past the size it
+ * was created with.
+ *
+ * Plain C with no Win32 dependency.
+ */
+
+#ifndef THUMB_H
+#define THUMB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dib.h"
+
+#define THUMB_MAX_SIDE   128
+#define THUMB_SLOT_BYTES (THUMB_MAX_SIDE * THUMB_MAX_SIDE * 4)
+#define THUMB_MAX_TAPS   2      /* source rows averaged per thumbnail row */
+
+/* Thumbnail dimensions for a w x h image: the longer side becomes
+ * THUMB_MAX_SIDE (or stays, if shorter), aspect ratio kept, at least 1. */
+void thumb_size(uint32_t w, uint32_t h, uint32_t *tw, uint32_t *th);
+
+/* Writes a tw x th RGBA thumbnail (opaque, rows tw * 4 bytes apart) of
+ * `src`. tw and th must not exceed the source dimensions. */
+void thumb_downscale(const RgbImage *src, uint8_t *rgba, uint32_t tw, uint32_t th);
+
+/* The same without SIMD; the reference for benchmarks and cross-checks. */
+void thumb_downscale_scalar(const RgbImage *src, uint8_t *rgba, uint32_t tw, uint32_t th);
+
+/* The same from a row source; reads at most THUMB_MAX_TAPS rows per
+ * thumbnail row, so a streamed DIB is never decoded in full. */
+void thumb_downscale_rows(RgbRowSource *src, uint8_t *rgba, uint32_t tw, uint32_t th);
+
+typedef struct {
+    uint32_t id;            /* 0 = slot empty */
+    uint32_t width;         /* thumbnail */
+    uint32_t height;
+    uint32_t srcWidth;      /* image it was made from */
+    uint32_t srcHeight;
+} ThumbInfo;
+
+typedef struct {
+    uint8_t   *pixels;      /* slotCount * THUMB_SLOT_BYTES */
+    ThumbInfo *info;
+    unsigned   slotCount;
+    unsigned   next;        /* slot the next thumbnail goes to */
+    uint32_t   lastId;
+} ThumbArena;
+
+/* Allocates as many slots as fit in `maxBytes`, bookkeeping included.
+ * Returns 0 if not even one fits or memory is short. */
+int  thumb_arena_init(ThumbArena *a, size_t maxBytes);
+void thumb_arena_free(ThumbArena *a);
+
+/* Makes a thumbnail of `src` in the oldest slot. Returns its id, never 0. */
+uint32_t thumb_arena_add(ThumbArena *a, RgbRowSource *src);
+
+/* Stores a thumbnail made elsewhere, such as on another thread with
+ * thumb_downscale_rows(); `made` gives its and its source's dimensions.
+ * Returns its id, never 0. */
+uint32_t thumb_arena_put(ThumbArena *a, const uint8_t *rgba, const ThumbInfo *made);
+
+/* The RGBA pixels of thumbnail `id`, or NULL if it has been reused. */
+const uint8_t *thumb_arena_get(const ThumbArena *a, uint32_t id, ThumbInfo *info);
+
+#endif // THUMB_H
@@ -0,0 +1,253 @@
+/*
+ * ImagePaster - tools/inflate.c
+ *
+ * Canonical-Huffman inflater (see inflate.h), decoding one bit at a time in
+ * the style of zlib's contrib/puff.
+ */
+
+#include <string.h>
+#include "inflate.h"
+#include "deflate.h"
+
+#define MAXBITS   15
+#define MAXLCODES 286
+#define MAXDCODES 30
+
+typedef struct {
+    const uint8_t *src;
+    size_t         len;
+    size_t         pos;
+    uint32_t       bitBuf;
+    int            bitCount;
+    ByteBuf       *out;
+    int            truncated;
+} InState;
+
+typedef struct {
+    uint16_t count[MAXBITS + 1];
+    uint16_t symbol[MAXLCODES];
+} Huffman;
+
+static int bits(InState *s, int need)
+{
+    uint32_t val = s->bitBuf;
+    while (s->bitCount < need) {
+        if (s->pos >= s->len) { s->truncated = 1; return 0; }
+        val |= (uint32_t)s->src[s->pos++] << s->bitCount;
+        s->bitCount += 8;
+    }
+    s->bitBuf = val >> need;
+    s->bitCount -= need;
+    return (int)(val & ((1u << need) - 1));
+}
+
+static int decode(InState *s, const Huffman *h)
+{
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= MAXBITS; len++) {
+        code |= bits(s, 1);
+        if (s->truncated) return -1;
+        int count = h->count[len];
+        if (code - count < first) return h->symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+/* Returns 0 for a complete code, >0 incomplete, <0 over-subscribed. */
+static int construct(Huffman *h, const uint8_t *length, int n)
+{
+    uint16_t offs[MAXBITS + 1];
+    memset(h->count, 0, sizeof(h->count));
+    for (int sym = 0; sym < n; sym++) h->count[length[sym]]++;
+    if (h->count[0] == n) return 0;
+
+    int left = 1;
+    for (int len = 1; len <= MAXBITS; len++) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) return left;
+    }
+    offs[1] = 0;
+    for (int len = 1; len < MAXBITS; len++) offs[len + 1] = (uint16_t)(offs[len] + h->count[len]);
+    for (int sym = 0; sym < n; sym++)
+        if (length[sym]) h->symbol[offs[length[sym]]++] = (uint16_t)sym;
+    return left;
+}
+
+static InflateResult stored(InState *s)
+{
+    s->bitBuf = 0;
+    s->bitCount = 0;
+    if (s->pos + 4 > s->len) return INFLATE_ERR_TRUNCATED;
+    unsigned len  = s->src[s->pos] | s->src[s->pos + 1] << 8;
+    unsigned nlen = s->src[s->pos + 2] | s->src[s->pos + 3] << 8;
+    s->pos += 4;
+    if (len != (~nlen & 0xFFFF)) return INFLATE_ERR_DATA;
+    if (s->pos + len > s->len) return INFLATE_ERR_TRUNCATED;
+    bb_append(s->out, s->src + s->pos, len);
+    s->pos += len;
+    return s->out->failed ? INFLATE_ERR_NOMEM : INFLATE_OK;
+}
+
+static InflateResult codes(InState *s, const Huffman *lencode, const Huffman *distcode)
+{
+    static const uint16_t lbase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8_t lext[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16_t dbase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577 };
+    static const uint8_t dext[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    for (;;) {
+        int sym = decode(s, lencode);
+        if (sym < 0) return s->truncated ? INFLATE_ERR_TRUNCATED : INFLATE_ERR_DATA;
+        if (sym < 256) {
+            bb_put_u8(s->out, (uint8_t)sym);
+        } else if (sym == 256) {
+            return s->out->failed ? INFLATE_ERR_NOMEM : INFLATE_OK;
+        } else {
+            sym -= 257;
+            if (sym >= 29) return INFLATE_ERR_DATA;
+            size_t len = lbase[sym] + (size_t)bits(s, lext[sym]);
+            int dsym = decode(s, distcode);
+            if (dsym < 0 || dsym >= 30) return s->truncated ? INFLATE_ERR_TRUNCATED : INFLATE_ERR_DATA;
+            size_t dist = dbase[dsym] + (size_t)bits(s, dext[dsym]);
+            if (s->truncated) return INFLATE_ERR_TRUNCATED;
+            if (dist > s->out->len) return INFLATE_ERR_DATA;
+            if (!bb_reserve(s->out, len)) return INFLATE_ERR_NOMEM;
+            uint8_t *dst = s->out->data + s->out->len;
+            const uint8_t *from = dst - dist;
+            for (size_t i = 0; i < len; i++) dst[i] = from[i];   /* may overlap */
+            s->out->len += len;
+        }
+    }
+}
+
+static InflateResult fixed(InState *s)
+{
+    static Huffman lencode, distcode;
+    static int built = 0;
+    if (!built) {
+        uint8_t lengths[288];
+        int sym = 0;
+        for (; sym < 144; sym++) lengths[sym] = 8;
+        for (; sym < 256; sym++) lengths[sym] = 9;
+        for (; sym < 280; sym++) lengths[sym] = 7;
+        for (; sym < 288; sym++) lengths[sym] = 8;
+        construct(&lencode, lengths, 288);
+        for (sym = 0; sym < MAXDCODES; sym++) lengths[sym] = 5;
+        construct(&distcode, lengths, MAXDCODES);
+        built = 1;
+    }
+    return codes(s, &lencode, &distcode);
+}
+
+static InflateResult dynamic(InState *s)
+{
+    static const uint8_t order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    uint8_t lengths[MAXLCODES + MAXDCODES];
+    Huffman lencode, distcode;
+
+    int nlen  = bits(s, 5) + 257;
+    int ndist = bits(s, 5) + 1;
+    int ncode = bits(s, 4) + 4;
+    if (s->truncated) return INFLATE_ERR_TRUNCATED;
+    if (nlen > MAXLCODES || ndist > MAXDCODES) return INFLATE_ERR_DATA;
+
+    int index;
+    for (index = 0; index < ncode; index++) lengths[order[index]] = (uint8_t)bits(s, 3);
+    for (; index < 19; index++) lengths[order[index]] = 0;
+    if (construct(&lencode, lengths, 19) != 0) return INFLATE_ERR_DATA;
+
+    index = 0;
+    while (index < nlen + ndist) {
+        int sym = decode(s, &lencode);
+        if (sym < 0) return s->truncated ? INFLATE_ERR_TRUNCATED : INFLATE_ERR_DATA;
+        if (sym < 16) {
+            lengths[index++] = (uint8_t)sym;
+            continue;
+        }
+        int len = 0, repeat;
+        if (sym == 16) {
+            if (index == 0) return INFLATE_ERR_DATA;
+            len = lengths[index - 1];
+            repeat = 3 + bits(s, 2);
+        } else if (sym == 17) {
+            repeat = 3 + bits(s, 3);
+        } else {
+            repeat = 11 + bits(s, 7);
+        }
+        if (index + repeat > nlen + ndist) return INFLATE_ERR_DATA;
+        while (repeat--) lengths[index++] = (uint8_t)len;
+    }
+    if (lengths[256] == 0) return INFLATE_ERR_DATA;
+
+    int err = construct(&lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1)) return INFLATE_ERR_DATA;
+    err = construct(&distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1)) return INFLATE_ERR_DATA;
+
+    return codes(s, &lencode, &distcode);
+}
+
+InflateResult zlib_inflate(const uint8_t *src, size_t len, ByteBuf *out)
+{
+    if (len < 6) return INFLATE_ERR_TRUNCATED;
+    if ((src[0] & 0x0F) != 8 || (src[0] >> 4) > 7 || ((src[0] << 8) | src[1]) % 31 != 0
+        || (src[1] & 0x20))
+        return INFLATE_ERR_HEADER;
+
+    InState s;
+    memset(&s, 0, sizeof(s));
+    s.src = src;
+    s.len = len - 4;         /* Adler-32 trailer */
+    s.pos = 2;
+    s.out = out;
+    size_t outStart = out->len;
+
+    int last;
+    do {
+        last = bits(&s, 1);
+        int type = bits(&s, 2);
+        if (s.truncated) return INFLATE_ERR_TRUNCATED;
+        InflateResult r;
+        switch (type) {
+        case 0:  r = stored(&s); break;
+        case 1:  r = fixed(&s); break;
+        case 2:  r = dynamic(&s); break;
+        default: r = INFLATE_ERR_DATA; break;
+        }
+        if (r != INFLATE_OK) return r;
+    } while (!last);
+
+    const uint8_t *t = src + len - 4;
+    uint32_t expect = (uint32_t)t[0] << 24 | (uint32_t)t[1] << 16 | (uint32_t)t[2] << 8 | t[3];
+    if (adler32_update(1, out->data + outStart, out->len - outStart) != expect)
+        return INFLATE_ERR_CHECKSUM;
+    return INFLATE_OK;
+}
+
+const char *inflate_result_string(InflateResult r)
+{
+    switch (r) {
+    case INFLATE_OK:            return "ok";
+    case INFLATE_ERR_HEADER:    return "bad zlib header";
+    case INFLATE_ERR_DATA:      return "invalid deflate data";
+    case INFLATE_ERR_TRUNCATED: return "truncated stream";
+    case INFLATE_ERR_CHECKSUM:  return "Adler-32 mismatch";
+    case INFLATE_ERR_NOMEM:     return "out of memory";
+    }
+    return "unknown error";
+}
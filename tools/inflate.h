@@ -0,0 +1,30 @@
+/*
+ * ImagePaster - tools/inflate.h
+ *
+ * Minimal zlib (RFC 1950/1951) decompressor for the host-side tools. Favours
+ * clarity over speed: it only unpacks capture files and verifies encoder
+ * output, never the paste path.
+ */
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bytebuf.h"
+
+typedef enum {
+    INFLATE_OK = 0,
+    INFLATE_ERR_HEADER,
+    INFLATE_ERR_DATA,
+    INFLATE_ERR_TRUNCATED,
+    INFLATE_ERR_CHECKSUM,
+    INFLATE_ERR_NOMEM
+} InflateResult;
+
+/* Decompresses a complete zlib stream, appending to `out`. */
+InflateResult zlib_inflate(const uint8_t *src, size_t len, ByteBuf *out);
+
+const char *inflate_result_string(InflateResult r);
+
+#endif // INFLATE_H
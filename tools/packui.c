@@ -0,0 +1,307 @@
+/*
+ * ImagePaster - tools/packui.c
+ *
+ * Packs the built UI (assets/dist) into the resource served to WebView2 from
+ * https://imagepaster.local/ (see uipack.h). Text files are deflated at the
+ * highest level once, at build time, and the resource handler passes them on
+ * with "Content-Encoding: deflate" so the browser inflates them itself.
+ *
+ *   packui [--verify] DIST-DIR OUT.pak
+ *
+ * Prints each file's raw and stored size. --verify reads the pack back,
+ * inflates every entry and compares it with the source file.
+ *
+ * Built natively by `make` for the resource step (see Makefile).
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "bytebuf.h"
+#include "deflate.h"
+#include "inflate.h"
+#include "uipack.h"
+
+#define PACK_MAX_FILES 1024
+#define PACK_MAX_PATH  255
+
+/* Only keep the deflated copy if it saves at least this share (percent) */
+#define PACK_MIN_SAVING 5
+
+typedef struct {
+    char     path[PACK_MAX_PATH + 1];    /* relative, '/' separated */
+    const char *mime;
+    ByteBuf  stored;
+    uint32_t rawSize;
+    uint8_t  encoding;
+    uint8_t  flags;
+} PackFile;
+
+static PackFile g_files[PACK_MAX_FILES];
+static unsigned g_fileCount = 0;
+
+static const struct { const char *ext; const char *mime; int compress; } g_types[] = {
+    { ".html",  "text/html; charset=utf-8",              1 },
+    { ".js",    "text/javascript; charset=utf-8",        1 },
+    { ".css",   "text/css; charset=utf-8",               1 },
+    { ".json",  "application/json",                      1 },
+    { ".svg",   "image/svg+xml",                         1 },
+    { ".map",   "application/json",                      1 },
+    { ".ico",   "image/x-icon",                          1 },
+    { ".png",   "image/png",                             0 },
+    { ".jpg",   "image/jpeg",                            0 },
+    { ".webp",  "image/webp",                            0 },
+    { ".woff2", "font/woff2",                            0 },
+    { ".woff",  "font/woff",                             0 },
+};
+
+static int type_index(const char *path)
+{
+    size_t n = strlen(path);
+    for (size_t i = 0; i < sizeof(g_types) / sizeof(g_types[0]); i++) {
+        size_t e = strlen(g_types[i].ext);
+        if (n >= e && strcmp(path + n - e, g_types[i].ext) == 0) return (int)i;
+    }
+    return -1;
+}
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    ByteBuf b = {0};
+    uint8_t chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) bb_append(&b, chunk, n);
+    fclose(f);
+    if (b.failed) { bb_free(&b); return NULL; }
+    *len = b.len;
+    return b.data ? b.data : (uint8_t *)calloc(1, 1);
+}
+
+static int add_file(const char *full, const char *rel)
+{
+    if (g_fileCount >= PACK_MAX_FILES) {
+        fprintf(stderr, "packui: more than %d files\n", PACK_MAX_FILES);
+        return 0;
+    }
+    if (strlen(rel) > PACK_MAX_PATH) {
+        fprintf(stderr, "packui: path too long: %s\n", rel);
+        return 0;
+    }
+
+    size_t len = 0;
+    uint8_t *data = read_file(full, &len);
+    if (!data) {
+        fprintf(stderr, "packui: cannot read %s\n", full);
+        return 0;
+    }
+    if (len > 0xFFFFFFFFu) {
+        fprintf(stderr, "packui: %s is too large\n", full);
+        free(data);
+        return 0;
+    }
+
+    PackFile *f = &g_files[g_fileCount++];
+    memset(f, 0, sizeof(*f));
+    strcpy(f->path, rel);
+    int t = type_index(rel);
+    f->mime = t >= 0 ? g_types[t].mime : "application/octet-stream";
+    f->rawSize = (uint32_t)len;
+    f->encoding = UIPACK_ENCODING_IDENTITY;
+    /* Vite puts content-hashed files under assets/ */
+    if (strncmp(rel, "assets/", 7) == 0) f->flags |= UIPACK_FLAG_IMMUTABLE;
+
+    if (t >= 0 && g_types[t].compress && len > 0) {
+        ByteBuf z = {0};
+        DeflateStream *s = deflate_create(DEFLATE_MAX_LEVEL, &z);
+        int ok = s && deflate_write(s, data, len) && deflate_finish(s);
+        deflate_destroy(s);
+        if (ok && !z.failed && z.len * 100 <= len * (100 - PACK_MIN_SAVING)) {
+            f->stored = z;
+            f->encoding = UIPACK_ENCODING_DEFLATE;
+            free(data);
+            return 1;
+        }
+        bb_free(&z);
+    }
+    bb_append(&f->stored, data, len);
+    free(data);
+    return !f->stored.failed;
+}
+
+static int walk(const char *root, const char *rel)
+{
+    char dirPath[4096];
+    snprintf(dirPath, sizeof(dirPath), rel[0] ? "%s/%s" : "%s", root, rel);
+    DIR *d = opendir(dirPath);
+    if (!d) {
+        fprintf(stderr, "packui: cannot open directory %s\n", dirPath);
+        return 0;
+    }
+
+    int ok = 1;
+    struct dirent *de;
+    while (ok && (de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+        char child[4096];
+        snprintf(child, sizeof(child), rel[0] ? "%s/%s" : "%s%s", rel, de->d_name);
+        char full[8192];
+        snprintf(full, sizeof(full), "%s/%s", root, child);
+        struct stat st;
+        if (stat(full, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) ok = walk(root, child);
+        else if (S_ISREG(st.st_mode)) ok = add_file(full, child);
+    }
+    closedir(d);
+    return ok;
+}
+
+static int compare_files(const void *a, const void *b)
+{
+    return strcmp(((const PackFile *)a)->path, ((const PackFile *)b)->path);
+}
+
+static void put_le16(ByteBuf *b, uint16_t v)
+{
+    uint8_t t[2] = { (uint8_t)v, (uint8_t)(v >> 8) };
+    bb_append(b, t, 2);
+}
+
+static void put_le32(ByteBuf *b, uint32_t v)
+{
+    uint8_t t[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    bb_append(b, t, 4);
+}
+
+static int write_pack(ByteBuf *out)
+{
+    size_t dirSize = 8;
+    for (unsigned i = 0; i < g_fileCount; i++) {
+        dirSize += 16 + strlen(g_files[i].path) + 1 + strlen(g_files[i].mime) + 1;
+    }
+
+    put_le32(out, UIPACK_MAGIC);
+    put_le16(out, UIPACK_VERSION);
+    put_le16(out, (uint16_t)g_fileCount);
+
+    size_t offset = dirSize;
+    for (unsigned i = 0; i < g_fileCount; i++) {
+        const PackFile *f = &g_files[i];
+        if (offset + f->stored.len > 0xFFFFFFFFu) return 0;
+        put_le32(out, (uint32_t)offset);
+        put_le32(out, (uint32_t)f->stored.len);
+        put_le32(out, f->rawSize);
+        bb_put_u8(out, f->encoding);
+        bb_put_u8(out, f->flags);
+        bb_put_u8(out, (uint8_t)strlen(f->path));
+        bb_put_u8(out, (uint8_t)strlen(f->mime));
+        bb_append(out, f->path, strlen(f->path) + 1);
+        bb_append(out, f->mime, strlen(f->mime) + 1);
+        offset += f->stored.len;
+    }
+    for (unsigned i = 0; i < g_fileCount; i++) {
+        bb_append(out, g_files[i].stored.data, g_files[i].stored.len);
+    }
+    return !out->failed && out->len == offset;
+}
+
+static int verify_pack(const char *root, const ByteBuf *pack)
+{
+    UiPack p;
+    if (!uipack_open(&p, pack->data, pack->len) || p.count != g_fileCount) {
+        fprintf(stderr, "packui: verify: pack does not parse\n");
+        return 0;
+    }
+
+    int ok = 1;
+    for (unsigned i = 0; i < g_fileCount; i++) {
+        UiPackEntry e;
+        if (!uipack_find(&p, g_files[i].path, &e)) {
+            fprintf(stderr, "packui: verify: %s missing\n", g_files[i].path);
+            ok = 0;
+            continue;
+        }
+
+        char full[4096];
+        size_t len = 0;
+        snprintf(full, sizeof(full), "%s/%s", root, e.path);
+        uint8_t *src = read_file(full, &len);
+
+        ByteBuf raw = {0};
+        InflateResult r = INFLATE_OK;
+        if (e.encoding == UIPACK_ENCODING_DEFLATE) r = zlib_inflate(e.data, e.size, &raw);
+        else bb_append(&raw, e.data, e.size);
+
+        if (!src || r != INFLATE_OK || raw.len != len || raw.len != e.rawSize
+            || (len && memcmp(raw.data, src, len) != 0)) {
+            fprintf(stderr, "packui: verify: %s differs (%s)\n", e.path,
+                    r == INFLATE_OK ? "content" : inflate_result_string(r));
+            ok = 0;
+        }
+        bb_free(&raw);
+        free(src);
+    }
+    return ok;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: packui [--verify] DIST-DIR OUT.pak\n"
+        "  --verify  read the pack back and compare every entry with its source\n");
+}
+
+int main(int argc, char **argv)
+{
+    int verify = 0, first = 1;
+    while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+        if (strcmp(argv[first], "--verify") == 0) verify = 1;
+        else { usage(); return 2; }
+        first++;
+    }
+    if (argc - first != 2) { usage(); return 2; }
+    const char *root = argv[first], *outPath = argv[first + 1];
+
+    if (!walk(root, "")) return 1;
+    if (g_fileCount == 0) {
+        fprintf(stderr, "packui: %s is empty\n", root);
+        return 1;
+    }
+    qsort(g_files, g_fileCount, sizeof(g_files[0]), compare_files);
+
+    ByteBuf pack = {0};
+    if (!write_pack(&pack)) {
+        fprintf(stderr, "packui: pack too large or out of memory\n");
+        return 1;
+    }
+
+    FILE *out = fopen(outPath, "wb");
+    if (!out || fwrite(pack.data, 1, pack.len, out) != pack.len) {
+        fprintf(stderr, "packui: cannot write %s\n", outPath);
+        if (out) fclose(out);
+        return 1;
+    }
+    fclose(out);
+
+    uint64_t raw = 0, stored = 0;
+    printf("%-40s %10s %10s\n", "file", "raw", "stored");
+    for (unsigned i = 0; i < g_fileCount; i++) {
+        const PackFile *f = &g_files[i];
+        printf("%-40s %10u %10lu%s\n", f->path, f->rawSize, (unsigned long)f->stored.len,
+               f->encoding == UIPACK_ENCODING_DEFLATE ? " deflate" : "");
+        raw += f->rawSize;
+        stored += f->stored.len;
+    }
+    printf("%u files, %llu bytes raw, %llu stored, pack %lu bytes\n", g_fileCount,
+           (unsigned long long)raw, (unsigned long long)stored, (unsigned long)pack.len);
+
+    int ok = !verify || verify_pack(root, &pack);
+    if (verify && ok) printf("verify: ok\n");
+
+    bb_free(&pack);
+    for (unsigned i = 0; i < g_fileCount; i++) bb_free(&g_files[i].stored);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,450 @@
+/*
+ * ImagePaster - tools/replay.c
+ *
+ * Replays captured pastes (.ipcap files written by the "Capture Pastes" tray
+ * option) through the conversion pipeline on the build host, with no
+ * clipboard involved. For each record it prints the captured per-stage
+ * timings and output sizes next to freshly measured ones, so encoder changes
+ * can be judged against real production inputs.
+ *
+ *   replay [--level N] [--repeat N] [--json] [--verify] FILE.ipcap...
+ *
+ * Built natively by `make tools` (see Makefile).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "capture.h"
+#include "pipeline.h"
+#include "pngenc.h"
+#include "stats.h"
+#include "deflate.h"
+#include "inflate.h"
+
+typedef struct {
+    int level;
+    int repeat;
+    int json;
+    int verify;
+} ReplayOptions;
+
+typedef struct {
+    uint64_t lastNs;
+    uint64_t stageNs[PIPE_STAGE_COUNT];
+} StageClock;
+
+typedef struct {
+    unsigned records;
+    unsigned skipped;
+    unsigned verifyFailures;
+    uint64_t capturedPng, replayPng;
+    uint64_t capturedB64, replayB64;
+    StatHistogram stages[PIPE_STAGE_COUNT];
+    StatHistogram total;
+} ReplaySummary;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void on_stage(void *ctx, PipeStage stage, uint64_t bytes)
+{
+    StageClock *c = (StageClock *)ctx;
+    uint64_t t = now_ns();
+    (void)bytes;
+    c->stageNs[stage] = t - c->lastNs;
+    c->lastNs = t;
+}
+
+/* Capture replay has no clipboard, so only the conversion stages are timed,
+ * and it replays at a fixed format, so there is no format choice. */
+static int replayed_stage(int s)
+{
+    return s >= PIPE_STAGE_DIB_DECODE && s <= PIPE_STAGE_BASE64 && s != PIPE_STAGE_CLASSIFY;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Captured micros for a pipeline stage, or -1 if the record lacks it.
+ * Captures from before JPEG support call the encode stage "PNG encode". */
+static int64_t captured_micros(const CaptureRecord *rec, const char *name)
+{
+    for (uint32_t i = 0; i < rec->stageCount; i++) {
+        if (strcmp(rec->stageNames[i], name) == 0 ||
+            (strcmp(name, "Image encode") == 0 && strcmp(rec->stageNames[i], "PNG encode") == 0))
+            return (int64_t)rec->stageMicros[i];
+    }
+    return -1;
+}
+
+static void json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') printf("\\%c", c);
+        else if (c < 0x20) printf("\\u%04x", c);
+        else putchar(c);
+    }
+    putchar('"');
+}
+
+static const char *compression_name(uint32_t c)
+{
+    switch (c) {
+    case DIB_BI_RGB:       return "BI_RGB";
+    case DIB_BI_RLE8:      return "BI_RLE8";
+    case DIB_BI_RLE4:      return "BI_RLE4";
+    case DIB_BI_BITFIELDS: return "BI_BITFIELDS";
+    case DIB_BI_JPEG:      return "BI_JPEG";
+    case DIB_BI_PNG:       return "BI_PNG";
+    }
+    return "other";
+}
+
+static double pct_delta(double captured, double replayed)
+{
+    return captured > 0 ? (replayed - captured) * 100.0 / captured : 0.0;
+}
+
+/* ── PNG verification ──────────────────────────────────────────────────── */
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/* Decodes the PNG we produced and compares it with the source pixels. */
+static const char *verify_png(const uint8_t *png, size_t len, const RgbImage *img)
+{
+    static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    ByteBuf idat = {0}, raw = {0};
+    const char *err = NULL;
+    size_t pos = 8;
+    int sawEnd = 0;
+
+    if (len < 8 || memcmp(png, sig, 8) != 0) return "bad signature";
+    while (!sawEnd && !err) {
+        if (pos + 12 > len) { err = "truncated chunk"; break; }
+        uint32_t n = be32(png + pos);
+        if (n > len - pos - 12) { err = "chunk overruns file"; break; }
+        const uint8_t *type = png + pos + 4, *data = png + pos + 8;
+        if (crc32_update(0, type, n + 4) != be32(data + n)) { err = "chunk CRC mismatch"; break; }
+        if (memcmp(type, "IHDR", 4) == 0) {
+            if (n != 13 || be32(data) != img->width || be32(data + 4) != img->height ||
+                data[8] != 8 || data[9] != 2)
+                err = "unexpected IHDR";
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            bb_append(&idat, data, n);
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            sawEnd = 1;
+        }
+        pos += 12 + n;
+    }
+
+    if (!err) {
+        InflateResult r = zlib_inflate(idat.data, idat.len, &raw);
+        if (r != INFLATE_OK) err = inflate_result_string(r);
+    }
+
+    size_t rowBytes = (size_t)img->width * 3;
+    if (!err && raw.len != (rowBytes + 1) * img->height) err = "wrong decompressed size";
+
+    for (uint32_t y = 0; !err && y < img->height; y++) {
+        uint8_t *row = raw.data + (rowBytes + 1) * y + 1;
+        const uint8_t *prev = y ? row - (rowBytes + 1) : NULL;
+        int type = row[-1];
+        for (size_t i = 0; i < rowBytes; i++) {
+            int a = i >= 3 ? row[i - 3] : 0;
+            int b = prev ? prev[i] : 0;
+            int c = (prev && i >= 3) ? prev[i - 3] : 0;
+            int pred;
+            switch (type) {
+            case 0: pred = 0; break;
+            case 1: pred = a; break;
+            case 2: pred = b; break;
+            case 3: pred = (a + b) >> 1; break;
+            case 4: {
+                int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+                pred = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                break;
+            }
+            default: err = "bad filter type"; pred = 0; break;
+            }
+            row[i] = (uint8_t)(row[i] + pred);
+        }
+        if (!err && memcmp(row, img->pixels + img->stride * y, rowBytes) != 0)
+            err = "pixel mismatch";
+    }
+
+    bb_free(&idat);
+    bb_free(&raw);
+    return err;
+}
+
+/* ── Replay ────────────────────────────────────────────────────────────── */
+
+static void replay_record(const CaptureRecord *rec, unsigned index, const ReplayOptions *opt,
+                          ReplaySummary *sum)
+{
+    ByteBuf dib = {0};
+    const uint8_t *dibData = rec->dib;
+    size_t dibLen = rec->storedSize;
+    DibInfo info;
+    const char *skip = NULL;
+
+    if (rec->flags & CAPTURE_FLAG_DEFLATED) {
+        InflateResult r = zlib_inflate(rec->dib, rec->storedSize, &dib);
+        if (r != INFLATE_OK) skip = inflate_result_string(r);
+        else if (dib.len != rec->dibSize) skip = "DIB size mismatch";
+        dibData = dib.data;
+        dibLen = dib.len;
+    }
+    if (!skip) {
+        DibResult r = dib_parse(dibData, dibLen, &info);
+        if (r != DIB_OK) skip = dib_result_string(r);
+    }
+
+    /* Run the pipeline `repeat` times; keep per-stage medians */
+    uint64_t *samples = (uint64_t *)calloc((size_t)opt->repeat * (PIPE_STAGE_COUNT + 1), sizeof(uint64_t));
+    uint64_t median[PIPE_STAGE_COUNT + 1] = {0};
+    PipeResult res = {0};
+    const char *verifyErr = NULL;
+    if (!samples && !skip) skip = "out of memory";
+
+    for (int run = 0; run < opt->repeat && !skip; run++) {
+        StageClock clk = { now_ns(), {0} };
+        PipeOptions po = { .level = opt->level, .onStage = on_stage, .ctx = &clk };
+        uint64_t start = clk.lastNs;
+
+        pipeline_result_free(&res);
+        PipeStatus st = pipeline_convert_dib(dibData, dibLen, &po, &res);
+        if (st != PIPE_OK) {
+            skip = st == PIPE_ERR_DECODE ? dib_result_string(res.dibResult) : pipeline_status_string(st);
+            break;
+        }
+        for (int s = 0; s < PIPE_STAGE_COUNT; s++)
+            samples[(size_t)s * opt->repeat + run] = clk.stageNs[s];
+        samples[(size_t)PIPE_STAGE_COUNT * opt->repeat + run] = now_ns() - start;
+    }
+
+    if (!skip) {
+        for (int s = 0; s <= PIPE_STAGE_COUNT; s++) {
+            uint64_t *v = samples + (size_t)s * opt->repeat;
+            qsort(v, (size_t)opt->repeat, sizeof(uint64_t), cmp_u64);
+            median[s] = v[opt->repeat / 2];
+        }
+        if (opt->verify) {
+            /* Re-encode once more to get the PNG bytes rather than base64 */
+            RgbImage img;
+            ByteBuf png = {0};
+            if (dib_to_rgb(dibData, dibLen, &img) != DIB_OK || !png_encode_rgb(&img, opt->level, &png))
+                verifyErr = "re-encode failed";
+            else
+                verifyErr = verify_png(png.data, png.len, &img);
+            rgb_image_free(&img);
+            bb_free(&png);
+            if (verifyErr) sum->verifyFailures++;
+        }
+
+        sum->records++;
+        sum->capturedPng += rec->pngSize;
+        sum->replayPng   += res.imageSize;
+        sum->capturedB64 += rec->base64Len;
+        sum->replayB64   += res.base64Len;
+        for (int s = 0; s < PIPE_STAGE_COUNT; s++)
+            stat_record(&sum->stages[s], median[s] / 1000, s == PIPE_STAGE_DIB_DECODE ? dibLen : 0);
+        stat_record(&sum->total, median[PIPE_STAGE_COUNT] / 1000, dibLen);
+    } else {
+        sum->skipped++;
+    }
+
+    char when[32] = "";
+    time_t secs = (time_t)(rec->timestampMs / 1000);
+    struct tm tmv;
+    if (localtime_r(&secs, &tmv)) strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tmv);
+
+    if (opt->json) {
+        printf("%s{\"index\":%u,\"timestampMs\":%llu,\"title\":", index > 1 ? "," : "",
+               index, (unsigned long long)rec->timestampMs);
+        json_string(rec->title);
+        printf(",\"dibSize\":%zu,\"captureFailed\":%s", rec->dibSize,
+               (rec->flags & CAPTURE_FLAG_FAILED) ? "true" : "false");
+        if (skip) {
+            printf(",\"skipped\":");
+            json_string(skip);
+            printf("}");
+        } else {
+            printf(",\"width\":%d,\"height\":%d,\"bitCount\":%u,\"compression\":%u",
+                   info.width, info.height, info.bitCount, info.compression);
+            printf(",\"captured\":{\"stages\":{");
+            for (uint32_t i = 0; i < rec->stageCount; i++) {
+                if (i) putchar(',');
+                json_string(rec->stageNames[i]);
+                printf(":%llu", (unsigned long long)rec->stageMicros[i]);
+            }
+            printf("},\"pngSize\":%llu,\"base64Len\":%llu}",
+                   (unsigned long long)rec->pngSize, (unsigned long long)rec->base64Len);
+            printf(",\"replay\":{\"stages\":{");
+            for (int s = 0; s < PIPE_STAGE_COUNT; s++) {
+                if (!replayed_stage(s)) continue;
+                if (s > PIPE_STAGE_DIB_DECODE) putchar(',');
+                json_string(pipeline_stage_name((PipeStage)s));
+                printf(":%.1f", median[s] / 1000.0);
+            }
+            printf("},\"totalMicros\":%.1f,\"pngSize\":%zu,\"base64Len\":%zu}",
+                   median[PIPE_STAGE_COUNT] / 1000.0, res.imageSize, res.base64Len);
+            if (opt->verify) {
+                printf(",\"verified\":%s", verifyErr ? "false" : "true");
+            }
+            printf("}");
+        }
+    } else {
+        printf("#%u  %s  \"%s\"\n", index, when, rec->title);
+        if (skip) {
+            printf("    skipped: %s\n\n", skip);
+        } else {
+            printf("    %dx%d %u bpp %s, DIB %zu bytes%s\n", info.width, info.height,
+                   info.bitCount, compression_name(info.compression), rec->dibSize,
+                   (rec->flags & CAPTURE_FLAG_FAILED) ? " (live conversion failed)" : "");
+            printf("    %-16s %12s %12s %9s\n", "stage", "captured", "replay", "delta");
+            for (int s = 0; s < PIPE_STAGE_COUNT; s++) {
+                if (!replayed_stage(s)) continue;
+                const char *name = pipeline_stage_name((PipeStage)s);
+                int64_t cap = captured_micros(rec, name);
+                double rep = median[s] / 1000.0;
+                if (cap >= 0)
+                    printf("    %-16s %9lld us %9.0f us %+8.1f%%\n", name, (long long)cap, rep,
+                           pct_delta((double)cap, rep));
+                else
+                    printf("    %-16s %12s %9.0f us\n", name, "-", rep);
+            }
+            printf("    %-16s %10llu B %10zu B %+8.1f%%\n", "PNG size",
+                   (unsigned long long)rec->pngSize, res.imageSize,
+                   pct_delta((double)rec->pngSize, (double)res.imageSize));
+            printf("    %-16s %10llu B %10zu B %+8.1f%%\n", "Base64 length",
+                   (unsigned long long)rec->base64Len, res.base64Len,
+                   pct_delta((double)rec->base64Len, (double)res.base64Len));
+            if (opt->verify) printf("    verify: %s\n", verifyErr ? verifyErr : "ok");
+            printf("\n");
+        }
+    }
+
+    pipeline_result_free(&res);
+    free(samples);
+    bb_free(&dib);
+}
+
+static void print_summary(const ReplaySummary *sum, const ReplayOptions *opt)
+{
+    if (opt->json) {
+        printf("],\"summary\":{\"records\":%u,\"skipped\":%u", sum->records, sum->skipped);
+        if (opt->verify) printf(",\"verifyFailures\":%u", sum->verifyFailures);
+        printf(",\"capturedPngBytes\":%llu,\"replayPngBytes\":%llu",
+               (unsigned long long)sum->capturedPng, (unsigned long long)sum->replayPng);
+        printf(",\"capturedBase64Bytes\":%llu,\"replayBase64Bytes\":%llu,\"stages\":{",
+               (unsigned long long)sum->capturedB64, (unsigned long long)sum->replayB64);
+        for (int s = 0; s <= PIPE_STAGE_COUNT; s++) {
+            const StatHistogram *h = s < PIPE_STAGE_COUNT ? &sum->stages[s] : &sum->total;
+            if (s < PIPE_STAGE_COUNT && !replayed_stage(s)) continue;
+            if (s > PIPE_STAGE_DIB_DECODE) putchar(',');
+            json_string(s < PIPE_STAGE_COUNT ? pipeline_stage_name((PipeStage)s) : "Total");
+            printf(":{\"p50\":%llu,\"p95\":%llu,\"max\":%llu,\"totalMicros\":%llu}",
+                   (unsigned long long)stat_percentile(h, 50),
+                   (unsigned long long)stat_percentile(h, 95),
+                   (unsigned long long)h->maxMicros,
+                   (unsigned long long)h->totalMicros);
+        }
+        printf("}}}\n");
+        return;
+    }
+
+    printf("%u record(s) replayed at level %d, %d run(s) each", sum->records, opt->level, opt->repeat);
+    if (sum->skipped) printf(", %u skipped", sum->skipped);
+    printf("\n");
+    if (!sum->records) return;
+    printf("  %-16s %10s %10s %10s %12s\n", "stage", "p50 us", "p95 us", "max us", "total us");
+    for (int s = 0; s <= PIPE_STAGE_COUNT; s++) {
+        const StatHistogram *h = s < PIPE_STAGE_COUNT ? &sum->stages[s] : &sum->total;
+        if (s < PIPE_STAGE_COUNT && !replayed_stage(s)) continue;
+        printf("  %-16s %10llu %10llu %10llu %12llu\n",
+               s < PIPE_STAGE_COUNT ? pipeline_stage_name((PipeStage)s) : "Total",
+               (unsigned long long)stat_percentile(h, 50),
+               (unsigned long long)stat_percentile(h, 95),
+               (unsigned long long)h->maxMicros,
+               (unsigned long long)h->totalMicros);
+    }
+    printf("  PNG bytes    captured %llu, replay %llu (%+.1f%%)\n",
+           (unsigned long long)sum->capturedPng, (unsigned long long)sum->replayPng,
+           pct_delta((double)sum->capturedPng, (double)sum->replayPng));
+    printf("  Base64 bytes captured %llu, replay %llu (%+.1f%%)\n",
+           (unsigned long long)sum->capturedB64, (unsigned long long)sum->replayB64,
+           pct_delta((double)sum->capturedB64, (double)sum->replayB64));
+    if (opt->verify) printf("  Verification failures: %u\n", sum->verifyFailures);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: replay [--level N] [--repeat N] [--json] [--verify] FILE.ipcap...\n"
+        "  --level N   deflate level 0-9 (default %d)\n"
+        "  --repeat N  runs per record; the median is reported (default 5)\n"
+        "  --json      print one JSON document instead of tables\n"
+        "  --verify    decode each produced PNG and compare with the source pixels\n",
+        PIPELINE_DEFAULT_LEVEL);
+}
+
+int main(int argc, char **argv)
+{
+    ReplayOptions opt = { PIPELINE_DEFAULT_LEVEL, 5, 0, 0 };
+    ReplaySummary *sum = (ReplaySummary *)calloc(1, sizeof(ReplaySummary));
+    int first = 1, failed = 0;
+    unsigned index = 0;
+
+    if (!sum) return 1;
+    for (int s = 0; s < PIPE_STAGE_COUNT; s++) stat_reset(&sum->stages[s]);
+    stat_reset(&sum->total);
+
+    while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+        const char *a = argv[first++];
+        if (strcmp(a, "--json") == 0) opt.json = 1;
+        else if (strcmp(a, "--verify") == 0) opt.verify = 1;
+        else if (strcmp(a, "--level") == 0 && first < argc) opt.level = atoi(argv[first++]);
+        else if (strcmp(a, "--repeat") == 0 && first < argc) opt.repeat = atoi(argv[first++]);
+        else { usage(); return 2; }
+    }
+    if (first >= argc || opt.level < 0 || opt.level > 9 || opt.repeat < 1) { usage(); return 2; }
+
+    if (opt.json) printf("{\"level\":%d,\"repeat\":%d,\"records\":[", opt.level, opt.repeat);
+
+    for (int i = first; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) { fprintf(stderr, "replay: cannot open %s\n", argv[i]); failed = 1; continue; }
+        CaptureRecord *rec = (CaptureRecord *)malloc(sizeof(CaptureRecord));
+        int r = -1;
+        while (rec && (r = capture_read(f, rec)) == 1) {
+            replay_record(rec, ++index, &opt, sum);
+            free(rec->dib);
+        }
+        if (r < 0) {
+            fprintf(stderr, "replay: %s: corrupt record after #%u, stopping\n", argv[i], index);
+            failed = 1;
+        }
+        free(rec);
+        fclose(f);
+    }
+
+    print_summary(sum, &opt);
+    failed |= sum->verifyFailures != 0;
+    free(sum);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,272 @@
+/*
+ * ImagePaster - tools/unframe.c
+ *
+ * Receiver for the "framed" text encoding (see frame.h), for the far side
+ * of a terminal: run it on the remote Linux host, paste, and it writes the
+ * image file once the whole frame has arrived and its length and CRC32C
+ * check out. Anything typed or pasted before the header is ignored.
+ *
+ *   unframe [-o FILE] [-f] [-i INPUT] [-q]
+ *
+ *   -o FILE    where to write the image; default paste.<format>, or
+ *              paste-N.<format> if that exists
+ *   -f         overwrite FILE if it exists
+ *   -i INPUT   read from INPUT (a file or a tty such as /dev/pts/3)
+ *              instead of stdin
+ *   -q         no progress on stderr
+ *
+ * When reading from a terminal, echo and line editing are switched off
+ * while the frame arrives, so a multi-megabyte paste neither scrolls by nor
+ * hits the line-length limit; Ctrl-C cancels. The image goes to a temporary
+ * file in the destination directory and is renamed into place only once
+ * verified, so a failed transfer leaves nothing behind. Memory use does not
+ * depend on the size of the image.
+ *
+ * Needs only frame.c and base64.c, so it builds on a host without the rest
+ * of the tree:
+ *
+ *   cc -O2 -I. -o unframe tools/unframe.c frame.c base64.c
+ *
+ * Built natively by `make tools` (see Makefile).
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "frame.h"
+
+#define READ_CHUNK      (64 * 1024)
+#define PROGRESS_STEP   (1024 * 1024)   /* image bytes between progress lines */
+
+typedef struct {
+    const char *outPath;    /* -o, or NULL for the default name */
+    int         force;
+    const char *inPath;
+    int         quiet;
+} UnframeOptions;
+
+typedef struct {
+    const UnframeOptions *opt;
+    FrameDecoder         *dec;
+    char                  path[4096];
+    char                  tmpPath[4096 + 8];
+    int                   fd;
+    uint64_t              nextProgress;
+} Output;
+
+static struct termios g_savedTty;
+static int            g_ttyFd = -1;
+static char           g_tmpToRemove[4096 + 8];
+
+static void restore_tty(void)
+{
+    if (g_ttyFd >= 0) tcsetattr(g_ttyFd, TCSANOW, &g_savedTty);
+}
+
+static void on_signal(int sig)
+{
+    restore_tty();
+    if (g_tmpToRemove[0]) unlink(g_tmpToRemove);
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+/* No echo, no line buffering: bytes arrive as they are pasted. CR is still
+ * turned into LF and Ctrl-C still interrupts. */
+static void raw_tty(int fd)
+{
+    struct termios t;
+    if (!isatty(fd) || tcgetattr(fd, &g_savedTty) != 0) return;
+    t = g_savedTty;
+    t.c_lflag &= ~(tcflag_t)(ECHO | ICANON);
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    g_ttyFd = fd;
+    atexit(restore_tty);
+    tcsetattr(fd, TCSANOW, &t);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* The destination, picked when the header says what the format is */
+static int choose_path(Output *out)
+{
+    const char *format = out->dec->format;
+    if (out->opt->outPath) {
+        snprintf(out->path, sizeof(out->path), "%s", out->opt->outPath);
+        if (!out->opt->force && access(out->path, F_OK) == 0) {
+            fprintf(stderr, "unframe: %s exists (use -f to overwrite)\n", out->path);
+            return 0;
+        }
+        return 1;
+    }
+    snprintf(out->path, sizeof(out->path), "paste.%s", format);
+    for (int n = 1; access(out->path, F_OK) == 0; n++) {
+        if (n > 9999) return 0;
+        snprintf(out->path, sizeof(out->path), "paste-%d.%s", n, format);
+    }
+    return 1;
+}
+
+static int open_output(Output *out)
+{
+    if (!choose_path(out)) return 0;
+    snprintf(out->tmpPath, sizeof(out->tmpPath), "%s.XXXXXX", out->path);
+    out->fd = mkstemp(out->tmpPath);
+    if (out->fd < 0) {
+        fprintf(stderr, "unframe: cannot create %s: %s\n", out->tmpPath, strerror(errno));
+        return 0;
+    }
+    /* mkstemp creates it private; give it the permissions a plain file gets */
+    mode_t mask = umask(0);
+    umask(mask);
+    fchmod(out->fd, 0666 & ~mask);
+    snprintf(g_tmpToRemove, sizeof(g_tmpToRemove), "%s", out->tmpPath);
+    return 1;
+}
+
+static int write_all(int fd, const uint8_t *p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return 0;
+        p += w;
+        n -= (size_t)w;
+    }
+    return 1;
+}
+
+static int on_bytes(void *ctx, const uint8_t *data, size_t len)
+{
+    Output *out = (Output *)ctx;
+    if (out->fd < 0 && !open_output(out)) return 0;
+    if (!write_all(out->fd, data, len)) {
+        fprintf(stderr, "unframe: writing %s: %s\n", out->tmpPath, strerror(errno));
+        return 0;
+    }
+    if (!out->opt->quiet && out->dec->decoded + len >= out->nextProgress) {
+        fprintf(stderr, "\rReceived %llu of %llu bytes",
+                (unsigned long long)(out->dec->decoded + len), (unsigned long long)out->dec->length);
+        out->nextProgress += PROGRESS_STEP;
+    }
+    return 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: unframe [-o FILE] [-f] [-i INPUT] [-q]\n");
+}
+
+int main(int argc, char **argv)
+{
+    UnframeOptions opt = { NULL, 0, NULL, 0 };
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            opt.outPath = argv[++i];
+        } else if (strcmp(argv[i], "-f") == 0) {
+            opt.force = 1;
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            opt.inPath = argv[++i];
+        } else if (strcmp(argv[i], "-q") == 0) {
+            opt.quiet = 1;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    int fd = 0;
+    if (opt.inPath) {
+        fd = open(opt.inPath, O_RDONLY | O_NOCTTY);
+        if (fd < 0) {
+            fprintf(stderr, "unframe: cannot open %s: %s\n", opt.inPath, strerror(errno));
+            return 1;
+        }
+    }
+
+    /* The decoder holds its own buffers; keep it off the stack */
+    static FrameDecoder dec;
+    static char buf[READ_CHUNK];
+    Output out;
+    memset(&out, 0, sizeof(out));
+    out.opt = &opt;
+    out.dec = &dec;
+    out.fd = -1;
+    frame_decoder_init(&dec, on_bytes, &out);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGHUP, on_signal);
+    if (isatty(fd)) {
+        raw_tty(fd);
+        if (!opt.quiet) fprintf(stderr, "Waiting for a framed paste (Ctrl-C to cancel)...\n");
+    }
+
+    double started = 0;
+    FrameStatus st = FRAME_MORE;
+    while (st == FRAME_MORE) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            fprintf(stderr, "unframe: read: %s\n", strerror(errno));
+            break;
+        }
+        if (n == 0) {
+            st = frame_decode_end(&dec);
+            break;
+        }
+        int hadHeader = dec.haveHeader;
+        st = frame_decode(&dec, buf, (size_t)n);
+        if (!hadHeader && dec.haveHeader) {
+            started = now_seconds();
+            if (!opt.quiet) fprintf(stderr, "Frame: %s, %llu bytes, CRC32C %08x\n", dec.format,
+                                    (unsigned long long)dec.length, (unsigned)dec.crc);
+        }
+    }
+    restore_tty();
+
+    if (st == FRAME_DONE && out.fd < 0 && !open_output(&out)) st = FRAME_ERR_SINK;  /* empty image */
+    if (out.fd >= 0) {
+        if (st == FRAME_DONE && fsync(out.fd) != 0) st = FRAME_ERR_SINK;
+        if (close(out.fd) != 0 && st == FRAME_DONE) st = FRAME_ERR_SINK;
+    }
+    if (out.nextProgress > 0) fprintf(stderr, "\n");
+
+    if (st != FRAME_DONE) {
+        if (out.fd >= 0) unlink(out.tmpPath);
+        if (st == FRAME_MORE) {
+            fprintf(stderr, "unframe: %s\n", dec.haveHeader ? "input ended before the frame trailer"
+                                                            : "no frame header found");
+        } else {
+            fprintf(stderr, "unframe: %s after %llu bytes\n", frame_status_message(st),
+                    (unsigned long long)dec.decoded);
+        }
+        return 1;
+    }
+    if (rename(out.tmpPath, out.path) != 0) {
+        fprintf(stderr, "unframe: cannot rename to %s: %s\n", out.path, strerror(errno));
+        unlink(out.tmpPath);
+        return 1;
+    }
+    g_tmpToRemove[0] = '\0';
+
+    if (!opt.quiet) {
+        double secs = now_seconds() - started;
+        fprintf(stderr, "Wrote %s (%llu bytes, CRC32C verified) in %.1f s\n", out.path,
+                (unsigned long long)dec.length, secs);
+    }
+    return 0;
+}
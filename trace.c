@@ -0,0 +1,206 @@
+/*
+ * ImagePaster - trace.c
+ *
+ * Per-thread span buffers and Chrome trace-event JSON export (see trace.h).
+ *
+ * Each thread lazily allocates a fixed-size ring on its first event and links
+ * it into a global list with a CAS push; buffers are never freed. Only the
+ * owning thread writes to a ring. The dumper snapshots `head` before and after
+ * copying, and drops any slot that may have been overwritten in between, so no
+ * lock is ever taken on the recording path.
+ */
+
+#define UNICODE
+#define _UNICODE
+#define _WIN32_WINNT 0x0600
+#define WIN32_LEAN_AND_MEAN
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+#define TRACE_RING_CAPACITY 16384   /* events per thread, power of two */
+
+typedef struct {
+    const char *name;
+    LONGLONG    ts;     /* QPC ticks */
+    LONGLONG    dur;    /* QPC ticks, 'X' events only */
+    char        phase;  /* 'B', 'E' or 'X' */
+} TraceEvent;
+
+typedef struct TraceBuffer {
+    struct TraceBuffer *next;
+    DWORD         tid;
+    char          threadName[32];
+    volatile LONG head;      /* total events written by the owner thread */
+    volatile LONG base;      /* events before this index were cleared */
+    TraceEvent    events[TRACE_RING_CAPACITY];
+} TraceBuffer;
+
+volatile LONG g_traceEnabled = 0;
+
+static TraceBuffer *volatile g_traceBuffers = NULL;
+static __thread TraceBuffer *t_traceBuf = NULL;
+static __thread char t_pendingName[32];
+
+static TraceBuffer *trace_thread_buffer(void)
+{
+    TraceBuffer *buf = t_traceBuf;
+    if (buf) return buf;
+
+    buf = (TraceBuffer *)calloc(1, sizeof(*buf));
+    if (!buf) return NULL;
+    buf->tid = GetCurrentThreadId();
+    if (t_pendingName[0]) {
+        memcpy(buf->threadName, t_pendingName, sizeof(buf->threadName));
+    }
+
+    TraceBuffer *head;
+    do {
+        head = g_traceBuffers;
+        buf->next = head;
+    } while (InterlockedCompareExchangePointer((PVOID volatile *)&g_traceBuffers,
+                                               buf, head) != head);
+    t_traceBuf = buf;
+    return buf;
+}
+
+void trace_record(const char *name, char phase, LONGLONG ts, LONGLONG dur)
+{
+    TraceBuffer *buf = trace_thread_buffer();
+    if (!buf) return;
+
+    if (phase != 'X') {
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        ts = now.QuadPart;
+    }
+
+    LONG h = buf->head;
+    TraceEvent *ev = &buf->events[(ULONG)h & (TRACE_RING_CAPACITY - 1)];
+    ev->name  = name;
+    ev->ts    = ts;
+    ev->dur   = dur;
+    ev->phase = phase;
+    InterlockedExchange(&buf->head, h + 1);   /* publish (full barrier) */
+}
+
+void trace_set_enabled(BOOL enabled)
+{
+    InterlockedExchange(&g_traceEnabled, enabled ? 1 : 0);
+}
+
+void trace_set_thread_name(const char *name)
+{
+    strncpy(t_pendingName, name, sizeof(t_pendingName) - 1);
+    t_pendingName[sizeof(t_pendingName) - 1] = '\0';
+    if (t_traceBuf) {
+        memcpy(t_traceBuf->threadName, t_pendingName, sizeof(t_pendingName));
+    }
+}
+
+void trace_clear(void)
+{
+    for (TraceBuffer *buf = g_traceBuffers; buf; buf = buf->next) {
+        InterlockedExchange(&buf->base, buf->head);
+    }
+}
+
+/* ── JSON export ───────────────────────────────────────────────────────── */
+
+typedef struct {
+    HANDLE hFile;
+    char   buf[65536];
+    DWORD  len;
+    BOOL   failed;
+} TraceWriter;
+
+static void tw_flush(TraceWriter *w)
+{
+    DWORD written = 0;
+    if (w->len && !w->failed) {
+        if (!WriteFile(w->hFile, w->buf, w->len, &written, NULL) || written != w->len)
+            w->failed = TRUE;
+    }
+    w->len = 0;
+}
+
+static void tw_printf(TraceWriter *w, const char *fmt, ...)
+{
+    if (w->len > sizeof(w->buf) - 512) tw_flush(w);
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(w->buf + w->len, sizeof(w->buf) - w->len, fmt, args);
+    va_end(args);
+    if (n > 0) w->len += (DWORD)n;
+}
+
+long trace_dump_json(const WCHAR *path)
+{
+    LARGE_INTEGER freq;
+    if (!QueryPerformanceFrequency(&freq) || freq.QuadPart <= 0) return -1;
+    double toMicros = 1000000.0 / (double)freq.QuadPart;
+
+    TraceEvent *copy = (TraceEvent *)malloc(sizeof(TraceEvent) * TRACE_RING_CAPACITY);
+    if (!copy) return -1;
+
+    TraceWriter *w = (TraceWriter *)calloc(1, sizeof(*w));
+    if (!w) { free(copy); return -1; }
+    w->hFile = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+    if (w->hFile == INVALID_HANDLE_VALUE) { free(w); free(copy); return -1; }
+
+    DWORD pid = GetCurrentProcessId();
+    long total = 0;
+
+    tw_printf(w, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    tw_printf(w, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":0,"
+                 "\"args\":{\"name\":\"ImagePaster\"}}", (unsigned long)pid);
+
+    for (TraceBuffer *buf = g_traceBuffers; buf; buf = buf->next) {
+        LONG h1 = InterlockedCompareExchange(&buf->head, 0, 0);
+        LONG start = buf->base;
+        if (h1 - start > TRACE_RING_CAPACITY) start = h1 - TRACE_RING_CAPACITY;
+        for (LONG i = start; i < h1; i++) {
+            copy[(ULONG)i & (TRACE_RING_CAPACITY - 1)] =
+                buf->events[(ULONG)i & (TRACE_RING_CAPACITY - 1)];
+        }
+        /* Slots the owner may have rewritten while we copied are dropped */
+        LONG h2 = InterlockedCompareExchange(&buf->head, 0, 0);
+        if (h2 - TRACE_RING_CAPACITY + 1 > start) start = h2 - TRACE_RING_CAPACITY + 1;
+
+        if (buf->threadName[0]) {
+            tw_printf(w, ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%lu,"
+                         "\"args\":{\"name\":\"%s\"}}",
+                      (unsigned long)pid, (unsigned long)buf->tid, buf->threadName);
+        }
+
+        for (LONG i = start; i < h1; i++) {
+            const TraceEvent *ev = &copy[(ULONG)i & (TRACE_RING_CAPACITY - 1)];
+            if (ev->phase == 'X') {
+                tw_printf(w, ",{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                             "\"pid\":%lu,\"tid\":%lu}",
+                          ev->name,
+                          (double)ev->ts * toMicros, (double)ev->dur * toMicros,
+                          (unsigned long)pid, (unsigned long)buf->tid);
+            } else {
+                tw_printf(w, ",{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                             "\"pid\":%lu,\"tid\":%lu}",
+                          ev->name, ev->phase,
+                          (double)ev->ts * toMicros,
+                          (unsigned long)pid, (unsigned long)buf->tid);
+            }
+            total++;
+        }
+    }
+
+    tw_printf(w, "]}\n");
+    tw_flush(w);
+    BOOL failed = w->failed;
+    CloseHandle(w->hFile);
+    free(w);
+    free(copy);
+    return failed ? -1 : total;
+}
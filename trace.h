@@ -0,0 +1,40 @@
+/*
+ * ImagePaster - trace.h
+ *
+ * Opt-in span recorder for the paste pipeline, exported as Chrome trace-event
+ * JSON (load in Perfetto or chrome://tracing). Each thread appends to its own
+ * ring buffer without locks; the buffers are only walked when dumping.
+ *
+ * With tracing disabled every span costs one predictable branch on
+ * g_traceEnabled.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <windows.h>
+
+extern volatile LONG g_traceEnabled;
+
+void trace_record(const char *name, char phase, LONGLONG ts, LONGLONG dur);
+
+#define TRACE_ACTIVE() __builtin_expect(g_traceEnabled != 0, 0)
+
+/* Begin/end pair on the calling thread. `name` must be a string literal. */
+#define TRACE_BEGIN(name) \
+    do { if (TRACE_ACTIVE()) trace_record((name), 'B', 0, 0); } while (0)
+#define TRACE_END(name) \
+    do { if (TRACE_ACTIVE()) trace_record((name), 'E', 0, 0); } while (0)
+
+/* Complete span from two QueryPerformanceCounter readings. */
+#define TRACE_SPAN(name, startQpc, endQpc) \
+    do { if (TRACE_ACTIVE()) trace_record((name), 'X', (startQpc), (endQpc) - (startQpc)); } while (0)
+
+void  trace_set_enabled(BOOL enabled);
+void  trace_set_thread_name(const char *name);
+void  trace_clear(void);
+
+/* Writes all buffered events to `path`; returns the number written or -1. */
+long  trace_dump_json(const WCHAR *path);
+
+#endif // TRACE_H
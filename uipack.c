@@ -0,0 +1,92 @@
+/*
+ * ImagePaster - uipack.c
+ *
+ * Reader for the packed UI resource (see uipack.h). Entries are returned as
+ * pointers into the pack; nothing is copied.
+ */
+
+#include <string.h>
+#include "uipack.h"
+
+#define UIPACK_HEADER_SIZE 8
+#define UIPACK_ENTRY_FIXED 16
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* Decodes the entry at *pos and advances it. Returns 0 if it runs past the
+ * pack or its strings are not NUL-terminated. */
+static int read_entry(const UiPack *p, size_t *pos, UiPackEntry *out)
+{
+    const uint8_t *d = p->data;
+    if (p->len - *pos < UIPACK_ENTRY_FIXED) return 0;
+    const uint8_t *e = d + *pos;
+    uint32_t offset = get_le32(e);
+    size_t pathLen = e[14], mimeLen = e[15];
+    size_t strings = pathLen + 1 + mimeLen + 1;
+    if (p->len - *pos - UIPACK_ENTRY_FIXED < strings) return 0;
+
+    const char *path = (const char *)e + UIPACK_ENTRY_FIXED;
+    const char *mime = path + pathLen + 1;
+    if (path[pathLen] != '\0' || mime[mimeLen] != '\0') return 0;
+
+    out->path = path;
+    out->mime = mime;
+    out->size = get_le32(e + 4);
+    out->rawSize = get_le32(e + 8);
+    out->encoding = e[12];
+    out->flags = e[13];
+    if (offset > p->len || out->size > p->len - offset) return 0;
+    out->data = d + offset;
+
+    *pos += UIPACK_ENTRY_FIXED + strings;
+    return 1;
+}
+
+int uipack_open(UiPack *p, const uint8_t *data, size_t len)
+{
+    memset(p, 0, sizeof(*p));
+    if (!data || len < UIPACK_HEADER_SIZE) return 0;
+    if (get_le32(data) != UIPACK_MAGIC || get_le16(data + 4) != UIPACK_VERSION) return 0;
+
+    p->data = data;
+    p->len = len;
+    p->count = get_le16(data + 6);
+
+    size_t pos = UIPACK_HEADER_SIZE;
+    UiPackEntry e;
+    for (unsigned i = 0; i < p->count; i++) {
+        if (!read_entry(p, &pos, &e)) {
+            memset(p, 0, sizeof(*p));
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int uipack_entry(const UiPack *p, unsigned index, UiPackEntry *out)
+{
+    if (index >= p->count) return 0;
+    size_t pos = UIPACK_HEADER_SIZE;
+    for (unsigned i = 0; i <= index; i++) {
+        if (!read_entry(p, &pos, out)) return 0;
+    }
+    return 1;
+}
+
+int uipack_find(const UiPack *p, const char *path, UiPackEntry *out)
+{
+    size_t pos = UIPACK_HEADER_SIZE;
+    for (unsigned i = 0; i < p->count; i++) {
+        if (!read_entry(p, &pos, out)) return 0;
+        if (strcmp(out->path, path) == 0) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * ImagePaster - uipack.h
+ *
+ * The built UI (assets/dist) packed into one RCDATA resource by
+ * tools/packui.c. Files are stored precompressed so the WebView2 resource
+ * handler can serve them straight out of the mapped image.
+ *
+ * Pack layout, all integers little-endian:
+ *
+ *   u32 magic 'IPUI'   u16 version   u16 count
+ *   count entries: u32 offset, u32 size, u32 rawSize,
+ *                  u8 encoding, u8 flags, u8 pathLen, u8 mimeLen,
+ *                  path, NUL, mime, NUL
+ *   file data, at the entry offsets (from the start of the pack)
+ *
+ * Paths are relative to the dist directory with '/' separators, e.g.
+ * "index.html" or "assets/index-3f2a9c1e.js".
+ */
+
+#ifndef UIPACK_H
+#define UIPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UIPACK_MAGIC    0x49555049u   /* "IPUI" */
+#define UIPACK_VERSION  1
+
+#define UIPACK_ENCODING_IDENTITY  0
+#define UIPACK_ENCODING_DEFLATE   1   /* zlib stream, HTTP "Content-Encoding: deflate" */
+
+#define UIPACK_FLAG_IMMUTABLE  0x01   /* content-hashed name: cache forever */
+
+typedef struct {
+    const char    *path;
+    const char    *mime;
+    const uint8_t *data;      /* points into the pack */
+    uint32_t       size;      /* stored bytes */
+    uint32_t       rawSize;   /* bytes after decoding */
+    uint8_t        encoding;
+    uint8_t        flags;
+} UiPackEntry;
+
+typedef struct {
+    const uint8_t *data;
+    size_t         len;
+    unsigned       count;
+} UiPack;
+
+/* Validates the pack header and every entry. Returns 0 if malformed. */
+int  uipack_open(UiPack *p, const uint8_t *data, size_t len);
+
+/* Looks up a path; returns 0 if absent. */
+int  uipack_find(const UiPack *p, const char *path, UiPackEntry *out);
+
+/* The index-th entry, for listing. Returns 0 past the end. */
+int  uipack_entry(const UiPack *p, unsigned index, UiPackEntry *out);
+
+#endif // UIPACK_H